@@ -0,0 +1,268 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: AsyncLog.cpp
+ *
+ * This file implements a log whose records are written by a thread of its own.
+ */
+
+#include "AsyncLog.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+
+
+/* how long the writer sleeps when the ring is empty, in milliseconds */
+static const int IDLE_WAIT = 10;
+
+/* output written at once, in bytes */
+static const size_t BATCH_SIZE = 65536;
+
+static const char* const LEVEL_NAMES[] = {"ERROR", "WARNING", "INFO", "DEBUG"};
+
+
+std::shared_ptr<AsyncLog> AsyncLog::get(const std::string& path)
+{
+    static std::mutex                                     registrymtx;
+    static std::map<std::string, std::weak_ptr<AsyncLog>> registry;
+
+    std::unique_lock<std::mutex> lock(registrymtx);
+    std::shared_ptr<AsyncLog>    log = registry[path].lock();
+    if (!log) {
+        log.reset(new AsyncLog(path));
+        registry[path] = log;
+    }
+    return log;
+}
+
+
+LogLevel AsyncLog::parseLevel(const std::string& name)
+{
+    for (int i = LOGLVL_ERROR; i <= LOGLVL_DEBUG; i++) {
+        if (strcasecmp(name.c_str(), LEVEL_NAMES[i]) == 0 ||
+                name == std::to_string(i))
+            return static_cast<LogLevel>(i);
+    }
+    throw std::invalid_argument("AsyncLog::parseLevel() Invalid log level: " +
+            name);
+}
+
+
+AsyncLog::AsyncLog(const std::string& path, const size_t capacity)
+    :
+    path(path),
+    level(LOGLVL_INFO),
+    mask(0),
+    ring(NULL),
+    tail(0),
+    head(0),
+    dropped(0),
+    reported(0),
+    file(NULL),
+    timesec(-1),
+    mutex(),
+    cond(),
+    stop(false),
+    thread()
+{
+    const char* env = getenv("FMTP_LOG_LEVEL");
+    if (env) {
+        try {
+            level = parseLevel(env);
+        }
+        catch (const std::invalid_argument& e) {
+            /* keep the default */
+        }
+    }
+
+    uint64_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    mask = size - 1;
+    ring = new Record[size];
+    for (uint64_t i = 0; i < size; i++)
+        ring[i].seq.store(i, std::memory_order_relaxed);
+
+    int retval = pthread_create(&thread, NULL, &AsyncLog::runWrapper, this);
+    if (retval) {
+        delete[] ring;
+        throw std::runtime_error("AsyncLog::AsyncLog() pthread_create() "
+                "error with retval = " + std::to_string(retval));
+    }
+}
+
+
+AsyncLog::~AsyncLog()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    (void)pthread_join(thread, NULL);
+    if (file)
+        (void)fclose(file);
+    delete[] ring;
+}
+
+
+/**
+ * Claims the next free slot, fills it and hands it to the writer. Concurrent
+ * callers race for a position with a compare-and-swap; a slot's sequence
+ * number tells whether the writer is done with it.
+ */
+bool AsyncLog::write(const LogLevel level, const std::string& msg)
+{
+    if (!enabled(level))
+        return false;
+
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    Record*  rec;
+    for (;;) {
+        rec = &ring[pos & mask];
+        const int64_t diff = static_cast<int64_t>(
+                rec->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    struct timespec now;
+    (void)clock_gettime(CLOCK_REALTIME, &now);
+    rec->sec   = now.tv_sec;
+    rec->nsec  = now.tv_nsec;
+    rec->level = level;
+    rec->len   = msg.copy(rec->text, MSGLEN);
+    rec->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+void AsyncLog::flush()
+{
+    const uint64_t target = tail.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.notify_all();
+    while (head.load(std::memory_order_acquire) < target)
+        (void)cond.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT));
+}
+
+
+void AsyncLog::format(const Record& rec, std::string& out)
+{
+    if (rec.sec != timesec) {
+        const time_t sec = rec.sec;
+        struct tm    tm;
+        (void)strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S",
+                       localtime_r(&sec, &tm));
+        timesec = rec.sec;
+    }
+    char prefix[64];
+    (void)snprintf(prefix, sizeof(prefix), "%s.%06d  %-7s  ", timebuf,
+                   rec.nsec / 1000, LEVEL_NAMES[rec.level]);
+    out += prefix;
+    out.append(rec.text, rec.len);
+    out += '\n';
+}
+
+
+/**
+ * Opens the file on first use, creating its directory if it doesn't exist.
+ * Records that can't be written count as dropped.
+ */
+void AsyncLog::output(const std::string& out, const uint64_t nrecs)
+{
+    if (!file) {
+        const size_t slash = path.rfind('/');
+        if (slash != std::string::npos && slash > 0)
+            (void)mkdir(path.substr(0, slash).c_str(), 0755);
+        file = fopen(path.c_str(), "a");
+        if (!file) {
+            dropped.fetch_add(nrecs, std::memory_order_relaxed);
+            return;
+        }
+    }
+    (void)fwrite(out.data(), 1, out.size(), file);
+    (void)fflush(file);
+}
+
+
+/**
+ * Drains the ring in batches until the log is destroyed. Slots are released
+ * as soon as their records are formatted, so appending doesn't wait for the
+ * file.
+ */
+void AsyncLog::run()
+{
+    std::string out;
+    out.reserve(BATCH_SIZE + MSGLEN + 64);
+
+    for (;;) {
+        uint64_t pos   = head.load(std::memory_order_relaxed);
+        uint64_t nrecs = 0;
+        out.clear();
+        while (out.size() < BATCH_SIZE) {
+            Record& rec = ring[pos & mask];
+            if (rec.seq.load(std::memory_order_acquire) != pos + 1)
+                break;
+            format(rec, out);
+            rec.seq.store(pos + mask + 1, std::memory_order_release);
+            pos++;
+            nrecs++;
+        }
+
+        const uint64_t lost = dropped.load(std::memory_order_relaxed);
+        if (lost != reported && file) {
+            char note[64];
+            (void)snprintf(note, sizeof(note), "%s  %-7s  ", timebuf,
+                           LEVEL_NAMES[LOGLVL_WARNING]);
+            out += note + std::to_string(lost - reported) +
+                   " log records dropped\n";
+            reported = lost;
+        }
+
+        if (nrecs || !out.empty()) {
+            output(out, nrecs);
+            head.store(pos, std::memory_order_release);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+            }
+            cond.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stop)
+            break;
+        (void)cond.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT));
+    }
+}
+
+
+/**
+ * A wrapper to call the actual AsyncLog::run().
+ *
+ * @param[in] *ptr  A pointer to the AsyncLog object.
+ */
+void* AsyncLog::runWrapper(void* ptr)
+{
+    static_cast<AsyncLog*>(ptr)->run();
+    return NULL;
+}
@@ -0,0 +1,184 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: AsyncLog.h
+ *
+ * This file defines a log whose records are appended to a ring buffer by the
+ * logging threads and written to a file by a thread of its own.
+ */
+
+#ifndef FMTP_ASYNCLOG_H_
+#define FMTP_ASYNCLOG_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+/** severity of a log record; a log keeps the records up to its level */
+enum LogLevel {
+    LOGLVL_ERROR = 0,
+    LOGLVL_WARNING,
+    LOGLVL_INFO,     /*!< the default */
+    LOGLVL_DEBUG     /*!< per-packet and per-product events */
+};
+
+
+/**
+ * A log file written asynchronously. Logging a record copies the message,
+ * already formatted by the caller, into a slot of a bounded ring buffer that
+ * any number of threads append to without locking; the writer thread adds the
+ * time and the level and writes it. The file is opened once, on the first
+ * record, and its directory is created if need be. When the ring is full,
+ * records are dropped rather than delaying the caller, and the writer notes
+ * how many were lost. Messages longer than a slot are truncated.
+ *
+ * The level is checked with a single relaxed load, so callers build a
+ * message only if `enabled()` is true; it can be changed at any time, and
+ * starts at the value of the environment variable FMTP_LOG_LEVEL ("error",
+ * "warning", "info" or "debug") if set.
+ */
+class AsyncLog
+{
+public:
+    /**
+     * Returns the log of a file, creating it if need be. All the users of a
+     * file in a process share its log, and with it its level.
+     *
+     * @param[in] path  Pathname of the file.
+     * @return          The log.
+     * @throw std::runtime_error  if the writer thread can't be started.
+     */
+    static std::shared_ptr<AsyncLog> get(const std::string& path);
+    /**
+     * Parses the name of a level.
+     *
+     * @param[in] name  "error", "warning", "info" or "debug", or the number
+     *                  of the level.
+     * @return          The level.
+     * @throw std::invalid_argument  if the name is unknown.
+     */
+    static LogLevel parseLevel(const std::string& name);
+
+    /**
+     * Constructs a log. Use `get()` instead unless the log isn't to be
+     * shared.
+     *
+     * @param[in] path      Pathname of the file.
+     * @param[in] capacity  Number of records the ring holds; rounded up to a
+     *                      power of 2.
+     * @throw std::runtime_error  if the writer thread can't be started.
+     */
+    explicit AsyncLog(const std::string& path, const size_t capacity = 4096);
+    /** writes the pending records and closes the file */
+    ~AsyncLog();
+
+    /**
+     * Returns whether records of a level are kept.
+     *
+     * @param[in] level  The level.
+     * @return           Whether `write()` would keep a record of the level.
+     */
+    bool     enabled(const LogLevel level) const
+    {
+        return level <= this->level.load(std::memory_order_relaxed);
+    }
+    /** sets the level of the records that are kept */
+    void     setLevel(const LogLevel level)
+    {
+        this->level.store(level, std::memory_order_relaxed);
+    }
+    LogLevel getLevel() const
+    {
+        return static_cast<LogLevel>(level.load(std::memory_order_relaxed));
+    }
+    /**
+     * Logs a record. Never blocks.
+     *
+     * @param[in] level  Level of the record.
+     * @param[in] msg    The message, without a trailing newline.
+     * @return           Whether the record was appended; false if its level
+     *                   isn't kept or the ring is full.
+     */
+    bool     write(const LogLevel level, const std::string& msg);
+    /**
+     * Waits until the records logged before the call are written to the
+     * file.
+     */
+    void     flush();
+    /**
+     * Returns the number of records dropped because the ring was full or the
+     * file couldn't be opened.
+     */
+    uint64_t getDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    /** longest message kept, in bytes */
+    static const size_t MSGLEN = 232;
+
+    /** a slot of the ring */
+    struct Record
+    {
+        /* position the slot is free for, or position + 1 once filled */
+        std::atomic<uint64_t> seq;
+        int64_t               sec;   /*!< wall-clock time of the record */
+        int32_t               nsec;
+        uint16_t              level;
+        uint16_t              len;
+        char                  text[MSGLEN];
+    };
+
+    /** writer thread */
+    void         run();
+    /** a wrapper to call the actual AsyncLog::run() */
+    static void* runWrapper(void* ptr);
+    /**
+     * Formats a record and adds it to the output buffer.
+     *
+     * @param[in]     rec  The record.
+     * @param[in,out] out  The buffer.
+     */
+    void         format(const Record& rec, std::string& out);
+    /**
+     * Writes the output buffer to the file, opening it if need be.
+     *
+     * @param[in] out     The buffer.
+     * @param[in] nrecs   Number of records in the buffer.
+     */
+    void         output(const std::string& out, const uint64_t nrecs);
+    /* Prevent copying because it's meaningless */
+    AsyncLog(AsyncLog&);
+    AsyncLog& operator=(const AsyncLog&);
+
+    const std::string      path;
+    std::atomic<int>       level;
+    uint64_t               mask;      /*!< capacity - 1 */
+    Record*                ring;
+    /* next position to append to; the writer reads from `head` */
+    std::atomic<uint64_t>  tail;
+    std::atomic<uint64_t>  head;
+    std::atomic<uint64_t>  dropped;
+    /* dropped records already reported in the file */
+    uint64_t               reported;
+    FILE*                  file;
+    /* second whose formatted time is in `timebuf` */
+    int64_t                timesec;
+    char                   timebuf[32];
+    /* protects `stop` and the waits of the writer and of flush() */
+    std::mutex             mutex;
+    std::condition_variable cond;
+    bool                   stop;
+    pthread_t              thread;
+};
+
+#endif /* FMTP_ASYNCLOG_H_ */
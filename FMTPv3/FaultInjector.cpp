@@ -0,0 +1,335 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FaultInjector.cpp
+ *
+ * This file implements the fault injector.
+ */
+
+#include "FaultInjector.h"
+
+#include <stdlib.h>
+#include <sstream>
+#include <stdexcept>
+
+
+FaultInjector::FaultInjector(const uint32_t seed)
+    : gen(seed), uniform(0, 1), lossGood(0), lossBad(0), toBad(0), toGood(0),
+      bad(false), typeLoss(), targets(), dupProb(0), delayProb(0), depth(1),
+      stats()
+{
+}
+
+
+FaultInjector::~FaultInjector()
+{
+}
+
+
+/**
+ * Checks a probability.
+ *
+ * @param[in] p  The probability.
+ * @throw std::invalid_argument  if the probability isn't in [0, 1].
+ */
+void FaultInjector::checkProb(const double p)
+{
+    if (!(p >= 0 && p <= 1)) {
+        throw std::invalid_argument("FaultInjector::checkProb() invalid "
+                "probability " + std::to_string(p));
+    }
+}
+
+
+/**
+ * Returns whether an event of a probability happens. Events that can't
+ * happen or always happen don't advance the generator, so enabling one
+ * fault doesn't change where the others occur.
+ *
+ * @param[in] p  The probability.
+ * @return       Whether the event happens.
+ */
+bool FaultInjector::draw(const double p)
+{
+    if (p <= 0)
+        return false;
+    if (p >= 1)
+        return true;
+    return uniform(gen) < p;
+}
+
+
+/**
+ * Configures the injector from a specification of comma-separated settings.
+ * Settings that aren't in the specification are left alone.
+ *
+ * @param[in] spec  The specification.
+ * @throw std::invalid_argument  if the specification is invalid.
+ */
+void FaultInjector::Configure(const std::string& spec)
+{
+    std::istringstream settings(spec);
+    std::string        setting;
+
+    while (std::getline(settings, setting, ',')) {
+        if (setting.empty())
+            continue;
+        const size_t eq = setting.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("FaultInjector::Configure() invalid "
+                    "setting \"" + setting + "\"");
+        }
+        const std::string key = setting.substr(0, eq);
+        std::vector<std::string> args;
+        std::istringstream values(setting.substr(eq + 1));
+        std::string        value;
+        while (std::getline(values, value, ':'))
+            args.push_back(value);
+
+        std::vector<double> nums;
+        bool                numeric = true;
+        for (size_t i = 0; i < args.size(); i++) {
+            char* end;
+            nums.push_back(strtod(args[i].c_str(), &end));
+            numeric = numeric && !args[i].empty() && *end == 0;
+        }
+
+        if (key == "seed" && args.size() == 1 && numeric) {
+            SetSeed(static_cast<uint32_t>(nums[0]));
+        }
+        else if (key == "loss" && args.size() == 1 && numeric) {
+            SetLoss(nums[0]);
+        }
+        else if (key == "burst" && (args.size() == 2 || args.size() == 3) &&
+                 numeric) {
+            SetBurstLoss(nums[0], nums[1], args.size() == 3 ? nums[2] : 1);
+        }
+        else if (key == "bop" && args.size() == 1 && numeric) {
+            SetTypeLoss(FMTP_BOP, nums[0]);
+        }
+        else if (key == "eop" && args.size() == 1 && numeric) {
+            SetTypeLoss(FMTP_EOP, nums[0]);
+        }
+        else if (key == "dup" && args.size() == 1 && numeric) {
+            SetDuplication(nums[0]);
+        }
+        else if (key == "reorder" && args.size() == 2 && numeric) {
+            SetReorder(nums[0], static_cast<unsigned>(nums[1]));
+        }
+        else if (key == "drop" && (args.size() == 2 || args.size() == 3)) {
+            uint16_t flags;
+            if (args[1] == "bop")
+                flags = FMTP_BOP;
+            else if (args[1] == "eop")
+                flags = FMTP_EOP;
+            else if (args[1] == "data")
+                flags = FMTP_MEM_DATA;
+            else if (args[1] == "cont")
+                flags = FMTP_BOP_CONT;
+            else
+                flags = 0;
+            if (!flags || args[0].empty()) {
+                throw std::invalid_argument("FaultInjector::Configure() "
+                        "invalid setting \"" + setting + "\"");
+            }
+            AddTarget(strtoul(args[0].c_str(), NULL, 0), flags,
+                      args.size() == 3 ? strtoll(args[2].c_str(), NULL, 0) :
+                                         -1);
+        }
+        else {
+            throw std::invalid_argument("FaultInjector::Configure() invalid "
+                    "setting \"" + setting + "\"");
+        }
+    }
+}
+
+
+/**
+ * Reseeds the generator and restarts the loss model in its good state.
+ *
+ * @param[in] seed  Seed of the generator.
+ */
+void FaultInjector::SetSeed(const uint32_t seed)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    gen.seed(seed);
+    uniform.reset();
+    bad = false;
+}
+
+
+/**
+ * Drops every packet independently with a probability. With burst loss, this
+ * is the loss probability in the good state.
+ *
+ * @param[in] p  The probability.
+ * @throw std::invalid_argument  if the probability isn't in [0, 1].
+ */
+void FaultInjector::SetLoss(const double p)
+{
+    checkProb(p);
+    std::unique_lock<std::mutex> lock(mtx);
+    lossGood = p;
+}
+
+
+/**
+ * Drops packets in bursts following the Gilbert-Elliott model.
+ *
+ * @param[in] toBad    Probability of moving to the bad state.
+ * @param[in] toGood   Probability of moving to the good state.
+ * @param[in] lossBad  Loss probability in the bad state.
+ * @throw std::invalid_argument  if a probability isn't in [0, 1] or
+ *                               `toGood` is 0 while `toBad` isn't.
+ */
+void FaultInjector::SetBurstLoss(const double toBad, const double toGood,
+                                 const double lossBad)
+{
+    checkProb(toBad);
+    checkProb(toGood);
+    checkProb(lossBad);
+    if (toBad > 0 && toGood == 0) {
+        throw std::invalid_argument("FaultInjector::SetBurstLoss() bursts "
+                "wouldn't end");
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    this->toBad   = toBad;
+    this->toGood  = toGood;
+    this->lossBad = lossBad;
+    bad           = false;
+}
+
+
+/**
+ * Drops the packets of a type with a probability.
+ *
+ * @param[in] flags  The type of the packets.
+ * @param[in] p      The probability.
+ * @throw std::invalid_argument  if the probability isn't in [0, 1].
+ */
+void FaultInjector::SetTypeLoss(const uint16_t flags, const double p)
+{
+    checkProb(p);
+    std::unique_lock<std::mutex> lock(mtx);
+    for (size_t i = 0; i < typeLoss.size(); i++) {
+        if (typeLoss[i].first == flags) {
+            typeLoss[i].second = p;
+            return;
+        }
+    }
+    typeLoss.push_back(std::make_pair(flags, p));
+}
+
+
+/**
+ * Drops the first packet of a product that has a type and, optionally, a
+ * sequence number.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] flags      The type of the packet.
+ * @param[in] seqnum     The sequence number or -1 for any.
+ */
+void FaultInjector::AddTarget(const uint32_t prodindex, const uint16_t flags,
+                              const int64_t seqnum)
+{
+    Target target = {prodindex, flags, seqnum};
+    std::unique_lock<std::mutex> lock(mtx);
+    targets.push_back(target);
+}
+
+
+/**
+ * Duplicates packets with a probability.
+ *
+ * @param[in] p  The probability.
+ * @throw std::invalid_argument  if the probability isn't in [0, 1].
+ */
+void FaultInjector::SetDuplication(const double p)
+{
+    checkProb(p);
+    std::unique_lock<std::mutex> lock(mtx);
+    dupProb = p;
+}
+
+
+/**
+ * Delays packets with a probability until a number of later packets have
+ * gone through.
+ *
+ * @param[in] p      The probability.
+ * @param[in] depth  The number of later packets.
+ * @throw std::invalid_argument  if the probability isn't in [0, 1] or the
+ *                               depth is 0.
+ */
+void FaultInjector::SetReorder(const double p, const unsigned depth)
+{
+    checkProb(p);
+    if (depth == 0) {
+        throw std::invalid_argument("FaultInjector::SetReorder() depth is 0");
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    delayProb   = p;
+    this->depth = depth;
+}
+
+
+/**
+ * Decides the fate of a packet.
+ *
+ * @param[in] header  The header of the packet in host byte order.
+ * @return            What is to happen to the packet.
+ */
+FaultAction FaultInjector::decide(const FmtpHeader& header)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    stats.packets++;
+
+    /* a self-describing or stamped data packet is a data packet */
+    const uint16_t type  = header.flags & ~FMTP_TIMESTAMPED;
+    const uint16_t flags = type == FMTP_MEM_DATA_EXT ? FMTP_MEM_DATA : type;
+    for (std::vector<Target>::iterator it = targets.begin();
+         it != targets.end(); ++it) {
+        if (it->prodindex == header.prodindex && it->flags == flags &&
+                (it->seqnum < 0 || it->seqnum == header.seqnum)) {
+            targets.erase(it);
+            stats.dropped++;
+            return FAULT_DROP;
+        }
+    }
+
+    bool drop = false;
+    for (size_t i = 0; i < typeLoss.size(); i++) {
+        if (typeLoss[i].first == flags)
+            drop = draw(typeLoss[i].second);
+    }
+    /* the state advances with every packet, lost or not */
+    bad = bad ? !draw(toGood) : draw(toBad);
+    drop = draw(bad ? lossBad : lossGood) || drop;
+    if (drop) {
+        stats.dropped++;
+        return FAULT_DROP;
+    }
+    if (draw(dupProb)) {
+        stats.duplicated++;
+        return FAULT_DUPLICATE;
+    }
+    if (draw(delayProb)) {
+        stats.delayed++;
+        return FAULT_DELAY;
+    }
+    return FAULT_PASS;
+}
+
+
+/**
+ * Returns the counters of the injector.
+ *
+ * @return  The counters.
+ */
+FaultStats FaultInjector::getStats()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    return stats;
+}
@@ -0,0 +1,210 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FaultInjector.h
+ *
+ * This file defines a fault injector: a seeded, deterministic source of
+ * multicast packet loss, reordering and duplication for testing a FMTP
+ * sender and its receivers on one host.
+ */
+
+#ifndef FMTP_FAULTINJECTOR_H_
+#define FMTP_FAULTINJECTOR_H_
+
+#include <stdint.h>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fmtpBase.h"
+
+
+/** what happens to a packet that passes a fault injector */
+enum FaultAction {
+    FAULT_PASS = 0,  /*!< the packet goes through */
+    FAULT_DROP,      /*!< the packet is lost */
+    FAULT_DUPLICATE, /*!< the packet goes through twice */
+    FAULT_DELAY      /*!< the packet goes through after later packets */
+};
+
+
+/** counters of a fault injector, see FaultInjector::getStats() */
+struct FaultStats
+{
+    uint64_t packets;    /*!< packets that passed the injector */
+    uint64_t dropped;
+    uint64_t duplicated;
+    uint64_t delayed;
+
+    FaultStats() : packets(0), dropped(0), duplicated(0), delayed(0) {}
+};
+
+
+/**
+ * Decides the fate of the multicast packets that pass it. Every decision is
+ * drawn from a generator seeded by `SetSeed()`, so the same seed and the
+ * same sequence of packets give the same faults. The faults are, in the
+ * order they are considered:
+ *   - targeted loss: the first packet of a product that matches a target,
+ *     or any packet whose type is chosen with `SetTypeLoss()`;
+ *   - random loss: independent (Bernoulli) or in bursts (Gilbert-Elliott);
+ *   - duplication;
+ *   - reordering: a packet is held back until `depth` later packets have
+ *     gone through.
+ * A fault injector is safe to use from several threads, but decisions are
+ * only reproducible if the packets pass it in the same order.
+ */
+class FaultInjector
+{
+public:
+    /**
+     * Constructs an injector that injects no faults.
+     *
+     * @param[in] seed  Seed of the generator.
+     */
+    explicit FaultInjector(const uint32_t seed = 1);
+    ~FaultInjector();
+
+    /**
+     * Configures the injector from a specification of comma-separated
+     * settings, e.g. "seed=7,loss=0.01,dup=0.001,reorder=0.01:3":
+     *   - seed=N           seed of the generator;
+     *   - loss=P           Bernoulli loss with probability P;
+     *   - burst=P:R[:H]    Gilbert-Elliott loss, see `SetBurstLoss()`;
+     *   - bop=P, eop=P     loss of BOP or EOP packets with probability P;
+     *   - drop=I:TYPE[:S]  loss of a packet of product I, where TYPE is
+     *                      bop, eop, data or cont and S is the seqnum;
+     *   - dup=P            duplication with probability P;
+     *   - reorder=P:D      reordering with probability P by D packets.
+     * An empty specification injects no faults.
+     *
+     * @param[in] spec  The specification.
+     * @throw std::invalid_argument  if the specification is invalid.
+     */
+    void Configure(const std::string& spec);
+    /**
+     * Reseeds the generator and restarts the loss model in its good state.
+     *
+     * @param[in] seed  Seed of the generator.
+     */
+    void SetSeed(const uint32_t seed);
+    /**
+     * Drops every packet independently with a probability.
+     *
+     * @param[in] p  The probability.
+     * @throw std::invalid_argument  if the probability isn't in [0, 1].
+     */
+    void SetLoss(const double p);
+    /**
+     * Drops packets in bursts following the Gilbert-Elliott model: after
+     * every packet, the model moves from its good to its bad state with a
+     * probability and back with another one. Packets are dropped with
+     * `lossBad` in the bad state and with the Bernoulli probability of
+     * `SetLoss()` in the good state.
+     *
+     * @param[in] toBad    Probability of moving to the bad state.
+     * @param[in] toGood   Probability of moving to the good state. The mean
+     *                     length of a burst is 1/toGood packets.
+     * @param[in] lossBad  Loss probability in the bad state.
+     * @throw std::invalid_argument  if a probability isn't in [0, 1] or
+     *                               `toGood` is 0 while `toBad` isn't.
+     */
+    void SetBurstLoss(const double toBad, const double toGood,
+                      const double lossBad = 1);
+    /**
+     * Drops the packets of a type with a probability, in addition to the
+     * random loss.
+     *
+     * @param[in] flags  The type of the packets, e.g. FMTP_BOP.
+     * @param[in] p      The probability.
+     * @throw std::invalid_argument  if the probability isn't in [0, 1].
+     */
+    void SetTypeLoss(const uint16_t flags, const double p);
+    /**
+     * Drops the first packet of a product that has a type and, optionally, a
+     * sequence number.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] flags      The type of the packet, e.g. FMTP_EOP.
+     * @param[in] seqnum     The sequence number or -1 for any.
+     */
+    void AddTarget(const uint32_t prodindex, const uint16_t flags,
+                   const int64_t seqnum = -1);
+    /**
+     * Duplicates packets with a probability.
+     *
+     * @param[in] p  The probability.
+     * @throw std::invalid_argument  if the probability isn't in [0, 1].
+     */
+    void SetDuplication(const double p);
+    /**
+     * Delays packets with a probability until a number of later packets have
+     * gone through.
+     *
+     * @param[in] p      The probability.
+     * @param[in] depth  The number of later packets.
+     * @throw std::invalid_argument  if the probability isn't in [0, 1] or
+     *                               the depth is 0.
+     */
+    void SetReorder(const double p, const unsigned depth);
+    /**
+     * Decides the fate of a packet.
+     *
+     * @param[in] header  The header of the packet in host byte order.
+     * @return            What is to happen to the packet.
+     */
+    FaultAction decide(const FmtpHeader& header);
+    /**
+     * Returns the number of later packets a delayed packet waits for.
+     *
+     * @return  The number of packets.
+     */
+    unsigned    reorderDepth() const {return depth;}
+    /**
+     * Returns the counters of the injector.
+     *
+     * @return  The counters.
+     */
+    FaultStats  getStats();
+
+private:
+    /** a packet to drop, see AddTarget() */
+    struct Target
+    {
+        uint32_t prodindex;
+        uint16_t flags;
+        int64_t  seqnum;
+    };
+
+    /**
+     * Checks a probability.
+     *
+     * @param[in] p  The probability.
+     * @throw std::invalid_argument  if the probability isn't in [0, 1].
+     */
+    static void checkProb(const double p);
+    /** returns whether an event of a probability happens */
+    bool        draw(const double p);
+
+    std::mutex                             mtx;
+    std::mt19937                           gen;
+    std::uniform_real_distribution<double> uniform;
+    double                                 lossGood;
+    double                                 lossBad;
+    double                                 toBad;
+    double                                 toGood;
+    bool                                   bad;
+    /* loss probability per packet type, see SetTypeLoss() */
+    std::vector<std::pair<uint16_t, double> > typeLoss;
+    std::vector<Target>                    targets;
+    double                                 dupProb;
+    double                                 delayProb;
+    unsigned                               depth;
+    FaultStats                             stats;
+};
+
+#endif /* FMTP_FAULTINJECTOR_H_ */
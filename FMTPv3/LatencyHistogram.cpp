@@ -0,0 +1,193 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LatencyHistogram.cpp
+ *
+ * This file implements fixed-memory histograms of latencies.
+ */
+
+#include "LatencyHistogram.h"
+#include "MetricsExporter.h"
+
+#include <math.h>
+#include <utility>
+
+
+/* number of buckets per power of 2, as a power of 2 */
+static const int SUB_BITS = 5;
+
+/* values below this have a bucket of their own */
+static const uint64_t LINEAR = 2 << SUB_BITS;
+
+/* largest power of 2 that has buckets */
+static const int MAX_EXP = 41;
+
+/* upper bounds of the buckets of the Prometheus histograms, in seconds */
+static const double BOUNDS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5,
+                                10, 30, 60};
+
+
+SizeClass sizeClassOf(const uint64_t bytes)
+{
+    if (bytes <= 16 * 1024)
+        return SIZE_16KIB;
+    if (bytes <= 256 * 1024)
+        return SIZE_256KIB;
+    if (bytes <= 4 * 1024 * 1024)
+        return SIZE_4MIB;
+    return SIZE_LARGE;
+}
+
+
+const char* sizeClassName(const SizeClass sizeclass)
+{
+    static const char* const names[NUM_SIZE_CLASSES] = {"16KiB", "256KiB",
+                                                        "4MiB", "large"};
+    return names[sizeclass];
+}
+
+
+size_t HistogramSnapshot::bucketOf(const uint64_t ns)
+{
+    if (ns < LINEAR)
+        return ns;
+    const int exp = 63 - __builtin_clzll(ns);
+    if (exp > MAX_EXP)
+        return NBUCKETS - 1;
+    return LINEAR + ((exp - SUB_BITS - 1) << SUB_BITS) +
+           ((ns >> (exp - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+
+uint64_t HistogramSnapshot::highestOf(const size_t bucket)
+{
+    if (bucket < LINEAR)
+        return bucket;
+    const int      exp   = ((bucket - LINEAR) >> SUB_BITS) + SUB_BITS + 1;
+    const uint64_t sub   = (bucket - LINEAR) & ((1 << SUB_BITS) - 1);
+    const uint64_t width = uint64_t(1) << (exp - SUB_BITS);
+    return (((uint64_t(1) << SUB_BITS) + sub) << (exp - SUB_BITS)) +
+           width - 1;
+}
+
+
+HistogramSnapshot::HistogramSnapshot()
+    : counts(NBUCKETS, 0),
+      count(0),
+      sum(0),
+      min(UINT64_MAX),
+      max(0)
+{
+}
+
+
+void HistogramSnapshot::record(const uint64_t ns)
+{
+    counts[bucketOf(ns)]++;
+    count++;
+    sum += ns;
+    if (ns < min)
+        min = ns;
+    if (ns > max)
+        max = ns;
+}
+
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other)
+{
+    for (size_t i = 0; i < NBUCKETS; i++)
+        counts[i] += other.counts[i];
+    count += other.count;
+    sum   += other.sum;
+    if (other.min < min)
+        min = other.min;
+    if (other.max > max)
+        max = other.max;
+}
+
+
+uint64_t HistogramSnapshot::getPercentile(const double percent) const
+{
+    if (count == 0)
+        return 0;
+    uint64_t rank = ceil(percent / 100 * count);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NBUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            const uint64_t value = highestOf(i);
+            return value < max ? (value > min ? value : min) : max;
+        }
+    }
+    return max;
+}
+
+
+uint64_t HistogramSnapshot::countAtMost(const uint64_t ns) const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < NBUCKETS && highestOf(i) <= ns; i++)
+        total += counts[i];
+    return total;
+}
+
+
+void HistogramSnapshot::write(MetricsWriter& writer, const std::string& name,
+                              const std::string& help,
+                              const std::string& labels) const
+{
+    std::vector<std::pair<double, uint64_t> > buckets;
+    for (size_t i = 0; i < sizeof(BOUNDS) / sizeof(BOUNDS[0]); i++)
+        buckets.push_back(std::make_pair(BOUNDS[i],
+                countAtMost(static_cast<uint64_t>(BOUNDS[i] * 1e9))));
+    writer.histogram(name, help, labels, buckets, sum / 1e9, count);
+}
+
+
+LatencyHistogram::LatencyHistogram()
+    : sum(0),
+      min(UINT64_MAX),
+      max(0)
+{
+    for (size_t i = 0; i < HistogramSnapshot::NBUCKETS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::record(const uint64_t ns)
+{
+    counts[HistogramSnapshot::bucketOf(ns)].fetch_add(1,
+            std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev = min.load(std::memory_order_relaxed);
+    while (ns < prev && !min.compare_exchange_weak(prev, ns,
+                                                   std::memory_order_relaxed))
+        ;
+    prev = max.load(std::memory_order_relaxed);
+    while (ns > prev && !max.compare_exchange_weak(prev, ns,
+                                                   std::memory_order_relaxed))
+        ;
+}
+
+
+/**
+ * Copies the buckets one by one. The count is the sum of the buckets, so that
+ * percentiles agree with it even while values are being recorded.
+ */
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot snap;
+    for (size_t i = 0; i < HistogramSnapshot::NBUCKETS; i++) {
+        snap.counts[i] = counts[i].load(std::memory_order_relaxed);
+        snap.count    += snap.counts[i];
+    }
+    snap.sum = sum.load(std::memory_order_relaxed);
+    snap.min = min.load(std::memory_order_relaxed);
+    snap.max = max.load(std::memory_order_relaxed);
+    return snap;
+}
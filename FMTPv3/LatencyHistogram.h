@@ -0,0 +1,169 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LatencyHistogram.h
+ *
+ * This file defines fixed-memory histograms of latencies in the style of
+ * HdrHistogram.
+ */
+
+#ifndef FMTP_LATENCYHISTOGRAM_H_
+#define FMTP_LATENCYHISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+class MetricsWriter;
+
+
+/** classes of product sizes that latencies are recorded by */
+enum SizeClass {
+    SIZE_16KIB = 0,  /*!< up to 16 KiB */
+    SIZE_256KIB,     /*!< up to 256 KiB */
+    SIZE_4MIB,       /*!< up to 4 MiB */
+    SIZE_LARGE,      /*!< larger */
+    NUM_SIZE_CLASSES
+};
+
+/**
+ * Returns the class of a product size.
+ *
+ * @param[in] bytes  Size of the product in bytes.
+ * @return           The class.
+ */
+SizeClass   sizeClassOf(const uint64_t bytes);
+/**
+ * Returns the name of a size class, used as the value of the "size" label of
+ * the metrics.
+ *
+ * @param[in] sizeclass  The class.
+ * @return               The name, e.g. "16KiB" for SIZE_16KIB or "large".
+ */
+const char* sizeClassName(const SizeClass sizeclass);
+
+
+/**
+ * A histogram of latencies in nanoseconds. Below 64 ns every value has a
+ * bucket of its own; above, every power of 2 is divided into 32 buckets, so a
+ * value is known within 1/32 (about 3%) of itself, up to 2^42 ns (73
+ * minutes), which larger values are counted as. A histogram takes 10 KiB
+ * whatever the number of values. Snapshots of several histograms -- of
+ * several receivers, say -- can be merged, since they share their buckets.
+ * A snapshot isn't safe to use from several threads, see LatencyHistogram.
+ */
+class HistogramSnapshot
+{
+public:
+    /** constructs an empty histogram */
+    HistogramSnapshot();
+
+    /**
+     * Records a value.
+     *
+     * @param[in] ns  The value in nanoseconds.
+     */
+    void     record(const uint64_t ns);
+    /**
+     * Adds the values of another histogram.
+     *
+     * @param[in] other  The other histogram.
+     */
+    void     merge(const HistogramSnapshot& other);
+    /** returns the number of values */
+    uint64_t getCount() const {return count;}
+    /** returns the smallest value or 0 if there are none */
+    uint64_t getMin() const {return count ? min : 0;}
+    /** returns the largest value or 0 if there are none */
+    uint64_t getMax() const {return max;}
+    /** returns the sum of the values */
+    uint64_t getSum() const {return sum;}
+    /** returns the mean of the values or 0 if there are none */
+    double   getMean() const {return count ? (double)sum / count : 0;}
+    /**
+     * Returns a percentile.
+     *
+     * @param[in] percent  The percentile, from 0 to 100.
+     * @return             The largest value of the bucket that the
+     *                     percentile falls in, but no more than the largest
+     *                     value, or 0 if there are no values.
+     */
+    uint64_t getPercentile(const double percent) const;
+    /**
+     * Returns the number of values at most a limit. Values of the bucket the
+     * limit falls in count only if the whole bucket is at most the limit.
+     *
+     * @param[in] ns  The limit in nanoseconds.
+     * @return        The number of values.
+     */
+    uint64_t countAtMost(const uint64_t ns) const;
+    /**
+     * Adds the histogram to a scrape as a Prometheus histogram in seconds,
+     * with buckets from 100 microseconds to 1 minute.
+     *
+     * @param[in] writer  The scrape.
+     * @param[in] name    Name of the metric, ending in "_seconds".
+     * @param[in] help    Description of the metric.
+     * @param[in] labels  Labels of the histogram, see MetricsWriter.
+     */
+    void     write(MetricsWriter& writer, const std::string& name,
+                   const std::string& help, const std::string& labels) const;
+
+    /** number of buckets */
+    static const size_t NBUCKETS = 64 + 36 * 32;
+    /** returns the bucket of a value */
+    static size_t   bucketOf(const uint64_t ns);
+    /** returns the largest value of a bucket */
+    static uint64_t highestOf(const size_t bucket);
+
+private:
+    friend class LatencyHistogram;
+
+    std::vector<uint64_t> counts;
+    uint64_t              count;
+    uint64_t              sum;
+    uint64_t              min;
+    uint64_t              max;
+};
+
+
+/**
+ * A histogram that any number of threads record latencies into without
+ * locking, for statistics such as those of fmtpSendv3 and fmtpRecvv3. It's
+ * read through snapshots, which are consistent with each other only once
+ * recording has stopped.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    /**
+     * Records a value. Safe to call from any thread.
+     *
+     * @param[in] ns  The value in nanoseconds.
+     */
+    void              record(const uint64_t ns);
+    /**
+     * Returns a copy of the histogram.
+     *
+     * @return  The copy.
+     */
+    HistogramSnapshot snapshot() const;
+
+private:
+    /* Prevent copying because it's meaningless */
+    LatencyHistogram(LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    std::atomic<uint64_t> counts[HistogramSnapshot::NBUCKETS];
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+};
+
+#endif /* FMTP_LATENCYHISTOGRAM_H_ */
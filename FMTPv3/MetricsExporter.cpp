@@ -0,0 +1,414 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: MetricsExporter.cpp
+ *
+ * This file implements the exporter of metrics in the Prometheus text
+ * exposition format.
+ */
+
+#include "MetricsExporter.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <system_error>
+
+
+/* longest HTTP request header read */
+static const size_t MAX_REQUEST = 8192;
+
+/* longest time a client may take to send its request, in seconds */
+static const int REQUEST_TIMEOUT = 2;
+
+
+/**
+ * Formats the value of a sample. Integral values are written without an
+ * exponent so that large counts stay exact; others, such as the bounds of
+ * histogram buckets, as briefly as they can be read back exactly.
+ *
+ * @param[in] value  The value.
+ * @return           The formatted value.
+ */
+static std::string formatValue(const double value)
+{
+    if (isnan(value))
+        return "NaN";
+    if (isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+    char buf[32];
+    if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+        (void)snprintf(buf, sizeof(buf), "%.0f", value);
+    }
+    else {
+        /* the shortest form that reads back as the same value */
+        (void)snprintf(buf, sizeof(buf), "%.15g", value);
+        if (strtod(buf, NULL) != value)
+            (void)snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    return buf;
+}
+
+
+/**
+ * Writes all of a buffer to a connection.
+ *
+ * @param[in] sock  The connection.
+ * @param[in] data  The buffer.
+ * @param[in] len   Size of the buffer in bytes.
+ * @return          Whether everything was written.
+ */
+static bool writeAll(const int sock, const char* data, size_t len)
+{
+    while (len > 0) {
+        const ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len  -= n;
+    }
+    return true;
+}
+
+
+MetricsWriter::Family& MetricsWriter::family(const std::string& name,
+                                             const std::string& type,
+                                             const std::string& help)
+{
+    std::map<std::string, Family>::iterator it = families.find(name);
+    if (it == families.end()) {
+        order.push_back(name);
+        it = families.insert(std::make_pair(name, Family())).first;
+        it->second.type = type;
+        it->second.help = help;
+    }
+    return it->second;
+}
+
+
+void MetricsWriter::counter(const std::string& name, const std::string& help,
+                            const std::string& labels, const uint64_t value)
+{
+    family(name, "counter", help).samples.push_back(
+            (labels.empty() ? name : name + "{" + labels + "}") + " " +
+            std::to_string(value));
+}
+
+
+void MetricsWriter::gauge(const std::string& name, const std::string& help,
+                          const std::string& labels, const double value)
+{
+    family(name, "gauge", help).samples.push_back(
+            (labels.empty() ? name : name + "{" + labels + "}") + " " +
+            formatValue(value));
+}
+
+
+void MetricsWriter::histogram(const std::string& name,
+        const std::string& help, const std::string& labels,
+        const std::vector<std::pair<double, uint64_t> >& buckets,
+        const double sum, const uint64_t count)
+{
+    Family&           fam = family(name, "histogram", help);
+    const std::string sep = labels.empty() ? "" : labels + ",";
+    for (size_t i = 0; i < buckets.size(); i++)
+        fam.samples.push_back(name + "_bucket{" + sep + "le=\"" +
+                formatValue(buckets[i].first) + "\"} " +
+                std::to_string(buckets[i].second));
+    fam.samples.push_back(name + "_bucket{" + sep + "le=\"+Inf\"} " +
+            std::to_string(count));
+    const std::string braced = labels.empty() ? "" : "{" + labels + "}";
+    fam.samples.push_back(name + "_sum" + braced + " " + formatValue(sum));
+    fam.samples.push_back(name + "_count" + braced + " " +
+            std::to_string(count));
+}
+
+
+std::string MetricsWriter::str() const
+{
+    std::string text;
+    for (size_t i = 0; i < order.size(); i++) {
+        const Family& fam = families.find(order[i])->second;
+        text += "# HELP " + order[i] + " " + fam.help + "\n";
+        text += "# TYPE " + order[i] + " " + fam.type + "\n";
+        for (size_t j = 0; j < fam.samples.size(); j++)
+            text += fam.samples[j] + "\n";
+    }
+    return text;
+}
+
+
+std::string MetricsWriter::label(const std::string& name,
+                                 const std::string& value)
+{
+    std::string escaped;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '\\' || value[i] == '"')
+            escaped += '\\';
+        if (value[i] == '\n')
+            escaped += "\\n";
+        else
+            escaped += value[i];
+    }
+    return name + "=\"" + escaped + "\"";
+}
+
+
+std::string MetricsWriter::join(const std::string& first,
+                                const std::string& second)
+{
+    if (first.empty())
+        return second;
+    if (second.empty())
+        return first;
+    return first + "," + second;
+}
+
+
+MetricsExporter::MetricsExporter(const std::string& address)
+    :
+    listenfd(-1),
+    wakefd(-1),
+    port(0),
+    unixPath(),
+    thread(),
+    collectmtx(),
+    collectors(),
+    nextId(0)
+{
+    if (address.compare(0, 5, "unix:") == 0) {
+        unixPath = address.substr(5);
+        struct sockaddr_un addr = {};
+        if (unixPath.empty() || unixPath.size() >= sizeof(addr.sun_path))
+            throw std::invalid_argument("MetricsExporter::MetricsExporter() "
+                    "Invalid socket path: " + unixPath);
+        addr.sun_family = AF_UNIX;
+        (void)strcpy(addr.sun_path, unixPath.c_str());
+        listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenfd < 0)
+            throw std::system_error(errno, std::system_category(),
+                    "MetricsExporter::MetricsExporter() socket() error");
+        (void)unlink(unixPath.c_str());
+        if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) ||
+                listen(listenfd, 8)) {
+            const int err = errno;
+            closeAll();
+            throw std::system_error(err, std::system_category(),
+                    "MetricsExporter::MetricsExporter() Couldn't listen on " +
+                    unixPath);
+        }
+    }
+    else {
+        const size_t colon = address.rfind(':');
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        char* end;
+        const unsigned long portnum = (colon == std::string::npos) ? 0 :
+                strtoul(address.c_str() + colon + 1, &end, 10);
+        if (colon == std::string::npos || *end || portnum > 0xffff ||
+                inet_pton(AF_INET, address.substr(0, colon).c_str(),
+                          &addr.sin_addr) != 1)
+            throw std::invalid_argument("MetricsExporter::MetricsExporter() "
+                    "Invalid address: " + address);
+        addr.sin_port = htons(portnum);
+        listenfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenfd < 0)
+            throw std::system_error(errno, std::system_category(),
+                    "MetricsExporter::MetricsExporter() socket() error");
+        const int on = 1;
+        (void)setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        socklen_t len = sizeof(addr);
+        if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) ||
+                listen(listenfd, 8) ||
+                getsockname(listenfd, (struct sockaddr*)&addr, &len)) {
+            const int err = errno;
+            closeAll();
+            throw std::system_error(err, std::system_category(),
+                    "MetricsExporter::MetricsExporter() Couldn't listen on " +
+                    address);
+        }
+        port = ntohs(addr.sin_port);
+    }
+
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakefd < 0) {
+        const int err = errno;
+        closeAll();
+        throw std::system_error(err, std::system_category(),
+                "MetricsExporter::MetricsExporter() eventfd() error");
+    }
+    int retval = pthread_create(&thread, NULL, &MetricsExporter::runWrapper,
+                                this);
+    if (retval) {
+        closeAll();
+        throw std::runtime_error("MetricsExporter::MetricsExporter() "
+                "pthread_create() error with retval = " +
+                std::to_string(retval));
+    }
+}
+
+
+MetricsExporter::~MetricsExporter()
+{
+    const uint64_t one = 1;
+    (void)write(wakefd, &one, sizeof(one));
+    (void)pthread_join(thread, NULL);
+    closeAll();
+}
+
+
+/**
+ * Closes the descriptors of the exporter and removes its Unix-domain socket.
+ */
+void MetricsExporter::closeAll()
+{
+    if (listenfd >= 0) {
+        (void)close(listenfd);
+        if (!unixPath.empty())
+            (void)unlink(unixPath.c_str());
+    }
+    if (wakefd >= 0)
+        (void)close(wakefd);
+}
+
+
+int MetricsExporter::addCollector(const Collector& collector)
+{
+    std::unique_lock<std::mutex> lock(collectmtx);
+    collectors[nextId] = collector;
+    return nextId++;
+}
+
+
+void MetricsExporter::removeCollector(const int id)
+{
+    std::unique_lock<std::mutex> lock(collectmtx);
+    collectors.erase(id);
+}
+
+
+std::string MetricsExporter::scrape()
+{
+    MetricsWriter writer;
+    {
+        std::unique_lock<std::mutex> lock(collectmtx);
+        for (std::map<int, Collector>::iterator it = collectors.begin();
+             it != collectors.end(); ++it)
+            it->second(writer);
+    }
+    return writer.str();
+}
+
+
+/**
+ * Answers one HTTP request. "GET /metrics" and "GET /" return the metrics;
+ * anything else is refused. The connection is closed afterwards.
+ *
+ * @param[in] sock  The connection.
+ */
+void MetricsExporter::serve(const int sock)
+{
+    const struct timeval timeout = {REQUEST_TIMEOUT, 0};
+    (void)setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char        buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.find("\n\n") == std::string::npos &&
+           request.size() < MAX_REQUEST) {
+        const ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        request.append(buf, n);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    const size_t sp1 = request.find(' ');
+    const size_t sp2 = (sp1 == std::string::npos) ? sp1 :
+                       request.find_first_of(" \r\n", sp1 + 1);
+    if (sp2 == std::string::npos) {
+        status = "400 Bad Request";
+    }
+    else if (request.compare(0, sp1, "GET") != 0) {
+        status = "405 Method Not Allowed";
+    }
+    else {
+        std::string path = request.substr(sp1 + 1, sp2 - sp1 - 1);
+        path = path.substr(0, path.find('?'));
+        if (path == "/metrics" || path == "/")
+            body = scrape();
+        else
+            status = "404 Not Found";
+    }
+    if (status[0] != '2')
+        body = status + "\n";
+
+    const std::string head = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n";
+    if (writeAll(sock, head.data(), head.size()))
+        (void)writeAll(sock, body.data(), body.size());
+}
+
+
+/**
+ * Serves one connection after another until the exporter is destroyed.
+ * Scrapes are rare, so connections aren't served concurrently.
+ */
+void MetricsExporter::run()
+{
+    struct pollfd fds[2];
+    fds[0].fd     = listenfd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = wakefd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & POLLIN) {
+            const int sock = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+            if (sock >= 0) {
+                serve(sock);
+                (void)close(sock);
+            }
+        }
+    }
+}
+
+
+/**
+ * A wrapper to call the actual MetricsExporter::run().
+ *
+ * @param[in] *ptr  A pointer to the MetricsExporter object.
+ */
+void* MetricsExporter::runWrapper(void* ptr)
+{
+    static_cast<MetricsExporter*>(ptr)->run();
+    return NULL;
+}
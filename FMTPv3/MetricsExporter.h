@@ -0,0 +1,209 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: MetricsExporter.h
+ *
+ * This file defines an exporter that serves the statistics of FMTP senders and
+ * receivers in the Prometheus text exposition format over a local socket.
+ */
+
+#ifndef FMTP_METRICSEXPORTER_H_
+#define FMTP_METRICSEXPORTER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Collects the samples of one scrape and formats them. Samples of the same
+ * metric are grouped under a single HELP and TYPE line, whatever the order
+ * in which they are added, so several senders or receivers can report the
+ * same metrics with different labels.
+ */
+class MetricsWriter
+{
+public:
+    /**
+     * Adds a sample of a counter.
+     *
+     * @param[in] name    Name of the metric, ending in "_total".
+     * @param[in] help    Description of the metric.
+     * @param[in] labels  Labels of the sample as `name="value"` pairs
+     *                    separated by commas, see `label()`. May be empty.
+     * @param[in] value   The value.
+     */
+    void counter(const std::string& name, const std::string& help,
+                 const std::string& labels, const uint64_t value);
+    /**
+     * Adds a sample of a gauge.
+     *
+     * @param[in] name    Name of the metric.
+     * @param[in] help    Description of the metric.
+     * @param[in] labels  Labels of the sample, see `counter()`.
+     * @param[in] value   The value.
+     */
+    void gauge(const std::string& name, const std::string& help,
+               const std::string& labels, const double value);
+    /**
+     * Adds the samples of a histogram.
+     *
+     * @param[in] name     Name of the metric, without the "_bucket", "_sum"
+     *                     and "_count" suffixes.
+     * @param[in] help     Description of the metric.
+     * @param[in] labels   Labels of the histogram, see `counter()`.
+     * @param[in] buckets  Upper bound of every bucket, in increasing order,
+     *                     and the number of values at most the bound. The
+     *                     "+Inf" bucket is added.
+     * @param[in] sum      Sum of the values.
+     * @param[in] count    Number of values.
+     */
+    void histogram(const std::string& name, const std::string& help,
+                   const std::string& labels,
+                   const std::vector<std::pair<double, uint64_t> >& buckets,
+                   const double sum, const uint64_t count);
+    /**
+     * Returns the samples in the text exposition format.
+     *
+     * @return  The text.
+     */
+    std::string str() const;
+    /**
+     * Returns a label, with the value escaped.
+     *
+     * @param[in] name   Name of the label.
+     * @param[in] value  Value of the label.
+     * @return           The label as `name="value"`.
+     */
+    static std::string label(const std::string& name,
+                             const std::string& value);
+    /**
+     * Joins two lists of labels.
+     *
+     * @param[in] first   The first list. May be empty.
+     * @param[in] second  The second list. May be empty.
+     * @return            The joined list.
+     */
+    static std::string join(const std::string& first,
+                            const std::string& second);
+
+private:
+    /** a metric and its samples */
+    struct Family
+    {
+        std::string              type;
+        std::string              help;
+        std::vector<std::string> samples;
+    };
+
+    /**
+     * Returns the family of a metric, creating it if need be.
+     *
+     * @param[in] name  Name of the metric.
+     * @param[in] type  Type of the metric.
+     * @param[in] help  Description of the metric.
+     * @return          The family.
+     */
+    Family& family(const std::string& name, const std::string& type,
+                   const std::string& help);
+
+    /* names of the metrics in the order they were first added */
+    std::vector<std::string>      order;
+    std::map<std::string, Family> families;
+};
+
+
+/**
+ * Serves metrics over HTTP on a loopback TCP socket or a Unix-domain socket,
+ * in a thread of its own. The metrics come from collectors that are called
+ * for every scrape, so nothing is gathered between scrapes; fmtpSendv3 and
+ * fmtpRecvv3 register one each through `SetMetricsExporter()`. Collectors
+ * read snapshots, such as those of `getStats()`, and never take a lock that
+ * the threads that send or receive packets take for every packet.
+ */
+class MetricsExporter
+{
+public:
+    /** produces the samples of a scrape */
+    typedef std::function<void(MetricsWriter&)> Collector;
+
+    /**
+     * Opens the socket and starts serving.
+     *
+     * @param[in] address  Where to listen: "host:port" for TCP, where a port
+     *                     of 0 lets the system choose one, or "unix:path" for
+     *                     a Unix-domain socket, which replaces any file at
+     *                     `path`. TCP should be on a loopback address since
+     *                     the metrics aren't protected.
+     * @throw std::invalid_argument  if the address is invalid.
+     * @throw std::system_error      if the socket can't be opened.
+     * @throw std::runtime_error     if the thread can't be started.
+     */
+    explicit MetricsExporter(const std::string& address);
+    /** stops serving and closes the socket; removes the Unix-domain socket */
+    ~MetricsExporter();
+
+    /**
+     * Adds a collector.
+     *
+     * @param[in] collector  The collector.
+     * @return               An identifier of the collector for
+     *                       `removeCollector()`.
+     */
+    int            addCollector(const Collector& collector);
+    /**
+     * Removes a collector. Once this returns, the collector won't be called
+     * again.
+     *
+     * @param[in] id  Identifier returned by `addCollector()`.
+     */
+    void           removeCollector(const int id);
+    /**
+     * Returns the metrics of all collectors, as served.
+     *
+     * @return  The metrics in the text exposition format.
+     */
+    std::string    scrape();
+    /**
+     * Returns the TCP port the exporter listens on.
+     *
+     * @return  The port or 0 for a Unix-domain socket.
+     */
+    unsigned short getPort() const {return port;}
+
+private:
+    /**
+     * Answers one HTTP request on a connection.
+     *
+     * @param[in] sock  The connection.
+     */
+    void         serve(const int sock);
+    /** exporter thread */
+    void         run();
+    /** a wrapper to call the actual MetricsExporter::run() */
+    static void* runWrapper(void* ptr);
+    /** closes the exporter's descriptors */
+    void         closeAll();
+    /* Prevent copying because it's meaningless */
+    MetricsExporter(MetricsExporter&);
+    MetricsExporter& operator=(const MetricsExporter&);
+
+    int                          listenfd;
+    int                          wakefd;    /*!< eventfd to stop */
+    unsigned short               port;
+    std::string                  unixPath;  /*!< empty for TCP */
+    pthread_t                    thread;
+    /* protects the collectors; taken by scrapes and (de)registrations only */
+    std::mutex                   collectmtx;
+    std::map<int, Collector>     collectors;
+    int                          nextId;
+};
+
+#endif /* FMTP_METRICSEXPORTER_H_ */
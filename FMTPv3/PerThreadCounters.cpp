@@ -0,0 +1,185 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: PerThreadCounters.cpp
+ *
+ * This file implements a set of counters that many threads increment without
+ * contending with each other.
+ */
+
+#include "PerThreadCounters.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+
+
+/* size of a cache line, the granularity of the blocks */
+static const size_t CACHE_LINE = 64;
+
+/* source of the identifiers of the sets; 0 is never used */
+static std::atomic<uint64_t> nextId(1);
+
+
+/* the blocks of a set's running threads and the counts of the ended ones */
+struct PerThreadCounters::Blocks
+{
+    explicit Blocks(const int n) : mutex(), live(), retired(n, 0) {}
+
+    /**
+     * Adds the counts of a block to the totals of the ended threads and
+     * frees it, unless the set was destroyed and freed it already.
+     *
+     * @param[in] block  The block of a thread that ends.
+     */
+    void retire(std::atomic<uint64_t>* const block)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::vector<std::atomic<uint64_t>*>::iterator it =
+                std::find(live.begin(), live.end(), block);
+        if (it == live.end())
+            return;
+        for (size_t i = 0; i < retired.size(); i++)
+            retired[i] += block[i].load(std::memory_order_relaxed);
+        live.erase(it);
+        free(block);
+    }
+
+    std::mutex                          mutex;
+    std::vector<std::atomic<uint64_t>*> live;
+    std::vector<uint64_t>               retired;
+};
+
+
+/**
+ * The blocks of the sets a thread uses, keyed by the identifiers of the sets.
+ * Destroyed when the thread ends, it retires them.
+ */
+class PerThreadCounters::Registry
+{
+public:
+    Registry() : entries() {}
+    ~Registry()
+    {
+        for (Map::iterator it = entries.begin(); it != entries.end(); ++it) {
+            std::shared_ptr<Blocks> set = it->second.set.lock();
+            if (set)
+                set->retire(it->second.block);
+        }
+    }
+
+    std::atomic<uint64_t>* find(const uint64_t id) const
+    {
+        Map::const_iterator it = entries.find(id);
+        return it == entries.end() ? NULL : it->second.block;
+    }
+
+    /* also forgets the blocks of the sets that were destroyed */
+    void insert(const uint64_t id, const std::shared_ptr<Blocks>& set,
+                std::atomic<uint64_t>* const block)
+    {
+        for (Map::iterator it = entries.begin(); it != entries.end();) {
+            if (it->second.set.expired())
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+        Entry& entry = entries[id];
+        entry.set   = set;
+        entry.block = block;
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<Blocks>  set;
+        std::atomic<uint64_t>* block;
+    };
+    typedef std::unordered_map<uint64_t, Entry> Map;
+
+    Map entries;
+};
+
+
+PerThreadCounters::PerThreadCounters(const int n)
+    : n(n),
+      id(nextId.fetch_add(1)),
+      blocks()
+{
+    if (n <= 0)
+        throw std::invalid_argument("PerThreadCounters::PerThreadCounters() "
+                "Invalid number of counters: " + std::to_string(n));
+    blocks.reset(new Blocks(n));
+}
+
+
+PerThreadCounters::~PerThreadCounters()
+{
+    std::unique_lock<std::mutex> lock(blocks->mutex);
+    for (size_t i = 0; i < blocks->live.size(); i++)
+        free(blocks->live[i]);
+    blocks->live.clear();
+}
+
+
+/**
+ * Returns the block of the calling thread, allocating it on first use. A
+ * thread that uses several sets keeps their blocks in a registry of its own,
+ * so switching between sets takes no lock either.
+ *
+ * @return  The thread's block.
+ * @throw std::bad_alloc  if memory can't be allocated.
+ */
+std::atomic<uint64_t>* PerThreadCounters::lookup()
+{
+    static thread_local Registry mine;
+    std::atomic<uint64_t>*       block = mine.find(id);
+    if (block)
+        return block;
+
+    const size_t size = (n * sizeof(std::atomic<uint64_t>) + CACHE_LINE - 1) /
+            CACHE_LINE * CACHE_LINE;
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE, size))
+        throw std::bad_alloc();
+    block = static_cast<std::atomic<uint64_t>*>(mem);
+    for (int i = 0; i < n; i++)
+        new (block + i) std::atomic<uint64_t>(0);
+    {
+        std::unique_lock<std::mutex> lock(blocks->mutex);
+        blocks->live.push_back(block);
+    }
+    try {
+        mine.insert(id, blocks, block);
+    }
+    catch (...) {
+        blocks->retire(block);
+        throw;
+    }
+    return block;
+}
+
+
+uint64_t PerThreadCounters::sum(const int which) const
+{
+    std::unique_lock<std::mutex> lock(blocks->mutex);
+    uint64_t                     total = blocks->retired[which];
+    for (size_t i = 0; i < blocks->live.size(); i++)
+        total += blocks->live[i][which].load(std::memory_order_relaxed);
+    return total;
+}
+
+
+std::vector<uint64_t> PerThreadCounters::sums() const
+{
+    std::unique_lock<std::mutex> lock(blocks->mutex);
+    std::vector<uint64_t>        totals(blocks->retired);
+    for (size_t i = 0; i < blocks->live.size(); i++)
+        for (int j = 0; j < n; j++)
+            totals[j] += blocks->live[i][j].load(std::memory_order_relaxed);
+    return totals;
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: PerThreadCounters.h
+ *
+ * This file defines a set of counters that many threads increment without
+ * contending with each other and that any thread can read at any time. The
+ * statistics of fmtpSendv3::getStats() and fmtpRecvv3::getStats() are kept
+ * in them.
+ */
+
+#ifndef FMTP_PERTHREADCOUNTERS_H_
+#define FMTP_PERTHREADCOUNTERS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+
+/**
+ * A fixed number of 64-bit counters. Every thread that increments them gets
+ * a block of counters of its own, on cache lines of its own, that no other
+ * thread writes. An increment is therefore a relaxed load and store of the
+ * thread's own counter: no locked instruction and no cache line moving
+ * between cores. Reading a counter sums it over the blocks, so a reader sees
+ * every increment that happened before, though not necessarily the
+ * increments of several counters at the same instant. When a thread ends,
+ * its counts are added to totals kept by the set and its block is freed, so
+ * they remain in the sums; a set destroyed first frees the blocks of the
+ * threads still running.
+ */
+class PerThreadCounters
+{
+public:
+    /**
+     * Constructs.
+     *
+     * @param[in] n  Number of counters.
+     */
+    explicit PerThreadCounters(int n);
+    ~PerThreadCounters();
+
+    /**
+     * Adds to a counter. Called by any thread; a thread's first call takes a
+     * lock to get its block, later calls don't.
+     *
+     * @param[in] which  Index of the counter.
+     * @param[in] n      Amount to add.
+     */
+    void add(const int which, const uint64_t n = 1)
+    {
+        std::atomic<uint64_t>& counter = local()[which];
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+    /**
+     * Returns the sum of a counter over all threads.
+     *
+     * @param[in] which  Index of the counter.
+     * @return           The sum.
+     */
+    uint64_t sum(int which) const;
+    /**
+     * Returns the sums of all counters.
+     *
+     * @return  The sums, indexed like the counters.
+     */
+    std::vector<uint64_t> sums() const;
+
+private:
+    PerThreadCounters(const PerThreadCounters&);
+    PerThreadCounters& operator=(const PerThreadCounters&);
+
+    /* the calling thread's block */
+    std::atomic<uint64_t>* local()
+    {
+        struct Cache {
+            uint64_t               owner;
+            std::atomic<uint64_t>* block;
+        };
+        /* the block of the set this thread used last */
+        static thread_local Cache cache = {0, NULL};
+        if (cache.owner != id) {
+            cache.block = lookup();
+            cache.owner = id;
+        }
+        return cache.block;
+    }
+    std::atomic<uint64_t>* lookup();
+
+    struct Blocks;
+    class Registry;
+
+    const int               n;
+    const uint64_t          id;      /*!< unique among all sets */
+    /* shared with the registries of the threads that have a block */
+    std::shared_ptr<Blocks> blocks;
+};
+
+
+#endif /* FMTP_PERTHREADCOUNTERS_H_ */
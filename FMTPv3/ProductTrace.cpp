@@ -0,0 +1,366 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: ProductTrace.cpp
+ *
+ * This file implements a trace of the lifecycle events of products.
+ */
+
+#include "ProductTrace.h"
+#include "fmtpBase.h"
+
+#include <endian.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+
+/* identifies a trace file and the version of its format */
+static const char MAGIC[8] = {'F', 'M', 'T', 'P', 'T', 'R', 'C', '1'};
+
+/* size of an event in a trace file */
+static const size_t EVENT_LEN = 24;
+
+/* number of words of an event in a ring */
+static const size_t WORDS = 3;
+
+/* source of the identifiers of the traces; 0 is never used */
+static std::atomic<uint64_t> nextId(1);
+
+
+/**
+ * A ring is written by its thread only. Before writing an event, the thread
+ * counts it as begun, so that a reader can tell which events it may have
+ * read while they were being overwritten, as in a seqlock.
+ */
+struct ProductTrace::Ring
+{
+    std::atomic<uint64_t>  begun;   /*!< events begun */
+    std::atomic<uint64_t>  head;    /*!< events written */
+    uint16_t               thread;
+    uint32_t               tid;
+    std::atomic<uint64_t>* slots;   /*!< WORDS per event */
+};
+
+
+ProductTrace::ProductTrace(const std::string& name, const size_t capacity)
+    : name(name),
+      capacity(capacity > 1 ? size_t(1) << (64 - __builtin_clzll(capacity - 1))
+                            : 1),
+      id(nextId.fetch_add(1)),
+      mutex(),
+      rings()
+{
+    if (capacity == 0)
+        throw std::invalid_argument("ProductTrace::ProductTrace() "
+                "Invalid capacity: 0");
+}
+
+
+ProductTrace::~ProductTrace()
+{
+    for (size_t i = 0; i < rings.size(); i++) {
+        delete[] rings[i]->slots;
+        delete rings[i];
+    }
+}
+
+
+/**
+ * Returns the ring of the calling thread, allocating it on first use. A
+ * thread that records into several traces keeps their rings in a map of its
+ * own, so switching between traces takes no lock either.
+ *
+ * @return  The thread's ring.
+ * @throw std::bad_alloc  if memory can't be allocated.
+ */
+ProductTrace::Ring* ProductTrace::lookup()
+{
+    static thread_local std::unordered_map<uint64_t, Ring*> mine;
+    std::unordered_map<uint64_t, Ring*>::iterator it = mine.find(id);
+    if (it != mine.end())
+        return it->second;
+
+    Ring* ring  = new Ring;
+    ring->begun.store(0, std::memory_order_relaxed);
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tid   = syscall(SYS_gettid);
+    ring->slots = new std::atomic<uint64_t>[WORDS * capacity];
+    for (size_t i = 0; i < WORDS * capacity; i++)
+        ring->slots[i].store(0, std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ring->thread = rings.size();
+        rings.push_back(ring);
+    }
+    mine[id] = ring;
+    return ring;
+}
+
+
+void ProductTrace::record(const TraceEventType type, const uint32_t prodindex,
+                          const uint32_t arg)
+{
+    Ring* const    ring = local();
+    const uint64_t h    = ring->head.load(std::memory_order_relaxed);
+
+    ring->begun.store(h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::atomic<uint64_t>* const slot = ring->slots +
+            WORDS * (h & (capacity - 1));
+    slot[0].store(wallClockNs(), std::memory_order_relaxed);
+    slot[1].store((uint64_t)prodindex << 32 | arg, std::memory_order_relaxed);
+    slot[2].store(type, std::memory_order_relaxed);
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+
+/**
+ * Copies the events of every ring, then drops those that the ring's thread
+ * may have overwritten meanwhile.
+ */
+std::vector<TraceEvent> ProductTrace::snapshot() const
+{
+    std::vector<TraceEvent>      events;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (size_t r = 0; r < rings.size(); r++) {
+        const Ring* const ring = rings[r];
+        const uint64_t    head = ring->head.load(std::memory_order_acquire);
+        const uint64_t    from = head > capacity ? head - capacity : 0;
+        std::vector<TraceEvent> copied;
+        for (uint64_t i = from; i < head; i++) {
+            const std::atomic<uint64_t>* const slot = ring->slots +
+                    WORDS * (i & (capacity - 1));
+            const uint64_t word = slot[1].load(std::memory_order_relaxed);
+            TraceEvent     event;
+            event.ns        = slot[0].load(std::memory_order_relaxed);
+            event.prodindex = word >> 32;
+            event.arg       = (uint32_t)word;
+            event.type      = slot[2].load(std::memory_order_relaxed);
+            event.thread    = ring->thread;
+            event.tid       = ring->tid;
+            copied.push_back(event);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t begun = ring->begun.load(std::memory_order_relaxed);
+        const uint64_t valid = begun > capacity ? begun - capacity : 0;
+        if (valid > from)
+            copied.erase(copied.begin(), copied.begin() +
+                         std::min<uint64_t>(valid - from, copied.size()));
+        events.insert(events.end(), copied.begin(), copied.end());
+    }
+    lock.unlock();
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TraceEvent& a, const TraceEvent& b) {
+                         return a.ns < b.ns;
+                     });
+    return events;
+}
+
+
+/**
+ * The file starts with MAGIC, the length of the name as a 32-bit integer,
+ * the name and the number of events as a 64-bit integer, followed by the
+ * events as in TraceEvent. Integers are little-endian.
+ */
+void ProductTrace::write(const std::string& path) const
+{
+    const std::vector<TraceEvent> events = snapshot();
+    std::string                   buf(MAGIC, sizeof(MAGIC));
+    const uint32_t                namelen = htole32(name.size());
+    const uint64_t                count   = htole64(events.size());
+
+    buf.append((const char*)&namelen, sizeof(namelen));
+    buf.append(name);
+    buf.append((const char*)&count, sizeof(count));
+    for (size_t i = 0; i < events.size(); i++) {
+        char           rec[EVENT_LEN];
+        const uint64_t ns        = htole64(events[i].ns);
+        const uint32_t prodindex = htole32(events[i].prodindex);
+        const uint32_t arg       = htole32(events[i].arg);
+        const uint16_t type      = htole16(events[i].type);
+        const uint16_t thread    = htole16(events[i].thread);
+        const uint32_t tid       = htole32(events[i].tid);
+        (void)memcpy(rec, &ns, 8);
+        (void)memcpy(rec + 8, &prodindex, 4);
+        (void)memcpy(rec + 12, &arg, 4);
+        (void)memcpy(rec + 16, &type, 2);
+        (void)memcpy(rec + 18, &thread, 2);
+        (void)memcpy(rec + 20, &tid, 4);
+        buf.append(rec, sizeof(rec));
+    }
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(buf.data(), buf.size());
+    file.close();
+    if (!file)
+        throw std::runtime_error("ProductTrace::write() Couldn't write " +
+                                 path);
+}
+
+
+void ProductTrace::read(const std::string& path, std::string& name,
+                        std::vector<TraceEvent>& events)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        throw std::runtime_error("ProductTrace::read() Couldn't open " + path);
+
+    char     magic[sizeof(MAGIC)];
+    uint32_t namelen;
+    if (!file.read(magic, sizeof(magic)) ||
+            memcmp(magic, MAGIC, sizeof(MAGIC)) ||
+            !file.read((char*)&namelen, sizeof(namelen)))
+        throw std::runtime_error("ProductTrace::read() Not a trace: " + path);
+    namelen = le32toh(namelen);
+    if (namelen > 4096)
+        throw std::runtime_error("ProductTrace::read() Invalid trace: " +
+                                 path);
+    name.resize(namelen);
+    uint64_t count;
+    if (!file.read(&name[0], namelen) ||
+            !file.read((char*)&count, sizeof(count)))
+        throw std::runtime_error("ProductTrace::read() Invalid trace: " +
+                                 path);
+    count = le64toh(count);
+
+    events.clear();
+    for (uint64_t i = 0; i < count; i++) {
+        char rec[EVENT_LEN];
+        if (!file.read(rec, sizeof(rec)))
+            throw std::runtime_error("ProductTrace::read() Truncated trace: " +
+                                     path);
+        TraceEvent event;
+        (void)memcpy(&event.ns, rec, 8);
+        (void)memcpy(&event.prodindex, rec + 8, 4);
+        (void)memcpy(&event.arg, rec + 12, 4);
+        (void)memcpy(&event.type, rec + 16, 2);
+        (void)memcpy(&event.thread, rec + 18, 2);
+        (void)memcpy(&event.tid, rec + 20, 4);
+        event.ns        = le64toh(event.ns);
+        event.prodindex = le32toh(event.prodindex);
+        event.arg       = le32toh(event.arg);
+        event.type      = le16toh(event.type);
+        event.thread    = le16toh(event.thread);
+        event.tid       = le32toh(event.tid);
+        events.push_back(event);
+    }
+}
+
+
+const char* ProductTrace::eventName(const unsigned type)
+{
+    static const char* const names[NUM_TRACE_EVENTS] = {
+        "SUBMITTED", "BOP_SENT", "BOP_RECVD", "FIRST_BLOCK", "LAST_BLOCK",
+        "FIRST_GAP", "RETX_REQ", "RETX_DATA", "EOP_SENT", "EOP_RECVD", "ACK",
+        "TIMEOUT", "REJECT"};
+    return type < NUM_TRACE_EVENTS ? names[type] : "UNKNOWN";
+}
+
+
+/* returns the name of the argument of an event type or NULL if it has none */
+static const char* argName(const unsigned type)
+{
+    switch (type) {
+    case TRACE_SUBMITTED:
+    case TRACE_BOP_SENT:
+    case TRACE_BOP_RECVD:
+        return "size";
+    case TRACE_FIRST_BLOCK:
+    case TRACE_LAST_BLOCK:
+    case TRACE_FIRST_GAP:
+    case TRACE_RETX_REQ:
+    case TRACE_RETX_DATA:
+        return "seqnum";
+    case TRACE_ACK:
+    case TRACE_REJECT:
+        return "arg";
+    default:
+        return NULL;
+    }
+}
+
+
+/* writes the time of an event in microseconds, as the format wants */
+static void writeTs(std::ostream& out, const uint64_t ns, const uint64_t base)
+{
+    const uint64_t rel = ns > base ? ns - base : 0;
+    out << "\"ts\": " << rel / 1000 << '.' << std::setw(3)
+        << std::setfill('0') << rel % 1000 << std::setfill(' ');
+}
+
+
+void ProductTrace::writeChromeEvents(std::ostream& out,
+                                     const std::string& name, const int pid,
+                                     const std::vector<TraceEvent>& events,
+                                     const uint64_t base, const bool first)
+{
+    const char* sep = first ? "\n" : ",\n";
+
+    out << sep << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+        << pid << ", \"args\": {\"name\": \"";
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == '"' || name[i] == '\\')
+            out << '\\';
+        if ((unsigned char)name[i] >= ' ')
+            out << name[i];
+    }
+    out << "\"}}";
+    sep = ",\n";
+
+    /* first and last event of every product */
+    std::map<uint32_t, std::pair<size_t, size_t> > products;
+    std::map<uint32_t, uint16_t>                   threads;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceEvent& event = events[i];
+        threads[event.tid] = event.thread;
+        std::map<uint32_t, std::pair<size_t, size_t> >::iterator it =
+                products.find(event.prodindex);
+        if (it == products.end())
+            products[event.prodindex] = std::make_pair(i, i);
+        else
+            it->second.second = i;
+
+        out << sep << "{\"name\": \"" << eventName(event.type)
+            << "\", \"cat\": \"fmtp\", \"ph\": \"i\", \"s\": \"t\", ";
+        writeTs(out, event.ns, base);
+        out << ", \"pid\": " << pid << ", \"tid\": " << event.tid
+            << ", \"args\": {\"product\": " << event.prodindex;
+        const char* const arg = argName(event.type);
+        if (arg)
+            out << ", \"" << arg << "\": " << event.arg;
+        out << "}}";
+    }
+
+    for (std::map<uint32_t, uint16_t>::const_iterator it = threads.begin();
+         it != threads.end(); ++it)
+        out << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": "
+            << pid << ", \"tid\": " << it->first << ", \"args\": {\"name\": "
+            "\"thread " << it->second << "\"}}";
+
+    for (std::map<uint32_t, std::pair<size_t, size_t> >::const_iterator it =
+             products.begin(); it != products.end(); ++it) {
+        const TraceEvent& begin = events[it->second.first];
+        const TraceEvent& end   = events[it->second.second];
+        out << sep << "{\"name\": \"product " << it->first << "\", \"cat\": "
+            "\"product\", \"ph\": \"b\", \"id2\": {\"local\": " << it->first
+            << "}, ";
+        writeTs(out, begin.ns, base);
+        out << ", \"pid\": " << pid << ", \"tid\": " << begin.tid << "}";
+        out << sep << "{\"name\": \"product " << it->first << "\", \"cat\": "
+            "\"product\", \"ph\": \"e\", \"id2\": {\"local\": " << it->first
+            << "}, ";
+        writeTs(out, end.ns, base);
+        out << ", \"pid\": " << pid << ", \"tid\": " << end.tid << "}";
+    }
+}
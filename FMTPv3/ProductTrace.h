@@ -0,0 +1,183 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: ProductTrace.h
+ *
+ * This file defines a trace of the lifecycle events of products, recorded by
+ * fmtpSendv3 and fmtpRecvv3 into rings of fixed size, one per thread, for
+ * finding out after the fact why a product completed late.
+ */
+
+#ifndef FMTP_PRODUCTTRACE_H_
+#define FMTP_PRODUCTTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/** events of the lifecycle of a product */
+enum TraceEventType {
+    TRACE_SUBMITTED = 0,  /*!< given to sendProduct(); arg: size */
+    TRACE_BOP_SENT,       /*!< BOP multicast; arg: size */
+    TRACE_BOP_RECVD,      /*!< BOP received; arg: size */
+    TRACE_FIRST_BLOCK,    /*!< first multicast block received; arg: seqnum */
+    TRACE_LAST_BLOCK,     /*!< multicast block at the end of the product
+                               received; arg: seqnum */
+    TRACE_FIRST_GAP,      /*!< first missing data detected; arg: seqnum of
+                               the gap */
+    TRACE_RETX_REQ,       /*!< retransmission requested; arg: seqnum, 0 for
+                               the BOP or EOP */
+    TRACE_RETX_DATA,      /*!< block retransmitted; arg: seqnum */
+    TRACE_EOP_SENT,       /*!< EOP multicast */
+    TRACE_EOP_RECVD,      /*!< EOP received */
+    TRACE_ACK,            /*!< RETX_END received; arg: socket of the
+                               receiver. Or RETX_END sent; arg: number of
+                               products */
+    TRACE_TIMEOUT,        /*!< retransmission or receiver timer expired */
+    TRACE_REJECT,         /*!< RETX_REJ sent; arg: socket of the receiver.
+                               Or RETX_REJ received */
+    NUM_TRACE_EVENTS
+};
+
+/** an event of a trace */
+struct TraceEvent
+{
+    uint64_t ns;         /*!< wall clock time in ns since the Unix epoch */
+    uint32_t prodindex;
+    uint32_t arg;        /*!< meaning depends on the type */
+    uint16_t type;       /*!< a TraceEventType */
+    uint16_t thread;     /*!< index of the recording thread in the trace */
+    uint32_t tid;        /*!< kernel id of the recording thread */
+};
+
+
+/**
+ * Per-thread rings of the last events of products. Recording an event takes
+ * no lock and no locked instruction: a thread only writes its own ring, and
+ * when the ring is full its oldest events are overwritten. A snapshot may be
+ * taken at any time by any thread; it has every event that wasn't
+ * overwritten, without events that were being overwritten while it was
+ * taken. Traces are written to files in a compact binary format, which the
+ * FmtpTraceDump tool converts to the Chrome trace format that Perfetto reads.
+ */
+class ProductTrace
+{
+public:
+    /**
+     * Constructs.
+     *
+     * @param[in] name      Name of the trace, e.g. "sender", shown as the
+     *                      process name in the converted trace.
+     * @param[in] capacity  Number of events per thread, rounded up to a power
+     *                      of 2.
+     * @throw std::invalid_argument  if `capacity` is 0.
+     */
+    explicit ProductTrace(const std::string& name, size_t capacity = 8192);
+    ~ProductTrace();
+
+    /**
+     * Records an event. Called by any thread; a thread's first call takes a
+     * lock to get its ring, later calls don't.
+     *
+     * @param[in] type       Type of the event.
+     * @param[in] prodindex  Index of the product.
+     * @param[in] arg        Argument, see TraceEventType.
+     */
+    void                    record(const TraceEventType type,
+                                   const uint32_t prodindex,
+                                   const uint32_t arg = 0);
+    /** returns the name of the trace */
+    const std::string&      getName() const {return name;}
+    /**
+     * Returns the events of all threads in chronological order.
+     *
+     * @return  The events.
+     */
+    std::vector<TraceEvent> snapshot() const;
+    /**
+     * Writes a snapshot to a file in the binary trace format.
+     *
+     * @param[in] path  Pathname of the file.
+     * @throw std::runtime_error  if the file can't be written.
+     */
+    void                    write(const std::string& path) const;
+
+    /**
+     * Reads a file written by `write()`.
+     *
+     * @param[in]  path    Pathname of the file.
+     * @param[out] name    Name of the trace.
+     * @param[out] events  Events of the trace.
+     * @throw std::runtime_error  if the file can't be read or isn't a trace.
+     */
+    static void        read(const std::string& path, std::string& name,
+                            std::vector<TraceEvent>& events);
+    /**
+     * Writes the events of a trace as the elements of the "traceEvents"
+     * array of the Chrome trace format: a thread name per recording thread,
+     * an instant event per event and an asynchronous slice per product, from
+     * its first to its last event.
+     *
+     * @param[in] out     Stream to write to.
+     * @param[in] name    Name of the trace, used as the process name.
+     * @param[in] pid     Process id of the trace in the converted trace.
+     * @param[in] events  Events of the trace.
+     * @param[in] base    Time in ns since the Unix epoch that timestamps are
+     *                    relative to.
+     * @param[in] first   Whether no element has been written yet, so that no
+     *                    comma is written before the first one.
+     */
+    static void        writeChromeEvents(std::ostream& out,
+                                         const std::string& name,
+                                         const int pid,
+                                         const std::vector<TraceEvent>& events,
+                                         const uint64_t base,
+                                         const bool first);
+    /**
+     * Returns the name of an event type.
+     *
+     * @param[in] type  The type.
+     * @return          The name, e.g. "RETX_REQ", or "UNKNOWN".
+     */
+    static const char* eventName(const unsigned type);
+
+private:
+    /* a ring of one thread */
+    struct Ring;
+
+    ProductTrace(const ProductTrace&);
+    ProductTrace& operator=(const ProductTrace&);
+
+    /* the calling thread's ring */
+    Ring* local()
+    {
+        struct Cache {
+            uint64_t owner;
+            Ring*    ring;
+        };
+        /* the ring of the trace this thread used last */
+        static thread_local Cache cache = {0, NULL};
+        if (cache.owner != id) {
+            cache.ring  = lookup();
+            cache.owner = id;
+        }
+        return cache.ring;
+    }
+    Ring* lookup();
+
+    const std::string  name;
+    const size_t       capacity;
+    const uint64_t     id;        /*!< unique among all traces */
+    mutable std::mutex mutex;
+    std::vector<Ring*> rings;
+};
+
+
+#endif /* FMTP_PRODUCTTRACE_H_ */
@@ -26,6 +26,7 @@
 
 
 #include <time.h>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 
@@ -38,6 +39,8 @@ public:
     ~RateShaper();
     /* sets the expected rate in bits/sec */
     void SetRate(uint64_t rate_bps);
+    /* gets the expected rate in bits/sec */
+    uint64_t GetRate() const {return rate;}
     /* calculate the time period based on the rate */
     void CalcPeriod(uint64_t size);
     /* sleep for an amount of time based the calculated value */
@@ -46,8 +49,11 @@ public:
 private:
     double period;
     double sleeptime;
-    /* uint32_t only supports up to 4Gbps, should use uint64_t */
-    uint64_t rate;
+    /*
+     * uint32_t only supports up to 4Gbps, should use uint64_t. Atomic since
+     * a rate controller may change it while packets are being sent.
+     */
+    std::atomic<uint64_t> rate;
     /* transmission packet size */
     uint64_t txsize;
     /* transmission start time */
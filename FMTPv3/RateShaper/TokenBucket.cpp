@@ -0,0 +1,103 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: TokenBucket.cpp
+ *
+ * This file implements the token bucket.
+ */
+
+
+#include "TokenBucket.h"
+
+#include <algorithm>
+
+
+/**
+ * Constructs a full bucket.
+ *
+ * @param[in] shaper  The rate shaper whose rate the bucket refills at. Must
+ *                    outlive the bucket.
+ * @param[in] burst   Most bytes that may be sent back to back after an idle
+ *                    period.
+ */
+TokenBucket::TokenBucket(const RateShaper& shaper, uint64_t burst)
+    :
+    shaper(shaper),
+    burst(static_cast<double>(burst)),
+    mtx(),
+    tokens(static_cast<double>(burst)),
+    last(Clock::now())
+{
+}
+
+
+/**
+ * Destructor of TokenBucket.
+ */
+TokenBucket::~TokenBucket()
+{
+}
+
+
+/**
+ * Returns when the next packet may be sent: now if the bucket isn't in debt,
+ * otherwise once the debt has been paid off at the current rate.
+ *
+ * @param[in] now  The current time.
+ * @return         When the next packet may be sent, `now` if it may already.
+ */
+TokenBucket::Clock::time_point TokenBucket::ReadyTime(Clock::time_point now)
+{
+    const uint64_t rate = shaper.GetRate();
+    if (rate == 0) {
+        return now;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    Refill(now, rate);
+    if (tokens >= 0) {
+        return now;
+    }
+    const std::chrono::duration<double> wait(-tokens * 8 / rate);
+    /* rounded up so that the debt is paid off by then */
+    return now + std::chrono::duration_cast<Clock::duration>(wait) +
+        Clock::duration(1);
+}
+
+
+/**
+ * Takes the tokens of a packet that was sent, which can put the bucket into
+ * debt.
+ *
+ * @param[in] size  Size of the packet in bytes.
+ */
+void TokenBucket::Take(uint64_t size)
+{
+    const uint64_t rate = shaper.GetRate();
+    if (rate == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    Refill(Clock::now(), rate);
+    tokens -= static_cast<double>(size);
+}
+
+
+/**
+ * Adds the tokens earned at a rate since the last refill, up to the burst.
+ *
+ * @pre             `mtx` is locked.
+ * @param[in] now   The current time.
+ * @param[in] rate  The rate in bits/sec.
+ */
+void TokenBucket::Refill(Clock::time_point now, uint64_t rate)
+{
+    if (now > last) {
+        const std::chrono::duration<double> elapsed = now - last;
+        tokens = std::min(burst, tokens + elapsed.count() * rate / 8);
+        last   = now;
+    }
+}
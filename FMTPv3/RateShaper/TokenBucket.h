@@ -0,0 +1,57 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: TokenBucket.h
+ *
+ * This file defines a token bucket, which paces the packets of a sender
+ * without blocking the thread that sends them.
+ */
+
+#ifndef FMTP_FMTPV3_TOKENBUCKET_H_
+#define FMTP_FMTPV3_TOKENBUCKET_H_
+
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "RateShaper.h"
+
+
+/**
+ * Paces packets at the rate of a rate shaper. Instead of sleeping after a
+ * packet, a sender asks the bucket when its next packet may go, so one thread
+ * can interleave the packets of several senders. A packet may be sent once
+ * the bucket isn't in debt; sending it takes its size from the bucket, which
+ * refills at the shaper's current rate up to a burst. Thread-safe.
+ */
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    TokenBucket(const RateShaper& shaper, uint64_t burst);
+    ~TokenBucket();
+    /* returns when the next packet may be sent, `now` if it may already */
+    Clock::time_point ReadyTime(Clock::time_point now);
+    /* takes the tokens of a packet of `size` bytes that was sent */
+    void Take(uint64_t size);
+
+private:
+    /* adds the tokens earned since the last refill */
+    void Refill(Clock::time_point now, uint64_t rate);
+
+    /* provides the rate in bits/sec, no pacing if 0 */
+    const RateShaper& shaper;
+    /* most tokens the bucket holds, in bytes */
+    const double burst;
+    std::mutex mtx;
+    /* tokens in bytes, negative while the last packet isn't paid off */
+    double tokens;
+    /* time of the last refill */
+    Clock::time_point last;
+};
+
+
+#endif /* FMTP_FMTPV3_TOKENBUCKET_H_ */
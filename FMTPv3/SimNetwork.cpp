@@ -0,0 +1,547 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: SimNetwork.cpp
+ *
+ * This file implements the simulated network.
+ */
+
+#include "SimNetwork.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+
+/* receive buffer of an ingress socket, which absorbs the sender's bursts */
+static const int INGRESS_RCVBUF = 8 * 1024 * 1024;
+
+
+/**
+ * Constructs a network and starts its thread.
+ *
+ * @param[in] seed  Seed of the links' faults; link i uses seed + i.
+ * @throw std::runtime_error  if the network can't be started.
+ */
+SimNetwork::SimNetwork(const uint32_t seed)
+    :
+    seed(seed),
+    epfd(epoll_create1(EPOLL_CLOEXEC)),
+    wakefd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    timerfd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    egress(socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)),
+    thread(),
+    simmtx(),
+    defaultLink(),
+    linkConfigs(),
+    links(),
+    groups(),
+    ingresses(),
+    deliveries(),
+    queued(0)
+{
+    if (epfd < 0 || wakefd < 0 || timerfd < 0 || egress < 0) {
+        closeAll();
+        throw std::runtime_error("SimNetwork::SimNetwork() couldn't create "
+                "descriptors");
+    }
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = wakefd;
+    (void)epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &event);
+    event.data.fd = timerfd;
+    (void)epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &event);
+
+    int retval = pthread_create(&thread, NULL, &SimNetwork::runWrapper, this);
+    if (retval) {
+        closeAll();
+        throw std::runtime_error("SimNetwork::SimNetwork() pthread_create() "
+                "error with retval = " + std::to_string(retval));
+    }
+}
+
+
+/**
+ * Stops the network and closes its descriptors. Datagrams still on their way
+ * are lost.
+ */
+SimNetwork::~SimNetwork()
+{
+    const uint64_t one = 1;
+    (void)write(wakefd, &one, sizeof(one));
+    (void)pthread_join(thread, NULL);
+    closeAll();
+    for (size_t i = 0; i < links.size(); i++)
+        delete links[i];
+}
+
+
+/**
+ * Closes the descriptors of the network, including the ingress sockets.
+ */
+void SimNetwork::closeAll()
+{
+    const int fds[] = {epfd, wakefd, timerfd, egress};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0)
+            (void)close(fds[i]);
+    }
+    for (std::map<int, std::string>::iterator it = ingresses.begin();
+            it != ingresses.end(); ++it)
+        (void)close(it->first);
+    ingresses.clear();
+}
+
+
+/**
+ * Sets the configuration of the links of receivers that don't have one set
+ * by `SetLink()`. Applies to links created afterwards.
+ *
+ * @param[in] link  The configuration.
+ * @throw std::invalid_argument  if the fault specification is invalid.
+ */
+void SimNetwork::SetDefaultLink(const SimLink& link)
+{
+    FaultInjector check;
+    check.Configure(link.faults);
+    std::unique_lock<std::mutex> lock(simmtx);
+    defaultLink = link;
+}
+
+
+/**
+ * Sets the configuration of the link of a receiver. Applies if called before
+ * the receiver opens its multicast socket.
+ *
+ * @param[in] receiver  Number of the receiver, starting at 0.
+ * @param[in] link      The configuration.
+ * @throw std::invalid_argument  if the fault specification is invalid.
+ */
+void SimNetwork::SetLink(const unsigned receiver, const SimLink& link)
+{
+    FaultInjector check;
+    check.Configure(link.faults);
+    std::unique_lock<std::mutex> lock(simmtx);
+    linkConfigs[receiver] = link;
+}
+
+
+/**
+ * Returns the number of receivers that have opened a multicast socket.
+ *
+ * @return  The number of receivers.
+ */
+unsigned SimNetwork::receiverCount()
+{
+    std::unique_lock<std::mutex> lock(simmtx);
+    return links.size();
+}
+
+
+/**
+ * Returns the counters of the link of a receiver.
+ *
+ * @param[in] receiver  Number of the receiver.
+ * @return              The counters.
+ * @throw std::out_of_range  if there's no such receiver.
+ */
+SimLinkStats SimNetwork::getLinkStats(const unsigned receiver)
+{
+    std::unique_lock<std::mutex> lock(simmtx);
+    if (receiver >= links.size()) {
+        throw std::out_of_range("SimNetwork::getLinkStats() no receiver " +
+                std::to_string(receiver));
+    }
+    return links[receiver]->stats;
+}
+
+
+/**
+ * Returns the group of an address, creating its ingress socket if need be.
+ * The caller must hold `simmtx`.
+ *
+ * @param[in] group  Address of the group.
+ * @param[in] port   Port number of the group.
+ * @return           The group.
+ * @throw std::runtime_error  if the ingress socket can't be created.
+ */
+SimNetwork::Group& SimNetwork::getGroup(const std::string&   group,
+                                        const unsigned short port)
+{
+    const std::string key = group + ":" + std::to_string(port);
+    std::map<std::string, Group>::iterator it = groups.find(key);
+    if (it != groups.end())
+        return it->second;
+
+    const int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                            0);
+    if (sock < 0) {
+        throw std::runtime_error("SimNetwork::getGroup() Couldn't create "
+                "UDP socket");
+    }
+    Group entry;
+    entry.ingress              = sock;
+    entry.addr                 = sockaddr_in();
+    entry.addr.sin_family      = AF_INET;
+    entry.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(entry.addr);
+    (void)setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &INGRESS_RCVBUF,
+                     sizeof(INGRESS_RCVBUF));
+    /* datagrams enter the links when they arrived, not when they're read */
+    const int timestamp = 1;
+    (void)setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp,
+                     sizeof(timestamp));
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = sock;
+    if (::bind(sock, (struct sockaddr*)&entry.addr, sizeof(entry.addr)) ||
+            getsockname(sock, (struct sockaddr*)&entry.addr, &len) ||
+            epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event)) {
+        (void)close(sock);
+        throw std::runtime_error("SimNetwork::getGroup() Couldn't set up "
+                "ingress socket of " + key);
+    }
+    ingresses[sock] = key;
+    return groups[key] = entry;
+}
+
+
+/**
+ * Returns a datagram socket connected to the network's entry for a group.
+ * The time to live and the interface don't apply.
+ *
+ * @param[in] group   Address of the group.
+ * @param[in] port    Port number of the group.
+ * @param[in] ttl     Ignored.
+ * @param[in] ifAddr  Ignored.
+ * @return            The socket.
+ * @throw std::runtime_error  if the socket can't be opened.
+ */
+int SimNetwork::openMcastSend(const std::string&   group,
+                              const unsigned short port,
+                              const unsigned char  /*ttl*/,
+                              const std::string&   /*ifAddr*/)
+{
+    struct sockaddr_in addr;
+    {
+        std::unique_lock<std::mutex> lock(simmtx);
+        addr = getGroup(group, port).addr;
+    }
+    const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        throw std::runtime_error("SimNetwork::openMcastSend() Couldn't "
+                "create UDP socket");
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+        (void)close(sock);
+        throw std::runtime_error("SimNetwork::openMcastSend() Couldn't "
+                "connect UDP socket to the network");
+    }
+    return sock;
+}
+
+
+/**
+ * Returns a datagram socket that receives a group over a new link. The
+ * interface doesn't apply.
+ *
+ * @param[in] group   Address of the group.
+ * @param[in] port    Port number of the group.
+ * @param[in] ifAddr  Ignored.
+ * @return            The socket.
+ * @throw std::runtime_error  if the socket can't be opened.
+ */
+int SimNetwork::openMcastRecv(const std::string&   group,
+                              const unsigned short port,
+                              const std::string&   /*ifAddr*/)
+{
+    const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        throw std::runtime_error("SimNetwork::openMcastRecv() creating "
+                "socket failed");
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+            getsockname(sock, (struct sockaddr*)&addr, &len)) {
+        (void)close(sock);
+        throw std::runtime_error("SimNetwork::openMcastRecv() couldn't bind "
+                "socket");
+    }
+
+    std::unique_lock<std::mutex> lock(simmtx);
+    try {
+        Group&         entry = getGroup(group, port);
+        const unsigned index = links.size();
+        Link* const    link = new Link(seed + index);
+        std::map<unsigned, SimLink>::const_iterator config =
+            linkConfigs.find(index);
+        link->config = config == linkConfigs.end() ? defaultLink :
+                                                     config->second;
+        link->faults.Configure(link->config.faults);
+        link->addr = addr;
+        links.push_back(link);
+        entry.links.push_back(index);
+    }
+    catch (const std::exception& e) {
+        (void)close(sock);
+        throw;
+    }
+    return sock;
+}
+
+
+/**
+ * Opens a TCP socket that listens on an address of the host.
+ *
+ * @param[in] addr     Address to listen on.
+ * @param[in] backlog  Length of the queue of pending connections.
+ * @return             The socket.
+ * @throw std::system_error  if the socket can't be opened.
+ */
+int SimNetwork::openListen(const struct sockaddr_in& addr, const int backlog)
+{
+    return Transport::sockets().openListen(addr, backlog);
+}
+
+
+/**
+ * Opens a TCP socket that is connected to an address of the host.
+ *
+ * @param[in] addr  Address of the sender.
+ * @return          The socket.
+ * @throw std::system_error  if the socket can't be connected.
+ */
+int SimNetwork::openConnect(const struct sockaddr_in& addr)
+{
+    return Transport::sockets().openConnect(addr);
+}
+
+
+/**
+ * Passes a datagram to the links of its group, each of which may drop,
+ * duplicate or hold it back. The caller must hold `simmtx`.
+ *
+ * @param[in] group    The group.
+ * @param[in] data     The datagram.
+ * @param[in] arrival  When the datagram entered the network.
+ */
+void SimNetwork::route(const Group& group, const Datagram& data,
+                       const Clock::time_point arrival)
+{
+    FmtpHeader header = {};
+    const bool hasHeader = data->size() >= FMTP_HEADER_LEN;
+    if (hasHeader) {
+        const unsigned char* wire = (const unsigned char*)data->data();
+        uint32_t word;
+        uint16_t half;
+        (void)memcpy(&word, wire, sizeof(word));
+        header.prodindex  = ntohl(word);
+        (void)memcpy(&word, wire + 4, sizeof(word));
+        header.seqnum     = ntohl(word);
+        (void)memcpy(&half, wire + 8, sizeof(half));
+        header.payloadlen = ntohs(half);
+        (void)memcpy(&half, wire + 10, sizeof(half));
+        header.flags      = ntohs(half);
+    }
+
+    for (size_t i = 0; i < group.links.size(); i++) {
+        const unsigned index = group.links[i];
+        Link&          link = *links[index];
+        const FaultAction action = hasHeader ? link.faults.decide(header) :
+                                               FAULT_PASS;
+        if (action == FAULT_DROP) {
+            link.stats.lost++;
+            continue;
+        }
+        if (action == FAULT_DELAY) {
+            link.held.push_back(std::make_pair(link.faults.reorderDepth(),
+                                               data));
+            continue;
+        }
+        enqueue(index, data, arrival);
+        if (action == FAULT_DUPLICATE)
+            enqueue(index, data, arrival);
+    }
+}
+
+
+/**
+ * Queues a datagram on a link behind the datagrams queued before it, and
+ * releases the reordered datagrams it was the last to pass. The caller must
+ * hold `simmtx`.
+ *
+ * @param[in] index    Index of the link.
+ * @param[in] data     The datagram.
+ * @param[in] arrival  When the datagram entered the network.
+ */
+void SimNetwork::enqueue(const unsigned index, const Datagram& data,
+                         const Clock::time_point arrival)
+{
+    Link&             link = *links[index];
+    Clock::time_point due = arrival;
+
+    if (link.config.bandwidth) {
+        const Clock::time_point start = std::max(arrival, link.busyUntil);
+        const double backlog = std::chrono::duration<double>(start - arrival).
+            count() * link.config.bandwidth / 8;
+        if (link.config.queue && backlog + data->size() > link.config.queue) {
+            link.stats.overflowed++;
+            return;
+        }
+        link.busyUntil = start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(
+                    data->size() * 8.0 / link.config.bandwidth));
+        due = link.busyUntil;
+    }
+    due += std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(link.config.delay));
+
+    Delivery delivery;
+    delivery.due   = due;
+    delivery.order = queued++;
+    delivery.link  = index;
+    delivery.data  = data;
+    deliveries.push(delivery);
+
+    for (size_t i = 0; i < link.held.size(); i++)
+        link.held[i].first--;
+    while (!link.held.empty() && link.held.front().first == 0) {
+        const Datagram released = link.held.front().second;
+        link.held.pop_front();
+        enqueue(index, released, arrival);
+    }
+}
+
+
+/**
+ * Sends the datagrams that are due to their receivers and arms the timer for
+ * the next one.
+ */
+void SimNetwork::deliver()
+{
+    std::unique_lock<std::mutex> lock(simmtx);
+    const Clock::time_point now = Clock::now();
+
+    while (!deliveries.empty() && deliveries.top().due <= now) {
+        const Delivery& delivery = deliveries.top();
+        Link&           link = *links[delivery.link];
+        if (sendto(egress, delivery.data->data(), delivery.data->size(), 0,
+                   (struct sockaddr*)&link.addr, sizeof(link.addr)) >= 0)
+            link.stats.delivered++;
+        deliveries.pop();
+    }
+
+    struct itimerspec when = {};
+    if (!deliveries.empty()) {
+        /* steady_clock is CLOCK_MONOTONIC */
+        const std::chrono::nanoseconds due =
+            deliveries.top().due.time_since_epoch();
+        when.it_value.tv_sec  = due.count() / 1000000000;
+        when.it_value.tv_nsec = due.count() % 1000000000;
+    }
+    (void)timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+
+/**
+ * Returns when a datagram arrived on an ingress socket, from its kernel
+ * timestamp if it has one.
+ *
+ * @param[in] msg  The message the datagram was received with.
+ * @return         The time of arrival on the steady clock.
+ */
+SimNetwork::Clock::time_point SimNetwork::arrival(const struct msghdr& msg)
+{
+    const Clock::time_point now = Clock::now();
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec stamp;
+            struct timespec realtime;
+            (void)memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            (void)clock_gettime(CLOCK_REALTIME, &realtime);
+            /* the timestamp is on the real-time clock */
+            const std::chrono::nanoseconds age(
+                    (realtime.tv_sec - stamp.tv_sec) * 1000000000LL +
+                    realtime.tv_nsec - stamp.tv_nsec);
+            return age > std::chrono::nanoseconds::zero() ? now - age : now;
+        }
+    }
+    return now;
+}
+
+
+/**
+ * Network thread. Routes the datagrams arriving on the ingress sockets and
+ * delivers them when they are due, until the destructor wakes it.
+ */
+void SimNetwork::run()
+{
+    struct epoll_event events[16];
+    char               buf[65536];
+    char               control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec       iov = {buf, sizeof(buf)};
+    struct msghdr      msg = {};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+
+    for (;;) {
+        const int nevents = epoll_wait(epfd, events,
+                sizeof(events) / sizeof(events[0]), -1);
+        if (nevents < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        for (int i = 0; i < nevents; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == wakefd)
+                return;
+            if (fd == timerfd) {
+                uint64_t expirations;
+                (void)read(timerfd, &expirations, sizeof(expirations));
+                continue;
+            }
+            ssize_t nbytes;
+            msg.msg_control    = control;
+            msg.msg_controllen = sizeof(control);
+            while ((nbytes = recvmsg(fd, &msg, 0)) >= 0) {
+                const Datagram data(new std::string(buf, nbytes));
+                std::unique_lock<std::mutex> lock(simmtx);
+                std::map<int, std::string>::const_iterator key =
+                    ingresses.find(fd);
+                if (key != ingresses.end())
+                    route(groups[key->second], data, arrival(msg));
+                msg.msg_controllen = sizeof(control);
+            }
+        }
+        deliver();
+    }
+}
+
+
+/**
+ * A wrapper to call the actual SimNetwork::run().
+ *
+ * @param[in] *ptr  A pointer to the SimNetwork object.
+ */
+void* SimNetwork::runWrapper(void* ptr)
+{
+    static_cast<SimNetwork*>(ptr)->run();
+    return NULL;
+}
@@ -0,0 +1,232 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: SimNetwork.h
+ *
+ * This file defines a simulated network: a transport whose multicast reaches
+ * every receiver over a link of its own with a given bandwidth, delay and
+ * loss, so that many receivers can be studied in one process.
+ */
+
+#ifndef FMTP_SIMNETWORK_H_
+#define FMTP_SIMNETWORK_H_
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "FaultInjector.h"
+#include "Transport.h"
+
+
+/** the configuration of a link from the simulated network to a receiver */
+struct SimLink
+{
+    uint64_t    bandwidth; /*!< bits per second, 0 for unlimited */
+    double      delay;     /*!< propagation delay in seconds */
+    /* bytes waiting to be sent on the link beyond which packets are dropped,
+     * 0 for unlimited */
+    size_t      queue;
+    /* loss, duplication and reordering on the link as a FaultInjector
+     * specification; a reordered packet is held back until `depth` later
+     * packets have been queued on the link */
+    std::string faults;
+
+    SimLink() : bandwidth(0), delay(0), queue(0), faults() {}
+};
+
+
+/** counters of a link, see SimNetwork::getLinkStats() */
+struct SimLinkStats
+{
+    uint64_t delivered;  /*!< packets delivered to the receiver's socket */
+    uint64_t lost;       /*!< packets dropped by the link's faults */
+    uint64_t overflowed; /*!< packets dropped because the queue was full */
+
+    SimLinkStats() : delivered(0), lost(0), overflowed(0) {}
+};
+
+
+/**
+ * A transport that simulates the multicast network. A sender's multicast
+ * socket sends to the network, which copies every datagram to the receivers
+ * of the group. Each receiver gets its datagrams over a link of its own,
+ * whose bandwidth delays a datagram by its serialization time behind the
+ * datagrams queued before it, whose delay adds a fixed latency and whose
+ * faults drop, duplicate or delay datagrams. Links are numbered in the order
+ * the receivers open their multicast sockets.
+ *
+ * The network runs in a thread of its own, in real time, and delivers to the
+ * receivers through loopback UDP sockets, so the receivers' sockets, buffers
+ * and kernel drop counters behave as usual. The unicast channel isn't
+ * simulated: senders and receivers connect over loopback TCP.
+ */
+class SimNetwork : public Transport
+{
+public:
+    /**
+     * Constructs a network and starts its thread.
+     *
+     * @param[in] seed  Seed of the links' faults; link i uses seed + i.
+     * @throw std::runtime_error  if the network can't be started.
+     */
+    explicit SimNetwork(const uint32_t seed = 1);
+    /** stops the network; sockets opened by the network remain open */
+    ~SimNetwork();
+
+    /**
+     * Sets the configuration of the links of receivers that don't have one
+     * set by `SetLink()`. Applies to links created afterwards.
+     *
+     * @param[in] link  The configuration.
+     * @throw std::invalid_argument  if the fault specification is invalid.
+     */
+    void         SetDefaultLink(const SimLink& link);
+    /**
+     * Sets the configuration of the link of a receiver. Applies if called
+     * before the receiver opens its multicast socket.
+     *
+     * @param[in] receiver  Number of the receiver, starting at 0.
+     * @param[in] link      The configuration.
+     * @throw std::invalid_argument  if the fault specification is invalid.
+     */
+    void         SetLink(const unsigned receiver, const SimLink& link);
+    /**
+     * Returns the number of receivers that have opened a multicast socket.
+     *
+     * @return  The number of receivers.
+     */
+    unsigned     receiverCount();
+    /**
+     * Returns the counters of the link of a receiver.
+     *
+     * @param[in] receiver  Number of the receiver.
+     * @return              The counters.
+     * @throw std::out_of_range  if there's no such receiver.
+     */
+    SimLinkStats getLinkStats(const unsigned receiver);
+
+    int openMcastSend(const std::string& group, const unsigned short port,
+                      const unsigned char ttl, const std::string& ifAddr);
+    int openMcastRecv(const std::string& group, const unsigned short port,
+                      const std::string& ifAddr);
+    int openListen(const struct sockaddr_in& addr, const int backlog);
+    int openConnect(const struct sockaddr_in& addr);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::shared_ptr<const std::string> Datagram;
+
+    /** a link and its state */
+    struct Link
+    {
+        SimLink            config;
+        FaultInjector      faults;
+        struct sockaddr_in addr;      /*!< address of the receiver's socket */
+        /* when the link has sent the datagrams queued on it */
+        Clock::time_point  busyUntil;
+        /* reordered datagrams and the number of datagrams still to pass them */
+        std::deque<std::pair<unsigned, Datagram> > held;
+        SimLinkStats       stats;
+
+        explicit Link(const uint32_t seed) : faults(seed) {}
+    };
+
+    /** a multicast group: where its datagrams enter and who receives them */
+    struct Group
+    {
+        int                   ingress;
+        struct sockaddr_in    addr;   /*!< address of the ingress socket */
+        std::vector<unsigned> links;
+    };
+
+    /** a datagram on its way to a receiver */
+    struct Delivery
+    {
+        Clock::time_point due;
+        uint64_t          order;  /*!< keeps deliveries that are due together
+                                       in the order they were queued */
+        unsigned          link;
+        Datagram          data;
+
+        bool operator<(const Delivery& that) const {
+            return due != that.due ? due > that.due : order > that.order;
+        }
+    };
+
+    /**
+     * Returns the group of an address, creating its ingress socket if need be.
+     *
+     * @param[in] group  Address of the group.
+     * @param[in] port   Port number of the group.
+     * @return           The group.
+     * @throw std::runtime_error  if the ingress socket can't be created.
+     */
+    Group&       getGroup(const std::string& group, const unsigned short port);
+    /**
+     * Passes a datagram to the links of its group.
+     *
+     * @param[in] group    The group.
+     * @param[in] data     The datagram.
+     * @param[in] arrival  When the datagram entered the network.
+     */
+    void         route(const Group& group, const Datagram& data,
+                       const Clock::time_point arrival);
+    /**
+     * Queues a datagram on a link behind the datagrams queued before it.
+     *
+     * @param[in] index    Index of the link.
+     * @param[in] data     The datagram.
+     * @param[in] arrival  When the datagram entered the network.
+     */
+    void         enqueue(const unsigned index, const Datagram& data,
+                         const Clock::time_point arrival);
+    /**
+     * Returns when a datagram arrived on an ingress socket.
+     *
+     * @param[in] msg  The message the datagram was received with.
+     * @return         The time of arrival.
+     */
+    static Clock::time_point arrival(const struct msghdr& msg);
+    /** delivers the due datagrams and arms the timer for the next one */
+    void         deliver();
+    /** closes the network's descriptors */
+    void         closeAll();
+    /** network thread */
+    void         run();
+    /** a wrapper to call the actual SimNetwork::run() */
+    static void* runWrapper(void* ptr);
+    /* Prevent copying because it's meaningless */
+    SimNetwork(SimNetwork&);
+    SimNetwork& operator=(const SimNetwork&);
+
+    const uint32_t                       seed;
+    int                                  epfd;
+    int                                  wakefd;   /*!< eventfd to stop */
+    int                                  timerfd;  /*!< next delivery */
+    int                                  egress;   /*!< sends to receivers */
+    pthread_t                            thread;
+    /* protects everything below */
+    std::mutex                           simmtx;
+    SimLink                              defaultLink;
+    std::map<unsigned, SimLink>          linkConfigs;
+    std::vector<Link*>                   links;
+    std::map<std::string, Group>         groups;
+    /* ingress socket to the key of its group */
+    std::map<int, std::string>           ingresses;
+    std::priority_queue<Delivery>        deliveries;
+    uint64_t                             queued;
+};
+
+#endif /* FMTP_SIMNETWORK_H_ */
@@ -0,0 +1,186 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: ThreadPlacement.cpp
+ *
+ * This file implements the thread placement of a FMTP sender or receiver.
+ */
+
+#include "ThreadPlacement.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+
+
+ThreadPlacement::ThreadPlacement()
+{
+}
+
+
+ThreadPlacement::~ThreadPlacement()
+{
+}
+
+
+/**
+ * Checks a role.
+ *
+ * @param[in] role  The role.
+ * @throw std::invalid_argument  if the role is invalid.
+ */
+void ThreadPlacement::checkRole(ThreadRole role)
+{
+    if (role < 0 || role >= NUM_ROLES) {
+        throw std::invalid_argument("ThreadPlacement::checkRole() invalid "
+                "role " + std::to_string(role));
+    }
+}
+
+
+/**
+ * Restricts the threads of a role to a set of CPUs. An empty set lets them
+ * run on every CPU the process may run on.
+ *
+ * @param[in] role  The role.
+ * @param[in] cpus  The CPUs.
+ * @throw std::invalid_argument  if the role is invalid or a CPU is negative
+ *                               or not below CPU_SETSIZE.
+ */
+void ThreadPlacement::SetCpus(ThreadRole role, const std::vector<int>& cpus)
+{
+    checkRole(role);
+    for (std::vector<int>::const_iterator it = cpus.begin(); it != cpus.end();
+         ++it) {
+        if (*it < 0 || *it >= CPU_SETSIZE) {
+            throw std::invalid_argument("ThreadPlacement::SetCpus() invalid "
+                    "CPU " + std::to_string(*it));
+        }
+    }
+    roles[role].cpus = cpus;
+}
+
+
+/**
+ * Has the threads of a role allocate memory from a NUMA node: the buffers a
+ * thread allocates and first touches, packet buffers in particular, then come
+ * from that node if it has free memory.
+ *
+ * @param[in] role  The role.
+ * @param[in] node  The NUMA node or -1 for the default policy.
+ * @throw std::invalid_argument  if the role is invalid or the node is less
+ *                               than -1 or too large for a node mask.
+ */
+void ThreadPlacement::SetNumaNode(ThreadRole role, int node)
+{
+    checkRole(role);
+    if (node < -1 || node >= (int)(8 * sizeof(unsigned long)) - 1) {
+        throw std::invalid_argument("ThreadPlacement::SetNumaNode() invalid "
+                "node " + std::to_string(node));
+    }
+    roles[role].node = node;
+}
+
+
+/**
+ * Sets the scheduling class of the threads of a role. The real-time classes
+ * usually require the CAP_SYS_NICE capability or an RLIMIT_RTPRIO limit.
+ *
+ * @param[in] role      The role.
+ * @param[in] policy    SCHED_FIFO, SCHED_RR or SCHED_OTHER.
+ * @param[in] priority  The real-time priority, ignored for SCHED_OTHER.
+ * @throw std::invalid_argument  if the role or the policy is invalid or the
+ *                               priority is out of the policy's range.
+ */
+void ThreadPlacement::SetSched(ThreadRole role, int policy, int priority)
+{
+    checkRole(role);
+    if (policy != SCHED_FIFO && policy != SCHED_RR && policy != SCHED_OTHER) {
+        throw std::invalid_argument("ThreadPlacement::SetSched() invalid "
+                "policy " + std::to_string(policy));
+    }
+    if (policy == SCHED_OTHER) {
+        priority = 0;
+    }
+    else if (priority < sched_get_priority_min(policy) ||
+            priority > sched_get_priority_max(policy)) {
+        throw std::invalid_argument("ThreadPlacement::SetSched() invalid "
+                "priority " + std::to_string(priority));
+    }
+    roles[role].policy   = policy;
+    roles[role].priority = priority;
+}
+
+
+/**
+ * Returns the placement of a role.
+ *
+ * @param[in] role  The role.
+ * @return          The placement.
+ * @throw std::invalid_argument  if the role is invalid.
+ */
+const RolePlacement& ThreadPlacement::get(ThreadRole role) const
+{
+    checkRole(role);
+    return roles[role];
+}
+
+
+/**
+ * Applies the placement of a role to the calling thread. Does nothing for
+ * what isn't configured.
+ *
+ * @param[in] role  The role.
+ * @throw std::invalid_argument  if the role is invalid.
+ * @throw std::runtime_error     if the thread couldn't be restricted to its
+ *                               CPUs, bound to its NUMA node or given its
+ *                               scheduling class.
+ */
+void ThreadPlacement::apply(ThreadRole role) const
+{
+    const RolePlacement& place = get(role);
+
+    if (!place.cpus.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (std::vector<int>::const_iterator it = place.cpus.begin();
+             it != place.cpus.end(); ++it)
+            CPU_SET(*it, &cpus);
+        const int status = pthread_setaffinity_np(pthread_self(),
+                                                  sizeof(cpus), &cpus);
+        if (status) {
+            throw std::runtime_error("ThreadPlacement::apply() "
+                    "pthread_setaffinity_np() failed with status = " +
+                    std::to_string(status));
+        }
+    }
+
+    if (place.node >= 0) {
+        /* preferred rather than bound, so that a full node isn't fatal */
+        const unsigned long nodemask = 1ul << place.node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask,
+                    8 * sizeof(nodemask)) < 0) {
+            throw std::runtime_error("ThreadPlacement::apply() "
+                    "set_mempolicy() failed for node " +
+                    std::to_string(place.node));
+        }
+    }
+
+    if (place.policy >= 0) {
+        struct sched_param param = {};
+        param.sched_priority = place.priority;
+        const int status = pthread_setschedparam(pthread_self(),
+                                                 place.policy, &param);
+        if (status) {
+            throw std::runtime_error("ThreadPlacement::apply() "
+                    "pthread_setschedparam() failed with status = " +
+                    std::to_string(status));
+        }
+    }
+}
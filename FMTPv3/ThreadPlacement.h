@@ -0,0 +1,116 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: ThreadPlacement.h
+ *
+ * This file defines where and how the threads of a FMTP sender or receiver
+ * run: the CPUs they may run on, the NUMA node their buffers are allocated
+ * from and their scheduling class, configured per thread role.
+ */
+
+#ifndef FMTP_THREADPLACEMENT_H_
+#define FMTP_THREADPLACEMENT_H_
+
+#include <vector>
+
+
+/** roles of the FMTP threads, see ThreadPlacement */
+enum ThreadRole {
+    /* receiver multicast thread; the sender multicasts from the thread that
+     * calls sendProduct(), which the application can place itself */
+    ROLE_MCAST = 0,
+    /* sender per-receiver retransmission threads, receiver retransmission
+     * reception thread */
+    ROLE_RETX,
+    /* receiver retransmission-request thread */
+    ROLE_RETXREQ,
+    /* sender and receiver timer threads */
+    ROLE_TIMER,
+    /* sender thread accepting receivers */
+    ROLE_COORD,
+    /* aggregation, rate-control, slow-receiver and statistics threads */
+    ROLE_CONTROL,
+    NUM_ROLES
+};
+
+
+/**
+ * Placement of the threads of one role.
+ */
+struct RolePlacement
+{
+    std::vector<int> cpus;     /*!< CPUs the threads may run on, all if empty */
+    int              node;     /*!< NUMA node of their allocations or -1 */
+    int              policy;   /*!< SCHED_FIFO, SCHED_RR or SCHED_OTHER */
+    int              priority; /*!< real-time priority, 0 for SCHED_OTHER */
+
+    RolePlacement() : cpus(), node(-1), policy(-1), priority(0) {}
+};
+
+
+/**
+ * Thread placement of a FMTP sender or receiver. A role left alone keeps the
+ * attributes the thread inherits from the process.
+ */
+class ThreadPlacement
+{
+public:
+    ThreadPlacement();
+    ~ThreadPlacement();
+
+    /**
+     * Restricts the threads of a role to a set of CPUs.
+     *
+     * @param[in] role  The role.
+     * @param[in] cpus  The CPUs.
+     * @throw std::invalid_argument  if the role or a CPU is invalid.
+     */
+    void SetCpus(ThreadRole role, const std::vector<int>& cpus);
+    /**
+     * Has the threads of a role allocate memory from a NUMA node.
+     *
+     * @param[in] role  The role.
+     * @param[in] node  The NUMA node or -1 for the default policy.
+     * @throw std::invalid_argument  if the role or the node is invalid.
+     */
+    void SetNumaNode(ThreadRole role, int node);
+    /**
+     * Sets the scheduling class of the threads of a role.
+     *
+     * @param[in] role      The role.
+     * @param[in] policy    SCHED_FIFO, SCHED_RR or SCHED_OTHER.
+     * @param[in] priority  The real-time priority, ignored for SCHED_OTHER.
+     * @throw std::invalid_argument  if an argument is invalid.
+     */
+    void SetSched(ThreadRole role, int policy, int priority = 1);
+    /**
+     * Returns the placement of a role.
+     *
+     * @param[in] role  The role.
+     * @return          The placement.
+     * @throw std::invalid_argument  if the role is invalid.
+     */
+    const RolePlacement& get(ThreadRole role) const;
+    /**
+     * Applies the placement of a role to the calling thread.
+     *
+     * @param[in] role  The role.
+     * @throw std::runtime_error  if the placement couldn't be applied.
+     */
+    void apply(ThreadRole role) const;
+
+private:
+    /**
+     * Checks a role.
+     *
+     * @param[in] role  The role.
+     * @throw std::invalid_argument  if the role is invalid.
+     */
+    static void checkRole(ThreadRole role);
+
+    RolePlacement roles[NUM_ROLES];
+};
+
+#endif /* FMTP_THREADPLACEMENT_H_ */
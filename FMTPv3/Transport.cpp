@@ -0,0 +1,232 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: Transport.cpp
+ *
+ * This file implements the transport over the host's sockets.
+ */
+
+#include "Transport.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <system_error>
+
+
+/**
+ * Returns the transport over the host's sockets.
+ *
+ * @return  The transport.
+ */
+Transport& Transport::sockets()
+{
+    static SocketTransport transport;
+    return transport;
+}
+
+
+/**
+ * Opens a UDP socket that multicasts to a group. The socket is connected to
+ * the group, which spares the kernel a route lookup per datagram.
+ *
+ * @param[in] group   Address of the group.
+ * @param[in] port    Port number of the group.
+ * @param[in] ttl     Time to live of the datagrams.
+ * @param[in] ifAddr  Address of the interface to multicast on.
+ * @return            The socket.
+ * @throw std::runtime_error  if the socket can't be created, configured or
+ *                            connected.
+ */
+int SocketTransport::openMcastSend(const std::string&   group,
+                                   const unsigned short port,
+                                   const unsigned char  ttl,
+                                   const std::string&   ifAddr)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        throw std::runtime_error(
+                "SocketTransport::openMcastSend() Couldn't create UDP socket");
+    }
+
+    try {
+        int reuseaddr = true;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
+                       sizeof(reuseaddr)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastSend() "
+                    "Couldn't enable Address reuse");
+        }
+
+#ifdef SO_REUSEPORT
+        int reuseport = true;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuseport,
+                       sizeof(reuseport)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastSend() "
+                    "Couldn't enable Port reuse");
+        }
+#endif
+
+        int newttl = ttl;
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &newttl,
+                       sizeof(newttl)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastSend() "
+                    "Couldn't set UDP socket time-to-live option to " +
+                    std::to_string(ttl));
+        }
+
+        struct in_addr interfaceIP;
+        interfaceIP.s_addr = inet_addr(ifAddr.c_str());
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interfaceIP,
+                       sizeof(interfaceIP)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastSend() "
+                    "Couldn't set UDP socket default interface");
+        }
+
+        struct sockaddr_in groupAddr = {};
+        groupAddr.sin_family      = AF_INET;
+        groupAddr.sin_addr.s_addr = inet_addr(group.c_str());
+        groupAddr.sin_port        = htons(port);
+        if (connect(sock, (struct sockaddr*)&groupAddr,
+                    sizeof(groupAddr)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastSend() "
+                    "Couldn't connect UDP socket to " + group + ":" +
+                    std::to_string(port));
+        }
+    }
+    catch (const std::exception& e) {
+        close(sock);
+        throw;
+    }
+    return sock;
+}
+
+
+/**
+ * Opens a UDP socket that is bound to a multicast group and has joined it on
+ * an interface. Several sockets of the host can receive the same group.
+ *
+ * @param[in] group   Address of the group.
+ * @param[in] port    Port number of the group.
+ * @param[in] ifAddr  Address of the interface to receive on.
+ * @return            The socket.
+ * @throw std::runtime_error  if the socket couldn't be created.
+ * @throw std::runtime_error  if the socket couldn't be bound.
+ * @throw std::runtime_error  if the socket couldn't join the multicast group.
+ */
+int SocketTransport::openMcastRecv(const std::string&   group,
+                                   const unsigned short port,
+                                   const std::string&   ifAddr)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        throw std::runtime_error("SocketTransport::openMcastRecv() creating "
+                "socket failed");
+    }
+
+    try {
+        /* lets several receivers of the same group run on one host */
+        const int reuseaddr = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
+                       sizeof(reuseaddr)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastRecv() "
+                    "setsockopt() SO_REUSEADDR failed.");
+        }
+        struct sockaddr_in groupAddr = {};
+        groupAddr.sin_family      = AF_INET;
+        groupAddr.sin_port        = htons(port);
+        groupAddr.sin_addr.s_addr = inet_addr(group.c_str());
+        if (::bind(sock, (struct sockaddr*)&groupAddr, sizeof(groupAddr)) <
+                0) {
+            throw std::runtime_error("SocketTransport::openMcastRecv() "
+                    "couldn't bind socket to multicast group " + group + ":" +
+                    std::to_string(port));
+        }
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(group.c_str());
+        mreq.imr_interface.s_addr = inet_addr(ifAddr.c_str());
+        if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                       sizeof(mreq)) < 0) {
+            throw std::runtime_error("SocketTransport::openMcastRecv() "
+                    "setsockopt() add membership failed.");
+        }
+    }
+    catch (const std::exception& e) {
+        close(sock);
+        throw;
+    }
+    return sock;
+}
+
+
+/**
+ * Opens a TCP socket that listens on an address.
+ *
+ * @param[in] addr     Address to listen on.
+ * @param[in] backlog  Length of the queue of pending connections.
+ * @return             The socket.
+ * @throw std::system_error  if the socket can't be created or bound.
+ */
+int SocketTransport::openListen(const struct sockaddr_in& addr,
+                                const int backlog)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        throw std::system_error(errno, std::system_category(),
+                "SocketTransport::openListen() error creating socket");
+    }
+    if (::bind(sock, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        const int error = errno;
+        close(sock);
+        throw std::system_error(error, std::system_category(),
+                std::string("SocketTransport::openListen(): Couldn't bind ") +
+                inet_ntoa(addr.sin_addr) + ":" +
+                std::to_string(ntohs(addr.sin_port)));
+    }
+    /* listen() returns right away, it's non-blocking */
+    listen(sock, backlog);
+    return sock;
+}
+
+
+/**
+ * Opens a TCP socket that is connected to an address. Blocks until the
+ * connection is established or a severe error occurs. The interval between
+ * two trials is 30 seconds.
+ *
+ * @param[in] addr  Address to connect to.
+ * @return          The socket.
+ * @throw std::system_error  if the socket is not created.
+ * @throw std::system_error  if connect() returns errors.
+ */
+int SocketTransport::openConnect(const struct sockaddr_in& addr)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        throw std::system_error(errno, std::system_category(),
+                "SocketTransport::openConnect() error creating socket");
+    }
+
+    while (connect(sock, (const struct sockaddr*)&addr, sizeof(addr))) {
+        if (errno == ECONNREFUSED || errno == ETIMEDOUT ||
+                errno == ECONNRESET || errno == EHOSTUNREACH) {
+            if (sleep(30)) {
+                close(sock);
+                throw std::system_error(EINTR, std::system_category(),
+                        "SocketTransport::openConnect() sleep() interrupted");
+            }
+        }
+        else {
+            const int error = errno;
+            close(sock);
+            throw std::system_error(error, std::system_category(),
+                    std::string("SocketTransport::openConnect() Error "
+                    "connecting to ") + inet_ntoa(addr.sin_addr) + ":" +
+                    std::to_string(ntohs(addr.sin_port)));
+        }
+    }
+    return sock;
+}
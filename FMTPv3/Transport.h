@@ -0,0 +1,102 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: Transport.h
+ *
+ * This file defines the transport of a FMTP sender or receiver: where the
+ * sockets of its multicast and unicast channels come from.
+ */
+
+#ifndef FMTP_TRANSPORT_H_
+#define FMTP_TRANSPORT_H_
+
+#include <netinet/in.h>
+#include <string>
+
+
+/**
+ * Opens the sockets of the multicast and unicast channels. Whatever opens
+ * them, the sockets are used with the usual socket calls: the multicast
+ * sockets are datagram sockets and the unicast sockets are TCP sockets.
+ */
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    /**
+     * Opens a datagram socket that is connected to a multicast group, so that
+     * everything sent on it is multicast to the group.
+     *
+     * @param[in] group   Address of the group.
+     * @param[in] port    Port number of the group.
+     * @param[in] ttl     Time to live of the datagrams.
+     * @param[in] ifAddr  Address of the interface to multicast on.
+     * @return            The socket.
+     * @throw std::runtime_error  if the socket can't be opened.
+     */
+    virtual int openMcastSend(const std::string&   group,
+                              const unsigned short port,
+                              const unsigned char  ttl,
+                              const std::string&   ifAddr) = 0;
+    /**
+     * Opens a datagram socket on which the datagrams multicast to a group
+     * arrive.
+     *
+     * @param[in] group   Address of the group.
+     * @param[in] port    Port number of the group.
+     * @param[in] ifAddr  Address of the interface to receive on.
+     * @return            The socket.
+     * @throw std::runtime_error  if the socket can't be opened.
+     */
+    virtual int openMcastRecv(const std::string&   group,
+                              const unsigned short port,
+                              const std::string&   ifAddr) = 0;
+    /**
+     * Opens a TCP socket that listens for receivers.
+     *
+     * @param[in] addr     Address to listen on; a port of 0 lets the system
+     *                     choose one.
+     * @param[in] backlog  Length of the queue of pending connections.
+     * @return             The socket.
+     * @throw std::system_error  if the socket can't be opened.
+     */
+    virtual int openListen(const struct sockaddr_in& addr,
+                           const int backlog) = 0;
+    /**
+     * Opens a TCP socket that is connected to a sender. Retries while the
+     * sender can't be reached.
+     *
+     * @param[in] addr  Address of the sender.
+     * @return          The socket.
+     * @throw std::system_error  if the socket can't be connected.
+     */
+    virtual int openConnect(const struct sockaddr_in& addr) = 0;
+
+    /**
+     * Returns the transport over the host's sockets, which FMTP senders and
+     * receivers use unless they are given another one.
+     *
+     * @return  The transport.
+     */
+    static Transport& sockets();
+};
+
+
+/**
+ * Transport over the host's UDP multicast and TCP sockets.
+ */
+class SocketTransport : public Transport
+{
+public:
+    int openMcastSend(const std::string& group, const unsigned short port,
+                      const unsigned char ttl, const std::string& ifAddr);
+    int openMcastRecv(const std::string& group, const unsigned short port,
+                      const std::string& ifAddr);
+    int openListen(const struct sockaddr_in& addr, const int backlog);
+    int openConnect(const struct sockaddr_in& addr);
+};
+
+#endif /* FMTP_TRANSPORT_H_ */
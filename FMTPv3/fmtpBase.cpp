@@ -29,6 +29,8 @@
 
 #include "fmtpBase.h"
 
+#include <time.h>
+
 
 fmtpBase::fmtpBase()
 {
@@ -37,3 +39,38 @@ fmtpBase::fmtpBase()
 fmtpBase::~fmtpBase()
 {
 }
+
+
+/**
+ * Computes the digest of a product's metadata that is carried by
+ * self-describing data packets (32-bit FNV-1a).
+ *
+ * @param[in] metadata  The metadata.
+ * @param[in] metasize  Size of the metadata in bytes.
+ * @return              The digest.
+ */
+uint32_t metaDigest(const void* metadata, const size_t metasize)
+{
+    const unsigned char* bytes  = (const unsigned char*)metadata;
+    uint32_t             digest = 2166136261u;
+
+    for (size_t i = 0; i < metasize; ++i) {
+        digest ^= bytes[i];
+        digest *= 16777619u;
+    }
+    return digest;
+}
+
+
+/**
+ * Returns the time of the system clock, which the timestamps of FMTP packets
+ * are taken from.
+ *
+ * @return  Nanoseconds since the Unix epoch.
+ */
+uint64_t wallClockNs()
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
@@ -71,6 +71,12 @@ const int MAX_FMTP_PACKET_LEN = MTU - 20 - 20; /* exclude IP and TCP header */
 const int FMTP_DATA_LEN       = MAX_FMTP_PACKET_LEN - FMTP_HEADER_LEN;
 /* sizeof(uint32_t) for BOPMsg.prodsize, sizeof(uint16_t) for BOPMsg.metasize */
 const int AVAIL_BOP_LEN       = FMTP_DATA_LEN - sizeof(uint32_t) - sizeof(uint16_t);
+/**
+ * Largest metadata a product can carry. Metadata longer than AVAIL_BOP_LEN is
+ * multicast as a BOP followed by BOP continuation packets, and a RETX_BOP
+ * carries all of it, so its payload length must fit into a uint16_t.
+ */
+const int MAX_BOP_META_LEN    = 0xFFFF - (FMTP_DATA_LEN - AVAIL_BOP_LEN);
 
 
 /**
@@ -96,6 +102,99 @@ const uint16_t FMTP_BOP_REQ   = 0x0080;
 const uint16_t FMTP_RETX_BOP  = 0x0100;
 const uint16_t FMTP_EOP_REQ   = 0x0200;
 const uint16_t FMTP_RETX_EOP  = 0x0400;
+const uint16_t FMTP_AGGR_DATA = 0x0800;
+/**
+ * A self-describing data packet (FMTP_MEM_DATA_EXT) is a data packet whose
+ * header is followed by a DataExt. Its payloadlen includes the DataExt, so
+ * the amount of data it carries is payloadlen - DATA_EXT_LEN. A receiver can
+ * store the data of such packets before the product's BOP has arrived.
+ */
+const uint16_t FMTP_MEM_DATA_EXT = 0x2000;
+/**
+ * A BOP continuation (FMTP_BOP_CONT) carries the part of the metadata that
+ * didn't fit into the BOP. Its seqnum is the offset of the carried part within
+ * the metadata, and its payload is that part.
+ */
+const uint16_t FMTP_BOP_CONT  = 0x1000;
+/**
+ * A receiver statistics report (FMTP_RECV_STATS) is sent by a receiver to the
+ * sender over the TCP connection at a set interval. Its prodindex is the
+ * sequence number of the report and its payload is a RecvStatsMsg.
+ */
+const uint16_t FMTP_RECV_STATS = 0x4000;
+/**
+ * A multicast BOP, EOP or data packet whose flags also have FMTP_TIMESTAMPED
+ * set ends with the time the sender sent it (for a BOP, the time the product
+ * was given to sendProduct()), in nanoseconds since the Unix epoch as a
+ * uint64_t in network byte order. Its payloadlen includes the timestamp.
+ * Receivers that predate timestamps discard such packets as unknown.
+ */
+const uint16_t FMTP_TIMESTAMPED = 0x8000;
+const int      TIMESTAMP_LEN    = sizeof(uint64_t);
+
+
+/**
+ * An aggregate envelope (FMTP_AGGR_DATA) carries several small products in a
+ * single multicast datagram. The header's prodindex is the index of the first
+ * product, the seqnum is the number of products packed in the envelope, and
+ * the payload is a sequence of entries, one per product with consecutive
+ * product indices. Every entry is laid out on the wire as
+ *
+ *     prodsize (uint32_t) | metasize (uint16_t) | metadata | data
+ *
+ * A RETX_END whose seqnum is greater than 1 acknowledges that many consecutive
+ * products starting at its prodindex. The products of such a run come from a
+ * single envelope, so there are at most AGGR_MAX_ENTRIES of them.
+ */
+const int AGGR_ENTRY_HEADER_LEN = sizeof(uint32_t) + sizeof(uint16_t);
+const int AGGR_MAX_ENTRIES      = FMTP_DATA_LEN / AGGR_ENTRY_HEADER_LEN;
+
+
+/**
+ * struct of the extension of a self-describing data packet. The datagram it
+ * is part of still fits into a 1500-byte MTU since a UDP/IP header is smaller
+ * than the TCP/IP header that MAX_FMTP_PACKET_LEN accounts for.
+ */
+typedef struct FmtpDataExtension {
+    uint32_t   prodsize;     /*!< size of the product */
+    uint32_t   metadigest;   /*!< metaDigest() of the metadata, 0 if unused */
+} DataExt;
+const int DATA_EXT_LEN = sizeof(DataExt);
+
+/**
+ * Computes the digest of a product's metadata that is carried by
+ * self-describing data packets (32-bit FNV-1a).
+ *
+ * @param[in] metadata  The metadata.
+ * @param[in] metasize  Size of the metadata in bytes.
+ * @return              The digest.
+ */
+uint32_t metaDigest(const void* metadata, const size_t metasize);
+
+/**
+ * Returns the time of the system clock, which the timestamps of FMTP packets
+ * are taken from.
+ *
+ * @return  Nanoseconds since the Unix epoch.
+ */
+uint64_t wallClockNs();
+
+
+/**
+ * struct of a receiver statistics report. Counters are cumulative since the
+ * receiver started and every field is in network byte order on the wire.
+ */
+typedef struct FmtpRecvStatsMessage {
+    uint64_t   mcastpkts;    /*!< multicast packets received */
+    uint64_t   kerneldrops;  /*!< datagrams dropped by the kernel (SO_RXQ_OVFL) */
+    uint64_t   recovered;    /*!< data blocks recovered through retransmission */
+    uint64_t   retxreqs;     /*!< retransmission requests sent */
+    uint32_t   retxqueue;    /*!< requests waiting to be sent */
+    uint32_t   inflight;     /*!< products being received */
+    uint32_t   missingbops;  /*!< BOPs requested but not yet received */
+    uint32_t   rtt;          /*!< smoothed TCP round-trip time in microseconds */
+} RecvStatsMsg;
+const int RECV_STATS_LEN = sizeof(RecvStatsMsg);
 
 
 /** For communication between mcast thread and retx thread */
@@ -103,6 +202,7 @@ const int MISSING_BOP  = 1;
 const int MISSING_DATA = 2;
 const int MISSING_EOP  = 3;
 const int SHUTDOWN     = 4;
+const int SEND_STATS   = 5;
 typedef struct recvInternalRetxReqMessage {
     int reqtype;
     uint32_t prodindex;
@@ -32,6 +32,7 @@
 
 #include <errno.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -50,11 +51,23 @@
  *                              byte-order.
  */
 TcpRecv::TcpRecv(const std::string& tcpaddr, unsigned short tcpport)
-    : tcpAddr(tcpaddr), tcpPort(tcpport), servAddr()
+    : servAddr(), tcpAddr(tcpaddr), tcpPort(tcpport),
+      transport(&Transport::sockets())
 {
 }
 
 
+/**
+ * Sets the transport that opens the connection.
+ *
+ * @param[in] transport  The transport.
+ */
+void TcpRecv::SetTransport(Transport& transport)
+{
+    this->transport = &transport;
+}
+
+
 /**
  * Establishes a TCP connection to the sender.
  *
@@ -85,6 +98,23 @@ void TcpRecv::Init()
 }
 
 
+/**
+ * Returns the kernel's smoothed round-trip time of the TCP connection, which
+ * is sampled from the acknowledgements of the messages sent to the sender.
+ *
+ * @return  The round-trip time in microseconds or 0 if it's unknown.
+ */
+uint32_t TcpRecv::getRTT()
+{
+    struct tcp_info info;
+    socklen_t       len = sizeof(info);
+
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return 0;
+    return info.tcpi_rtt;
+}
+
+
 /**
  * Receives a header and a payload on the TCP connection. Blocks until a
  * complete packet is received, the end-of-file is encountered, or an error
@@ -142,33 +172,13 @@ ssize_t TcpRecv::sendData(void* header, size_t headLen, char* payload,
 
 
 /**
- * Initializes the TCP connection. Blocks until the connection is established
- * or a severe error occurs. The interval between two trials is 30 seconds.
+ * Initializes the TCP connection through the transport. Blocks until the
+ * connection is established or a severe error occurs.
  *
  * @throws std::system_error  if the socket is not created.
  * @throws std::system_error  if connect() returns errors.
  */
 void TcpRecv::initSocket()
 {
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-
-    if (sockfd < 0)
-        throw std::system_error(errno, std::system_category(),
-                "TcpRecv::TcpRecv() error creating socket");
-
-    while (connect(sockfd, (struct sockaddr*)&servAddr, sizeof(servAddr))) {
-        if (errno == ECONNREFUSED || errno == ETIMEDOUT ||
-                errno == ECONNRESET || errno == EHOSTUNREACH) {
-            if (sleep(30)) {
-                close(sockfd);
-                throw std::system_error(EINTR, std::system_category(),
-                    "TcpRecv:TcpRecv() sleep() interrupted");
-            }
-        }
-        else {
-            close(sockfd);
-            throw std::system_error(errno, std::system_category(),
-                    "TcpRecv:TcpRecv() Error connecting to " + servAddr);
-        }
-    }
+    sockfd = transport->openConnect(servAddr);
 }
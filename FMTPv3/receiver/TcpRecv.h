@@ -33,8 +33,10 @@
 
 
 #include "TcpBase.h"
+#include "Transport.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <stdint.h>
 #include <mutex>
 #include <string>
 #include <sys/types.h>
@@ -45,6 +47,25 @@ class TcpRecv: public TcpBase
 public:
     TcpRecv(const std::string& tcpaddr, unsigned short tcpport);
     void Init();  /*!< the start point which upper layer should call */
+    /**
+     * Sets the transport that opens the connection. Must be called before
+     * `Init()`.
+     *
+     * @param[in] transport  The transport.
+     */
+    void SetTransport(Transport& transport);
+    /**
+     * Returns the kernel's smoothed round-trip time of the TCP connection.
+     *
+     * @return  The round-trip time in microseconds or 0 if it's unknown.
+     */
+    uint32_t getRTT();
+    /**
+     * Returns the socket of the TCP connection.
+     *
+     * @return  The socket.
+     */
+    int getSock() const {return sockfd;}
     /**
      * Receives a header and a payload on the TCP connection. Blocks until the
      * packet is received or a severe error occurs. Re-establishes the TCP
@@ -86,6 +107,7 @@ private:
     struct sockaddr_in      servAddr;
     std::string             tcpAddr;  /* a copy of the passed-in tcpAddr */
     unsigned short          tcpPort;  /* a copy of the passed-in tcpPort */
+    Transport*              transport;
 };
 
 
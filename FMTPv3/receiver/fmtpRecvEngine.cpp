@@ -0,0 +1,712 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpRecvEngine.cpp
+ *
+ * This file implements the multi-feed receiver engine.
+ */
+
+#include "fmtpRecvEngine.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+/**
+ * Constructs an engine. No thread runs until `Start()` is called.
+ *
+ * @param[in] reactors  Number of I/O threads.
+ * @throw std::invalid_argument  if the number is 0.
+ * @throw std::runtime_error     if an epoll instance can't be created.
+ */
+fmtpRecvEngine::fmtpRecvEngine(const unsigned reactors)
+    :
+    reactors(),
+    placement(),
+    feedmtx(),
+    feeds(),
+    running(false),
+    stopping(false),
+    timermtx(),
+    timer_cv(),
+    timers(),
+    timer_t(),
+    exitmtx(),
+    except()
+{
+    if (reactors == 0) {
+        throw std::invalid_argument("fmtpRecvEngine::fmtpRecvEngine() no "
+                "I/O thread");
+    }
+    for (unsigned i = 0; i < reactors; i++) {
+        Reactor* const reactor = new Reactor();
+        reactor->engine = this;
+        reactor->epfd   = epoll_create1(EPOLL_CLOEXEC);
+        reactor->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        this->reactors.push_back(reactor);
+        if (reactor->epfd < 0 || reactor->wakefd < 0) {
+            closeAll();
+            throw std::runtime_error("fmtpRecvEngine::fmtpRecvEngine() "
+                    "couldn't create epoll instance");
+        }
+        struct epoll_event event = {};
+        event.events  = EPOLLIN;
+        event.data.fd = reactor->wakefd;
+        (void)epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakefd,
+                        &event);
+    }
+}
+
+
+/**
+ * Destroys the engine. Stops it first if it is running; failures are then
+ * ignored.
+ */
+fmtpRecvEngine::~fmtpRecvEngine()
+{
+    bool isRunning;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        isRunning = running;
+    }
+    if (isRunning) {
+        try {
+            Stop();
+        }
+        catch (...) {
+        }
+    }
+    closeAll();
+}
+
+
+/**
+ * Releases the thread states and closes the epoll instances.
+ */
+void fmtpRecvEngine::closeAll()
+{
+    for (size_t i = 0; i < reactors.size(); i++) {
+        if (reactors[i]->epfd >= 0)
+            (void)close(reactors[i]->epfd);
+        if (reactors[i]->wakefd >= 0)
+            (void)close(reactors[i]->wakefd);
+        delete reactors[i];
+    }
+    reactors.clear();
+}
+
+
+/**
+ * Adds a configured receiver as a feed. The receiver must not have been
+ * started and must outlive the engine's `Stop()`. If the engine is running,
+ * the feed is started immediately; otherwise it is started by `Start()`.
+ * Starting a feed blocks until its sender accepts the connection. The feed's
+ * own `Start()` must not be called, and its `Stop()` only to stop receiving
+ * it before the engine stops.
+ *
+ * @param[in] feed  The receiver.
+ * @throw std::invalid_argument  if the feed is NULL or was already added.
+ * @throw std::runtime_error     if the feed can't be started.
+ */
+void fmtpRecvEngine::addFeed(fmtpRecvv3* const feed)
+{
+    bool isRunning;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        if (feed == NULL || feeds.count(feed)) {
+            throw std::invalid_argument("fmtpRecvEngine::addFeed() invalid "
+                    "or duplicate feed");
+        }
+        RecvEngineFeed& entry = feeds[feed];
+        entry.reactor = (feeds.size() - 1) % reactors.size();
+        entry.active  = false;
+        isRunning     = running;
+    }
+
+    if (isRunning) {
+        try {
+            attachFeed(feed);
+        }
+        catch (...) {
+            std::unique_lock<std::mutex> lock(feedmtx);
+            feeds.erase(feed);
+            throw;
+        }
+    }
+}
+
+
+/**
+ * Starts a feed and has the engine's threads serve it. The sender is
+ * connected to without holding a lock, so that the other feeds continue to be
+ * served meanwhile.
+ *
+ * @param[in] feed  The feed.
+ * @throw std::runtime_error  if the feed can't be started.
+ */
+void fmtpRecvEngine::attachFeed(fmtpRecvv3* const feed)
+{
+    try {
+        feed->startHosted(this);
+    }
+    catch (...) {
+        feed->engine = NULL;
+        throw;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(timermtx);
+        RecvEngineTimers& entry = timers[feed];
+        entry.statsinterval = feed->statsinterval;
+        entry.statsdue      = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(entry.statsinterval));
+        timer_cv.notify_one();
+    }
+
+    Reactor* reactor;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        RecvEngineFeed& entry = feeds[feed];
+        entry.active = true;
+        reactor = reactors[entry.reactor];
+    }
+    Conn mcast = {feed, true, std::shared_ptr<std::vector<char> >()};
+    watch(reactor, feed->mcastSock, mcast);
+    Conn retx  = {feed, false, std::make_shared<std::vector<char> >()};
+    watch(reactor, feed->tcprecv->getSock(), retx);
+}
+
+
+/**
+ * Stops serving a feed: its sockets are no longer waited for and its timers
+ * are dropped. Called by the feed when it stops, possibly on one of the
+ * engine's threads.
+ *
+ * @param[in] feed  The feed.
+ */
+void fmtpRecvEngine::detachFeed(fmtpRecvv3* const feed)
+{
+    Reactor* reactor;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        std::map<fmtpRecvv3*, RecvEngineFeed>::iterator it = feeds.find(feed);
+        if (it == feeds.end() || !it->second.active)
+            return;
+        it->second.active = false;
+        reactor = reactors[it->second.reactor];
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(reactor->mtx);
+        std::map<int, Conn>::iterator it = reactor->conns.begin();
+        while (it != reactor->conns.end()) {
+            if (it->second.feed == feed) {
+                (void)epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, it->first,
+                                NULL);
+                reactor->conns.erase(it++);
+            }
+            else {
+                ++it;
+            }
+        }
+        reactor->posted.erase(std::remove(reactor->posted.begin(),
+                                          reactor->posted.end(), feed),
+                              reactor->posted.end());
+    }
+
+    std::unique_lock<std::mutex> lock(timermtx);
+    timers.erase(feed);
+}
+
+
+/**
+ * Returns whether the engine serves a feed.
+ *
+ * @param[in] feed  The feed.
+ * @return          Whether the feed is served.
+ */
+bool fmtpRecvEngine::isActive(fmtpRecvv3* const feed)
+{
+    std::unique_lock<std::mutex> lock(feedmtx);
+    std::map<fmtpRecvv3*, RecvEngineFeed>::const_iterator it =
+        feeds.find(feed);
+    return it != feeds.end() && it->second.active;
+}
+
+
+/**
+ * Sets where and how the engine's threads run: the I/O threads have the
+ * multicast role and the timer thread the timer role. Must be called before
+ * `Start()`.
+ *
+ * @param[in] placement  The thread placement.
+ */
+void fmtpRecvEngine::SetThreadPlacement(const ThreadPlacement& placement)
+{
+    this->placement = placement;
+}
+
+
+/**
+ * Starts the engine's threads and the feeds added so far. Unlike
+ * `fmtpRecvv3::Start()`, returns once they are running. If a thread can't be
+ * created, the ones created before it are stopped again and the engine isn't
+ * running.
+ *
+ * @throw std::runtime_error  if the engine is already running or a thread or
+ *                            feed can't be started.
+ */
+void fmtpRecvEngine::Start()
+{
+    std::vector<fmtpRecvv3*> added;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        if (running) {
+            throw std::runtime_error("fmtpRecvEngine::Start() already "
+                    "running");
+        }
+
+        int retval = pthread_create(&timer_t, NULL,
+                                    &fmtpRecvEngine::timerWrapper, this);
+        if (retval != 0) {
+            throw std::runtime_error("fmtpRecvEngine::Start() "
+                    "pthread_create() timerWrapper error with retval = " +
+                    std::to_string(retval));
+        }
+        /* the threads created so far are stopped again if one can't be */
+        for (size_t i = 0; i < reactors.size(); i++) {
+            retval = pthread_create(&reactors[i]->thread, NULL,
+                                    &fmtpRecvEngine::reactWrapper,
+                                    reactors[i]);
+            if (retval != 0) {
+                joinThreads(i);
+                throw std::runtime_error("fmtpRecvEngine::Start() "
+                        "pthread_create() reactWrapper error with retval = " +
+                        std::to_string(retval));
+            }
+        }
+        running = true;
+
+        for (std::map<fmtpRecvv3*, RecvEngineFeed>::iterator it =
+                 feeds.begin(); it != feeds.end(); ++it)
+            added.push_back(it->first);
+    }
+
+    for (size_t i = 0; i < added.size(); i++)
+        attachFeed(added[i]);
+}
+
+
+/**
+ * Stops the engine's threads and stops serving every feed. The feeds keep
+ * their sockets until they are destroyed. Doesn't return until all threads
+ * have stopped.
+ *
+ * @throw std::exception  the first failure of an engine thread or, if there
+ *                        was none, of a feed.
+ */
+void fmtpRecvEngine::Stop()
+{
+    std::vector<fmtpRecvv3*> served;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        if (!running)
+            return;
+        running = false;
+        for (std::map<fmtpRecvv3*, RecvEngineFeed>::iterator it =
+                 feeds.begin(); it != feeds.end(); ++it)
+            served.push_back(it->first);
+    }
+
+    joinThreads(reactors.size());
+
+    std::exception_ptr failure;
+    for (size_t i = 0; i < served.size(); i++) {
+        detachFeed(served[i]);
+        served[i]->engine = NULL;
+        std::unique_lock<std::mutex> lock(served[i]->exitMutex);
+        if (!failure && served[i]->except)
+            failure = served[i]->except;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(exitmtx);
+        if (except)
+            failure = except;
+        except = std::exception_ptr();
+    }
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+
+/**
+ * Stops and joins the timer thread and the given number of the first I/O
+ * threads.
+ *
+ * @param[in] nreactors  Number of I/O threads that were started.
+ */
+void fmtpRecvEngine::joinThreads(const size_t nreactors)
+{
+    stopping = true;
+    {
+        std::unique_lock<std::mutex> lock(timermtx);
+        timer_cv.notify_all();
+    }
+    (void)pthread_join(timer_t, NULL);
+    for (size_t i = 0; i < nreactors; i++) {
+        const uint64_t one = 1;
+        uint64_t       count;
+        (void)write(reactors[i]->wakefd, &one, sizeof(one));
+        (void)pthread_join(reactors[i]->thread, NULL);
+        /* a restarted I/O thread mustn't be woken up again */
+        (void)read(reactors[i]->wakefd, &count, sizeof(count));
+    }
+    stopping = false;
+}
+
+
+/**
+ * Starts the timer of a product of a feed on the timer thread. The timers of
+ * a feed expire in the order they were started, as on the receiver's own
+ * timer thread.
+ *
+ * @param[in] feed       The feed.
+ * @param[in] prodindex  Index of the product.
+ * @param[in] seconds    Time until the timer expires in seconds.
+ */
+void fmtpRecvEngine::startTimer(fmtpRecvv3* const feed,
+                                const uint32_t prodindex,
+                                const double seconds)
+{
+    RecvEngineTimer timer;
+    timer.deadline  = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+    timer.prodindex = prodindex;
+
+    std::unique_lock<std::mutex> lock(timermtx);
+    std::map<fmtpRecvv3*, RecvEngineTimers>::iterator it = timers.find(feed);
+    if (it == timers.end())
+        return;
+    it->second.pending.push_back(timer);
+    if (it->second.pending.size() == 1)
+        timer_cv.notify_one();
+}
+
+
+/**
+ * Expires the pending timers of a feed now. Used when a later product begins
+ * or an EOP arrives, like the interruption of the receiver's own timer
+ * thread.
+ *
+ * @param[in] feed  The feed.
+ */
+void fmtpRecvEngine::wakeTimers(fmtpRecvv3* const feed)
+{
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(timermtx);
+    std::map<fmtpRecvv3*, RecvEngineTimers>::iterator it = timers.find(feed);
+    if (it == timers.end() || it->second.pending.empty())
+        return;
+    for (std::deque<RecvEngineTimer>::iterator timer =
+             it->second.pending.begin();
+         timer != it->second.pending.end(); ++timer) {
+        if (now < timer->deadline)
+            timer->deadline = now;
+    }
+    timer_cv.notify_one();
+}
+
+
+/**
+ * Has the I/O thread of a feed send the feed's queued requests, so that all
+ * messages of a feed to its sender are written by the same thread.
+ *
+ * @param[in] feed  The feed.
+ */
+void fmtpRecvEngine::post(fmtpRecvv3* const feed)
+{
+    Reactor* reactor;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        std::map<fmtpRecvv3*, RecvEngineFeed>::const_iterator it =
+            feeds.find(feed);
+        if (it == feeds.end() || !it->second.active)
+            return;
+        reactor = reactors[it->second.reactor];
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(reactor->mtx);
+        if (std::find(reactor->posted.begin(), reactor->posted.end(), feed)
+                != reactor->posted.end())
+            return;
+        reactor->posted.push_back(feed);
+    }
+    const uint64_t one = 1;
+    (void)write(reactor->wakefd, &one, sizeof(one));
+}
+
+
+/**
+ * Has an I/O thread wait for a socket to become readable.
+ *
+ * @param[in] reactor  The I/O thread.
+ * @param[in] sock     The socket.
+ * @param[in] conn     What the socket is.
+ * @throw std::runtime_error  if the socket can't be added.
+ */
+void fmtpRecvEngine::watch(Reactor* const reactor, const int sock,
+                           const Conn& conn)
+{
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = sock;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, sock, &event) < 0) {
+        throw std::runtime_error("fmtpRecvEngine::watch() epoll_ctl() "
+                "failed for socket " + std::to_string(sock));
+    }
+    reactor->conns[sock] = conn;
+}
+
+
+/**
+ * Records the first failure of an engine thread, which `Stop()` rethrows.
+ *
+ * @param[in] e  The failure.
+ */
+void fmtpRecvEngine::fail(const std::exception_ptr& e)
+{
+    std::unique_lock<std::mutex> lock(exitmtx);
+    if (!except)
+        except = e;
+}
+
+
+/**
+ * Handles a readable socket of a feed: a batch of multicast packets or what
+ * has arrived from the sender. The connection to the sender is read without
+ * blocking, so a message that arrives in pieces doesn't hold up the other
+ * feeds of the thread; the start of a message is kept until the rest has
+ * arrived. Then sends the requests the feed queued. A feed that fails stops
+ * itself and is no longer served.
+ *
+ * @param[in] sock  The socket.
+ * @param[in] conn  What the socket is.
+ */
+void fmtpRecvEngine::serve(const int sock, const Conn& conn)
+{
+    /* bounds the time other feeds of the thread wait */
+    const int maxPackets = 64;
+
+    try {
+        if (conn.mcast) {
+            for (int i = 0; i < maxPackets &&
+                     conn.feed->handleMcastPacket(true); i++)
+                ;
+        }
+        else {
+            char          buf[64 * 1024];
+            const ssize_t nbytes = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+            if (nbytes == 0) {
+                /* the sender closed the connection */
+                conn.feed->Stop();
+                return;
+            }
+            if (nbytes < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                        errno != EINTR) {
+                    throw std::runtime_error("fmtpRecvEngine::serve() "
+                            "recv() error: " + std::string(strerror(errno)));
+                }
+            }
+            else {
+                std::vector<char>& in = *conn.in;
+                in.insert(in.end(), buf, buf + nbytes);
+                const size_t used = conn.feed->serveRetxBuffer(in.data(),
+                                                               in.size());
+                in.erase(in.begin(), in.begin() + used);
+            }
+        }
+        conn.feed->drainRetxRequests();
+    }
+    catch (const std::exception& e) {
+        conn.feed->taskExit(std::current_exception());
+    }
+}
+
+
+/**
+ * The I/O thread. Waits for the sockets of its feeds to become readable and
+ * handles them without blocking on any of them.
+ *
+ * @param[in] reactor  The I/O thread's state.
+ */
+void fmtpRecvEngine::react(Reactor* const reactor)
+{
+    const int          maxEvents = 64;
+    struct epoll_event events[maxEvents];
+
+    placement.apply(ROLE_MCAST);
+    while (!stopping) {
+        const int nevents = epoll_wait(reactor->epfd, events, maxEvents, -1);
+        if (nevents < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("fmtpRecvEngine::react() epoll_wait() "
+                    "failed");
+        }
+
+        for (int i = 0; i < nevents && !stopping; i++) {
+            const int sock = events[i].data.fd;
+
+            if (sock == reactor->wakefd) {
+                uint64_t                 count;
+                std::vector<fmtpRecvv3*> posted;
+                (void)read(reactor->wakefd, &count, sizeof(count));
+                {
+                    std::unique_lock<std::mutex> lock(reactor->mtx);
+                    posted.swap(reactor->posted);
+                }
+                for (size_t j = 0; j < posted.size(); j++) {
+                    try {
+                        posted[j]->drainRetxRequests();
+                    }
+                    catch (const std::exception& e) {
+                        posted[j]->taskExit(std::current_exception());
+                    }
+                }
+                continue;
+            }
+
+            Conn conn;
+            {
+                std::unique_lock<std::mutex> lock(reactor->mtx);
+                std::map<int, Conn>::const_iterator it =
+                    reactor->conns.find(sock);
+                if (it == reactor->conns.end())
+                    continue; // a detached feed
+                conn = it->second;
+            }
+            serve(sock, conn);
+        }
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real react().
+ *
+ * @param[in] ptr  a pointer to the I/O thread's state.
+ */
+void* fmtpRecvEngine::reactWrapper(void* ptr)
+{
+    Reactor* const reactor = static_cast<Reactor*>(ptr);
+    try {
+        reactor->engine->react(reactor);
+    }
+    catch (const std::exception& e) {
+        reactor->engine->fail(std::current_exception());
+    }
+    return NULL;
+}
+
+
+/**
+ * The timer thread. Expires the product timers of all feeds and queues their
+ * statistics reports. The requests this queues are sent by the feeds' I/O
+ * threads.
+ */
+void fmtpRecvEngine::timer()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    placement.apply(ROLE_TIMER);
+    std::unique_lock<std::mutex> lock(timermtx);
+    while (!stopping) {
+        const Clock::time_point now  = Clock::now();
+        Clock::time_point       next = Clock::time_point::max();
+        std::vector<std::pair<fmtpRecvv3*, uint32_t> > expired;
+        std::vector<fmtpRecvv3*> reports;
+
+        for (std::map<fmtpRecvv3*, RecvEngineTimers>::iterator it =
+                 timers.begin(); it != timers.end(); ++it) {
+            std::deque<RecvEngineTimer>& pending = it->second.pending;
+            while (!pending.empty() && pending.front().deadline <= now) {
+                expired.push_back(std::make_pair(it->first,
+                                                 pending.front().prodindex));
+                pending.pop_front();
+            }
+            if (!pending.empty())
+                next = std::min(next, pending.front().deadline);
+
+            if (it->second.statsinterval > 0) {
+                if (it->second.statsdue <= now) {
+                    reports.push_back(it->first);
+                    it->second.statsdue +=
+                        std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(
+                                it->second.statsinterval));
+                }
+                next = std::min(next, it->second.statsdue);
+            }
+        }
+
+        if (expired.empty() && reports.empty()) {
+            if (next == Clock::time_point::max())
+                timer_cv.wait(lock);
+            else
+                timer_cv.wait_until(lock, next);
+            continue;
+        }
+
+        lock.unlock();
+        for (size_t i = 0; i < expired.size(); i++) {
+            try {
+                expired[i].first->expireTimer(expired[i].second);
+            }
+            catch (const std::exception& e) {
+                expired[i].first->taskExit(std::current_exception());
+            }
+            post(expired[i].first);
+        }
+        for (size_t i = 0; i < reports.size(); i++) {
+            reports[i]->queueStatsReport();
+            post(reports[i]);
+        }
+        lock.lock();
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real timer().
+ *
+ * @param[in] ptr  a pointer to the engine.
+ */
+void* fmtpRecvEngine::timerWrapper(void* ptr)
+{
+    fmtpRecvEngine* const engine = static_cast<fmtpRecvEngine*>(ptr);
+    try {
+        engine->timer();
+    }
+    catch (const std::exception& e) {
+        engine->fail(std::current_exception());
+    }
+    return NULL;
+}
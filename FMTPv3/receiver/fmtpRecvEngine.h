@@ -0,0 +1,243 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpRecvEngine.h
+ *
+ * This file defines a multi-feed receiver engine: a fixed pool of I/O threads
+ * and a timer thread that serve any number of FMTP receivers (feeds).
+ */
+
+#ifndef FMTP_RECEIVER_FMTPRECVENGINE_H_
+#define FMTP_RECEIVER_FMTPRECVENGINE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPlacement.h"
+#include "fmtpRecvv3.h"
+
+
+/** the timer of a product of a feed */
+struct RecvEngineTimer
+{
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t        prodindex;
+};
+
+/** the timers of a feed, expired in the order they were started */
+struct RecvEngineTimers
+{
+    std::deque<RecvEngineTimer>           pending;
+    /* interval between statistics reports in seconds or 0 */
+    double                                statsinterval;
+    std::chrono::steady_clock::time_point statsdue;
+};
+
+/** the engine's view of a feed */
+struct RecvEngineFeed
+{
+    unsigned        reactor;     /*!< index of the feed's I/O thread */
+    bool            active;      /*!< whether the engine serves the feed */
+};
+
+
+/**
+ * Serves many FMTP receivers with a fixed number of threads. Every feed keeps
+ * its own multicast socket, connection to its sender, product trackers and
+ * request queue, but instead of the four or five threads of its own that
+ * `fmtpRecvv3::Start()` runs, it shares the engine's threads:
+ *   - I/O threads wait for the multicast and unicast sockets of their feeds
+ *     with epoll, handle the packets and send the feeds' requests; the
+ *     connection to a feed's sender is read without blocking into a buffer
+ *     of its own;
+ *   - a timer thread expires the product timers of all feeds and has their
+ *     statistics reports sent.
+ * The notifications of a feed's application are made on these threads, so
+ * they must not block.
+ */
+class fmtpRecvEngine
+{
+public:
+    /**
+     * Constructs an engine.
+     *
+     * @param[in] reactors  Number of I/O threads.
+     * @throw std::invalid_argument  if the number is 0.
+     * @throw std::runtime_error     if an epoll instance can't be created.
+     */
+    explicit fmtpRecvEngine(const unsigned reactors = 1);
+    ~fmtpRecvEngine();
+
+    /**
+     * Adds a configured, not yet started receiver as a feed.
+     *
+     * @param[in] feed  The receiver.
+     * @throw std::invalid_argument  if the feed was already added.
+     * @throw std::runtime_error     if the feed can't be started.
+     */
+    void     addFeed(fmtpRecvv3* const feed);
+    /**
+     * Sets where and how the engine's threads run. Must be called before
+     * `Start()`.
+     *
+     * @param[in] placement  The thread placement.
+     */
+    void     SetThreadPlacement(const ThreadPlacement& placement);
+    /**
+     * Starts the engine's threads and the feeds added so far. Returns once
+     * they are running.
+     *
+     * @throw std::runtime_error  if a thread or feed can't be started.
+     */
+    void     Start();
+    /**
+     * Stops the engine's threads and stops serving every feed.
+     *
+     * @throw std::exception  if an engine thread or a feed failed.
+     */
+    void     Stop();
+    /**
+     * Returns the number of threads the engine runs.
+     *
+     * @return  The number of threads.
+     */
+    unsigned threadCount() const {return reactors.size() + 1;}
+
+private:
+    friend class fmtpRecvv3;
+
+    /** a socket waited for by an I/O thread */
+    struct Conn
+    {
+        fmtpRecvv3*     feed;
+        bool            mcast;   /*!< multicast rather than unicast socket */
+        /* bytes read from the sender that don't make a complete message
+         * yet, NULL if `mcast` */
+        std::shared_ptr<std::vector<char> > in;
+    };
+
+    /** an I/O thread and its sockets */
+    struct Reactor
+    {
+        fmtpRecvEngine*          engine;
+        pthread_t                thread;
+        int                      epfd;
+        int                      wakefd;
+        std::mutex               mtx;
+        std::map<int, Conn>      conns;
+        /* feeds whose queued requests are to be sent */
+        std::vector<fmtpRecvv3*> posted;
+    };
+
+    /**
+     * Starts a feed and has the engine's threads serve it.
+     *
+     * @param[in] feed  The feed.
+     * @throw std::runtime_error  if the feed can't be started.
+     */
+    void attachFeed(fmtpRecvv3* const feed);
+    /**
+     * Stops serving a feed. Called by the feed when it stops.
+     *
+     * @param[in] feed  The feed.
+     */
+    void detachFeed(fmtpRecvv3* const feed);
+    /**
+     * Returns whether the engine serves a feed.
+     *
+     * @param[in] feed  The feed.
+     * @return          Whether the feed is served.
+     */
+    bool isActive(fmtpRecvv3* const feed);
+    /**
+     * Starts the timer of a product of a feed.
+     *
+     * @param[in] feed       The feed.
+     * @param[in] prodindex  Index of the product.
+     * @param[in] seconds    Time until the timer expires in seconds.
+     */
+    void startTimer(fmtpRecvv3* const feed, const uint32_t prodindex,
+                    const double seconds);
+    /**
+     * Expires the pending timers of a feed now.
+     *
+     * @param[in] feed  The feed.
+     */
+    void wakeTimers(fmtpRecvv3* const feed);
+    /**
+     * Has the I/O thread of a feed send the feed's queued requests.
+     *
+     * @param[in] feed  The feed.
+     */
+    void post(fmtpRecvv3* const feed);
+    /**
+     * Has an I/O thread wait for a socket.
+     *
+     * @param[in] reactor  The I/O thread.
+     * @param[in] sock     The socket.
+     * @param[in] conn     What the socket is.
+     * @throw std::runtime_error  if the socket can't be added.
+     */
+    void watch(Reactor* const reactor, const int sock, const Conn& conn);
+    /**
+     * Handles a readable socket of a feed and sends the feed's requests.
+     *
+     * @param[in] sock  The socket.
+     * @param[in] conn  What the socket is.
+     */
+    void serve(const int sock, const Conn& conn);
+    /**
+     * Records the first failure of an engine thread.
+     *
+     * @param[in] e  The failure.
+     */
+    void fail(const std::exception_ptr& e);
+    /**
+     * Stops and joins the timer thread and the first I/O threads.
+     *
+     * @param[in] nreactors  Number of I/O threads that were started.
+     */
+    void joinThreads(const size_t nreactors);
+    /** releases the thread states and closes the epoll instances */
+    void closeAll();
+    /** I/O thread */
+    void react(Reactor* const reactor);
+    /** a wrapper to call the actual fmtpRecvEngine::react() */
+    static void* reactWrapper(void* ptr);
+    /** timer thread */
+    void timer();
+    /** a wrapper to call the actual fmtpRecvEngine::timer() */
+    static void* timerWrapper(void* ptr);
+    /* Prevent copying because it's meaningless */
+    fmtpRecvEngine(fmtpRecvEngine&);
+    fmtpRecvEngine& operator=(const fmtpRecvEngine&);
+
+    std::vector<Reactor*>                  reactors;
+    ThreadPlacement                        placement;
+    /* protects `feeds` and `running` */
+    std::mutex                             feedmtx;
+    std::map<fmtpRecvv3*, RecvEngineFeed>  feeds;
+    bool                                   running;
+    /* set when the threads are to exit */
+    std::atomic<bool>                      stopping;
+    /* protects `timers` */
+    std::mutex                             timermtx;
+    std::condition_variable                timer_cv;
+    std::map<fmtpRecvv3*, RecvEngineTimers> timers;
+    pthread_t                              timer_t;
+    std::mutex                             exitmtx;
+    std::exception_ptr                     except;
+};
+
+#endif /* FMTP_RECEIVER_FMTPRECVENGINE_H_ */
@@ -29,25 +29,43 @@
 
 
 #include "fmtpRecvv3.h"
+#include "fmtpRecvEngine.h"
 
 #include <arpa/inet.h>
+#include <endian.h>
 #include <errno.h>
 #include <exception>
 #include <fcntl.h>
+#include <linux/net_tstamp.h>
 #include <math.h>
 #include <memory.h>
 #include <netinet/in.h>
+#include <sched.h>
 #include <sys/socket.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <utility>
-#include <fstream>
-#include <iostream>
 #include <system_error>
 
 #define Frcv 20
+/* largest product stored before its BOP has arrived */
+#define STAGE_MAX_PRODSIZE (64 * 1024 * 1024)
+
+
+/**
+ * Returns the pathname of the receivers' log, which is named after the host
+ * so that receivers sharing a directory don't share a file.
+ *
+ * @return  The pathname.
+ */
+static std::string logPath()
+{
+    /* allocate a large enough buffer in case some long hostnames */
+    char hostname[1024] = {0};
+    (void)gethostname(hostname, sizeof(hostname) - 1);
+    return "logs/FMTPv3_RECEIVER_" + std::string(hostname) + ".log";
+}
 
 
 /**
@@ -74,8 +92,6 @@ fmtpRecvv3::fmtpRecvv3(
     tcpPort(tcpPort),
     mcastAddr(mcastAddr),
     mcastPort(mcastPort),
-    mcastgroup(),
-    mreq(),
     prodidx_mcast(0xFFFFFFFF),
     ifAddr(ifAddr),
     tcprecv(new TcpRecv(tcpAddr, tcpPort)),
@@ -100,7 +116,40 @@ fmtpRecvv3::fmtpRecvv3(
     linkspeed(20000000),
     retxHandlerCanceled(ATOMIC_FLAG_INIT),
     mcastHandlerCanceled(ATOMIC_FLAG_INIT),
-    measure(new Measure())
+    latency(),
+    delay(),
+    rxtimestamps(false),
+    mcastRxNs(0),
+    counters(RECV_NCOUNTERS),
+    kerneldrops(0),
+    statsseq(0),
+    statsinterval(0),
+    stats_t(),
+    statsStop(false),
+    statsmtx(),
+    stats_cv(),
+    rcvbufburst(0.1),
+    rcvbufmax(64 * 1024 * 1024),
+    rcvbufreq(0),
+    rcvbuf(0),
+    rcvbufgrowths(0),
+    rcvbufgrown(),
+    observedrate(0),
+    ratewinbytes(0),
+    ratewinpkts(0),
+    ratewinstart(std::chrono::steady_clock::now()),
+    busypoll(false),
+    busypollcpu(-1),
+    busypollusecs(0),
+    placement(),
+    mcastStarted(false),
+    engine(NULL),
+    injector(NULL),
+    trace(NULL),
+    transport(&Transport::sockets()),
+    exporter(NULL),
+    exporterId(0),
+    logger(AsyncLog::get(logPath()))
 {
 }
 
@@ -112,6 +161,8 @@ fmtpRecvv3::fmtpRecvv3(
  */
 fmtpRecvv3::~fmtpRecvv3()
 {
+    if (exporter)
+        exporter->removeCollector(exporterId);
     Stop();
     close(mcastSock);
     (void)close(retxSock); // failure is irrelevant
@@ -121,11 +172,14 @@ fmtpRecvv3::~fmtpRecvv3()
     }
     {
         std::unique_lock<std::mutex> lock(trackermtx);
+        for (TrackerMap::iterator it = trackermap.begin();
+             it != trackermap.end(); ++it) {
+            delete[] it->second.stageptr;
+        }
         trackermap.clear();
     }
     delete tcprecv;
     delete pSegMNG;
-    delete measure;
 }
 
 
@@ -159,6 +213,545 @@ void fmtpRecvv3::SetLinkSpeed(uint64_t speed)
 }
 
 
+/**
+ * Sets the interval at which the receiver reports its statistics to the
+ * sender over the TCP connection. Must be called before `Start()`. The sender
+ * must understand FMTP_RECV_STATS messages.
+ *
+ * @param[in] seconds  Interval between two reports in seconds. 0, the default,
+ *                     disables reporting.
+ * @throw std::invalid_argument  if `seconds` is negative.
+ */
+void fmtpRecvv3::SetStatsInterval(double seconds)
+{
+    if (seconds < 0) {
+        throw std::invalid_argument("fmtpRecvv3::SetStatsInterval() negative "
+                "interval");
+    }
+    statsinterval = seconds;
+}
+
+
+/**
+ * Sets how the receive buffer of the multicast socket is sized. The buffer
+ * initially holds a burst of `burst` seconds at the link speed given to
+ * SetLinkSpeed(). Whenever the kernel drops multicast packets for lack of
+ * buffer, the buffer is doubled, or sized for a burst at the observed rate if
+ * that is larger, but not beyond `maxbytes` and not more than once per burst
+ * duration. Sizes beyond the system's `net.core.rmem_max` are only possible
+ * if the process has the CAP_NET_ADMIN capability. The defaults are 0.1
+ * seconds and 64 MiB. Must be called before `Start()`.
+ *
+ * @param[in] burst     Duration in seconds of a burst at the link speed the
+ *                      buffer must be able to absorb.
+ * @param[in] maxbytes  Largest size in bytes the buffer may grow to.
+ * @throw std::invalid_argument  if `burst` isn't positive or `maxbytes` is
+ *                               smaller than a maximum-size FMTP packet.
+ */
+void fmtpRecvv3::SetRcvBufPolicy(double burst, int maxbytes)
+{
+    if (burst <= 0 || maxbytes < MAX_FMTP_PACKET_LEN) {
+        throw std::invalid_argument("fmtpRecvv3::SetRcvBufPolicy() invalid "
+                "argument");
+    }
+    rcvbufburst = burst;
+    rcvbufmax   = maxbytes;
+}
+
+
+/**
+ * Returns the counters of the multicast socket. Thread-safe.
+ *
+ * @return  The counters.
+ */
+McastRecvStats fmtpRecvv3::getMcastStats() const
+{
+    McastRecvStats stats;
+    stats.mcastpkts     = counters.sum(RECV_MCASTPKTS);
+    stats.kerneldrops   = kerneldrops.load(std::memory_order_relaxed);
+    stats.rcvbuf        = rcvbuf.load(std::memory_order_relaxed);
+    stats.rcvbufgrowths = rcvbufgrowths.load(std::memory_order_relaxed);
+    stats.observedrate  = observedrate.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+/**
+ * Returns the receiver's statistics. The counters are summed over the threads
+ * that incremented them, so taking a snapshot costs the receiving threads
+ * nothing. The gauges hold the locks of the structures they count for a
+ * moment.
+ *
+ * @return  A snapshot of the statistics.
+ */
+RecvStats fmtpRecvv3::getStats()
+{
+    const std::vector<uint64_t> sums = counters.sums();
+    RecvStats                   stats;
+
+    stats.mcastpkts   = sums[RECV_MCASTPKTS];
+    stats.mcastbytes  = sums[RECV_MCASTBYTES];
+    stats.kerneldrops = kerneldrops.load(std::memory_order_relaxed);
+    stats.bops        = sums[RECV_BOPS];
+    stats.dupbops     = sums[RECV_DUPBOPS];
+    stats.eops        = sums[RECV_EOPS];
+    stats.completed   = sums[RECV_COMPLETED];
+    stats.missed      = sums[RECV_MISSED];
+    stats.retxreqs    = sums[RECV_RETXREQS];
+    stats.bopreqs     = sums[RECV_BOPREQS];
+    stats.eopreqs     = sums[RECV_EOPREQS];
+    stats.retxpkts    = sums[RECV_RETXPKTS];
+    stats.retxbytes   = sums[RECV_RETXBYTES];
+    stats.recovered   = sums[RECV_RECOVERED];
+    stats.retxbops    = sums[RECV_RETXBOPS];
+    stats.retxeops    = sums[RECV_RETXEOPS];
+    stats.retxrejs    = sums[RECV_RETXREJS];
+    stats.retxends    = sums[RECV_RETXENDS];
+    stats.timeouts    = sums[RECV_TIMEOUTS];
+    {
+        std::unique_lock<std::mutex> lock(msgQmutex);
+        stats.retxqueue = msgqueue.size();
+    }
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        stats.inflight = trackermap.size();
+    }
+    {
+        std::unique_lock<std::mutex> lock(BOPSetMtx);
+        stats.missingbops = misBOPset.size();
+    }
+    return stats;
+}
+
+
+/**
+ * Returns a histogram of the latencies of completed products of a size.
+ *
+ * @param[in] which      The latency.
+ * @param[in] sizeclass  Size of the products.
+ * @return               A snapshot of the histogram in nanoseconds.
+ */
+HistogramSnapshot fmtpRecvv3::getLatency(const RecvLatency which,
+                                         const SizeClass sizeclass)
+{
+    return latency[which][sizeclass].snapshot();
+}
+
+
+/**
+ * Returns a histogram of the latencies of completed products of all sizes.
+ *
+ * @param[in] which  The latency.
+ * @return           The histograms of every size, merged.
+ */
+HistogramSnapshot fmtpRecvv3::getLatency(const RecvLatency which)
+{
+    HistogramSnapshot merged;
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++)
+        merged.merge(latency[which][i].snapshot());
+    return merged;
+}
+
+
+/**
+ * Enables the busy-poll receive mode, which trades a core for a shorter
+ * receive latency. Instead of blocking in `recvmsg()` until the kernel wakes
+ * it up, the multicast thread spins on non-blocking reads of the multicast
+ * socket, optionally pinned to a CPU that should be reserved for it. The
+ * socket is also asked to busy-poll the device queue (SO_BUSY_POLL and, where
+ * the kernel supports it, SO_PREFER_BUSY_POLL); raising SO_BUSY_POLL above
+ * `net.core.busy_read` requires the CAP_NET_ADMIN capability and isn't done
+ * otherwise. Must be called before `Start()`.
+ *
+ * @param[in] cpu    CPU the multicast thread is pinned to or -1 to not pin it.
+ * @param[in] usecs  Time in microseconds the kernel busy-polls the device
+ *                   queue for a socket read. 0 leaves it as is.
+ * @throw std::invalid_argument  if `cpu` is less than -1 or `usecs` is
+ *                               negative.
+ */
+void fmtpRecvv3::SetBusyPoll(int cpu, int usecs)
+{
+    if (cpu < -1 || usecs < 0) {
+        throw std::invalid_argument("fmtpRecvv3::SetBusyPoll() invalid "
+                "argument");
+    }
+    busypoll      = true;
+    busypollcpu   = cpu;
+    busypollusecs = usecs;
+}
+
+
+/**
+ * Has the kernel timestamp the multicast packets as they arrive
+ * (SO_TIMESTAMPING), by the network card if it has been set up to and by the
+ * kernel's software otherwise. The time from that timestamp to the read of
+ * the packet, the in-host queuing delay, is then recorded for every packet,
+ * and the time from the sender's timestamp to it, the network delay, for
+ * every FMTP_TIMESTAMPED packet (see fmtpSendv3::SetTimestamps()). Hardware
+ * timestamps are only meaningful if the card's clock is synchronized with the
+ * system clock, and network delays only if the hosts' clocks are; negative
+ * delays aren't recorded. Must be called before `Start()`.
+ *
+ * @param[in] enable  Whether to timestamp received packets.
+ */
+void fmtpRecvv3::SetRxTimestamps(bool enable)
+{
+    rxtimestamps = enable;
+}
+
+
+/**
+ * Sets where and how the receiver's threads run: the CPUs, the NUMA node and
+ * the scheduling class of the multicast, retransmission-reception,
+ * retransmission-request, timer and statistics threads. Pinning the
+ * multicast thread to a CPU close to the NIC and binding it to the NIC's NUMA
+ * node keeps the packet buffers it allocates local. A CPU given to
+ * SetBusyPoll() overrides the multicast thread's CPUs. A thread whose
+ * placement can't be applied makes `Start()` fail. Must be called before
+ * `Start()`.
+ *
+ * @param[in] placement  The thread placement.
+ */
+void fmtpRecvv3::SetThreadPlacement(const ThreadPlacement& placement)
+{
+    this->placement = placement;
+}
+
+
+/**
+ * Has a fault injector decide the fate of every multicast packet received. A
+ * dropped packet is read and discarded as if it had been lost on the way, so
+ * several receivers of one sender can see different loss. Only loss applies
+ * here; duplication and reordering are injected at the sender (see
+ * fmtpSendv3::SetFaultInjector()). Must be called before `Start()`.
+ *
+ * @param[in] injector  The fault injector or NULL for none. It must outlive
+ *                      the receiver.
+ */
+void fmtpRecvv3::SetFaultInjector(FaultInjector* injector)
+{
+    this->injector = injector;
+}
+
+
+/**
+ * Records the lifecycle events of products into a trace: the arrival of
+ * their BOP, of the multicast blocks at their start and end and of their
+ * EOP, the first gap, every retransmission request, the RETX_END sent, the
+ * RETX_REJs received and the expiry of their timers. Must be called before
+ * `Start()`.
+ *
+ * @param[in] trace  The trace or NULL for none. It must outlive the
+ *                   receiver.
+ */
+void fmtpRecvv3::SetTrace(ProductTrace* trace)
+{
+    this->trace = trace;
+}
+
+
+/**
+ * Sets the transport that opens the multicast socket and the connection to
+ * the sender, for example a SimNetwork instead of the host's sockets. Must be
+ * called before `Start()`.
+ *
+ * @param[in] transport  The transport. It must outlive the receiver.
+ */
+void fmtpRecvv3::SetTransport(Transport& transport)
+{
+    this->transport = &transport;
+    tcprecv->SetTransport(transport);
+}
+
+
+/**
+ * Sets the level of the records written to the log. Records below the level
+ * cost a load and a branch.
+ *
+ * @param[in] level  The level.
+ */
+void fmtpRecvv3::SetLogLevel(const LogLevel level)
+{
+    logger->setLevel(level);
+}
+
+
+/**
+ * Has an exporter serve the receiver's statistics. The exporter takes a
+ * snapshot for every scrape, so serving costs the receiving threads nothing.
+ *
+ * @param[in] exporter  The exporter. It must outlive the receiver.
+ * @param[in] feed      Value of the "feed" label of the receiver's metrics or
+ *                      empty for no label.
+ */
+void fmtpRecvv3::SetMetricsExporter(MetricsExporter&  exporter,
+                                    const std::string& feed)
+{
+    const std::string labels = feed.empty() ? "" :
+                               MetricsWriter::label("feed", feed);
+    this->exporter = &exporter;
+    exporterId     = exporter.addCollector([this, labels](MetricsWriter& w) {
+        writeMetrics(w, labels);
+    });
+}
+
+
+/**
+ * Adds the receiver's statistics to a scrape of the metrics exporter.
+ *
+ * @param[in] writer  The scrape.
+ * @param[in] labels  Labels of the receiver's samples.
+ */
+void fmtpRecvv3::writeMetrics(MetricsWriter& writer, const std::string& labels)
+{
+    const RecvStats      stats = getStats();
+    const McastRecvStats mcast = getMcastStats();
+
+    writer.counter("fmtp_receiver_mcast_packets_total",
+                   "Multicast packets received.", labels, stats.mcastpkts);
+    writer.counter("fmtp_receiver_mcast_bytes_total",
+                   "Multicast bytes received, FMTP headers included.", labels,
+                   stats.mcastbytes);
+    writer.counter("fmtp_receiver_kernel_drops_total",
+                   "Multicast datagrams dropped by the kernel for lack of "
+                   "buffer.", labels, stats.kerneldrops);
+    writer.counter("fmtp_receiver_bops_total", "Products begun.", labels,
+                   stats.bops);
+    writer.counter("fmtp_receiver_duplicate_bops_total",
+                   "BOPs of products already begun.", labels, stats.dupbops);
+    writer.counter("fmtp_receiver_eops_total", "EOPs received by multicast.",
+                   labels, stats.eops);
+    writer.counter("fmtp_receiver_products_completed_total",
+                   "Products completely received.", labels, stats.completed);
+    writer.counter("fmtp_receiver_products_missed_total",
+                   "Products given up on.", labels, stats.missed);
+    const char* const help = "Retransmission requests sent.";
+    writer.counter("fmtp_receiver_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "data")),
+                   stats.retxreqs);
+    writer.counter("fmtp_receiver_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "bop")),
+                   stats.bopreqs);
+    writer.counter("fmtp_receiver_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "eop")),
+                   stats.eopreqs);
+    writer.counter("fmtp_receiver_retx_packets_total",
+                   "Data blocks retransmitted to the receiver.", labels,
+                   stats.retxpkts);
+    writer.counter("fmtp_receiver_retx_bytes_total",
+                   "Bytes of data retransmitted to the receiver.", labels,
+                   stats.retxbytes);
+    writer.counter("fmtp_receiver_recovered_blocks_total",
+                   "Retransmitted data blocks that were missing.", labels,
+                   stats.recovered);
+    writer.counter("fmtp_receiver_retx_bops_total",
+                   "BOPs retransmitted to the receiver.", labels,
+                   stats.retxbops);
+    writer.counter("fmtp_receiver_retx_eops_total",
+                   "EOPs retransmitted to the receiver.", labels,
+                   stats.retxeops);
+    writer.counter("fmtp_receiver_retx_rejects_total",
+                   "Retransmission requests rejected by the sender.", labels,
+                   stats.retxrejs);
+    writer.counter("fmtp_receiver_retx_ends_total",
+                   "Notices of completion sent.", labels, stats.retxends);
+    writer.counter("fmtp_receiver_timeouts_total",
+                   "Product timers that expired.", labels, stats.timeouts);
+    writer.gauge("fmtp_receiver_retx_queue",
+                 "Requests waiting to be sent.", labels, stats.retxqueue);
+    writer.gauge("fmtp_receiver_products_in_flight",
+                 "Products being received.", labels, stats.inflight);
+    writer.gauge("fmtp_receiver_missing_bops",
+                 "Products whose BOP is being requested.", labels,
+                 stats.missingbops);
+    writer.gauge("fmtp_receiver_rcvbuf_bytes",
+                 "Receive buffer size of the multicast socket.", labels,
+                 mcast.rcvbuf);
+    writer.gauge("fmtp_receiver_observed_rate_bps",
+                 "Observed multicast rate in bits per second.", labels,
+                 mcast.observedrate);
+
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+        const SizeClass   sizeclass = static_cast<SizeClass>(i);
+        const std::string sized     = MetricsWriter::join(labels,
+                MetricsWriter::label("size", sizeClassName(sizeclass)));
+        latency[LATENCY_COMPLETION][i].snapshot().write(writer,
+                "fmtp_receiver_completion_seconds",
+                "Time from the BOP to the completion of a product.", sized);
+        latency[LATENCY_MCAST][i].snapshot().write(writer,
+                "fmtp_receiver_mcast_completion_seconds",
+                "Time from the BOP to the completion of a product that "
+                "needed no retransmission.", sized);
+        latency[LATENCY_RETX][i].snapshot().write(writer,
+                "fmtp_receiver_retx_seconds",
+                "Time from the first retransmission request for a product "
+                "to its completion.", sized);
+        latency[LATENCY_END_TO_END][i].snapshot().write(writer,
+                "fmtp_receiver_end_to_end_seconds",
+                "Time from the submission of a product to the sender to its "
+                "completion.", sized);
+    }
+    delay[DELAY_NETWORK].snapshot().write(writer,
+            "fmtp_receiver_network_delay_seconds",
+            "Time from the sender's timestamp of a multicast packet to its "
+            "receive timestamp.", labels);
+    delay[DELAY_HOST].snapshot().write(writer,
+            "fmtp_receiver_host_delay_seconds",
+            "Time from the receive timestamp of a multicast packet to its "
+            "read by the receiver.", labels);
+}
+
+
+/**
+ * Records the latencies of a product that has just been completed: the time
+ * since its BOP and either the time since its first retransmission request
+ * or, if there was none, the same time since its BOP again but in the
+ * histograms of products that multicast alone delivered. If the BOP carried a
+ * sender timestamp, the time since the product was sent is recorded too.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] tracker    The tracker of the product, already removed.
+ */
+void fmtpRecvv3::recordCompletion(const uint32_t prodindex,
+                                  const ProdTracker& tracker)
+{
+    const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+    const SizeClass sizeclass = sizeClassOf(tracker.prodsize);
+    const uint64_t  elapsed   =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - tracker.start).count();
+    const bool      retx      =
+            tracker.retxstart != std::chrono::steady_clock::time_point();
+
+    latency[LATENCY_COMPLETION][sizeclass].record(elapsed);
+    if (retx) {
+        latency[LATENCY_RETX][sizeclass].record(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - tracker.retxstart).count());
+    }
+    else {
+        latency[LATENCY_MCAST][sizeclass].record(elapsed);
+    }
+    if (tracker.submitted) {
+        const uint64_t wallnow = wallClockNs();
+        if (wallnow >= tracker.submitted) {
+            latency[LATENCY_END_TO_END][sizeclass].record(
+                    wallnow - tracker.submitted);
+        }
+    }
+
+    #ifdef MEASURE
+        #ifdef MODBASE
+            uint32_t tmpidx = prodindex % MODBASE;
+        #else
+            uint32_t tmpidx = prodindex;
+        #endif
+
+        std::string measuremsg = "[SUCCESS] Product #" +
+            std::to_string(tmpidx);
+        measuremsg += ": product received, size = ";
+        measuremsg += std::to_string(tracker.prodsize);
+        measuremsg += " bytes, elapsed time = ";
+        measuremsg += std::to_string(elapsed / 1e9);
+        measuremsg += " seconds.";
+        if (retx) {
+            measuremsg += " Retransmission was requested";
+        }
+        logger->write(LOGLVL_INFO, measuremsg);
+    #else
+        (void)prodindex;
+    #endif
+}
+
+
+/**
+ * Notes the time of the first retransmission request for a product, from
+ * which the time the product spends in retransmission is measured, and
+ * traces the gap that caused it.
+ *
+ * @param[in] prodindex  Index of the product.
+ */
+void fmtpRecvv3::markRetx(const uint32_t prodindex)
+{
+    std::unique_lock<std::mutex> lock(trackermtx);
+    TrackerMap::iterator         it = trackermap.find(prodindex);
+    if (it != trackermap.end() &&
+            it->second.retxstart == std::chrono::steady_clock::time_point()) {
+        it->second.retxstart = std::chrono::steady_clock::now();
+        if (trace) {
+            trace->record(TRACE_FIRST_GAP, prodindex,
+                          it->second.seqnum + it->second.paylen);
+        }
+    }
+}
+
+
+/**
+ * Reads the sender timestamp at the end of a peeked-at FMTP_TIMESTAMPED
+ * packet, which is peeked at as a whole, and strips it from the header. The
+ * packet's handler then reads the packet without the timestamp.
+ *
+ * @param[in,out] header  The decoded header of the packet.
+ * @return                The timestamp in ns since the Unix epoch.
+ * @throw std::runtime_error  if an error occurs while reading the socket.
+ * @throw std::runtime_error  if the packet is invalid.
+ */
+uint64_t fmtpRecvv3::readTimestamp(FmtpHeader& header)
+{
+    char          pktBuf[FMTP_HEADER_LEN + DATA_EXT_LEN + FMTP_DATA_LEN];
+    const ssize_t nbytes = recv(mcastSock, pktBuf, sizeof(pktBuf), MSG_PEEK);
+
+    if (nbytes < 0) {
+        throw std::runtime_error("fmtpRecvv3::readTimestamp() recv() less "
+                "than zero bytes.");
+    }
+    checkPayloadLen(header, nbytes);
+    if (header.payloadlen < TIMESTAMP_LEN) {
+        throw std::runtime_error("fmtpRecvv3::readTimestamp() packet too "
+                "small");
+    }
+
+    uint64_t stamp;
+    (void)memcpy(&stamp, pktBuf + nbytes - TIMESTAMP_LEN, sizeof(stamp));
+    header.flags      &= ~FMTP_TIMESTAMPED;
+    header.payloadlen -= TIMESTAMP_LEN;
+    return be64toh(stamp);
+}
+
+
+/**
+ * Notes the sender timestamp of the BOP of a product, from which the
+ * product's end-to-end latency is measured. A BOP whose metadata is still
+ * being reassembled keeps it until the product is initialized.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] submitted  The timestamp in ns since the Unix epoch.
+ */
+void fmtpRecvv3::noteSubmitted(const uint32_t prodindex,
+                               const uint64_t submitted)
+{
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        TrackerMap::iterator         it = trackermap.find(prodindex);
+        if (it != trackermap.end()) {
+            if (it->second.submitted == 0) {
+                it->second.submitted = submitted;
+            }
+            return;
+        }
+    }
+    std::unique_lock<std::mutex> lock(bopassemblymtx);
+    BOPAssemblyMap::iterator     it = bopassembly.find(prodindex);
+    if (it != bopassembly.end()) {
+        it->second.submitted = submitted;
+    }
+}
+
+
 /**
  * Connect to sender via TCP socket, join given multicast group (defined by
  * mcastAddr:mcastPort) to receive multicasting products. Start retransmission
@@ -185,6 +778,9 @@ void fmtpRecvv3::Start()
 
     StartRetxProcedure();
     startTimerThread();
+    if (statsinterval > 0) {
+        startStatsReporter();
+    }
 
     int status = pthread_create(&mcast_t, NULL, &fmtpRecvv3::StartMcastHandler,
                                 this);
@@ -200,6 +796,9 @@ void fmtpRecvv3::Start()
         while (!stopRequested && !except)
             exitCond.wait(lock);
     }
+    if (statsinterval > 0) {
+        stopJoinStatsReporter();
+    }
     stopJoinRetxRequester();
     stopJoinRetxHandler();
     stopJoinTimerThread();
@@ -222,9 +821,28 @@ void fmtpRecvv3::Start()
 
 
 /**
- * Stops a running FMTP receiver. Returns immediately. Idempotent.
+ * Starts this instance as a feed of a multi-feed engine: connects to the
+ * sender and joins the multicast group, but starts no thread. The engine
+ * handles the packets, requests and timers of the feed on its shared threads.
+ *
+ * @param[in] host  The engine.
+ * @throw std::runtime_error  if the multicast group couldn't be joined.
+ * @throw std::system_error   if the sender couldn't be connected to.
+ */
+void fmtpRecvv3::startHosted(fmtpRecvEngine* const host)
+{
+    engine = host;
+    tcprecv->Init();
+    joinGroup(mcastAddr, mcastPort);
+}
+
+
+/**
+ * Stops a running FMTP receiver. Returns immediately. Idempotent. A feed of
+ * an engine is no longer served by the engine.
  *
- * @pre  `fmtpRecvv3::Start()` was previously called.
+ * @pre  `fmtpRecvv3::Start()` or `fmtpRecvEngine::addFeed()` was previously
+ *       called.
  */
 void fmtpRecvv3::Stop()
 {
@@ -233,6 +851,9 @@ void fmtpRecvv3::Stop()
         stopRequested = true;
         exitCond.notify_one();
     }
+    if (engine) {
+        engine->detachFeed(this);
+    }
 
     int prevState;
 
@@ -282,13 +903,12 @@ void fmtpRecvv3::mcastBOPHandler(const FmtpHeader& header)
         uint32_t tmpidx = header.prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "[MCAST BOP] Product #" +
             std::to_string(tmpidx);
         debugmsg += ": BOP received from multicast.";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 
     const int     bufsize = FMTP_HEADER_LEN + header.payloadlen;
     char          pktBuf[bufsize];
@@ -300,7 +920,7 @@ void fmtpRecvv3::mcastBOPHandler(const FmtpHeader& header)
     }
 
     checkPayloadLen(header, nbytes);
-    BOPHandler(header, pktBuf + FMTP_HEADER_LEN);
+    (void)BOPHandler(header, pktBuf + FMTP_HEADER_LEN);
 
     /**
      * detects completely missing products by checking the consistency
@@ -310,13 +930,104 @@ void fmtpRecvv3::mcastBOPHandler(const FmtpHeader& header)
 }
 
 
+/**
+ * Handles a multicast BOP continuation given its peeked-at and decoded FMTP
+ * header. The carried part of the metadata is appended to the pending BOP of
+ * the product. Once the metadata is complete, the product is initialized. A
+ * continuation that doesn't follow the previously received part means a
+ * continuation was lost, in which case the whole BOP is requested.
+ * Continuations of a product whose BOP wasn't received are discarded; the
+ * missing BOP is detected by the product's data or EOP packets.
+ *
+ * @pre                       The multicast socket contains a FMTP BOP_CONT
+ *                            packet.
+ * @param[in] header          The associated, peeked-at and already-decoded
+ *                            FMTP header.
+ * @throw std::runtime_error  if an error occurs while reading the socket.
+ * @throw std::runtime_error  if the packet is invalid.
+ */
+void fmtpRecvv3::mcastBOPContHandler(const FmtpHeader& header)
+{
+    char          pktBuf[MAX_FMTP_PACKET_LEN];
+    const ssize_t nbytes = recv(mcastSock, pktBuf, sizeof(pktBuf), 0);
+
+    if (nbytes < 0) {
+        throw std::runtime_error("fmtpRecvv3::mcastBOPContHandler() recv() "
+                "less than zero bytes.");
+    }
+    checkPayloadLen(header, nbytes);
+
+    BOPAssembly assembly;
+    {
+        std::unique_lock<std::mutex> lock(bopassemblymtx);
+        BOPAssemblyMap::iterator it = bopassembly.find(header.prodindex);
+        if (it == bopassembly.end()) {
+            return;
+        }
+        BOPAssembly& pending = it->second;
+        if (header.seqnum == pending.received &&
+                header.payloadlen <= pending.metadata.size() - pending.received) {
+            (void)memcpy(pending.metadata.data() + pending.received,
+                         pktBuf + FMTP_HEADER_LEN, header.payloadlen);
+            pending.received += header.payloadlen;
+            if (pending.received < pending.metadata.size()) {
+                return;
+            }
+            assembly = std::move(pending);
+            bopassembly.erase(it);
+        }
+        else {
+            lock.unlock();
+            (void)reqBOPifPartial(header.prodindex);
+            return;
+        }
+    }
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "[MCAST BOP] Product #" +
+            std::to_string(header.prodindex);
+        debugmsg += ": BOP metadata reassembled from continuations.";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    (void)initProduct(header.prodindex, assembly.prodsize,
+                      assembly.metadata.data(), assembly.metadata.size());
+    if (assembly.submitted) {
+        noteSubmitted(header.prodindex, assembly.submitted);
+    }
+}
+
+
+/**
+ * Abandons the reassembly of a BOP whose continuation was lost and requests
+ * the whole BOP over the retransmission connection instead.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @return               True if a reassembly was pending. Otherwise, false.
+ */
+bool fmtpRecvv3::reqBOPifPartial(const uint32_t prodindex)
+{
+    {
+        std::unique_lock<std::mutex> lock(bopassemblymtx);
+        if (!bopassembly.erase(prodindex)) {
+            return false;
+        }
+    }
+    if (addUnrqBOPinSet(prodindex)) {
+        pushMissingBopReq(prodindex);
+    }
+    return true;
+}
+
+
 /**
  * Handles a retransmitted BOP message given its FMTP header.
  *
  * @param[in] header           Header associated with the packet.
  * @param[in] FmtpPacketData  Pointer to payload of FMTP packet.
+ * @return                     Whether the BOP bound a staged product.
  */
-void fmtpRecvv3::retxBOPHandler(const FmtpHeader& header,
+bool fmtpRecvv3::retxBOPHandler(const FmtpHeader& header,
                                  const char* const  FmtpPacketData)
 {
     #ifdef MODBASE
@@ -325,81 +1036,146 @@ void fmtpRecvv3::retxBOPHandler(const FmtpHeader& header,
         uint32_t tmpidx = header.prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "[RETX BOP] Product #" +
             std::to_string(tmpidx);
         debugmsg += ": BOP received from unicast.";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 
-    BOPHandler(header, FmtpPacketData);
+    return BOPHandler(header, FmtpPacketData);
 }
 
 
 /**
- * Parse BOP message and call notifier to notify receiving application.
+ * Parse BOP message and call notifier to notify receiving application. A
+ * multicast BOP whose metadata continues in BOP continuation packets is kept
+ * until the rest of the metadata has arrived.
  *
  * @param[in] header           Header associated with the packet.
  * @param[in] FmtpPacketData  Pointer to payload of FMTP packet.
+ * @return                     Whether the BOP bound a staged product.
  * @throw std::runtime_error   if the payload is too small.
  * @throw std::runtime_error   if the amount of metadata is invalid.
  */
-void fmtpRecvv3::BOPHandler(const FmtpHeader& header,
+bool fmtpRecvv3::BOPHandler(const FmtpHeader& header,
                             const char* const  FmtpPacketData)
 {
-    void*    prodptr = NULL;
-    BOPMsg   BOPmsg;
+    uint32_t prodsize;
+    uint16_t metasize;
     /**
      * Every time a new BOP arrives, save the msg to check following data
      * packets
      */
-    size_t BOPCONST = sizeof(BOPmsg.prodsize) + sizeof(BOPmsg.metasize);
+    size_t BOPCONST = sizeof(prodsize) + sizeof(metasize);
     if (header.payloadlen < BOPCONST) {
         throw std::runtime_error("fmtpRecvv3::BOPHandler(): packet too small");
     }
-    const unsigned char* wire = (unsigned char*)FmtpPacketData;
-    BOPmsg.prodsize = ntohl(*(uint32_t*)wire);
-    wire += sizeof(BOPmsg.prodsize);
-    BOPmsg.metasize = ntohs(*(uint16_t*)wire);
-    wire += sizeof(BOPmsg.metasize);
-    if ((header.payloadlen - BOPCONST) != BOPmsg.metasize) {
+    const char* wire = FmtpPacketData;
+    prodsize = ntohl(*(uint32_t*)wire);
+    wire += sizeof(prodsize);
+    metasize = ntohs(*(uint16_t*)wire);
+    wire += sizeof(metasize);
+
+    const size_t carried = header.payloadlen - BOPCONST;
+    if (carried > metasize || (carried < metasize &&
+            (header.flags != FMTP_BOP || carried != AVAIL_BOP_LEN))) {
         throw std::runtime_error("fmtpRecvv3::BOPHandler(): metasize "
                 "mismatched payload indicated by header");
     }
-    (void)memcpy(BOPmsg.metadata, wire, BOPmsg.metasize);
 
-    /**
-     * Here a strict check is performed to make sure the information in
-     * trackermap and BlockMNG would not be overwritten by duplicate BOP.
-     * By design, a product should exist in both the trackermap and
-     * BlockMNG or neither, which is the condition of executing all the
-     * initialization. Also, notify_of_bop() will only be called for a
-     * fresh new BOP. All the duplicate calls will be suppressed.
-     */
-    bool insertion = pSegMNG->addProd(header.prodindex, BOPmsg.prodsize);
+    if (carried < metasize) {
+        /**
+         * The rest of the metadata follows in BOP continuation packets. A
+         * duplicate BOP of a product being received is ignored.
+         */
+        bool inTracker;
+        {
+            std::unique_lock<std::mutex> lock(trackermtx);
+            inTracker = trackermap.count(header.prodindex);
+        }
+        if (!inTracker) {
+            std::unique_lock<std::mutex> lock(bopassemblymtx);
+            if (!bopassembly.count(header.prodindex)) {
+                BOPAssembly& assembly = bopassembly[header.prodindex];
+                assembly.prodsize = prodsize;
+                assembly.metadata.resize(metasize);
+                (void)memcpy(assembly.metadata.data(), wire, carried);
+                assembly.received = carried;
+            }
+        }
+        return false;
+    }
+
+    return initProduct(header.prodindex, prodsize, (char*)wire, metasize);
+}
+
+
+/**
+ * Initializes the reception of a product whose BOP is complete. Here a strict
+ * check is performed to make sure the information in trackermap and BlockMNG
+ * would not be overwritten by duplicate BOP. By design, a product should
+ * exist in both the trackermap and BlockMNG or neither, which is the
+ * condition of executing all the initialization. Also, notify_of_bop() will
+ * only be called for a fresh new BOP. All the duplicate calls will be
+ * suppressed.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] prodsize   Size of the product in bytes.
+ * @param[in] metadata   Metadata of the product.
+ * @param[in] metasize   Size of the metadata in bytes.
+ * @return               Whether the BOP bound a staged product.
+ * @throw std::runtime_error  if the product can't be tracked.
+ */
+bool fmtpRecvv3::initProduct(const uint32_t prodindex,
+                             const uint32_t prodsize,
+                             char* const    metadata,
+                             const uint16_t metasize)
+{
+    void* prodptr = NULL;
+
+    if (trace) {
+        trace->record(TRACE_BOP_RECVD, prodindex, prodsize);
+    }
+
+    /* a complete BOP makes any pending reassembly obsolete */
+    {
+        std::unique_lock<std::mutex> lock(bopassemblymtx);
+        bopassembly.erase(prodindex);
+    }
+
+    if (bindStagedProduct(prodindex, prodsize, metadata, metasize)) {
+        counters.add(RECV_BOPS);
+        return true;
+    }
+
+    bool insertion = pSegMNG->addProd(prodindex, prodsize);
     bool inTracker;
     {
         std::unique_lock<std::mutex> lock(trackermtx);
-        inTracker = trackermap.count(header.prodindex);
+        inTracker = trackermap.count(prodindex);
     }
     if (insertion && !inTracker) {
+        counters.add(RECV_BOPS);
         if(notifier) {
-            notifier->notify_of_bop(header.prodindex, BOPmsg.prodsize,
-                    BOPmsg.metadata, BOPmsg.metasize, &prodptr);
+            notifier->notify_of_bop(prodindex, prodsize, metadata, metasize,
+                                    &prodptr);
         }
 
         /* Atomic insertion for BOP of new product */
         {
-            ProdTracker tracker = {BOPmsg.prodsize, prodptr, 0, 0};
+            ProdTracker tracker{};
+            tracker.prodsize = prodsize;
+            tracker.prodptr  = prodptr;
+            tracker.start    = std::chrono::steady_clock::now();
             std::unique_lock<std::mutex> lock(trackermtx);
-            trackermap[header.prodindex] = tracker;
+            trackermap[prodindex] = tracker;
         }
 
         /* forcibly terminate the previous timer */
-        timerWake.notify_all();
+        wakeTimer();
 
-        initEOPStatus(header.prodindex);
+        initEOPStatus(prodindex);
 
         /**
          * Since the receiver timer starts after BOP is received, the RTT is not
@@ -412,56 +1188,229 @@ void fmtpRecvv3::BOPHandler(const FmtpHeader& header,
         double sleeptime = 0.0;
         {
             std::unique_lock<std::mutex> lock(trackermtx);
-            if (trackermap.count(header.prodindex)) {
+            if (trackermap.count(prodindex)) {
                 sleeptime =
-                    Frcv * ((double)trackermap[header.prodindex].prodsize /
+                    Frcv * ((double)trackermap[prodindex].prodsize /
                     (double)linkspeed);
             }
             else {
-                throw std::runtime_error("fmtpRecvv3::BOPHandler(): "
+                throw std::runtime_error("fmtpRecvv3::initProduct(): "
                         "Error accessing newly added BOP in trackermap.");
             }
         }
         /* add the new product into timer queue */
-        {
-            std::unique_lock<std::mutex> lock(timerQmtx);
-            timerParam timerparam = {header.prodindex, sleeptime};
-            timerParamQ.push(timerparam);
-            timerQfilled.notify_all();
-        }
+        startTimer(prodindex, sleeptime);
     }
     else {
-        std::cout << "fmtpRecvv3::BOPHandler(): duplicate BOP for product #"
-            << header.prodindex << "received." << std::endl;
+        counters.add(RECV_DUPBOPS);
+        if (logger->enabled(LOGLVL_DEBUG))
+            logger->write(LOGLVL_DEBUG, "fmtpRecvv3::initProduct(): duplicate "
+                    "BOP for product #" + std::to_string(prodindex) +
+                    " received.");
     }
 
     #ifdef MODBASE
-        uint32_t tmpidx = header.prodindex % MODBASE;
+        uint32_t tmpidx = prodindex % MODBASE;
     #else
-        uint32_t tmpidx = header.prodindex;
+        uint32_t tmpidx = prodindex;
     #endif
 
     #ifdef MEASURE
-        {
-            std::unique_lock<std::mutex> lock(trackermtx);
-            if (trackermap.count(header.prodindex)) {
-                ProdTracker tracker = trackermap[header.prodindex];
-                measure->insert(header.prodindex, tracker.prodsize);
-            }
-            else {
-                throw std::runtime_error("fmtpRecvv3::BOPHandler(): "
-                        "[Measure] Error accessing newly added BOP");
-            }
-        }
         std::string measuremsg = "[MEASURE] Product #" +
             std::to_string(tmpidx);
         measuremsg += ": BOP is received. Product size = ";
-        measuremsg += std::to_string(BOPmsg.prodsize);
+        measuremsg += std::to_string(prodsize);
         measuremsg += ", Metadata size = ";
-        measuremsg += std::to_string(BOPmsg.metasize);
-        std::cout << measuremsg << std::endl;
-        WriteToLog(measuremsg);
+        measuremsg += std::to_string(metasize);
+        logger->write(LOGLVL_INFO, measuremsg);
     #endif
+
+    return false;
+}
+
+
+/**
+ * Binds a product that was staged by self-describing data packets before its
+ * BOP arrived. The receiving application is notified of the BOP as usual, but
+ * the data keeps going to the internal buffer until the product is complete,
+ * when it's copied to the location given by the application. If the EOP has
+ * already arrived, the product is checked for completeness right away. A BOP
+ * that doesn't match the staged product -- by size or by metadata digest --
+ * causes the staged data to be discarded.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] prodsize   Size of the product in bytes.
+ * @param[in] metadata   Metadata of the product.
+ * @param[in] metasize   Size of the metadata in bytes.
+ * @return               Whether the product was staged and is now bound.
+ */
+bool fmtpRecvv3::bindStagedProduct(const uint32_t prodindex,
+                                   const uint32_t prodsize,
+                                   char* const    metadata,
+                                   const uint16_t metasize)
+{
+    uint32_t digest;
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        TrackerMap::iterator it = trackermap.find(prodindex);
+        if (it == trackermap.end() || !it->second.awaitBOP) {
+            return false;
+        }
+        if (it->second.prodsize != prodsize) {
+            digest = ~0u;
+        }
+        else {
+            digest = it->second.digest;
+        }
+    }
+
+    if (digest && digest != metaDigest(metadata, metasize)) {
+        logger->write(LOGLVL_WARNING, "fmtpRecvv3::bindStagedProduct(): BOP "
+                "doesn't match the staged product #" +
+                std::to_string(prodindex) + ", staged data discarded.");
+        (void)pSegMNG->rmProd(prodindex);
+        releaseStaged(prodindex, false);
+        {
+            std::unique_lock<std::mutex> lock(trackermtx);
+            trackermap.erase(prodindex);
+        }
+        clearEOPStatus(prodindex);
+        return false;
+    }
+
+    void* prodptr = NULL;
+    if (notifier) {
+        notifier->notify_of_bop(prodindex, prodsize, metadata, metasize,
+                                &prodptr);
+    }
+
+    bool hasEOP;
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        ProdTracker& tracker = trackermap[prodindex];
+        tracker.appptr   = prodptr;
+        tracker.awaitBOP = false;
+        /* read under the lock that EOPHandler() sets the status under */
+        hasEOP = getEOPStatus(prodindex);
+    }
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "[MSG] Product #" + std::to_string(prodindex);
+        debugmsg += ": staged product bound to its BOP";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    wakeTimer();
+    startTimer(prodindex, Frcv * ((double)prodsize / (double)linkspeed));
+
+    if (hasEOP) {
+        FmtpHeader header = {prodindex, 0, 0, FMTP_EOP};
+        EOPHandler(header);
+    }
+    return true;
+}
+
+
+/**
+ * Returns whether a product was staged by self-describing data packets and
+ * still waits for its BOP.
+ *
+ * @param[in] prodindex  Index of the product.
+ */
+bool fmtpRecvv3::awaitingBOP(const uint32_t prodindex)
+{
+    std::unique_lock<std::mutex> lock(trackermtx);
+    TrackerMap::iterator it = trackermap.find(prodindex);
+    return it != trackermap.end() && it->second.awaitBOP;
+}
+
+
+/**
+ * Releases the internal buffer of a staged product. If requested, the product
+ * is copied to the location given by the receiving application first.
+ * Nothing is done for a product that wasn't staged.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] deliver    Whether to copy the product out.
+ */
+void fmtpRecvv3::releaseStaged(const uint32_t prodindex, const bool deliver)
+{
+    std::unique_lock<std::mutex> lock(trackermtx);
+    TrackerMap::iterator it = trackermap.find(prodindex);
+    if (it == trackermap.end() || it->second.stageptr == NULL) {
+        return;
+    }
+
+    ProdTracker& tracker = it->second;
+    if (deliver && tracker.appptr) {
+        (void)memcpy(tracker.appptr, tracker.stageptr, tracker.prodsize);
+    }
+    delete[] tracker.stageptr;
+    tracker.stageptr = NULL;
+    tracker.prodptr  = tracker.appptr;
+}
+
+
+/**
+ * Starts storing a product announced by a self-describing data packet whose
+ * BOP hasn't arrived. The data is stored in an internal buffer until the BOP
+ * is bound to the product, which is requested here together with the BOPs
+ * of any products missed before it. Only products newer than the most recent
+ * one seen on multicast, or whose BOP is partially received, are staged so
+ * that late duplicates of finished products aren't received again.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] ext        Decoded extension of the data packet.
+ * @return               Whether the product is now staged.
+ */
+bool fmtpRecvv3::stageProduct(const uint32_t prodindex, const DataExt& ext)
+{
+    if (ext.prodsize == 0 || ext.prodsize > STAGE_MAX_PRODSIZE) {
+        return false;
+    }
+
+    const bool isNew = (int32_t)(prodindex - prodidx_mcast) > 0;
+    bool       partial;
+    {
+        std::unique_lock<std::mutex> lock(bopassemblymtx);
+        partial = bopassembly.count(prodindex);
+    }
+    if (!isNew && !partial) {
+        return false;
+    }
+    if (!pSegMNG->addProd(prodindex, ext.prodsize)) {
+        return false;
+    }
+
+    ProdTracker tracker{};
+    tracker.prodsize = ext.prodsize;
+    tracker.stageptr = new char[ext.prodsize];
+    tracker.prodptr  = tracker.stageptr;
+    tracker.awaitBOP = true;
+    tracker.digest   = ext.metadigest;
+    tracker.start    = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        trackermap[prodindex] = tracker;
+    }
+    initEOPStatus(prodindex);
+
+    if (!reqBOPifPartial(prodindex)) {
+        (void)requestMissingBopsExclusive(prodindex);
+        if (addUnrqBOPinSet(prodindex)) {
+            pushMissingBopReq(prodindex);
+        }
+    }
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "[MCAST DATA] Product #" +
+            std::to_string(prodindex);
+        debugmsg += ": staged before its BOP, size = ";
+        debugmsg += std::to_string(ext.prodsize);
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    return true;
 }
 
 
@@ -475,22 +1424,147 @@ void fmtpRecvv3::BOPHandler(const FmtpHeader& header,
  */
 void fmtpRecvv3::checkPayloadLen(const FmtpHeader& header, const size_t nbytes)
 {
-    if (header.payloadlen != nbytes - FMTP_HEADER_LEN) {
-        throw std::runtime_error("fmtpRecvv3::checkPayloadLen(): "
-                "Invalid payload length");
-    }
+    if (header.payloadlen != nbytes - FMTP_HEADER_LEN) {
+        throw std::runtime_error("fmtpRecvv3::checkPayloadLen(): "
+                "Invalid payload length");
+    }
+}
+
+
+/**
+ * Clears the EOP arrival status.
+ *
+ * @param[in] prodindex    Product index which the EOP belongs to.
+ */
+void fmtpRecvv3::clearEOPStatus(const uint32_t prodindex)
+{
+    std::unique_lock<std::mutex> lock(EOPmapmtx);
+    EOPmap.erase(prodindex);
+}
+
+
+/**
+ * Counts a multicast packet that was peeked at and picks up the number of
+ * datagrams the kernel has dropped on the multicast socket so far, which is
+ * attached to the packet only if there were drops. The receive buffer is
+ * grown if the count went up. Also measures the multicast rate over windows
+ * of a tenth of a second and, if the packet has a receive timestamp, the
+ * time it waited in the host.
+ *
+ * @param[in] msg     The message header filled in by `recvmsg()`.
+ * @param[in] header  The decoded header of the packet.
+ */
+void fmtpRecvv3::countMcastPacket(struct msghdr& msg, const FmtpHeader& header)
+{
+    const size_t bytes = FMTP_HEADER_LEN + header.payloadlen;
+    counters.add(RECV_MCASTPKTS);
+    counters.add(RECV_MCASTBYTES, bytes);
+    mcastRxNs = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            (void)memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (kerneldrops.exchange(drops, std::memory_order_relaxed) !=
+                    drops)
+                growRcvBuf();
+        }
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            /* software, legacy and raw hardware timestamps */
+            struct timespec ts[3];
+            (void)memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+            const struct timespec& rx = (ts[2].tv_sec || ts[2].tv_nsec) ?
+                                        ts[2] : ts[0];
+            mcastRxNs = (uint64_t)rx.tv_sec * 1000000000u + rx.tv_nsec;
+        }
+    }
+    if (mcastRxNs) {
+        const uint64_t now = wallClockNs();
+        if (now >= mcastRxNs)
+            delay[DELAY_HOST].record(now - mcastRxNs);
+    }
+
+    ratewinbytes += bytes;
+    /* reading the clock for every packet would be a waste */
+    if ((ratewinpkts++ & 0x3f) == 0) {
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        const double elapsed =
+            std::chrono::duration<double>(now - ratewinstart).count();
+        if (elapsed >= 0.1) {
+            observedrate.store(ratewinbytes * 8 / elapsed,
+                               std::memory_order_relaxed);
+            ratewinbytes = 0;
+            ratewinstart = now;
+        }
+    }
+}
+
+
+/**
+ * Sets the receive buffer size of the multicast socket. The size is forced
+ * beyond the system limit if the process is privileged. The size the kernel
+ * actually uses is recorded.
+ *
+ * @param[in] bytes  The requested size.
+ * @throw std::runtime_error  if the size couldn't be set.
+ */
+void fmtpRecvv3::setRcvBuf(int bytes)
+{
+    if (setsockopt(mcastSock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes,
+                   sizeof(bytes)) < 0 &&
+            setsockopt(mcastSock, SOL_SOCKET, SO_RCVBUF, &bytes,
+                       sizeof(bytes)) < 0) {
+        throw std::runtime_error("fmtpRecvv3::setRcvBuf() setsockopt() "
+                "SO_RCVBUF failed.");
+    }
+    rcvbufreq = bytes;
+
+    int       actual;
+    socklen_t len = sizeof(actual);
+    if (getsockopt(mcastSock, SOL_SOCKET, SO_RCVBUF, &actual, &len) == 0)
+        rcvbuf.store(actual, std::memory_order_relaxed);
 }
 
 
 /**
- * Clears the EOP arrival status.
- *
- * @param[in] prodindex    Product index which the EOP belongs to.
+ * Grows the receive buffer of the multicast socket after the kernel dropped
+ * packets: doubles it, or sizes it for a burst at the observed rate if that is
+ * larger, up to the configured maximum. The buffer is grown at most once per
+ * burst duration so that the drops of a single burst don't inflate it.
  */
-void fmtpRecvv3::clearEOPStatus(const uint32_t prodindex)
+void fmtpRecvv3::growRcvBuf()
 {
-    std::unique_lock<std::mutex> lock(EOPmapmtx);
-    EOPmap.erase(prodindex);
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (rcvbufreq >= rcvbufmax || (rcvbufgrowths.load() &&
+            std::chrono::duration<double>(now - rcvbufgrown).count() <
+            rcvbufburst))
+        return;
+
+    double bytes = observedrate.load(std::memory_order_relaxed) / 8.0 *
+        rcvbufburst;
+    if (bytes < 2.0 * rcvbufreq)
+        bytes = 2.0 * rcvbufreq;
+    if (bytes > rcvbufmax)
+        bytes = rcvbufmax;
+
+    try {
+        setRcvBuf(static_cast<int>(bytes));
+    }
+    catch (const std::runtime_error&) {
+        return; // the buffer keeps its size
+    }
+    rcvbufgrown = now;
+    rcvbufgrowths.fetch_add(1, std::memory_order_relaxed);
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Receive buffer grown to " +
+            std::to_string(rcvbuf.load()) + " bytes after kernel drops";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 }
 
 
@@ -541,6 +1615,23 @@ void fmtpRecvv3::decodeHeader(char* const  packet, FmtpHeader& header)
  */
 void fmtpRecvv3::EOPHandler(const FmtpHeader& header)
 {
+    if (trace) {
+        trace->record(TRACE_EOP_RECVD, header.prodindex);
+    }
+
+    /**
+     * A staged product can't be finished before its BOP is bound, which
+     * checks the EOP status set here, see bindStagedProduct().
+     */
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        TrackerMap::iterator it = trackermap.find(header.prodindex);
+        if (it != trackermap.end() && it->second.awaitBOP) {
+            setEOPStatus(header.prodindex);
+            return;
+        }
+    }
+
     /**
      * if segmap check tells everything is completed, then sends the
      * RETX_END message back to sender. Meanwhile notify receiving
@@ -548,10 +1639,24 @@ void fmtpRecvv3::EOPHandler(const FmtpHeader& header)
      */
     if (pSegMNG->delIfComplete(header.prodindex)) {
         sendRetxEnd(header.prodindex);
-        bool inTracker;
+        releaseStaged(header.prodindex, true);
+        /**
+         * The tracker goes first so that no late multicast packet is
+         * written to the product once the application owns it again.
+         */
+        bool        inTracker = false;
+        ProdTracker tracker;
         {
             std::unique_lock<std::mutex> lock(trackermtx);
-            inTracker = trackermap.count(header.prodindex);
+            TrackerMap::iterator it = trackermap.find(header.prodindex);
+            if (it != trackermap.end()) {
+                tracker   = it->second;
+                inTracker = true;
+                trackermap.erase(it);
+            }
+        }
+        if (inTracker) {
+            recordCompletion(header.prodindex, tracker);
         }
         if (notifier && inTracker) {
             notifier->notify_of_eop(header.prodindex);
@@ -568,47 +1673,18 @@ void fmtpRecvv3::EOPHandler(const FmtpHeader& header)
             notify_cv.notify_one();
         }
 
-        {
-            std::unique_lock<std::mutex> lock(trackermtx);
-            trackermap.erase(header.prodindex);
-        }
-
         #ifdef MODBASE
             uint32_t tmpidx = header.prodindex % MODBASE;
         #else
             uint32_t tmpidx = header.prodindex;
         #endif
 
-        #ifdef DEBUG2
-            std::string debugmsg = "[MSG] Product #" +
-                std::to_string(tmpidx);
-            debugmsg += " has been completely received";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #elif DEBUG1
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "[MSG] Product #" +
                 std::to_string(tmpidx);
             debugmsg += " has been completely received";
-            std::cout << debugmsg << std::endl;
-        #endif
-
-        #ifdef MEASURE
-            uint32_t bytes = measure->getsize(header.prodindex);
-            std::string measuremsg = "[SUCCESS] Product #" +
-                std::to_string(tmpidx);
-            measuremsg += ": product received, size = ";
-            measuremsg += std::to_string(bytes);
-            measuremsg += " bytes, elapsed time = ";
-            measuremsg += measure->gettime(header.prodindex);
-            measuremsg += " seconds.";
-            if (measure->getEOPmiss(header.prodindex)) {
-                measuremsg += " EOP is retransmitted";
-            }
-            std::cout << measuremsg << std::endl;
-            WriteToLog(measuremsg);
-            /* remove the measurement if completely received */
-            measure->remove(header.prodindex);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
     else {
         /**
@@ -670,7 +1746,8 @@ void fmtpRecvv3::initEOPStatus(const uint32_t prodindex)
 
 
 /**
- * Join multicast group specified by mcastAddr:mcastPort.
+ * Joins the multicast group specified by mcastAddr:mcastPort through the
+ * transport and configures the socket.
  *
  * @param[in] mcastAddr      Udp multicast address for receiving data products.
  * @param[in] mcastPort      Udp multicast port for receiving data products.
@@ -682,25 +1759,71 @@ void fmtpRecvv3::joinGroup(
         std::string          mcastAddr,
         const unsigned short mcastPort)
 {
-    (void) memset(&mcastgroup, 0, sizeof(mcastgroup));
-    mcastgroup.sin_family = AF_INET;
-    // mcastgroup.sin_addr.s_addr = htonl(INADDR_ANY);
-    mcastgroup.sin_port = htons(mcastPort);
-    mcastgroup.sin_addr.s_addr = inet_addr(mcastAddr.c_str());
-    if((mcastSock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        throw std::runtime_error("fmtpRecvv3::joinGroup() creating socket failed");
+    mcastSock = transport->openMcastRecv(mcastAddr, mcastPort, ifAddr);
+    /* have the kernel report the datagrams it drops for lack of buffer */
+    const int on = 1;
+    if (setsockopt(mcastSock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) {
+        throw std::runtime_error("fmtpRecvv3::joinGroup() setsockopt() "
+                "SO_RXQ_OVFL failed.");
+    }
+    /* size the receive buffer for a burst at the link speed */
+    double bytes;
+    {
+        std::unique_lock<std::mutex> lock(linkmtx);
+        bytes = linkspeed / 8.0 * rcvbufburst;
+    }
+    if (bytes < MAX_FMTP_PACKET_LEN)
+        bytes = MAX_FMTP_PACKET_LEN;
+    if (bytes > rcvbufmax)
+        bytes = rcvbufmax;
+    setRcvBuf(static_cast<int>(bytes));
+
+    /* the receiver works without timestamps, it just can't measure delays */
+    if (rxtimestamps) {
+        const int flags = SOF_TIMESTAMPING_RX_SOFTWARE |
+                          SOF_TIMESTAMPING_SOFTWARE |
+                          SOF_TIMESTAMPING_RX_HARDWARE |
+                          SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (setsockopt(mcastSock, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                       sizeof(flags)) < 0) {
+            logger->write(LOGLVL_WARNING, "fmtpRecvv3::joinGroup() "
+                    "setsockopt() SO_TIMESTAMPING failed, packet delays "
+                    "won't be measured.");
+            rxtimestamps = false;
+        }
     }
-    if (::bind(mcastSock, (struct sockaddr *) &mcastgroup, sizeof(mcastgroup))
-            < 0) {
-        throw std::runtime_error("fmtprecvv3::joingroup(): couldn't bind socket "
-                " to multicast group " + mcastgroup);
+
+    /* the kernel's busy polling is an optimization, it's fine without it */
+    if (busypoll && busypollusecs) {
+        (void)setsockopt(mcastSock, SOL_SOCKET, SO_BUSY_POLL, &busypollusecs,
+                         sizeof(busypollusecs));
+        #ifdef SO_PREFER_BUSY_POLL
+            (void)setsockopt(mcastSock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on,
+                             sizeof(on));
+        #endif
     }
-    mreq.imr_multiaddr.s_addr = inet_addr(mcastAddr.c_str());
-    mreq.imr_interface.s_addr = inet_addr(ifAddr.c_str());
-    if( setsockopt(mcastSock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
-                   sizeof(mreq)) < 0 ) {
-        throw std::runtime_error("fmtpRecvv3::joinGroup() setsockopt() add "
-                "membership failed.");
+}
+
+
+/**
+ * Peeks at the header of the next multicast packet. In the busy-poll mode,
+ * spins on non-blocking reads until a packet arrives; the thread can be
+ * canceled while it spins.
+ *
+ * @param[out] msg  The message header to receive into.
+ * @return          What `recvmsg()` returned.
+ */
+ssize_t fmtpRecvv3::peekMcastPacket(struct msghdr& msg)
+{
+    if (!busypoll)
+        return recvmsg(mcastSock, &msg, MSG_PEEK);
+
+    for (;;) {
+        const ssize_t nbytes = recvmsg(mcastSock, &msg,
+                                       MSG_PEEK | MSG_DONTWAIT);
+        if (nbytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return nbytes;
+        pthread_testcancel();
     }
 }
 
@@ -709,8 +1832,10 @@ void fmtpRecvv3::joinGroup(
  * Handles multicast packets. To avoid extra copying operations, here recv()
  * is called with a MSG_PEEK flag to only peek the header instead of reading
  * it out (which would cause the buffer to be wiped). And the recv() call
- * will block if there is no data coming to the mcastSock.
+ * will block if there is no data coming to the mcastSock, unless the receiver
+ * is in the busy-poll mode, in which the thread spins instead.
  *
+ * @throw std::runtime_error   if the thread can't be pinned to its CPU.
  * @throw std::runtime_error   if an I/O error occurs.
  * @throw std::runtime_error  if a packet is invalid.
  * @throw std::runtime_error  Receiving application error.
@@ -718,65 +1843,284 @@ void fmtpRecvv3::joinGroup(
  */
 void fmtpRecvv3::mcastHandler()
 {
-    static bool started = false; // Has this method been called?
+    placement.apply(ROLE_MCAST);
+
+    if (busypoll && busypollcpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(busypollcpu, &cpus);
+        const int status = pthread_setaffinity_np(pthread_self(),
+                                                  sizeof(cpus), &cpus);
+        if (status) {
+            throw std::runtime_error("fmtpRecvv3::mcastHandler() Couldn't "
+                    "pin multicast thread to CPU " +
+                    std::to_string(busypollcpu));
+        }
+    }
+
     while(1)
-    {
-        FmtpHeader   header;
-        /* 
-         * Coverity Scan #1: Issue 5: Medium risk, coverity interprets recv() as "tainting" header object. 
-         * If my understanding is correct, Coverity sees the recv() changing the header object as an error,
-         * however this is simply the way that the recv() function works (a limitation of C++'s inability to return
-         * more than one return value).
-         */
-        
-	const ssize_t nbytes = recv(mcastSock, &header, sizeof(header),
-                                    MSG_PEEK);
-        /*
-         * Allow the current thread to be cancelled only when it is likely
-         * blocked attempting to read from the multicast socket because that
-         * prevents the receiver from being put into an inconsistent state yet
-         * allows for fast termination.
+        (void)handleMcastPacket(false);
+}
+
+
+/**
+ * Handles the next multicast packet: peeks at its header and reads it with
+ * the handler of its type.
+ *
+ * @param[in] nonblocking  Whether to return instead of waiting if no packet
+ *                         is queued on the socket.
+ * @retval    true         A packet was handled.
+ * @retval    false        No packet was queued (non-blocking only).
+ * @throw std::runtime_error  if an I/O error occurs.
+ * @throw std::runtime_error  if a packet is invalid.
+ * @throw std::runtime_error  Receiving application error.
+ * @throw std::out_of_range   The notifier doesn't know about the product-index.
+ */
+bool fmtpRecvv3::handleMcastPacket(const bool nonblocking)
+{
+    FmtpHeader   header;
+    /* 
+     * Coverity Scan #1: Issue 5: Medium risk, coverity interprets recv() as "tainting" header object. 
+     * If my understanding is correct, Coverity sees the recv() changing the header object as an error,
+     * however this is simply the way that the recv() function works (a limitation of C++'s inability to return
+     * more than one return value).
+     */
+    
+    /* room for the kernel drop count and the receive timestamps */
+    union {
+        char           buf[CMSG_SPACE(sizeof(uint32_t)) +
+                           CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec  iov = {&header, sizeof(header)};
+    struct msghdr msg = {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    const ssize_t nbytes = nonblocking ?
+            recvmsg(mcastSock, &msg, MSG_PEEK | MSG_DONTWAIT) :
+            peekMcastPacket(msg);
+    if (nbytes < 0 && nonblocking &&
+            (errno == EAGAIN || errno == EWOULDBLOCK))
+        return false;
+    /*
+     * Allow the current thread to be cancelled only when it is likely
+     * blocked attempting to read from the multicast socket because that
+     * prevents the receiver from being put into an inconsistent state yet
+     * allows for fast termination.
+     */
+    int initState;
+    (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &initState);
+
+    if (nbytes < 0) {
+        throw std::runtime_error("fmtpRecvv3::mcastHandler() recv() less "
+                "than zero bytes.");
+    }
+    if (nbytes != sizeof(header)) {
+        throw std::runtime_error("fmtpRecvv3::mcastHandler() Invalid packet "
+                "length.");
+    }
+    decodeHeader(header);
+    const uint64_t sent = (header.flags & FMTP_TIMESTAMPED) ?
+                          readTimestamp(header) : 0;
+    if (injector && injector->decide(header) == FAULT_DROP) {
+        char pktBuf[MAX_FMTP_PACKET_LEN];
+        (void)recv(mcastSock, pktBuf, sizeof(pktBuf), 0);
+        int ignoredState;
+        (void)pthread_setcancelstate(initState, &ignoredState);
+        return true;
+    }
+    countMcastPacket(msg, header);
+    if (sent) {
+        counters.add(RECV_MCASTBYTES, TIMESTAMP_LEN);
+        if (mcastRxNs && mcastRxNs >= sent)
+            delay[DELAY_NETWORK].record(mcastRxNs - sent);
+    }
+
+    if (!mcastStarted) {
+        /**
+         * every product of a first aggregate envelope is new, and so is
+         * the product of a first self-describing data packet
          */
-        int initState;
-        (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &initState);
+        prodidx_mcast = (header.flags == FMTP_AGGR_DATA ||
+                         header.flags == FMTP_MEM_DATA_EXT) ?
+                        header.prodindex - 1 : header.prodindex;
+        mcastStarted = true;
+    }
 
-        if (nbytes < 0) {
-            throw std::runtime_error("fmtpRecvv3::mcastHandler() recv() less "
-                    "than zero bytes.");
-        }
-        if (nbytes != sizeof(header)) {
-            throw std::runtime_error("fmtpRecvv3::mcastHandler() Invalid packet "
-                    "length.");
+    if (header.flags == FMTP_BOP) {
+        mcastBOPHandler(header);
+        if (sent) {
+            noteSubmitted(header.prodindex, sent);
         }
+    }
+    else if (header.flags == FMTP_MEM_DATA ||
+             header.flags == FMTP_MEM_DATA_EXT) {
+        recvMemData(header);
+    }
+    else if (header.flags == FMTP_EOP) {
+        counters.add(RECV_EOPS);
+        mcastEOPHandler(header);
+    }
+    else if (header.flags == FMTP_BOP_CONT) {
+        mcastBOPContHandler(header);
+    }
+    else if (header.flags == FMTP_AGGR_DATA) {
+        mcastAggrHandler(header);
+    }
+    else {
+        /* discards an unknown packet so that it isn't peeked at forever */
+        char pktBuf[MAX_FMTP_PACKET_LEN];
+        (void)recv(mcastSock, pktBuf, sizeof(pktBuf), 0);
+    }
+
+    int ignoredState;
+    (void)pthread_setcancelstate(initState, &ignoredState);
+    return true;
+}
 
-        decodeHeader(header);
 
-        if (!started) {
-            prodidx_mcast = header.prodindex;
-            started = true;
+/**
+ * Handles an aggregate envelope from the multicast thread. The envelope holds
+ * `header.seqnum` consecutive small products starting at `header.prodindex`.
+ * Products that are new to this receiver are delivered right away and
+ * acknowledged with RETX_END messages that each cover a run of consecutive
+ * products. Products that are already being recovered through the
+ * retransmission path are left to it. Products missed before the envelope
+ * are requested as usual.
+ *
+ * @param[in] header           The associated, already-decoded FMTP header.
+ * @throw std::runtime_error   if an error occurs while reading the socket.
+ * @throw std::runtime_error   if the packet is invalid.
+ */
+void fmtpRecvv3::mcastAggrHandler(const FmtpHeader& header)
+{
+    char          pktBuf[MAX_FMTP_PACKET_LEN];
+    const ssize_t nbytes = recv(mcastSock, pktBuf, sizeof(pktBuf), 0);
+
+    if (nbytes < 0) {
+        throw std::runtime_error("fmtpRecvv3::mcastAggrHandler() recv() less "
+                "than zero bytes.");
+    }
+    checkPayloadLen(header, nbytes);
+
+    /* the most recent product index before this envelope */
+    const uint32_t lastprodidx = prodidx_mcast;
+    if ((int32_t)(header.prodindex - lastprodidx) > 0) {
+        requestMissingBopsExclusive(header.prodindex);
+    }
+
+    const char* wire = pktBuf + FMTP_HEADER_LEN;
+    const char* end  = wire + header.payloadlen;
+    /* the run of consecutive delivered products to acknowledge */
+    uint32_t    runstart = header.prodindex;
+    uint32_t    runlen   = 0;
+
+    for (uint32_t i = 0; i < header.seqnum; ++i) {
+        if (end - wire < AGGR_ENTRY_HEADER_LEN) {
+            throw std::runtime_error("fmtpRecvv3::mcastAggrHandler(): "
+                    "entry header truncated");
         }
+        const uint32_t prodsize = ntohl(*(uint32_t*)wire);
+        wire += sizeof(uint32_t);
+        const uint16_t metasize = ntohs(*(uint16_t*)wire);
+        wire += sizeof(uint16_t);
+        if (end - wire < (ptrdiff_t)metasize + prodsize) {
+            throw std::runtime_error("fmtpRecvv3::mcastAggrHandler(): "
+                    "entry truncated");
+        }
+
+        const uint32_t prodindex = header.prodindex + i;
+        const bool     delivered = ((int32_t)(prodindex - lastprodidx) > 0) &&
+            aggrProdHandler(prodindex, prodsize, (char*)wire, metasize,
+                            wire + metasize);
+        wire += metasize + prodsize;
 
-        if (header.flags == FMTP_BOP) {
-            mcastBOPHandler(header);
+        if (delivered) {
+            if (runlen == 0) {
+                runstart = prodindex;
+            }
+            ++runlen;
         }
-        else if (header.flags == FMTP_MEM_DATA) {
-            #ifdef MEASURE
-                measure->setMcastClock(header.prodindex);
-            #endif
+        else if (runlen) {
+            sendRetxEnd(runstart, runlen);
+            runlen = 0;
+        }
+    }
+    if (runlen) {
+        sendRetxEnd(runstart, runlen);
+    }
+
+    const uint32_t last = header.prodindex + header.seqnum - 1;
+    if (header.seqnum && (int32_t)(last - prodidx_mcast) > 0) {
+        prodidx_mcast = last;
+    }
+}
 
-            recvMemData(header);
+
+/**
+ * Delivers a product received in an aggregate envelope to the receiving
+ * application. A product whose BOP has been requested or which is tracked
+ * already is left to the retransmission path so that it's delivered once.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] prodsize   Size of the product in bytes.
+ * @param[in] metadata   Metadata of the product.
+ * @param[in] metasize   Size of the metadata in bytes.
+ * @param[in] data       The product.
+ * @return               Whether the product was delivered.
+ */
+bool fmtpRecvv3::aggrProdHandler(const uint32_t    prodindex,
+                                 const uint32_t    prodsize,
+                                 char* const       metadata,
+                                 const uint16_t    metasize,
+                                 const char* const data)
+{
+    {
+        std::unique_lock<std::mutex> lock(BOPSetMtx);
+        if (misBOPset.count(prodindex)) {
+            return false;
         }
-        else if (header.flags == FMTP_EOP) {
-            #ifdef MEASURE
-                measure->setMcastClock(header.prodindex);
-            #endif
+    }
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        if (trackermap.count(prodindex)) {
+            return false;
+        }
+    }
 
-            mcastEOPHandler(header);
+    if (notifier) {
+        void* prodptr = NULL;
+        notifier->notify_of_bop(prodindex, prodsize, metadata, metasize,
+                                &prodptr);
+        if (prodptr) {
+            (void)memcpy(prodptr, data, prodsize);
         }
+        notifier->notify_of_eop(prodindex);
+    }
+    else {
+        {
+            std::unique_lock<std::mutex> lock(notifyprodmtx);
+            notifyprodidx = prodindex;
+        }
+        notify_cv.notify_one();
+    }
 
-        int ignoredState;
-        (void)pthread_setcancelstate(initState, &ignoredState);
+    #ifdef MODBASE
+        uint32_t tmpidx = prodindex % MODBASE;
+    #else
+        uint32_t tmpidx = prodindex;
+    #endif
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "[MCAST AGGR] Product #" +
+            std::to_string(tmpidx);
+        debugmsg += " has been completely received";
+        logger->write(LOGLVL_DEBUG, debugmsg);
     }
+
+    return true;
 }
 
 
@@ -807,13 +2151,12 @@ void fmtpRecvv3::mcastEOPHandler(const FmtpHeader& header)
         uint32_t tmpidx = header.prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "[MCAST EOP] Product #" +
             std::to_string(tmpidx);
         debugmsg += ": EOP is received";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 
     bool hasBOP = false;
     {
@@ -824,10 +2167,10 @@ void fmtpRecvv3::mcastEOPHandler(const FmtpHeader& header)
     }
     if (hasBOP) {
         setEOPStatus(header.prodindex);
-        timerWake.notify_all();
+        wakeTimer();
         EOPHandler(header);
     }
-    else {
+    else if (!reqBOPifPartial(header.prodindex)) {
         (void)requestMissingBopsInclusive(header.prodindex);
 #if 0
         /**
@@ -889,6 +2232,7 @@ void fmtpRecvv3::pushMissingBopReq(const uint32_t prodindex)
  */
 void fmtpRecvv3::pushMissingEopReq(const uint32_t prodindex)
 {
+    markRetx(prodindex);
     std::unique_lock<std::mutex> lock(msgQmutex);
     INLReqMsg                    reqmsg = {MISSING_EOP, prodindex, 0, 0};
     msgqueue.push(reqmsg);
@@ -909,12 +2253,10 @@ void fmtpRecvv3::pushMissingEopReq(const uint32_t prodindex)
  */
 void fmtpRecvv3::retxHandler()
 {
-    FmtpHeader header;
-    char        pktHead[FMTP_HEADER_LEN];
-    int         initState;
-    int         ignoredState;
+    int initState;
+    int ignoredState;
 
-    (void)memset(pktHead, 0, sizeof(pktHead));
+    placement.apply(ROLE_RETX);
     /*
      * Allow the current thread to be cancelled only when it is likely blocked
      * attempting to read from the unicast socket because that prevents the
@@ -923,321 +2265,373 @@ void fmtpRecvv3::retxHandler()
      */
     (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &initState);
 
-    while(1)
-    {
-        /* a useless place holder for header parsing */
-        char* pholder;
+    while (handleRetxMessage())
+        ;
+
+    (void)pthread_setcancelstate(initState, &ignoredState);
+}
+
+
+/**
+ * Handles one message from the unicast connection: reads its header and then
+ * its payload. Blocks until the whole message has been read.
+ *
+ * @retval    true   The message was handled.
+ * @retval    false  The sender closed the connection; the receiver has been
+ *                   stopped.
+ * @throw std::out_of_range   The notifier doesn't know about the product-index.
+ * @throw std::runtime_error  Receiving application error.
+ */
+bool fmtpRecvv3::handleRetxMessage()
+{
+    FmtpHeader header;
+    char        pktHead[FMTP_HEADER_LEN];
+    int         ignoredState;
+
+    (void)memset(pktHead, 0, sizeof(pktHead));
+
+    /* a useless place holder for header parsing */
+    char* pholder;
 
+    (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ignoredState);
+    size_t nbytes = tcprecv->recvData(pktHead, FMTP_HEADER_LEN, NULL, 0);
+    (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &ignoredState);
+    /*
+     * recvData returning 0 indicates an unexpected socket close, thus
+     * FMTP receiver should stop right away and throw an exception.
+     * Since TcpRecv::recvData() either returns 0 or FMTP_HEADER_LEN here,
+     * decodeHeader() should only be called if nbytes is not 0. Besides,
+     * decodeHeader() itself does not do any header size check, because
+     * nbytes should always equal FMTP_HEADER_LEN when successful.
+     */
+    if (nbytes == 0) {
+        Stop();
+        /*
+        throw std::runtime_error("fmtpRecvv3::retxHandler() "
+                "Error reading FMTP header: "
+                "EOF read from the retransmission TCP socket.");
+        */
+        return false;
+    }
+    else {
+        /* TcpRecv::recvData() will return requested number of bytes */
+        /*This should initialize header: Check Coverity check #3 below. 
+ 	     * Coverity only complained about header being uninitialized there. 
+ 	     */
+	    decodeHeader(pktHead, header);
+    }
+
+    /* dynamically creates a buffer on stack based on payload size */
+    const int bufsize = header.payloadlen;
+    char      paytmp[bufsize];
+    (void)memset(paytmp, 0, sizeof(paytmp));
+
+    if (header.payloadlen) {
         (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ignoredState);
-        size_t nbytes = tcprecv->recvData(pktHead, FMTP_HEADER_LEN, NULL, 0);
+        nbytes = tcprecv->recvData(NULL, 0, paytmp, header.payloadlen);
         (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &ignoredState);
-        /*
-         * recvData returning 0 indicates an unexpected socket close, thus
-         * FMTP receiver should stop right away and throw an exception.
-         * Since TcpRecv::recvData() either returns 0 or FMTP_HEADER_LEN here,
-         * decodeHeader() should only be called if nbytes is not 0. Besides,
-         * decodeHeader() itself does not do any header size check, because
-         * nbytes should always equal FMTP_HEADER_LEN when successful.
-         */
         if (nbytes == 0) {
-            Stop();
-            /*
             throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                    "Error reading FMTP header: "
+                    "Error reading the payload of a message: "
                     "EOF read from the retransmission TCP socket.");
-            */
-        }
-        else {
-            /* TcpRecv::recvData() will return requested number of bytes */
-            /*This should initialize header: Check Coverity check #3 below. 
- 	     * Coverity only complained about header being uninitialized there. 
- 	     */
-	    decodeHeader(pktHead, header);
         }
+    }
 
-        /* dynamically creates a buffer on stack based on payload size */
-        const int bufsize = header.payloadlen;
-        char      paytmp[bufsize];
-        (void)memset(paytmp, 0, sizeof(paytmp));
+    handleRetxPacket(header, paytmp);
+    return true;
+}
 
-        if (header.flags == FMTP_RETX_BOP) {
-            (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &ignoredState);
-            nbytes = tcprecv->recvData(NULL, 0, paytmp, header.payloadlen);
-            (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &ignoredState);
 
-            if (nbytes == 0) {
-                //Stop();
-                throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                        "Error reading FMTP_RETX_BOP: "
-                        "EOF read from the retransmission TCP socket.");
-            }
-            else {
-                retxBOPHandler(header, paytmp);
-            }
+/**
+ * Handles the complete messages that an engine's I/O thread has read from the
+ * unicast connection.
+ *
+ * @param[in] buf  Bytes read from the connection, starting with a message.
+ * @param[in] len  Number of bytes.
+ * @return         Number of bytes of the complete messages handled. The rest
+ *                 is the start of a message that hasn't fully arrived yet.
+ * @throw std::out_of_range   The notifier doesn't know about the product-index.
+ * @throw std::runtime_error  Receiving application error.
+ */
+size_t fmtpRecvv3::serveRetxBuffer(char* const buf, const size_t len)
+{
+    size_t used = 0;
+
+    while (len - used >= FMTP_HEADER_LEN) {
+        FmtpHeader header;
+        decodeHeader(buf + used, header);
+        const size_t msglen = FMTP_HEADER_LEN + header.payloadlen;
+        if (len - used < msglen)
+            break;
+        handleRetxPacket(header, buf + used + FMTP_HEADER_LEN);
+        used += msglen;
+    }
+
+    return used;
+}
+
+
+/**
+ * Handles one message from the unicast connection whose payload has been read.
+ *
+ * @param[in] header   The decoded header of the message.
+ * @param[in] paytmp   The payload of the message.
+ * @throw std::out_of_range   The notifier doesn't know about the product-index.
+ * @throw std::runtime_error  Receiving application error.
+ */
+void fmtpRecvv3::handleRetxPacket(const FmtpHeader& header,
+                                  const char* const paytmp)
+{
+    if (header.flags == FMTP_RETX_BOP) {
+        counters.add(RECV_RETXBOPS);
+        /**
+         * A staged product already has its data flowing in, and binding
+         * its BOP takes care of the EOP, see bindStagedProduct(). A BOP
+         * that doesn't match the staged product discards it, so the whole
+         * product is then requested.
+         */
+        const bool wasStaged = awaitingBOP(header.prodindex);
+        const bool bound     = retxBOPHandler(header, paytmp);
 
-            /** remove the BOP from missing list */
-            (void)rmMisBOPinSet(header.prodindex);
+        /** remove the BOP from missing list */
+        (void)rmMisBOPinSet(header.prodindex);
+        if (bound) {
+            return;
+        }
 
-            uint32_t prodsize    = 0;
-            uint32_t seqnum      = 0;
-            uint32_t lastprodidx = 0xFFFFFFFF;
+        bool     tracked     = false;
+        uint32_t prodsize    = 0;
+        uint32_t seqnum      = 0;
+        uint32_t lastprodidx = 0xFFFFFFFF;
+        {
+            std::unique_lock<std::mutex> lock(antiracemtx);
             {
-                std::unique_lock<std::mutex> lock(antiracemtx);
-                {
-                    std::unique_lock<std::mutex> lock(trackermtx);
-                    if (trackermap.count(header.prodindex)) {
-                        ProdTracker tracker  = trackermap[header.prodindex];
-                        prodsize             = tracker.prodsize;
-                        seqnum               = tracker.seqnum;
+                std::unique_lock<std::mutex> lock(trackermtx);
+                if (trackermap.count(header.prodindex)) {
+                    ProdTracker tracker  = trackermap[header.prodindex];
+                    tracked              = true;
+                    prodsize             = tracker.prodsize;
+                    seqnum               = tracker.seqnum;
 
-                        lastprodidx = prodidx_mcast;
-                    }
+                    lastprodidx = prodidx_mcast;
                 }
-                if (prodsize > 0) {
+            }
+            if (tracked) {
+                /**
+                 * If seqnum != 0, the seqnum is updated right after the
+                 * retx BOP is handled, which means the multicast thread
+                 * is receiving blocks. In this case, nothing needs to be
+                 * done.
+                 */
+                if (seqnum == 0) {
                     /**
-                     * If seqnum != 0, the seqnum is updated right after the
-                     * retx BOP is handled, which means the multicast thread
-                     * is receiving blocks. In this case, nothing needs to be
-                     * done.
+                     * If two indices don't equal, the product is totally
+                     * missed. Thus, all blocks should be requested.
+                     * On the other hand, if they equal, there could be
+                     * concurrency or a gap before next product arrives.
+                     * Only requesting EOP is the most economic choice.
                      */
-                    if (seqnum == 0) {
-                        /**
-                         * If two indices don't equal, the product is totally
-                         * missed. Thus, all blocks should be requested.
-                         * On the other hand, if they equal, there could be
-                         * concurrency or a gap before next product arrives.
-                         * Only requesting EOP is the most economic choice.
-                         */
-                        if (lastprodidx != header.prodindex) {
-                            requestAnyMissingData(header.prodindex, prodsize);
-                        }
-                        pushMissingEopReq(header.prodindex);
+                    if (wasStaged || lastprodidx != header.prodindex) {
+                        requestAnyMissingData(header.prodindex, prodsize);
                     }
+                    pushMissingEopReq(header.prodindex);
                 }
-                else {
-                    throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                            "Product not found in BOPMap after receiving retx BOP");
-                }
             }
+            else if (logger->enabled(LOGLVL_DEBUG)) {
+                /**
+                 * The multicast thread may have completed the product, and
+                 * removed its tracker, as soon as the BOP was handled.
+                 */
+                logger->write(LOGLVL_DEBUG, "fmtpRecvv3::handleRetxPacket() "
+                        "Product #" + std::to_string(header.prodindex) +
+                        " completed before its retransmitted BOP was "
+                        "handled");
+            }
+        }
+    }
+    else if (header.flags == FMTP_RETX_DATA) {
+        counters.add(RECV_RETXPKTS);
+        counters.add(RECV_RETXBYTES, header.payloadlen);
+        #ifdef MODBASE
+            uint32_t tmpidx = header.prodindex % MODBASE;
+        #else
+            uint32_t tmpidx = header.prodindex;
+        #endif
+
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "[RETX DATA] Product #" +
+                std::to_string(tmpidx);
+            debugmsg += ": Data block received on unicast, SeqNum = ";
+            debugmsg += std::to_string(header.seqnum);
+            debugmsg += ", Paylen = ";
+            debugmsg += std::to_string(header.payloadlen);
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+
+        uint32_t prodsize = 0;
+        void*    prodptr  = NULL;
+        bool     staged   = false;
+        {
+            std::unique_lock<std::mutex> lock(trackermtx);
+            if (trackermap.count(header.prodindex)) {
+                ProdTracker tracker = trackermap[header.prodindex];
+                prodsize = tracker.prodsize;
+                prodptr  = tracker.prodptr;
+                staged   = tracker.stageptr != NULL;
+            }
+        }
+
+        if ((prodsize > 0) &&
+            (header.seqnum + header.payloadlen > prodsize)) {
+            throw std::runtime_error("fmtpRecvv3::retxHandler() "
+                    "retx block out of boundary: seqnum=" +
+                    std::to_string(header.seqnum) + ", payloadlen=" +
+                    std::to_string(header.payloadlen) + "prodsize=" +
+                    std::to_string(prodsize));
+        }
+        else if (prodsize <= 0) {
+            /*
+             * The payload is dropped since there is no location allocated
+             * in the product queue. The TrackerMap will only be erased when
+             * the associated product has been completely received. So if no
+             * valid prodindex found, it indicates the product is received
+             * and thus removed or there is out-of-order arrival on TCP.
+             */
+            return;
         }
-        else if (header.flags == FMTP_RETX_DATA) {
-            #ifdef MEASURE
-                /* log the time first */
-                measure->setRetxClock(header.prodindex);
-            #endif
 
-            #ifdef MODBASE
-                uint32_t tmpidx = header.prodindex % MODBASE;
-            #else
-                uint32_t tmpidx = header.prodindex;
-            #endif
+        if (staged) {
+            /**
+             * The internal buffer of a staged product may be released by
+             * the multicast thread, so the block is copied into it only
+             * while the tracker is locked.
+             */
+            std::unique_lock<std::mutex> lock(trackermtx);
+            if (trackermap.count(header.prodindex) &&
+                    trackermap[header.prodindex].prodptr) {
+                (void)memcpy((char*)trackermap[header.prodindex].prodptr +
+                             header.seqnum, paytmp, header.payloadlen);
+            }
+        }
+        else if (prodptr) {
+            (void)memcpy((char*)prodptr + header.seqnum, paytmp,
+                         header.payloadlen);
+        }
+        /** otherwise the payload is dumped since there is no product queue */
 
-            #ifdef DEBUG2
-                std::string debugmsg = "[RETX DATA] Product #" +
-                    std::to_string(tmpidx);
-                debugmsg += ": Data block received on unicast, SeqNum = ";
-                debugmsg += std::to_string(header.seqnum);
-                debugmsg += ", Paylen = ";
-                debugmsg += std::to_string(header.payloadlen);
-                std::cout << debugmsg << std::endl;
-                WriteToLog(debugmsg);
-            #endif
+        /**
+         * set() returns -1/0/1, receiver can parse the info for detailed
+         * operations. Only a newly set block counts as recovered, other
+         * results are ignored to keep the process going.
+         */
+        if (pSegMNG->set(header.prodindex, header.seqnum,
+                         header.payloadlen) > 0) {
+            counters.add(RECV_RECOVERED);
+        }
 
-            uint32_t prodsize = 0;
-            void*    prodptr  = NULL;
+        /* a staged product is finished once its BOP is bound */
+        if (!awaitingBOP(header.prodindex) &&
+                pSegMNG->delIfComplete(header.prodindex)) {
+            sendRetxEnd(header.prodindex);
+            releaseStaged(header.prodindex, true);
+            /**
+             * The tracker goes first so that no late multicast packet is
+             * written to the product once the application owns it again.
+             */
+            bool        inTracker = false;
+            ProdTracker tracker;
             {
                 std::unique_lock<std::mutex> lock(trackermtx);
-                if (trackermap.count(header.prodindex)) {
-                    ProdTracker tracker = trackermap[header.prodindex];
-                    prodsize = tracker.prodsize;
-                    prodptr  = tracker.prodptr;
+                TrackerMap::iterator it = trackermap.find(header.prodindex);
+                if (it != trackermap.end()) {
+                    tracker   = it->second;
+                    inTracker = true;
+                    trackermap.erase(it);
                 }
             }
-
-            if ((prodsize > 0) &&
-                (header.seqnum + header.payloadlen > prodsize)) {
-                throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                        "retx block out of boundary: seqnum=" +
-                        std::to_string(header.seqnum) + ", payloadlen=" +
-                        std::to_string(header.payloadlen) + "prodsize=" +
-                        std::to_string(prodsize));
+            if (inTracker) {
+                recordCompletion(header.prodindex, tracker);
+            }
+            if (notifier && inTracker) {
+                notifier->notify_of_eop(header.prodindex);
             }
-            else if (prodsize <= 0) {
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,
-                                             &ignoredState);
+            else if (inTracker) {
                 /**
-                 * drop the payload since there is no location allocated
-                 * in the product queue.
-                 */
-                nbytes = tcprecv->recvData(NULL, 0, paytmp, header.payloadlen);
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,
-                                             &ignoredState);
-                if (nbytes == 0) {
-                    throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                            "Error reading FMTP_RETX_DATA (prodsize <= 0): "
-                            "EOF read from the retransmission TCP socket.");
-                }
-
-                /*
-                 * The TrackerMap will only be erased when the associated
-                 * product has been completely received. So if no valid
-                 * prodindex found, it indicates the product is received
-                 * and thus removed or there is out-of-order arrival on
-                 * TCP.
+                 * Updates the most recently acknowledged product and notifies
+                 * a dummy notification handler (getNotify()).
                  */
-                continue;
-            }
-
-            if (prodptr) {
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,
-                                             &ignoredState);
-                nbytes = tcprecv->recvData(NULL, 0, (char*)prodptr +
-                                           header.seqnum, header.payloadlen);
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,
-                                             &ignoredState);
-                if (nbytes == 0) {
-                    throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                            "Error reading FMTP_RETX_DATA (with prodptr): "
-                            "EOF read from the retransmission TCP socket.");
-                }
-            }
-            else {
-                /** dump the payload since there is no product queue */
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,
-                                             &ignoredState);
-                nbytes = tcprecv->recvData(NULL, 0, paytmp, header.payloadlen);
-                (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,
-                                             &ignoredState);
-                if (nbytes == 0) {
-                    throw std::runtime_error("fmtpRecvv3::retxHandler() "
-                            "Error reading FMTP_RETX_DATA (without prodptr): "
-                            "EOF read from the retransmission TCP socket.");
-                }
-            }
-
-            /**
-             * set() returns -1/0/1, receiver can parse the info for detailed
-             * operations. But currently it is ignored to keep the process going
-             */
-            pSegMNG->set(header.prodindex, header.seqnum, header.payloadlen);
-
-            if (pSegMNG->delIfComplete(header.prodindex)) {
-                sendRetxEnd(header.prodindex);
-                bool inTracker;
-                {
-                    std::unique_lock<std::mutex> lock(trackermtx);
-                    inTracker = trackermap.count(header.prodindex);
-                }
-                if (notifier && inTracker) {
-                    notifier->notify_of_eop(header.prodindex);
-                }
-                else if (inTracker) {
-                    /**
-                     * Updates the most recently acknowledged product and notifies
-                     * a dummy notification handler (getNotify()).
-                     */
-                    {
-                        std::unique_lock<std::mutex> lock(notifyprodmtx);
-                        notifyprodidx = header.prodindex;
-                    }
-                    notify_cv.notify_one();
-                }
-
                 {
-                    std::unique_lock<std::mutex> lock(trackermtx);
-                    trackermap.erase(header.prodindex);
+                    std::unique_lock<std::mutex> lock(notifyprodmtx);
+                    notifyprodidx = header.prodindex;
                 }
+                notify_cv.notify_one();
+            }
 
-                #ifdef DEBUG2
-                    std::string debugmsg = "[MSG] Product #" +
-                        std::to_string(tmpidx);
-                    debugmsg += " has been completely received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #elif DEBUG1
-                    std::string debugmsg = "[MSG] Product #" +
-                        std::to_string(tmpidx);
-                    debugmsg += " has been completely received";
-                    std::cout << debugmsg << std::endl;
-                #endif
-
-                #ifdef MEASURE
-                    uint32_t bytes = measure->getsize(header.prodindex);
-                    std::string measuremsg = "[SUCCESS] Product #" +
-                        std::to_string(tmpidx);
-                    measuremsg += ": product received, size = ";
-                    measuremsg += std::to_string(bytes);
-                    measuremsg += " bytes, elapsed time = ";
-                    measuremsg += measure->gettime(header.prodindex);
-                    measuremsg += " seconds.";
-                    if (measure->getEOPmiss(header.prodindex)) {
-                        measuremsg += " EOP is retransmitted";
-                    }
-                    std::cout << measuremsg << std::endl;
-                    WriteToLog(measuremsg);
-                    /* remove the measurement if completely received */
-                    measure->remove(header.prodindex);
-                #endif
+            if (logger->enabled(LOGLVL_DEBUG)) {
+                std::string debugmsg = "[MSG] Product #" +
+                    std::to_string(tmpidx);
+                debugmsg += " has been completely received";
+                logger->write(LOGLVL_DEBUG, debugmsg);
             }
         }
-        else if (header.flags == FMTP_RETX_EOP) {
-            #ifdef MEASURE
-                measure->setRetxClock(header.prodindex);
-                measure->setEOPmiss(header.prodindex);
-            #endif
-            /*
+    }
+    else if (header.flags == FMTP_RETX_EOP) {
+        counters.add(RECV_RETXEOPS);
+        /*
  	     * Coverity Scan #1: Issue 3: Priority supposedly high, claims header is uninitialized.
  	     * Header should be initialized in the decodeHeader function called above. Ignore for now..
  	     * 8/3/2016 - Ryan Aubrey
  	     */
-            retxEOPHandler(header);
+        retxEOPHandler(header);
+    }
+    else if (header.flags == FMTP_RETX_REJ) {
+        counters.add(RECV_RETXREJS);
+        if (trace) {
+            trace->record(TRACE_REJECT, header.prodindex);
         }
-        else if (header.flags == FMTP_RETX_REJ) {
-            const bool hadBop = rmMisBOPinSet(header.prodindex);
-            /*
-             * if associated segmap exists, remove the segmap. Also avoid
-             * duplicated notification if the product's segmap has
-             * already been removed.
-             */
-            if (pSegMNG->rmProd(header.prodindex) || hadBop) {
-                #ifdef MODBASE
-                    uint32_t tmpidx = header.prodindex % MODBASE;
-                #else
-                    uint32_t tmpidx = header.prodindex;
-                #endif
-
-                #ifdef DEBUG2
-                    std::string debugmsg = "[FAILURE] Product #" +
-                        std::to_string(tmpidx);
-                    debugmsg += " is not completely received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #endif
-
-                if (notifier) {
-                    notifier->notify_of_missed_prod(header.prodindex);
-                }
-                else {
-                    /**
-                     * Updates the most recently acknowledged product and
-                     * notifies a dummy notification handler (getNotify()).
-                     */
-                    {
-                        std::unique_lock<std::mutex> lock(notifyprodmtx);
-                        notifyprodidx = header.prodindex;
-                    }
-                    notify_cv.notify_one();
-                }
+        const bool hadBop = rmMisBOPinSet(header.prodindex);
+        /*
+         * if associated segmap exists, remove the segmap. Also avoid
+         * duplicated notification if the product's segmap has
+         * already been removed.
+         */
+        if (pSegMNG->rmProd(header.prodindex) || hadBop) {
+            #ifdef MODBASE
+                uint32_t tmpidx = header.prodindex % MODBASE;
+            #else
+                uint32_t tmpidx = header.prodindex;
+            #endif
+
+            if (logger->enabled(LOGLVL_DEBUG)) {
+                std::string debugmsg = "[FAILURE] Product #" +
+                    std::to_string(tmpidx);
+                debugmsg += " is not completely received";
+                logger->write(LOGLVL_DEBUG, debugmsg);
+            }
 
+            counters.add(RECV_MISSED);
+            if (notifier) {
+                notifier->notify_of_missed_prod(header.prodindex);
+            }
+            else {
+                /**
+                 * Updates the most recently acknowledged product and
+                 * notifies a dummy notification handler (getNotify()).
+                 */
                 {
-                    std::unique_lock<std::mutex> lock(trackermtx);
-                    trackermap.erase(header.prodindex);
+                    std::unique_lock<std::mutex> lock(notifyprodmtx);
+                    notifyprodidx = header.prodindex;
                 }
+                notify_cv.notify_one();
+            }
+
+            releaseStaged(header.prodindex, false);
+            {
+                std::unique_lock<std::mutex> lock(trackermtx);
+                trackermap.erase(header.prodindex);
             }
         }
     }
-
-    (void)pthread_setcancelstate(initState, &ignoredState);
 }
 
 
@@ -1253,6 +2647,7 @@ void fmtpRecvv3::retxHandler()
  */
 void fmtpRecvv3::retxRequester()
 {
+    placement.apply(ROLE_RETXREQ);
     while(1)
     {
         INLReqMsg reqmsg;
@@ -1267,14 +2662,7 @@ void fmtpRecvv3::retxRequester()
         if (reqmsg.reqtype == SHUTDOWN)
             break; // leave "shutdown" message in queue
 
-        if ( ((reqmsg.reqtype == MISSING_BOP) &&
-                sendBOPRetxReq(reqmsg.prodindex)) ||
-            ((reqmsg.reqtype == MISSING_DATA) &&
-                sendDataRetxReq(reqmsg.prodindex, reqmsg.seqnum,
-                                reqmsg.payloadlen)) ||
-            ((reqmsg.reqtype == MISSING_EOP) &&
-                sendEOPRetxReq(reqmsg.prodindex)) )
-        {
+        if (sendRetxRequest(reqmsg)) {
             std::unique_lock<std::mutex> lock(msgQmutex);
             msgqueue.pop();
         }
@@ -1282,6 +2670,65 @@ void fmtpRecvv3::retxRequester()
 }
 
 
+/**
+ * Sends a queued request or statistics report to the sender.
+ *
+ * @param[in] reqmsg  The request.
+ * @return            Whether the request was sent.
+ */
+bool fmtpRecvv3::sendRetxRequest(const INLReqMsg& reqmsg)
+{
+    if ((reqmsg.reqtype == MISSING_BOP) && sendBOPRetxReq(reqmsg.prodindex)) {
+        counters.add(RECV_BOPREQS);
+        if (trace) {
+            trace->record(TRACE_RETX_REQ, reqmsg.prodindex);
+        }
+        return true;
+    }
+    if ((reqmsg.reqtype == MISSING_DATA) &&
+            sendDataRetxReq(reqmsg.prodindex, reqmsg.seqnum,
+                            reqmsg.payloadlen)) {
+        counters.add(RECV_RETXREQS);
+        if (trace) {
+            trace->record(TRACE_RETX_REQ, reqmsg.prodindex, reqmsg.seqnum);
+        }
+        return true;
+    }
+    if ((reqmsg.reqtype == MISSING_EOP) && sendEOPRetxReq(reqmsg.prodindex)) {
+        counters.add(RECV_EOPREQS);
+        if (trace) {
+            trace->record(TRACE_RETX_REQ, reqmsg.prodindex);
+        }
+        return true;
+    }
+    return (reqmsg.reqtype == SEND_STATS) && sendRecvStats();
+}
+
+
+/**
+ * Sends the queued requests and statistics reports without waiting for more.
+ * Used instead of the retransmission-request thread when the receiver is a
+ * feed of an engine. A request that can't be sent is left in the queue for
+ * the next call.
+ */
+void fmtpRecvv3::drainRetxRequests()
+{
+    for (;;) {
+        INLReqMsg reqmsg;
+        {
+            std::unique_lock<std::mutex> lock(msgQmutex);
+            if (msgqueue.empty() || msgqueue.front().reqtype == SHUTDOWN)
+                return;
+            reqmsg = msgqueue.front();
+        }
+        if (!sendRetxRequest(reqmsg))
+            return;
+        std::unique_lock<std::mutex> lock(msgQmutex);
+        msgqueue.pop();
+    }
+}
+
+
 /**
  * Remove the BOP identified by the given prodindex out of the list. If the
  * BOP is not in the list, return a false. Or if it's in the list, remove it
@@ -1314,13 +2761,12 @@ void fmtpRecvv3::retxEOPHandler(const FmtpHeader& header)
         uint32_t tmpidx = header.prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "[RETX EOP] Product #" +
             std::to_string(tmpidx);
         debugmsg += ": EOP is received";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 
     bool hasBOP = false;
     {
@@ -1359,45 +2805,58 @@ void fmtpRecvv3::retxEOPHandler(const FmtpHeader& header)
  * FMTP header.
  *
  * @pre                       The socket contains a FMTP data-packet.
- * @param[in] header          The associated, peeked-at, and decoded header.
+ * @param[in] header          The associated, peeked-at, and decoded header
+ *                            whose payloadlen covers only the data.
+ * @param[in] extlen          Size of the extension between the header and the
+ *                            data in bytes.
  * @throw std::runtime_error  if an error occurs while reading the multicast
  *                            socket.
  * @throw std::runtime_error  if the packet is invalid.
  */
-void fmtpRecvv3::readMcastData(const FmtpHeader& header)
+void fmtpRecvv3::readMcastData(const FmtpHeader& header, const size_t extlen)
 {
     ssize_t nbytes = 0;
     void*   prodptr = NULL;
-    {
-        std::unique_lock<std::mutex> lock(trackermtx);
-        if (trackermap.count(header.prodindex)) {
-            ProdTracker tracker = trackermap[header.prodindex];
-            prodptr = tracker.prodptr;
-        }
+    /**
+     * The retx thread may finish the product, handing its buffer back to the
+     * receiving application, or release the internal buffer of a staged
+     * product at any time, so the product is only written while the tracker
+     * is locked.
+     */
+    std::unique_lock<std::mutex> lock(trackermtx);
+    if (trackermap.count(header.prodindex)) {
+        prodptr = trackermap[header.prodindex].prodptr;
+    }
+    else {
+        lock.unlock();
     }
 
     if (0 == prodptr) {
-        const int bufsize = FMTP_HEADER_LEN + header.payloadlen;
+        const int bufsize = FMTP_HEADER_LEN + extlen + header.payloadlen;
         char pktbuf[bufsize];
         nbytes = read(mcastSock, &pktbuf, bufsize);
     }
     else {
         struct iovec iovec[2];
-        FmtpHeader  headBuf; // ignored because already have peeked-at header
+        // ignored because already have peeked-at header and extension
+        char headBuf[FMTP_HEADER_LEN + DATA_EXT_LEN];
 
-        iovec[0].iov_base = &headBuf;
-        iovec[0].iov_len  = sizeof(headBuf);
+        iovec[0].iov_base = headBuf;
+        iovec[0].iov_len  = FMTP_HEADER_LEN + extlen;
         iovec[1].iov_base = (char*)prodptr + header.seqnum;
         iovec[1].iov_len  = header.payloadlen;
 
         nbytes = readv(mcastSock, iovec, 2);
     }
+    if (lock.owns_lock()) {
+        lock.unlock();
+    }
 
     if (nbytes == -1) {
         throw std::runtime_error("fmtpRecvv3::readMcastData(): readv() EOF.");
     }
     else {
-        checkPayloadLen(header, nbytes);
+        checkPayloadLen(header, nbytes - extlen);
 
         #ifdef MODBASE
             uint32_t tmpidx = header.prodindex % MODBASE;
@@ -1405,16 +2864,15 @@ void fmtpRecvv3::readMcastData(const FmtpHeader& header)
             uint32_t tmpidx = header.prodindex;
         #endif
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "[MCAST DATA] Product #" +
                 std::to_string(tmpidx);
             debugmsg += ": Data block received from multicast. SeqNum = ";
             debugmsg += std::to_string(header.seqnum);
             debugmsg += ", Paylen = ";
             debugmsg += std::to_string(header.payloadlen);
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
 
         /**
          * Since now receiver has no knowledge about the segment size, it
@@ -1454,6 +2912,7 @@ void fmtpRecvv3::requestAnyMissingData(const uint32_t prodindex,
      * block sequence number.
      */
     if (seqnum != mostRecent) {
+        markRetx(prodindex);
         std::unique_lock<std::mutex> lock(msgQmutex);
 
         for (; seqnum < mostRecent; seqnum += FMTP_DATA_LEN) {
@@ -1465,7 +2924,7 @@ void fmtpRecvv3::requestAnyMissingData(const uint32_t prodindex,
                 uint32_t tmpidx = prodindex;
             #endif
 
-            #ifdef DEBUG2
+            if (logger->enabled(LOGLVL_DEBUG)) {
                 std::string debugmsg = "[RETX REQ] Product #" +
                     std::to_string(tmpidx);
                 debugmsg += ": Data block is missing. SeqNum = ";
@@ -1473,9 +2932,8 @@ void fmtpRecvv3::requestAnyMissingData(const uint32_t prodindex,
                 debugmsg += ", PayLen = ";
                 debugmsg += std::to_string(mostRecent - seqnum);
                 debugmsg += ". Request retx.";
-                std::cout << debugmsg << std::endl;
-                WriteToLog(debugmsg);
-            #endif
+                logger->write(LOGLVL_DEBUG, debugmsg);
+            }
         }
 
         // TODO: Merged RETX_REQ cannot be implemented so far, because
@@ -1563,16 +3021,38 @@ int fmtpRecvv3::requestMissingBopsInclusive(const uint32_t prodindex)
 
 /**
  * Handles a multicast FMTP data-packet given the associated peeked-at and
- * decoded FMTP header. Directly store and check for missing blocks.
+ * decoded FMTP header. Directly store and check for missing blocks. The data
+ * of a self-describing packet is stored even if the BOP is missing.
  *
  * @pre                       The socket contains a FMTP data-packet.
- * @param[in] header          The associated, peeked-at and decoded header.
+ * @param[in] packetHeader    The associated, peeked-at and decoded header.
  * @throw std::runtime_error  if `seqnum + payloadlen` is out of boundary.
  * @throw std::runtime_error  if the packet is invalid.
  * @throw std::runtime_error   if an error occurs while reading the socket.
  */
-void fmtpRecvv3::recvMemData(const FmtpHeader& header)
+void fmtpRecvv3::recvMemData(const FmtpHeader& packetHeader)
 {
+    /* the header as if the packet carried only data */
+    FmtpHeader header = packetHeader;
+    DataExt    ext    = {0, 0};
+    size_t     extlen = 0;
+
+    if (packetHeader.flags == FMTP_MEM_DATA_EXT) {
+        char          peekBuf[FMTP_HEADER_LEN + DATA_EXT_LEN];
+        const ssize_t nbytes = recv(mcastSock, peekBuf, sizeof(peekBuf),
+                                    MSG_PEEK);
+        if (nbytes != sizeof(peekBuf) ||
+                packetHeader.payloadlen < DATA_EXT_LEN) {
+            throw std::runtime_error("fmtpRecvv3::recvMemData() invalid "
+                    "self-describing data packet");
+        }
+        (void)memcpy(&ext, peekBuf + FMTP_HEADER_LEN, DATA_EXT_LEN);
+        ext.prodsize   = ntohl(ext.prodsize);
+        ext.metadigest = ntohl(ext.metadigest);
+        extlen             = DATA_EXT_LEN;
+        header.payloadlen -= DATA_EXT_LEN;
+    }
+
     //int state = 0;
     uint32_t prodsize = 0;
     {
@@ -1582,6 +3062,10 @@ void fmtpRecvv3::recvMemData(const FmtpHeader& header)
             prodsize = tracker.prodsize;
         }
     }
+    /* a self-describing packet can be stored before the BOP arrives */
+    if (prodsize == 0 && extlen && stageProduct(header.prodindex, ext)) {
+        prodsize = ext.prodsize;
+    }
 
     if ((prodsize > 0) && (header.seqnum + header.payloadlen > prodsize)) {
         throw std::runtime_error(
@@ -1599,7 +3083,7 @@ void fmtpRecvv3::recvMemData(const FmtpHeader& header)
      * possibility.
      */
     if (prodsize > 0) {
-        readMcastData(header);
+        readMcastData(header, extlen);
         {
             std::unique_lock<std::mutex> lock(antiracemtx);
             requestAnyMissingData(header.prodindex, header.seqnum);
@@ -1607,16 +3091,27 @@ void fmtpRecvv3::recvMemData(const FmtpHeader& header)
             {
                 std::unique_lock<std::mutex> lock(trackermtx);
                 if (trackermap.count(header.prodindex)) {
-                    trackermap[header.prodindex].seqnum = header.seqnum;
-                    trackermap[header.prodindex].paylen = header.payloadlen;
+                    ProdTracker& tracker = trackermap[header.prodindex];
+                    if (trace && tracker.paylen == 0) {
+                        trace->record(TRACE_FIRST_BLOCK, header.prodindex,
+                                      header.seqnum);
+                    }
+                    tracker.seqnum = header.seqnum;
+                    tracker.paylen = header.payloadlen;
                 }
             }
         }
+        if (trace && header.seqnum + header.payloadlen == prodsize) {
+            trace->record(TRACE_LAST_BLOCK, header.prodindex, header.seqnum);
+        }
     }
     else {
         char buf[1];
         (void)recv(mcastSock, buf, 1, 0); // skip unusable datagram
-        (void)requestMissingBopsInclusive(header.prodindex);
+        /* a lost BOP continuation leaves the BOP partially received */
+        if (!reqBOPifPartial(header.prodindex)) {
+            (void)requestMissingBopsInclusive(header.prodindex);
+        }
     }
 
 #if 0
@@ -1728,16 +3223,70 @@ bool fmtpRecvv3::sendDataRetxReq(uint32_t prodindex, uint32_t seqnum,
  * indexed by prodindex has been completely received.
  *
  * @param[in] prodindex        The product index of the finished product.
+ * @param[in] nprods           Number of consecutive finished products starting
+ *                             at `prodindex`, which is more than 1 only for
+ *                             aggregated products.
  */
-bool fmtpRecvv3::sendRetxEnd(uint32_t prodindex)
+bool fmtpRecvv3::sendRetxEnd(uint32_t prodindex, uint32_t nprods)
 {
     FmtpHeader header;
     header.prodindex  = htonl(prodindex);
-    header.seqnum     = 0;
+    header.seqnum     = (nprods > 1) ? htonl(nprods) : 0;
     header.payloadlen = 0;
     header.flags      = htons(FMTP_RETX_END);
 
-    return (-1 != tcprecv->sendData(&header, sizeof(FmtpHeader), NULL, 0));
+    if (-1 == tcprecv->sendData(&header, sizeof(FmtpHeader), NULL, 0))
+        return false;
+    counters.add(RECV_RETXENDS);
+    counters.add(RECV_COMPLETED, nprods);
+    if (trace) {
+        trace->record(TRACE_ACK, prodindex, nprods);
+    }
+    return true;
+}
+
+
+/**
+ * Sends a statistics report to the sender. The report is written with a
+ * single call so that it can't be interleaved with messages sent by other
+ * threads.
+ *
+ * @return  Whether the report was sent.
+ */
+bool fmtpRecvv3::sendRecvStats()
+{
+    char buf[FMTP_HEADER_LEN + RECV_STATS_LEN];
+    FmtpHeader*   header = reinterpret_cast<FmtpHeader*>(buf);
+    RecvStatsMsg  stats;
+
+    header->prodindex  = htonl(statsseq++);
+    header->seqnum     = 0;
+    header->payloadlen = htons(RECV_STATS_LEN);
+    header->flags      = htons(FMTP_RECV_STATS);
+
+    const std::vector<uint64_t> sums = counters.sums();
+    stats.mcastpkts   = htobe64(sums[RECV_MCASTPKTS]);
+    stats.kerneldrops = htobe64(kerneldrops.load(std::memory_order_relaxed));
+    stats.recovered   = htobe64(sums[RECV_RECOVERED]);
+    stats.retxreqs    = htobe64(sums[RECV_RETXREQS] + sums[RECV_BOPREQS] +
+                                sums[RECV_EOPREQS]);
+    {
+        /* the report itself is still at the front of the queue */
+        std::unique_lock<std::mutex> lock(msgQmutex);
+        stats.retxqueue = htonl(msgqueue.size() - 1);
+    }
+    {
+        std::unique_lock<std::mutex> lock(trackermtx);
+        stats.inflight = htonl(trackermap.size());
+    }
+    {
+        std::unique_lock<std::mutex> lock(BOPSetMtx);
+        stats.missingbops = htonl(misBOPset.size());
+    }
+    stats.rtt = htonl(tcprecv->getRTT());
+    (void)memcpy(buf + FMTP_HEADER_LEN, &stats, RECV_STATS_LEN);
+
+    return (-1 != tcprecv->sendData(buf, sizeof(buf), NULL, 0));
 }
 
 
@@ -1926,6 +3475,99 @@ void fmtpRecvv3::startTimerThread()
 }
 
 
+/**
+ * Starts the thread that has statistics reports sent to the sender.
+ *
+ * @throw std::runtime_error  if the thread couldn't be created.
+ */
+void fmtpRecvv3::startStatsReporter()
+{
+    int retval = pthread_create(&stats_t, NULL,
+                                &fmtpRecvv3::StartStatsReporter, this);
+
+    if(retval != 0) {
+        throw std::runtime_error("fmtpRecvv3::startStatsReporter() "
+                "pthread_create() failed with retval = " + std::to_string(retval));
+    }
+}
+
+
+/**
+ * Start the statsReporter thread using a passed-in fmtpRecvv3 pointer. Called
+ * by `pthread_create()`.
+ *
+ * @param[in] *ptr        A pointer to the fmtpRecvv3 instance.
+ */
+void* fmtpRecvv3::StartStatsReporter(void* ptr)
+{
+    fmtpRecvv3* const recvr = static_cast<fmtpRecvv3*>(ptr);
+    try {
+        recvr->statsReporter();
+    }
+    catch (std::runtime_error& e) {
+        recvr->taskExit(std::current_exception());
+    }
+    return NULL;
+}
+
+
+/**
+ * Queues a statistics report for the retransmission-request thread every
+ * `statsinterval` seconds, so that reports are ordered with the requests.
+ * Doesn't return until `stopJoinStatsReporter()` is called.
+ */
+void fmtpRecvv3::statsReporter()
+{
+    placement.apply(ROLE_CONTROL);
+    const std::chrono::nanoseconds period(
+            static_cast<int64_t>(statsinterval * 1000000000lu));
+    std::unique_lock<std::mutex> lock(statsmtx);
+    std::chrono::steady_clock::time_point next =
+            std::chrono::steady_clock::now() + period;
+
+    while (!statsStop) {
+        if (stats_cv.wait_until(lock, next) == std::cv_status::timeout) {
+            queueStatsReport();
+            next += period;
+        }
+    }
+}
+
+
+/**
+ * Queues a statistics report for the retransmission-request thread, so that
+ * it is ordered with the requests.
+ */
+void fmtpRecvv3::queueStatsReport()
+{
+    std::unique_lock<std::mutex> lock(msgQmutex);
+    INLReqMsg                    reqmsg = {SEND_STATS, 0, 0, 0};
+    msgqueue.push(reqmsg);
+    msgQfilled.notify_one();
+}
+
+
+/**
+ * Stops the statistics-report task and joins with its thread.
+ *
+ * @throws std::runtime_error if the thread can't be joined.
+ */
+void fmtpRecvv3::stopJoinStatsReporter()
+{
+    {
+        std::unique_lock<std::mutex> lock(statsmtx);
+        statsStop = true;
+        stats_cv.notify_one();
+    }
+
+    int status = pthread_join(stats_t, NULL);
+    if (status) {
+        throw std::runtime_error("fmtpRecvv3::stopJoinStatsReporter() "
+                "Couldn't join statistics-report thread");
+    }
+}
+
+
 /**
  * Stops the timer task by adding a "shutdown" entry to the associated queue and
  * joins with its thread.
@@ -1963,6 +3605,39 @@ void fmtpRecvv3::setEOPStatus(const uint32_t prodindex)
 }
 
 
+/**
+ * Starts the timer of a product, on the timer thread or, if the receiver is
+ * a feed of an engine, on the engine's timer thread.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] seconds    Expected reception time of the product in seconds.
+ */
+void fmtpRecvv3::startTimer(const uint32_t prodindex, const double seconds)
+{
+    if (engine) {
+        engine->startTimer(this, prodindex, seconds);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(timerQmtx);
+    timerParam timerparam = {prodindex, seconds};
+    timerParamQ.push(timerparam);
+    timerQfilled.notify_all();
+}
+
+
+/**
+ * Ends the wait for the products whose timers were started before, so that
+ * their EOPs are checked now.
+ */
+void fmtpRecvv3::wakeTimer()
+{
+    if (engine)
+        engine->wakeTimers(this);
+    else
+        timerWake.notify_all();
+}
+
+
 /**
  * Runs a timer thread to watch for the case of missing EOP. If an expected
  * EOP is not received, the timer should trigger after sleeping. If it is
@@ -1973,6 +3648,7 @@ void fmtpRecvv3::setEOPStatus(const uint32_t prodindex)
  */
 void fmtpRecvv3::timerThread()
 {
+    placement.apply(ROLE_TIMER);
     while (1) {
         timerParam timerparam;
         {
@@ -1998,29 +3674,44 @@ void fmtpRecvv3::timerThread()
             timerParamQ.pop();
         }
 
-        /** if EOP has not been received yet, issue a request for retx */
-        if (reqEOPifMiss(timerparam.prodindex)) {
-            #ifdef MODBASE
-                uint32_t tmpidx = timerparam.prodindex % MODBASE;
-            #else
-                uint32_t tmpidx = timerparam.prodindex;
-            #endif
+        expireTimer(timerparam.prodindex);
+    }
+}
+
+
+/**
+ * Checks a product whose timer has expired: requests its EOP if it is still
+ * missing.
+ *
+ * @param[in] prodindex  Index of the product.
+ */
+void fmtpRecvv3::expireTimer(const uint32_t prodindex)
+{
+    /** if EOP has not been received yet, issue a request for retx */
+    counters.add(RECV_TIMEOUTS);
+    if (trace) {
+        trace->record(TRACE_TIMEOUT, prodindex);
+    }
+    if (reqEOPifMiss(prodindex)) {
+        #ifdef MODBASE
+            uint32_t tmpidx = prodindex % MODBASE;
+        #else
+            uint32_t tmpidx = prodindex;
+        #endif
 
-            #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "[TIMER] Timer has waken up. Product #" +
-                    std::to_string(tmpidx);
-                debugmsg += " is still missing EOP. Request retx.";
-                std::cout << debugmsg << std::endl;
-                WriteToLog(debugmsg);
-            #endif
+                std::to_string(tmpidx);
+            debugmsg += " is still missing EOP. Request retx.";
+            logger->write(LOGLVL_DEBUG, debugmsg);
         }
-        /**
-         * After waking up, the timer checks the EOP arrival status of
-         * a product and decides whether to request for re-transmission.
-         * Only the timer can clear the EOPmap.
-         */
-        clearEOPStatus(timerparam.prodindex);
     }
+    /**
+     * After waking up, the timer checks the EOP arrival status of
+     * a product and decides whether to request for re-transmission.
+     * Only the timer can clear the EOPmap.
+     */
+    clearEOPStatus(prodindex);
 }
 
 
@@ -2047,48 +3738,7 @@ void fmtpRecvv3::taskExit(const std::exception_ptr& e)
         }
         exitCond.notify_one();
     }
-}
-
-
-/**
- * Write a line of log record into the log file. If the log file doesn't exist,
- * create a new one and then append to it.
- *
- * @param[in] content       The content of the log record to be written.
- */
-void fmtpRecvv3::WriteToLog(const std::string& content)
-{
-    time_t rawtime;
-    struct tm *timeinfo;
-    char buf[30];
-    /* create logs  directory if it doesn't exist */
-    struct stat st = {0};
-    /* 
-     * Coverity Scan #1: Issue 4: Low risk, race condition on this check if the logs directory yet exists.
-     * For now, we are ignoring this known issue. The cost of locking on this simple check would slow the very crucial
-     * logging process down too much. Make note in future scans - 8/3/2016 Ryan Aubrey.
-     */
-    if (stat("logs", &st) == -1) {
-        /*
- 	 * Coverity Scan #1: Fix #6: Handle mkdir possible failure return value of -1. 
- 	 * This could fail because of lack of permissions.
- 	 */
-	if (mkdir("logs", 0755) < 0){
-		throw std::runtime_error("fmtpRecvv3::WriteToLog(): unable to create logs directory. This could be a permissions issue.");	
-	}
+    if (engine) {
+        engine->detachFeed(this);
     }
-    /* allocate a large enough buffer in case some long hostnames */
-    char hostname[1024];
-    gethostname(hostname, 1024);
-    std::string logpath(hostname);
-    logpath = "logs/FMTPv3_RECEIVER_" + logpath + ".log";
-
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(buf, 30, "%Y-%m-%d %I:%M:%S  ", timeinfo);
-    std::string time(buf);
-
-    std::ofstream logfile(logpath, std::ofstream::out | std::ofstream::app);
-    logfile << time << content << std::endl;
-    logfile.close();
 }
@@ -45,15 +45,24 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
-#include "Measure.h"
+#include "AsyncLog.h"
+#include "FaultInjector.h"
+#include "LatencyHistogram.h"
+#include "MetricsExporter.h"
+#include "PerThreadCounters.h"
 #include "ProdSegMNG.h"
+#include "ProductTrace.h"
 #include "RecvProxy.h"
 #include "TcpRecv.h"
+#include "ThreadPlacement.h"
+#include "Transport.h"
 #include "fmtpBase.h"
 
 
 class fmtpRecvv3;
+class fmtpRecvEngine;
 
 struct StartTimerInfo
 {
@@ -68,9 +77,104 @@ struct ProdTracker
     void*        prodptr;
     uint32_t     seqnum;
     uint16_t     paylen;
+    /* internal buffer of a product staged before its BOP, or NULL */
+    char*        stageptr;
+    /* location given by the receiving application for a staged product */
+    void*        appptr;
+    /* whether a staged product still waits for its BOP */
+    bool         awaitBOP;
+    /* metadata digest announced by self-describing data packets */
+    uint32_t     digest;
+    /* when the BOP, or the first packet of a staged product, arrived */
+    std::chrono::steady_clock::time_point start;
+    /* when data or the EOP was first requested; the epoch if never */
+    std::chrono::steady_clock::time_point retxstart;
+    /* sender timestamp of the BOP in ns since the Unix epoch, 0 if none */
+    uint64_t     submitted;
+};
+
+/**
+ * A BOP whose metadata is still being reassembled from BOP continuation
+ * packets.
+ */
+struct BOPAssembly
+{
+    uint32_t          prodsize;
+    std::vector<char> metadata;
+    /* number of metadata bytes received so far */
+    uint32_t          received;
+    /* sender timestamp of the BOP, see ProdTracker */
+    uint64_t          submitted;
+};
+
+/**
+ * Counters of the multicast socket, see fmtpRecvv3::getMcastStats().
+ */
+struct McastRecvStats
+{
+    uint64_t     mcastpkts;     /*!< multicast packets received */
+    uint64_t     kerneldrops;   /*!< datagrams dropped for lack of buffer */
+    uint64_t     rcvbuf;        /*!< current receive buffer size in bytes */
+    uint64_t     rcvbufgrowths; /*!< times the buffer was grown after drops */
+    uint64_t     observedrate;  /*!< multicast rate in bits per second */
+};
+
+/**
+ * A snapshot of the receiver's statistics, see fmtpRecvv3::getStats(). The
+ * counters are cumulative since the receiver was constructed.
+ */
+struct RecvStats
+{
+    uint64_t     mcastpkts;     /*!< multicast packets received */
+    uint64_t     mcastbytes;    /*!< multicast bytes, FMTP headers included */
+    uint64_t     kerneldrops;   /*!< datagrams dropped for lack of buffer */
+    uint64_t     bops;          /*!< products begun */
+    uint64_t     dupbops;       /*!< BOPs of products already begun */
+    uint64_t     eops;          /*!< EOPs received by multicast */
+    uint64_t     completed;     /*!< products completely received */
+    uint64_t     missed;        /*!< products given up on */
+    uint64_t     retxreqs;      /*!< RETX_REQs sent */
+    uint64_t     bopreqs;       /*!< BOP_REQs sent */
+    uint64_t     eopreqs;       /*!< EOP_REQs sent */
+    uint64_t     retxpkts;      /*!< data blocks retransmitted to us */
+    uint64_t     retxbytes;     /*!< bytes of data retransmitted to us */
+    uint64_t     recovered;     /*!< retransmitted blocks that were missing */
+    uint64_t     retxbops;      /*!< BOPs retransmitted to us */
+    uint64_t     retxeops;      /*!< EOPs retransmitted to us */
+    uint64_t     retxrejs;      /*!< RETX_REJs received */
+    uint64_t     retxends;      /*!< RETX_ENDs sent */
+    uint64_t     timeouts;      /*!< product timers that expired */
+    /* gauges, current at the time of the snapshot */
+    uint32_t     retxqueue;     /*!< requests waiting to be sent */
+    uint32_t     inflight;      /*!< products being received */
+    uint32_t     missingbops;   /*!< products whose BOP is being requested */
+};
+
+/** latencies of completed products, see fmtpRecvv3::getLatency() */
+enum RecvLatency {
+    /* from the BOP to the completion of every product */
+    LATENCY_COMPLETION = 0,
+    /* the same, for the products completed without retransmission */
+    LATENCY_MCAST,
+    /* from the first request to the completion, for the other products */
+    LATENCY_RETX,
+    /* from sendProduct() on the sender to the completion, for products
+       whose BOP carried a sender timestamp */
+    LATENCY_END_TO_END,
+    NUM_RECV_LATENCIES
+};
+
+/** delays of multicast packets, see fmtpRecvv3::getPacketDelay() */
+enum PacketDelay {
+    /* from the sender's timestamp to the kernel's receive timestamp */
+    DELAY_NETWORK = 0,
+    /* from the kernel's receive timestamp to the read by the receiver */
+    DELAY_HOST,
+    NUM_PACKET_DELAYS
 };
 
 typedef std::unordered_map<uint32_t, ProdTracker> TrackerMap;
+typedef std::unordered_map<uint32_t, BOPAssembly> BOPAssemblyMap;
 typedef std::unordered_map<uint32_t, bool> EOPStatusMap;
 
 
@@ -86,22 +190,228 @@ public:
 
     uint32_t getNotify();
     void SetLinkSpeed(uint64_t speed);
+    /**
+     * Sets the interval at which statistics are reported to the sender.
+     *
+     * @param[in] seconds  Interval in seconds. 0 disables reporting.
+     * @throw std::invalid_argument  if `seconds` is negative.
+     */
+    void SetStatsInterval(double seconds);
+    /**
+     * Sets how the receive buffer of the multicast socket is sized. Must be
+     * called before `Start()`.
+     *
+     * @param[in] burst     Duration in seconds of a burst at the link speed
+     *                      the buffer must be able to absorb.
+     * @param[in] maxbytes  Largest size in bytes the buffer may grow to.
+     * @throw std::invalid_argument  if an argument is out of range.
+     */
+    void SetRcvBufPolicy(double burst, int maxbytes);
+    /**
+     * Returns the counters of the multicast socket.
+     *
+     * @return  The counters.
+     */
+    McastRecvStats getMcastStats() const;
+    /**
+     * Returns the receiver's statistics. May be called by any thread at any
+     * time; the receiving threads aren't slowed down by it.
+     *
+     * @return  A snapshot of the statistics.
+     */
+    RecvStats getStats();
+    /**
+     * Returns a histogram of the latencies of completed products. May be
+     * called by any thread at any time. Products aggregated into envelopes,
+     * which complete with their envelope, aren't counted.
+     *
+     * @param[in] which      The latency.
+     * @param[in] sizeclass  Size of the products.
+     * @return               A snapshot of the histogram in nanoseconds.
+     */
+    HistogramSnapshot getLatency(const RecvLatency which,
+                                 const SizeClass sizeclass);
+    /**
+     * Returns a histogram of the latencies of completed products of all
+     * sizes.
+     *
+     * @param[in] which  The latency.
+     * @return           A snapshot of the histogram in nanoseconds.
+     */
+    HistogramSnapshot getLatency(const RecvLatency which);
+    /**
+     * Returns a histogram of the delays of multicast packets. Only recorded
+     * with receive timestamps, see `SetRxTimestamps()`.
+     *
+     * @param[in] which  The delay.
+     * @return           A snapshot of the histogram in nanoseconds.
+     */
+    HistogramSnapshot getPacketDelay(const PacketDelay which)
+        {return delay[which].snapshot();}
+    /**
+     * Has the kernel timestamp the multicast packets as they arrive. Must be
+     * called before `Start()`.
+     *
+     * @param[in] enable  Whether to timestamp received packets.
+     */
+    void SetRxTimestamps(bool enable);
+    /**
+     * Enables the busy-poll receive mode. Must be called before `Start()`.
+     *
+     * @param[in] cpu    CPU the multicast thread is pinned to or -1.
+     * @param[in] usecs  Time in microseconds the kernel busy-polls the device
+     *                   queue for a socket read. 0 leaves it as is.
+     * @throw std::invalid_argument  if an argument is negative.
+     */
+    void SetBusyPoll(int cpu = -1, int usecs = 50);
+    /**
+     * Sets where and how the receiver's threads run. Must be called before
+     * `Start()`.
+     *
+     * @param[in] placement  The thread placement.
+     */
+    void SetThreadPlacement(const ThreadPlacement& placement);
+    /**
+     * Has a fault injector drop multicast packets as they are received. Must
+     * be called before `Start()`.
+     *
+     * @param[in] injector  The fault injector or NULL for none. It must
+     *                      outlive the receiver.
+     */
+    void SetFaultInjector(FaultInjector* injector);
+    /**
+     * Records the lifecycle events of products into a trace. Must be called
+     * before `Start()`.
+     *
+     * @param[in] trace  The trace or NULL for none. It must outlive the
+     *                   receiver.
+     */
+    void SetTrace(ProductTrace* trace);
+    /**
+     * Sets the transport that opens the multicast socket and the connection
+     * to the sender. Must be called before `Start()`.
+     *
+     * @param[in] transport  The transport. It must outlive the receiver.
+     */
+    void SetTransport(Transport& transport);
+    /**
+     * Has an exporter serve the receiver's statistics, see `getStats()` and
+     * `getMcastStats()`. May be called at any time, once.
+     *
+     * @param[in] exporter  The exporter. It must outlive the receiver.
+     * @param[in] feed      Value of the "feed" label of the receiver's
+     *                      metrics or empty for no label.
+     */
+    void SetMetricsExporter(MetricsExporter& exporter,
+                            const std::string& feed = "");
+    /**
+     * Sets the level of the records written to the receiver's log,
+     * "logs/FMTPv3_RECEIVER_<host>.log" in the working directory. Debug
+     * records trace every packet. May be called at any time. The log is
+     * shared by the receivers of the process.
+     *
+     * @param[in] level  The level.
+     */
+    void SetLogLevel(const LogLevel level);
     void Start();
     void Stop();
 
 private:
+    friend class fmtpRecvEngine;
+
+    /* indexes of `counters` */
+    enum {
+        RECV_MCASTPKTS,
+        RECV_MCASTBYTES,
+        RECV_BOPS,
+        RECV_DUPBOPS,
+        RECV_EOPS,
+        RECV_COMPLETED,
+        RECV_MISSED,
+        RECV_RETXREQS,
+        RECV_BOPREQS,
+        RECV_EOPREQS,
+        RECV_RETXPKTS,
+        RECV_RETXBYTES,
+        RECV_RECOVERED,
+        RECV_RETXBOPS,
+        RECV_RETXEOPS,
+        RECV_RETXREJS,
+        RECV_RETXENDS,
+        RECV_TIMEOUTS,
+        RECV_NCOUNTERS
+    };
+
     bool addUnrqBOPinSet(uint32_t prodindex);
     /**
      * Parse BOP message and call notifier to notify receiving application.
      *
      * @param[in] header           Header associated with the packet.
      * @param[in] FmtpPacketData  Pointer to payload of FMTP packet.
+     * @return                     Whether the BOP bound a staged product.
      * @throw std::runtime_error   if the payload is too small.
      */
-    void BOPHandler(const FmtpHeader& header,
+    bool BOPHandler(const FmtpHeader& header,
                     const char* const  FmtpPacketData);
     void checkPayloadLen(const FmtpHeader& header, const size_t nbytes);
+    /**
+     * Initializes the reception of a product whose BOP is complete and
+     * notifies the receiving application.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] prodsize   Size of the product in bytes.
+     * @param[in] metadata   Metadata of the product.
+     * @param[in] metasize   Size of the metadata in bytes.
+     * @return               Whether the BOP bound a staged product.
+     * @throw std::runtime_error  if the product can't be tracked.
+     */
+    bool initProduct(const uint32_t prodindex, const uint32_t prodsize,
+                     char* const metadata, const uint16_t metasize);
     void clearEOPStatus(const uint32_t prodindex);
+    /**
+     * Counts a peeked-at multicast packet, updates the kernel drop count
+     * from the packet's ancillary data and grows the receive buffer if the
+     * kernel dropped packets.
+     *
+     * @param[in] msg     The message header filled in by `recvmsg()`.
+     * @param[in] header  The decoded header of the packet.
+     */
+    void countMcastPacket(struct msghdr& msg, const FmtpHeader& header);
+    /**
+     * Reads the sender timestamp of a peeked-at FMTP_TIMESTAMPED packet and
+     * strips it from the header, so that the packet is handled like any
+     * other.
+     *
+     * @param[in,out] header  The decoded header of the packet.
+     * @return                The timestamp in ns since the Unix epoch.
+     * @throw std::runtime_error  if the packet is invalid.
+     */
+    uint64_t readTimestamp(FmtpHeader& header);
+    /**
+     * Notes the sender timestamp of the BOP of a product.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] submitted  The timestamp in ns since the Unix epoch.
+     */
+    void noteSubmitted(const uint32_t prodindex, const uint64_t submitted);
+    /**
+     * Sets the receive buffer size of the multicast socket.
+     *
+     * @param[in] bytes  The requested size.
+     * @throw std::runtime_error  if the size couldn't be set.
+     */
+    void setRcvBuf(int bytes);
+    /**
+     * Grows the receive buffer of the multicast socket after drops.
+     */
+    void growRcvBuf();
+    /**
+     * Peeks at the header of the next multicast packet.
+     *
+     * @param[out] msg  The message header to receive into.
+     * @return          What `recvmsg()` returned.
+     */
+    ssize_t peekMcastPacket(struct msghdr& msg);
     /**
      * Decodes the header of a FMTP packet in-place.
      *
@@ -134,7 +444,49 @@ private:
      * @throw     std::runtime_error  if the packet is invalid.
      */
     void mcastBOPHandler(const FmtpHeader& header);
+    /**
+     * Handles a multicast aggregate envelope given a peeked-at FMTP header.
+     * Every product packed in the envelope is delivered as a complete product.
+     *
+     * @pre                           The multicast socket contains a FMTP
+     *                                AGGR_DATA packet.
+     * @param[in] header              The associated, already-decoded FMTP header.
+     * @throw     std::runtime_error  if an error occurs while reading the socket.
+     * @throw     std::runtime_error  if the packet is invalid.
+     */
+    void mcastAggrHandler(const FmtpHeader& header);
+    /**
+     * Delivers a product received in an aggregate envelope to the receiving
+     * application unless the product is already known to this receiver.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] prodsize   Size of the product in bytes.
+     * @param[in] metadata   Metadata of the product.
+     * @param[in] metasize   Size of the metadata in bytes.
+     * @param[in] data       The product.
+     * @return               Whether the product was delivered.
+     */
+    bool aggrProdHandler(const uint32_t prodindex, const uint32_t prodsize,
+                         char* const metadata, const uint16_t metasize,
+                         const char* const data);
+    /**
+     * Handles a multicast BOP continuation given a peeked-at FMTP header.
+     *
+     * @pre                           The multicast socket contains a FMTP
+     *                                BOP_CONT packet.
+     * @param[in] header              The associated, already-decoded FMTP header.
+     * @throw     std::runtime_error  if an error occurs while reading the socket.
+     * @throw     std::runtime_error  if the packet is invalid.
+     */
+    void mcastBOPContHandler(const FmtpHeader& header);
     void mcastHandler();
+    /**
+     * Handles the next multicast packet.
+     *
+     * @param[in] nonblocking  Whether to return if no packet is queued.
+     * @return                 Whether a packet was handled.
+     */
+    bool handleMcastPacket(const bool nonblocking);
     void mcastEOPHandler(const FmtpHeader& header);
     /**
      * Pushes a request for a data-packet onto the retransmission-request queue.
@@ -158,15 +510,71 @@ private:
      */
     void pushMissingEopReq(const uint32_t prodindex);
     void retxHandler();
+    /**
+     * Handles one message from the unicast connection.
+     *
+     * @return  Whether the message was handled; false on the end of the
+     *          connection.
+     */
+    bool handleRetxMessage();
+    /**
+     * Handles the complete messages read by an engine from the unicast
+     * connection.
+     *
+     * @param[in] buf  Bytes read, starting with a message.
+     * @param[in] len  Number of bytes.
+     * @return         Number of bytes handled.
+     */
+    size_t serveRetxBuffer(char* const buf, const size_t len);
+    /**
+     * Handles one message from the unicast connection.
+     *
+     * @param[in] header  The decoded header of the message.
+     * @param[in] paytmp  The payload of the message.
+     */
+    void handleRetxPacket(const FmtpHeader& header, const char* const paytmp);
     void retxRequester();
+    /**
+     * Sends a queued request or statistics report.
+     *
+     * @param[in] reqmsg  The request.
+     * @return            Whether it was sent.
+     */
+    bool sendRetxRequest(const INLReqMsg& reqmsg);
+    /** sends the queued requests without waiting for more */
+    void drainRetxRequests();
+    /** queues a statistics report */
+    void queueStatsReport();
+    /**
+     * Starts this instance as a feed of an engine.
+     *
+     * @param[in] host  The engine.
+     */
+    void startHosted(fmtpRecvEngine* const host);
+    /**
+     * Starts the timer of a product.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] seconds    Expected reception time in seconds.
+     */
+    void startTimer(const uint32_t prodindex, const double seconds);
+    /** ends the wait for the products whose timers were started before */
+    void wakeTimer();
+    /**
+     * Requests the EOP of a product whose timer has expired if it's missing.
+     *
+     * @param[in] prodindex  Index of the product.
+     */
+    void expireTimer(const uint32_t prodindex);
     bool rmMisBOPinSet(uint32_t prodindex);
     /**
      * Handles a retransmitted BOP message.
      *
      * @param[in] header           Header associated with the packet.
      * @param[in] FmtpPacketData  Pointer to payload of FMTP packet.
+     * @return                     Whether the BOP bound a staged product.
      */
-    void retxBOPHandler(const FmtpHeader& header,
+    bool retxBOPHandler(const FmtpHeader& header,
                         const char* const  FmtpPacketData);
     void retxEOPHandler(const FmtpHeader& header);
     /**
@@ -174,12 +582,49 @@ private:
      * by the receiving application.
      *
      * @pre                       The socket contains a FMTP data-packet.
-     * @param[in] header          The associated, peeked-at and decoded header.
+     * @param[in] header          The associated, peeked-at and decoded header
+     *                            whose payloadlen covers only the data.
+     * @param[in] extlen          Size of the extension between the header and
+     *                            the data in bytes.
      * @throw std::system_error   if an error occurs while reading the multicast
      *                            socket.
      * @throw std::runtime_error  if the packet is invalid.
      */
-    void readMcastData(const FmtpHeader& header);
+    void readMcastData(const FmtpHeader& header, const size_t extlen = 0);
+    /**
+     * Binds a product that was staged before its BOP arrived to the BOP.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] prodsize   Size of the product in bytes.
+     * @param[in] metadata   Metadata of the product.
+     * @param[in] metasize   Size of the metadata in bytes.
+     * @return               Whether the product was staged and is now bound.
+     */
+    bool bindStagedProduct(const uint32_t prodindex, const uint32_t prodsize,
+                           char* const metadata, const uint16_t metasize);
+    /**
+     * Returns whether a product was staged and still waits for its BOP.
+     *
+     * @param[in] prodindex  Index of the product.
+     */
+    bool awaitingBOP(const uint32_t prodindex);
+    /**
+     * Releases the internal buffer of a staged product, copying the product
+     * to the location given by the receiving application first if requested.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] deliver    Whether to copy the product out.
+     */
+    void releaseStaged(const uint32_t prodindex, const bool deliver);
+    /**
+     * Starts storing a product announced by a self-describing data packet
+     * before its BOP has arrived, and requests the BOP.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] ext        Decoded extension of the data packet.
+     * @return               Whether the product is now staged.
+     */
+    bool stageProduct(const uint32_t prodindex, const DataExt& ext);
     /**
      * Requests data-packets that lie between the last previously-received
      * data-packet of the current data-product and its most recently-received
@@ -220,34 +665,74 @@ private:
     int requestMissingBopsInclusive(const uint32_t prodindex);
     /**
      * Handles a multicast FMTP data-packet given the associated peeked-at and
-     * decoded FMTP header. Directly store and check for missing blocks.
+     * decoded FMTP header. Directly store and check for missing blocks. The
+     * data of a self-describing packet is stored even if the BOP is missing.
      *
      * @pre                       The socket contains a FMTP data-packet.
-     * @param[in] header          The associated, peeked-at and decoded header.
+     * @param[in] packetHeader    The associated, peeked-at and decoded header.
      * @throw std::system_error   if an error occurs while reading the socket.
      * @throw std::runtime_error  if the packet is invalid.
      */
-    void recvMemData(const FmtpHeader& header);
+    void recvMemData(const FmtpHeader& packetHeader);
     /**
      * request EOP retx if EOP is not received yet and return true if
      * the request is sent out. Otherwise, return false.
      * */
     bool reqEOPifMiss(const uint32_t prodindex);
+    /**
+     * Abandons the reassembly of a BOP whose continuation was lost and
+     * requests the whole BOP instead. Returns true if a reassembly was
+     * pending. Otherwise, returns false.
+     *
+     * @param[in] prodindex  Index of the product.
+     */
+    bool reqBOPifPartial(const uint32_t prodindex);
     static void* runTimerThread(void* ptr);
     bool sendBOPRetxReq(uint32_t prodindex);
     bool sendEOPRetxReq(uint32_t prodindex);
     bool sendDataRetxReq(uint32_t prodindex, uint32_t seqnum,
                          uint16_t payloadlen);
-    bool sendRetxEnd(uint32_t prodindex);
+    bool sendRetxEnd(uint32_t prodindex, uint32_t nprods = 1);
+    /**
+     * Adds the receiver's statistics to a scrape of the metrics exporter.
+     *
+     * @param[in] writer  The scrape.
+     * @param[in] labels  Labels of the receiver's samples.
+     */
+    void writeMetrics(MetricsWriter& writer, const std::string& labels);
+    /**
+     * Records the latencies of a product that has just been completed.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] tracker    The tracker of the product.
+     */
+    void recordCompletion(const uint32_t prodindex,
+                          const ProdTracker& tracker);
+    /**
+     * Notes that a product is being recovered by retransmission, if it
+     * wasn't already.
+     *
+     * @param[in] prodindex  Index of the product.
+     */
+    void markRetx(const uint32_t prodindex);
+    /**
+     * Sends a statistics report to the sender.
+     *
+     * @return  Whether the report was sent.
+     */
+    bool sendRecvStats();
     static void*  StartRetxRequester(void* ptr);
     static void*  StartRetxHandler(void* ptr);
     static void*  StartMcastHandler(void* ptr);
     void StartRetxProcedure();
     void startTimerThread();
+    void startStatsReporter();
+    static void*  StartStatsReporter(void* ptr);
+    void statsReporter();
+    void stopJoinStatsReporter();
     void setEOPStatus(const uint32_t prodindex);
     void timerThread();
     void taskExit(const std::exception_ptr& e);
-    void WriteToLog(const std::string& content);
     void stopJoinRetxRequester();
     void stopJoinRetxHandler();
     void stopJoinTimerThread();
@@ -262,9 +747,6 @@ private:
     std::string             ifAddr;
     int                     mcastSock;
     int                     retxSock;
-    struct sockaddr_in      mcastgroup;
-    /* struct of multicast object */
-    struct ip_mreq          mreq;
     std::atomic<uint32_t>   prodidx_mcast;
     /* callback function of the receiving application */
     RecvProxy*              notifier;
@@ -274,6 +756,9 @@ private:
     std::mutex              trackermtx;
     /* eliminate race conditions between mcast and retx */
     std::mutex              antiracemtx;
+    /* BOPs whose metadata is still arriving in continuation packets */
+    BOPAssemblyMap          bopassembly;
+    std::mutex              bopassemblymtx;
     /* a map from prodindex to EOP arrival status */
     EOPStatusMap            EOPmap;
     std::mutex              EOPmapmtx;
@@ -311,9 +796,61 @@ private:
     uint32_t                notifyprodidx;
     std::condition_variable notify_cv;
 
-    /* member variables for measurement use only */
-    Measure*                measure;
-    /* member variables for measurement use ends */
+    /* latencies of completed products, indexed by RecvLatency and size */
+    LatencyHistogram        latency[NUM_RECV_LATENCIES][NUM_SIZE_CLASSES];
+    /* delays of multicast packets, indexed by PacketDelay */
+    LatencyHistogram        delay[NUM_PACKET_DELAYS];
+    /* receive timestamps, see SetRxTimestamps() */
+    bool                    rxtimestamps;
+    /* receive timestamp of the current multicast packet in ns, 0 if none */
+    uint64_t                mcastRxNs;
+
+    /* counters of getStats(), indexed by RECV_* */
+    PerThreadCounters       counters;
+    /* statistics reported to the sender, see SetStatsInterval() */
+    std::atomic<uint64_t>   kerneldrops;
+    /* sequence number of the next report, used by the retx requester only */
+    uint32_t                statsseq;
+    double                  statsinterval;
+    /* statistics-report thread */
+    pthread_t               stats_t;
+    bool                    statsStop;
+    std::mutex              statsmtx;
+    std::condition_variable stats_cv;
+    /* receive buffer sizing of the multicast socket, see SetRcvBufPolicy() */
+    double                  rcvbufburst;
+    int                     rcvbufmax;
+    /* last requested size, used by joinGroup() and the mcast handler only */
+    int                     rcvbufreq;
+    std::atomic<uint64_t>   rcvbuf;
+    std::atomic<uint64_t>   rcvbufgrowths;
+    std::chrono::steady_clock::time_point rcvbufgrown;
+    /* observed multicast rate, updated by the mcast handler */
+    std::atomic<uint64_t>   observedrate;
+    uint64_t                ratewinbytes;
+    uint64_t                ratewinpkts;
+    std::chrono::steady_clock::time_point ratewinstart;
+    /* busy-poll receive mode, see SetBusyPoll() */
+    bool                    busypoll;
+    int                     busypollcpu;
+    int                     busypollusecs;
+    /* where and how the threads run, see SetThreadPlacement() */
+    ThreadPlacement         placement;
+    /* whether the first multicast packet has been handled */
+    bool                    mcastStarted;
+    /* the engine serving this receiver as a feed or NULL */
+    fmtpRecvEngine*         engine;
+    /* drops received multicast packets, see SetFaultInjector() */
+    FaultInjector*          injector;
+    /* lifecycle events of products, see SetTrace(), NULL if disabled */
+    ProductTrace*           trace;
+    /* opens the sockets, see SetTransport() */
+    Transport*              transport;
+    /* the exporter serving the statistics or NULL, see SetMetricsExporter() */
+    MetricsExporter*        exporter;
+    int                     exporterId;
+    /* the log, written by a thread of its own, see SetLogLevel() */
+    std::shared_ptr<AsyncLog> logger;
 };
 
 
@@ -0,0 +1,216 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LossMap.cpp
+ *
+ * This file implements a thread-safe, per-receiver map of the statistics that
+ * receivers report to the sender and of what the sender observes about them.
+ */
+
+#include "LossMap.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+/**
+ * Adds a receiver. Its address is looked up from the socket.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ */
+void LossMap::add(const int sock)
+{
+    ReceiverStats      entry;
+    struct sockaddr_in peer;
+    socklen_t          len = sizeof(peer);
+
+    entry.sock = sock;
+    if (getpeername(sock, (struct sockaddr*)&peer, &len) == 0) {
+        entry.addr = std::string(inet_ntoa(peer.sin_addr)) + ":" +
+                     std::to_string(ntohs(peer.sin_port));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    receivers[sock] = entry;
+}
+
+
+/**
+ * Removes a receiver.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ */
+void LossMap::remove(const int sock) noexcept
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    receivers.erase(sock);
+}
+
+
+/**
+ * Updates a receiver's entry from a statistics report. The loss and drop rates
+ * are computed from the difference to the previous report. A receiver that
+ * isn't in the map is ignored.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ * @param[in] stats       The report as received, in network byte order.
+ */
+void LossMap::update(const int sock, const RecvStatsMsg& stats)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<int, ReceiverStats>::iterator it = receivers.find(sock);
+    if (it == receivers.end())
+        return;
+
+    ReceiverStats& entry       = it->second;
+    const uint64_t mcastpkts   = be64toh(stats.mcastpkts);
+    const uint64_t kerneldrops = be64toh(stats.kerneldrops);
+    const uint64_t retxreqs    = be64toh(stats.retxreqs);
+
+    /* a counter that went backwards belongs to a restarted receiver */
+    if (entry.reports && mcastpkts >= entry.mcastpkts &&
+            kerneldrops >= entry.kerneldrops && retxreqs >= entry.retxreqs) {
+        const double received  = mcastpkts - entry.mcastpkts;
+        const double requested = retxreqs - entry.retxreqs;
+        const double dropped   = kerneldrops - entry.kerneldrops;
+        entry.lossrate = (received + requested > 0) ?
+                         requested / (received + requested) : 0;
+        entry.droprate = (received + dropped > 0) ?
+                         dropped / (received + dropped) : 0;
+    }
+
+    entry.mcastpkts   = mcastpkts;
+    entry.kerneldrops = kerneldrops;
+    entry.recovered   = be64toh(stats.recovered);
+    entry.retxreqs    = retxreqs;
+    entry.retxqueue   = ntohl(stats.retxqueue);
+    entry.inflight    = ntohl(stats.inflight);
+    entry.missingbops = ntohl(stats.missingbops);
+    entry.rtt         = ntohl(stats.rtt);
+    entry.updated     = std::chrono::steady_clock::now();
+    entry.reports++;
+}
+
+
+/**
+ * Counts a retransmission request from a receiver. A receiver that isn't in
+ * the map is ignored.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ * @param[in] bytes       Number of data bytes retransmitted in response.
+ */
+void LossMap::countRetxReq(const int sock, const uint32_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<int, ReceiverStats>::iterator it = receivers.find(sock);
+    if (it != receivers.end()) {
+        it->second.retxreqsrecvd++;
+        it->second.retxbytes += bytes;
+    }
+}
+
+
+/**
+ * Counts a product completed by a receiver. A receiver that isn't in the map
+ * is ignored.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ * @param[in] latency     Time in seconds from sending the product to its
+ *                        completion by the receiver.
+ */
+void LossMap::countCompletion(const int sock, const double latency)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<int, ReceiverStats>::iterator it = receivers.find(sock);
+    if (it != receivers.end()) {
+        it->second.completions++;
+        it->second.latencysum += latency;
+    }
+}
+
+
+/**
+ * Records the action taken on a slow receiver and counts it.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ * @param[in] action      The action.
+ * @return                Whether the receiver is in the map. If not, nothing
+ *                        is recorded.
+ */
+bool LossMap::setSlowAction(const int sock, const int action)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<int, ReceiverStats>::iterator it = receivers.find(sock);
+    if (it == receivers.end())
+        return false;
+
+    it->second.slowaction = action;
+    switch (action) {
+        case SLOWRECV_FLAG:       slowstats.flagged++;      break;
+        case SLOWRECV_THROTTLE:   slowstats.throttled++;    break;
+        case SLOWRECV_RELEGATE:   slowstats.relegated++;    break;
+        case SLOWRECV_DISCONNECT: slowstats.disconnected++; break;
+    }
+    return true;
+}
+
+
+/**
+ * Returns the action taken on a slow receiver.
+ *
+ * @param[in] sock        The receiver's TCP socket.
+ * @return                The action or 0 if none was taken or the receiver
+ *                        isn't in the map.
+ */
+int LossMap::getSlowAction(const int sock)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::map<int, ReceiverStats>::const_iterator it = receivers.find(sock);
+    return (it == receivers.end()) ? 0 : it->second.slowaction;
+}
+
+
+/**
+ * Returns the number of receivers each slow-receiver action was taken on.
+ *
+ * @return                The counts.
+ */
+SlowRecvStats LossMap::getSlowStats()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return slowstats;
+}
+
+
+/**
+ * Returns the number of receivers.
+ *
+ * @return                The number of receivers in the map.
+ */
+size_t LossMap::size()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return receivers.size();
+}
+
+
+/**
+ * Returns a snapshot of every receiver's entry.
+ *
+ * @return                The entries ordered by socket.
+ */
+std::vector<ReceiverStats> LossMap::get()
+{
+    std::vector<ReceiverStats> entries;
+    std::unique_lock<std::mutex> lock(mutex);
+    entries.reserve(receivers.size());
+    for (std::map<int, ReceiverStats>::const_iterator it = receivers.begin();
+         it != receivers.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    return entries;
+}
@@ -0,0 +1,168 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LossMap.h
+ *
+ * This file defines a thread-safe, per-receiver map of the statistics that
+ * receivers report to the sender and of what the sender observes about them.
+ */
+
+#ifndef FMTP_SENDER_LOSSMAP_H_
+#define FMTP_SENDER_LOSSMAP_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fmtpBase.h"
+
+
+/** actions taken on a slow receiver, see fmtpSendv3::SetSlowRecvPolicy() */
+const int SLOWRECV_FLAG       = 1; /*!< only mark it */
+const int SLOWRECV_THROTTLE   = 2; /*!< pace its retransmissions */
+const int SLOWRECV_RELEGATE   = 3; /*!< stop waiting for it */
+const int SLOWRECV_DISCONNECT = 4; /*!< close its connection */
+
+
+/**
+ * What is known about one receiver. The reported counters are cumulative
+ * since the receiver started. The rates cover the interval between the last
+ * two reports.
+ */
+struct ReceiverStats {
+    int          sock;          /*!< the receiver's TCP socket */
+    std::string  addr;          /*!< the receiver's address as "ip:port" */
+    uint32_t     reports;       /*!< number of reports received */
+    /* latest report of the receiver, see RecvStatsMsg */
+    uint64_t     mcastpkts;
+    uint64_t     kerneldrops;
+    uint64_t     recovered;
+    uint64_t     retxreqs;
+    uint32_t     retxqueue;
+    uint32_t     inflight;
+    uint32_t     missingbops;
+    uint32_t     rtt;           /*!< round-trip time in microseconds */
+    /* observed by the sender */
+    uint64_t     retxreqsrecvd; /*!< retransmission requests received */
+    uint64_t     retxbytes;     /*!< bytes of data retransmitted */
+    /* fraction of multicast packets the receiver had to request */
+    double       lossrate;
+    /* fraction of multicast packets dropped by the receiver's kernel */
+    double       droprate;
+    /* products the receiver completed and their total completion latency */
+    uint64_t     completions;
+    double       latencysum;    /*!< seconds */
+    /* action taken because the receiver is slow, 0 if none */
+    int          slowaction;
+    /* when the latest report arrived */
+    std::chrono::steady_clock::time_point updated;
+
+    ReceiverStats() : sock(-1), addr(), reports(0), mcastpkts(0),
+                      kerneldrops(0), recovered(0), retxreqs(0),
+                      retxqueue(0), inflight(0), missingbops(0), rtt(0),
+                      retxreqsrecvd(0), retxbytes(0), lossrate(0),
+                      droprate(0), completions(0), latencysum(0),
+                      slowaction(0), updated() {}
+};
+
+
+/**
+ * Number of receivers each slow-receiver action was taken on, including
+ * receivers that are gone.
+ */
+struct SlowRecvStats {
+    uint64_t     flagged;
+    uint64_t     throttled;
+    uint64_t     relegated;
+    uint64_t     disconnected;
+
+    SlowRecvStats() : flagged(0), throttled(0), relegated(0),
+                      disconnected(0) {}
+};
+
+
+class LossMap {
+public:
+    /**
+     * Adds a receiver.
+     *
+     * @param[in] sock  The receiver's TCP socket.
+     */
+    void add(const int sock);
+    /**
+     * Removes a receiver.
+     *
+     * @param[in] sock  The receiver's TCP socket.
+     */
+    void remove(const int sock) noexcept;
+    /**
+     * Updates a receiver's entry from a statistics report.
+     *
+     * @param[in] sock   The receiver's TCP socket.
+     * @param[in] stats  The report as received, in network byte order.
+     */
+    void update(const int sock, const RecvStatsMsg& stats);
+    /**
+     * Counts a retransmission request from a receiver.
+     *
+     * @param[in] sock   The receiver's TCP socket.
+     * @param[in] bytes  Number of data bytes retransmitted in response.
+     */
+    void countRetxReq(const int sock, const uint32_t bytes);
+    /**
+     * Counts a product completed by a receiver.
+     *
+     * @param[in] sock     The receiver's TCP socket.
+     * @param[in] latency  Time in seconds from sending the product to its
+     *                     completion by the receiver.
+     */
+    void countCompletion(const int sock, const double latency);
+    /**
+     * Records the action taken on a slow receiver.
+     *
+     * @param[in] sock    The receiver's TCP socket.
+     * @param[in] action  The action, one of SLOWRECV_*.
+     * @return            Whether the receiver is in the map.
+     */
+    bool setSlowAction(const int sock, const int action);
+    /**
+     * Returns the action taken on a slow receiver.
+     *
+     * @param[in] sock  The receiver's TCP socket.
+     * @return          The action or 0 if none was taken.
+     */
+    int getSlowAction(const int sock);
+    /**
+     * Returns the number of receivers each slow-receiver action was taken on.
+     *
+     * @return  The counts.
+     */
+    SlowRecvStats getSlowStats();
+    /**
+     * Returns the number of receivers.
+     *
+     * @return  The number of receivers in the map.
+     */
+    size_t size();
+    /**
+     * Returns a snapshot of every receiver's entry.
+     *
+     * **Exception Safety:** Strong guarantee
+     *
+     * @return                    The entries ordered by socket.
+     * @throws    std::bad_alloc  If necessary space couldn't be allocated.
+     */
+    std::vector<ReceiverStats> get();
+
+private:
+    std::mutex                   mutex;
+    std::map<int, ReceiverStats> receivers;
+    SlowRecvStats                slowstats;
+};
+
+#endif /* FMTP_SENDER_LOSSMAP_H_ */
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: RateController.cpp
+ *
+ * This file implements an additive-increase/multiplicative-decrease controller
+ * of the multicast sending rate.
+ */
+
+#include "RateController.h"
+
+#include <stdexcept>
+
+
+/**
+ * Constructs. The rate starts at the floor. By default, the rate grows by a
+ * 32nd of the control range after an interval without congestion and shrinks
+ * to 70% after an interval in which more than 1% of the packets were lost.
+ *
+ * @param[in] floor    Lowest rate in bits per second.
+ * @param[in] ceiling  Highest rate in bits per second.
+ * @throws std::runtime_error  if `floor` is less than 1 Kbps or greater than
+ *                             `ceiling`.
+ */
+RateController::RateController(uint64_t floor, uint64_t ceiling)
+    : floor(floor), ceiling(ceiling), rate(floor),
+      increase((ceiling - floor) / 32), decrease(0.7), threshold(0.01)
+{
+    if (floor < 1000 || floor > ceiling) {
+        throw std::runtime_error("RateController::RateController() invalid "
+                "rate range.");
+    }
+    if (increase == 0)
+        increase = 1;
+}
+
+
+/**
+ * Sets the parameters of the control law.
+ *
+ * @param[in] increase   Amount in bits per second the rate grows by after an
+ *                       interval without congestion.
+ * @param[in] decrease   Factor the rate is multiplied by after an interval
+ *                       with congestion.
+ * @param[in] threshold  Loss fraction above which an interval counts as
+ *                       congested.
+ * @throws std::runtime_error  if `decrease` isn't in (0, 1) or `threshold`
+ *                             isn't in [0, 1).
+ */
+void RateController::SetAIMD(uint64_t increase, double decrease,
+                             double threshold)
+{
+    if (decrease <= 0 || decrease >= 1 || threshold < 0 || threshold >= 1) {
+        throw std::runtime_error("RateController::SetAIMD() invalid "
+                "parameter.");
+    }
+    this->increase  = increase;
+    this->decrease  = decrease;
+    this->threshold = threshold;
+}
+
+
+/**
+ * Sets the current rate, clamped to the floor and the ceiling.
+ *
+ * @param[in] rate  Rate in bits per second.
+ * @return          The current rate.
+ */
+uint64_t RateController::SetRate(uint64_t rate)
+{
+    this->rate = (rate < floor) ? floor : (rate > ceiling) ? ceiling : rate;
+    return this->rate;
+}
+
+
+/**
+ * Adjusts the rate after a control interval: multiplicatively down if the
+ * loss exceeds the threshold, additively up otherwise.
+ *
+ * @param[in] loss  Fraction of multicast packets lost by the worst receiver
+ *                  during the interval.
+ * @return          The new rate in bits per second.
+ */
+uint64_t RateController::Update(double loss)
+{
+    if (loss > threshold) {
+        return SetRate(static_cast<uint64_t>(rate * decrease));
+    }
+    return SetRate((ceiling - rate < increase) ? ceiling : rate + increase);
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: RateController.h
+ *
+ * This file defines an additive-increase/multiplicative-decrease controller
+ * of the multicast sending rate.
+ */
+
+#ifndef FMTP_SENDER_RATECONTROLLER_H_
+#define FMTP_SENDER_RATECONTROLLER_H_
+
+#include <stdint.h>
+
+
+class RateController {
+public:
+    /**
+     * Constructs. The rate starts at the floor.
+     *
+     * @param[in] floor    Lowest rate in bits per second.
+     * @param[in] ceiling  Highest rate in bits per second.
+     * @throws std::runtime_error  if `floor` is less than 1 Kbps or greater
+     *                             than `ceiling`.
+     */
+    RateController(uint64_t floor, uint64_t ceiling);
+    /**
+     * Sets the parameters of the control law.
+     *
+     * @param[in] increase   Amount in bits per second the rate grows by after
+     *                       an interval without congestion.
+     * @param[in] decrease   Factor the rate is multiplied by after an interval
+     *                       with congestion.
+     * @param[in] threshold  Loss fraction above which an interval counts as
+     *                       congested.
+     * @throws std::runtime_error  if `decrease` isn't in (0, 1) or `threshold`
+     *                             isn't in [0, 1).
+     */
+    void     SetAIMD(uint64_t increase, double decrease, double threshold);
+    /**
+     * Sets the current rate, clamped to the floor and the ceiling.
+     *
+     * @param[in] rate  Rate in bits per second.
+     * @return          The current rate.
+     */
+    uint64_t SetRate(uint64_t rate);
+    uint64_t GetRate() const {return rate;}
+    /**
+     * Adjusts the rate after a control interval.
+     *
+     * @param[in] loss  Fraction of multicast packets lost by the worst
+     *                  receiver during the interval.
+     * @return          The new rate in bits per second.
+     */
+    uint64_t Update(double loss);
+
+private:
+    uint64_t floor;
+    uint64_t ceiling;
+    uint64_t rate;
+    uint64_t increase;
+    double   decrease;
+    double   threshold;
+};
+
+#endif /* FMTP_SENDER_RATECONTROLLER_H_ */
@@ -39,6 +39,17 @@ public:
      * @return    true: receiver accepted; false: receiver rejected.
      */
     virtual bool verify_new_recv(int newsock) = 0;
+    /**
+     * Notifies the sending application that a receiver was found to be slow
+     * and what was done about it (see fmtpSendv3::SetSlowRecvPolicy()). For
+     * SLOWRECV_RELEGATE, the application is expected to move the
+     * receiver to a slower feed. This method is thread-safe. Does nothing by
+     * default.
+     *
+     * @param[in] sock    The receiver's socket.
+     * @param[in] action  The action taken.
+     */
+    virtual void notify_of_slow_recv(int /*sock*/, int /*action*/) {}
 };
 
 
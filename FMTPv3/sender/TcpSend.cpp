@@ -59,8 +59,8 @@
  *                        available port)
  */
 TcpSend::TcpSend(std::string tcpaddr, unsigned short tcpport)
-    : tcpAddr(tcpaddr), tcpPort(tcpport), sockListMutex(),
-      servAddr()
+    : servAddr(), tcpAddr(tcpaddr), tcpPort(tcpport), sockListMutex(),
+      transport(&Transport::sockets())
 {
 }
 
@@ -268,50 +268,35 @@ unsigned short TcpSend::getPortNum()
  */
 void TcpSend::Init()
 {
-    int alive = 1;
-    //int aliveidle = 10; /* keep alive time = 10 sec */
-    int aliveintvl = 30; /* keep alive interval = 30 sec */
     pmtu = MIN_MTU; /* initialize pmtu with defined min MTU */
 
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
+    (void) memset((char *) &servAddr, 0, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    in_addr_t inAddr = inet_addr(tcpAddr.c_str());
+    if ((in_addr_t)(-1) == inAddr) {
         throw std::system_error(errno, std::system_category(),
-                "TcpSend::Init() error creating socket");
+                "TcpSend::Init() Invalid interface: " + tcpAddr);
     }
+    servAddr.sin_addr.s_addr = inAddr;
+    /* If tcpPort = 0, OS will automatically choose an available port number. */
+    servAddr.sin_port = htons(tcpPort);
+    /**
+     * Let the sender make some noise instead of quietly sending a FIN to the
+     * receiver. An exception thrown by the transport will bubble up and
+     * eventually being logged in the LDM log file.
+     */
+    sockfd = transport->openListen(servAddr, MAX_CONNECTION);
+}
 
-    try {
-        (void) memset((char *) &servAddr, 0, sizeof(servAddr));
-        servAddr.sin_family = AF_INET;
-        in_addr_t inAddr = inet_addr(tcpAddr.c_str());
-        if ((in_addr_t)(-1) == inAddr) {
-            throw std::system_error(errno, std::system_category(),
-                    "TcpSend::Init() Invalid interface: " + tcpAddr);
-        }
-        servAddr.sin_addr.s_addr = inAddr;
-        /* If tcpPort = 0, OS will automatically choose an available port number. */
-        servAddr.sin_port = htons(tcpPort);
-#if 0
-        cerr << std::string("TcpSend::TcpSend() Binding TCP socket to ").
-                append(tcpAddr).append(":").append(std::to_string(tcpPort)).
-                append("\n");
-#endif
-        if(::bind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0) {
-            throw std::system_error(errno, std::system_category(),
-                    "TcpSend::TcpSend(): Couldn't bind " + tcpAddr + ":"
-                    + std::to_string(static_cast<unsigned int>(tcpPort)));
-        }
-    }
-    catch (std::runtime_error& e) {
-        close(sockfd);
-        /**
-         * Let the sender make some noise instead of quietly sending a FIN
-         * to the receiver. The exception caught in TcpSend will bubble up
-         * and eventually being logged in the LDM log file.
-         */
-        std::rethrow_exception(std::current_exception());
-    }
-    /* listen() returns right away, it's non-blocking */
-    listen(sockfd, MAX_CONNECTION);
+
+/**
+ * Sets the transport that opens the listening socket.
+ *
+ * @param[in] transport  The transport.
+ */
+void TcpSend::SetTransport(Transport& transport)
+{
+    this->transport = &transport;
 }
 
 
@@ -361,6 +346,22 @@ int TcpSend::readSock(int retxsockfd, char* pktBuf, int bufSize)
 }
 
 
+/**
+ * Reads the payload that follows a header parsed by parseHeader(). Blocks
+ * until the whole payload is read or the end-of-file is encountered.
+ *
+ * @param[in]  retxsockfd   retransmission socket file descriptor.
+ * @param[out] buf          buffer to hold the payload.
+ * @param[in]  len          length of the payload in bytes.
+ * @return     size_t       number of bytes read, less than `len` on EOF.
+ * @throws std::system_error  if an error occurs reading the socket.
+ */
+size_t TcpSend::recvPayload(int retxsockfd, void* buf, size_t len)
+{
+    return recvall(retxsockfd, buf, len);
+}
+
+
 /**
  * Removes the given socket from the list.
  *
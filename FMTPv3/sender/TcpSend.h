@@ -43,6 +43,7 @@
 #include <string>
 
 #include "TcpBase.h"
+#include "Transport.h"
 #include "fmtpBase.h"
 
 
@@ -58,12 +59,31 @@ public:
     /** return the reference of a socket list */
     const std::list<int> getConnSockList();
     int getMinPathMTU();
+    /** returns the listening socket */
+    int getListenSock() const {return sockfd;}
     unsigned short getPortNum();
     void Init(); /*!< start point that upper layer should call */
+    /**
+     * Sets the transport that opens the listening socket. Must be called
+     * before `Init()`.
+     *
+     * @param[in] transport  The transport.
+     */
+    void SetTransport(Transport& transport);
     /** only parse the header part of a coming packet */
     int parseHeader(int retxsockfd, FmtpHeader* recvheader);
     /** read any data coming into this given socket */
     int readSock(int retxsockfd, char* pktBuf, int bufSize);
+    /**
+     * Reads the payload that follows a parsed header.
+     *
+     * @param[in]  retxsockfd  retransmission socket file descriptor.
+     * @param[out] buf         buffer to hold the payload.
+     * @param[in]  len         length of the payload in bytes.
+     * @return                 Number of bytes read. Less than `len` on EOF.
+     * @throws std::system_error  if an error occurs reading the socket.
+     */
+    size_t recvPayload(int retxsockfd, void* buf, size_t len);
     void rmSockInList(int sockfd);
     /** gathering send by calling io vector system call */
     int sendData(int retxsockfd, FmtpHeader* sendheader, char* payload,
@@ -79,6 +99,7 @@ private:
     std::list<int>     connSockList;
     std::mutex         sockListMutex; /*!< to protect shared sockList */
     std::atomic<int>   pmtu; /* min path MTU of the mcast group */
+    Transport*         transport;
 
     /**
      * Sets the keep-alive mechanism on a TCP socket.
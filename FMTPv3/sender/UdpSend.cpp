@@ -54,8 +54,8 @@
  */
 UdpSend::UdpSend(const std::string& recvaddr, const unsigned short recvport,
                  const unsigned char ttl, const std::string& ifAddr)
-    : recvAddr(recvaddr), recvPort(recvport), ttl(ttl), ifAddr(ifAddr),
-      sock_fd(-1), recv_addr()
+    : sock_fd(-1), recvAddr(recvaddr), recvPort(recvport), ttl(ttl),
+      ifAddr(ifAddr), transport(&Transport::sockets()), injector(NULL)
 {
 }
 
@@ -71,62 +71,26 @@ UdpSend::~UdpSend()
 
 
 /**
- * Initializer. It creates a new UDP socket and sets the address and port from
- * the pre-set parameters. Also it connects to the created socket and if
- * necessary, sets the TTL field with a new value.
+ * Initializer. It has the transport open a socket that multicasts to the
+ * address and port given to the constructor with the TTL and interface given
+ * to it.
  *
- * @throws std::runtime_error  if socket creation fails.
- * @throws std::runtime_error  if connecting to socket fails.
- * @throws std::runtime_error  if setting TTL fails.
+ * @throws std::runtime_error  if the socket can't be opened.
  */
 void UdpSend::Init()
 {
-    int newttl = ttl;
-    struct in_addr interfaceIP;
-    /** create a UDP datagram socket. */
-    if((sock_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        throw std::runtime_error(
-                "UdpSend::Init() Couldn't create UDP socket");
-    }
-
-    /** clear struct recv_addr. */
-    (void) memset(&recv_addr, 0, sizeof(recv_addr));
-    /** set connection type to IPv4 */
-    recv_addr.sin_family = AF_INET;
-    /** set the address to the receiver address passed to the constructor */
-    recv_addr.sin_addr.s_addr = inet_addr(recvAddr.c_str());
-    /** set the port number to the port number passed to the constructor */
-    recv_addr.sin_port = htons(recvPort);
-
-    int reuseaddr = true;
-    if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
-                   sizeof(reuseaddr)) < 0) {
-        throw std::runtime_error(
-                "UdpSend::Init() Couldn't enable Address reuse");
-    }
-
-#ifdef SO_REUSEPORT
-    int reuseport = true;
-    if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &reuseport,
-                   sizeof(reuseport)) < 0) {
-        throw std::runtime_error(
-                "UdpSend::Init() Couldn't enable Port reuse");
-    }
-#endif
+    sock_fd = transport->openMcastSend(recvAddr, recvPort, ttl, ifAddr);
+}
 
-    if (setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_TTL, &newttl,
-                sizeof(newttl)) < 0) {
-        throw std::runtime_error(
-                "UdpSend::Init() Couldn't set UDP socket time-to-live "
-                "option to " + std::to_string(ttl));
-    }
 
-    interfaceIP.s_addr = inet_addr(ifAddr.c_str());
-    if (setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_IF, &interfaceIP,
-                   sizeof(interfaceIP)) < 0) {
-        throw std::runtime_error(
-                "UdpSend::Init() Couldn't set UDP socket default interface");
-    }
+/**
+ * Sets the transport that opens the socket.
+ *
+ * @param[in] transport  The transport.
+ */
+void UdpSend::SetTransport(Transport& transport)
+{
+    this->transport = &transport;
 }
 
 
@@ -155,20 +119,21 @@ ssize_t UdpSend::SendData(void* header, size_t headerLen, void* data,
     iov[1].iov_base = data;
     iov[1].iov_len  = dataLen;
 
-    msg.msg_name       = &recv_addr;
-    msg.msg_namelen    = sizeof(recv_addr);
+    /* the socket is connected to the destination */
+    msg.msg_name       = NULL;
+    msg.msg_namelen    = 0;
     msg.msg_iov        = iov;
     msg.msg_iovlen     = 2;
     msg.msg_control    = NULL;
     msg.msg_controllen = 0;
     msg.msg_flags      = 0;
 
-    ssize_t ret = sendmsg(sock_fd, &msg, 0);
+    ssize_t ret = transmit(&msg);
     if (ret == -1) {
         throw std::runtime_error(
                 "UdpSend::SendData() error occurred when calling sendmsg()");
     }
-    else if (ret != (headerLen + dataLen)) {
+    else if ((size_t)ret != (headerLen + dataLen)) {
         throw std::runtime_error(
                 "UdpSend::SendData() bytes sent on wire not equal "
                 "to expectation.");
@@ -188,14 +153,27 @@ ssize_t UdpSend::SendData(void* header, size_t headerLen, void* data,
  */
 ssize_t UdpSend::SendTo(const void* buff, size_t len)
 {
-    ssize_t nbytes = sendto(sock_fd, buff, len, 0,
-                            (struct sockaddr *)&recv_addr, sizeof(recv_addr));
+    struct msghdr msg;
+    struct iovec  iov;
+    iov.iov_base = const_cast<void*>(buff);
+    iov.iov_len  = len;
+
+    /* the socket is connected to the destination */
+    msg.msg_name       = NULL;
+    msg.msg_namelen    = 0;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = NULL;
+    msg.msg_controllen = 0;
+    msg.msg_flags      = 0;
+
+    ssize_t nbytes = transmit(&msg);
 
     if (nbytes == -1) {
         throw std::runtime_error(
-                "UdpSend::SendTo() error occurred when calling sendto()");
+                "UdpSend::SendTo() error occurred when calling sendmsg()");
     }
-    else if (nbytes != len) {
+    else if ((size_t)nbytes != len) {
         throw std::runtime_error(
                 "UdpSend::SendTo() bytes sent on wire not equal "
                 "to expectation.");
@@ -217,15 +195,16 @@ ssize_t UdpSend::SendTo(struct iovec* const iovec, const int nvec)
 {
     struct msghdr msg;
 
-    msg.msg_name       = &recv_addr;
-    msg.msg_namelen    = sizeof(recv_addr);
+    /* the socket is connected to the destination */
+    msg.msg_name       = NULL;
+    msg.msg_namelen    = 0;
     msg.msg_iov        = iovec;
     msg.msg_iovlen     = nvec;
     msg.msg_control    = NULL;
     msg.msg_controllen = 0;
     msg.msg_flags      = 0;
 
-    ssize_t nbytes = sendmsg(sock_fd, &msg, 0);
+    ssize_t nbytes = transmit(&msg);
 
     /* computes total expected bytes to be sent. */
     size_t expbytes = 0;
@@ -237,7 +216,7 @@ ssize_t UdpSend::SendTo(struct iovec* const iovec, const int nvec)
         throw std::runtime_error(
                 "UdpSend::SendTo() error occurred when calling sendmsg()");
     }
-    else if (nbytes != expbytes) {
+    else if ((size_t)nbytes != expbytes) {
         throw std::runtime_error(
                 "UdpSend::SendTo() nbytes sent on wire not equal "
                 "to expbytes.");
@@ -245,3 +224,71 @@ ssize_t UdpSend::SendTo(struct iovec* const iovec, const int nvec)
 
     return nbytes;
 }
+
+
+/**
+ * Has a fault injector decide the fate of every packet sent.
+ *
+ * @param[in] injector  The fault injector or NULL for none.
+ */
+void UdpSend::SetFaultInjector(FaultInjector* const injector)
+{
+    this->injector = injector;
+}
+
+
+/**
+ * Sends a packet. With a fault injector, a dropped packet isn't sent, a
+ * duplicated one is sent twice and a delayed one is copied and sent once
+ * the injector's reorder depth of later packets have been sent.
+ *
+ * @param[in] msg  The packet.
+ * @return         What `sendmsg()` returned or, for a dropped or delayed
+ *                 packet, its length.
+ */
+ssize_t UdpSend::transmit(struct msghdr* const msg)
+{
+    if (!injector)
+        return sendmsg(sock_fd, msg, 0);
+
+    std::string packet;
+    for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+        packet.append(static_cast<const char*>(msg->msg_iov[i].iov_base),
+                      msg->msg_iov[i].iov_len);
+    }
+    if (packet.size() < sizeof(FmtpHeader))
+        return sendmsg(sock_fd, msg, 0);
+
+    FmtpHeader header;
+    (void)memcpy(&header, packet.data(), sizeof(header));
+    header.prodindex  = ntohl(header.prodindex);
+    header.seqnum     = ntohl(header.seqnum);
+    header.payloadlen = ntohs(header.payloadlen);
+    header.flags      = ntohs(header.flags);
+
+    std::unique_lock<std::mutex> lock(faultmtx);
+    const FaultAction action = injector->decide(header);
+    if (action == FAULT_DROP)
+        return packet.size();
+    if (action == FAULT_DELAY) {
+        delayed.push_back(std::make_pair(injector->reorderDepth(), packet));
+        return packet.size();
+    }
+
+    ssize_t nbytes = sendmsg(sock_fd, msg, 0);
+    if (nbytes >= 0 && action == FAULT_DUPLICATE)
+        nbytes = sendmsg(sock_fd, msg, 0);
+
+    /* a delayed packet that can't be sent is as good as dropped */
+    for (std::deque<std::pair<unsigned, std::string> >::iterator it =
+         delayed.begin(); it != delayed.end();) {
+        if (--it->first == 0) {
+            (void)send(sock_fd, it->second.data(), it->second.size(), 0);
+            it = delayed.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    return nbytes;
+}
@@ -37,7 +37,13 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <utility>
+
+#include "FaultInjector.h"
+#include "Transport.h"
 
 
 class UdpSend {
@@ -66,14 +72,42 @@ public:
      * @param[in] nvec   Number of I/O vectors.
      */
     ssize_t SendTo(struct iovec* const iovec, const int nvec);
+    /**
+     * Has a fault injector decide the fate of every packet sent. Must be
+     * called before the first packet is sent.
+     *
+     * @param[in] injector  The fault injector or NULL for none.
+     */
+    void SetFaultInjector(FaultInjector* const injector);
+    /**
+     * Sets the transport that opens the socket. Must be called before
+     * `Init()`.
+     *
+     * @param[in] transport  The transport.
+     */
+    void SetTransport(Transport& transport);
 
 private:
+    /**
+     * Sends a packet, subject to the fault injector if there is one.
+     *
+     * @param[in] msg  The packet.
+     * @return         What `sendmsg()` returned or, for a dropped or delayed
+     *                 packet, its length.
+     */
+    ssize_t transmit(struct msghdr* const msg);
+
     int                   sock_fd;
-    struct sockaddr_in    recv_addr;
     const std::string     recvAddr;
     const unsigned short  recvPort;
     const unsigned short  ttl;
     const std::string     ifAddr;
+    Transport*            transport;
+    /* fault injection, see SetFaultInjector() */
+    FaultInjector*        injector;
+    std::mutex            faultmtx;
+    /* delayed packets and the number of packets they still wait for */
+    std::deque<std::pair<unsigned, std::string> > delayed;
 };
 
 
@@ -0,0 +1,1029 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpSendEngine.cpp
+ *
+ * This file implements the multi-feed sender engine.
+ */
+
+#include "fmtpSendEngine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+/* most bytes queued for a receiver before its requests are no longer read */
+#define MAX_CONN_BACKLOG  (1024 * 1024)
+
+
+/**
+ * Constructs an engine. No thread runs until `Start()` is called.
+ *
+ * @param[in] transmitters  Number of transmit threads. A transmit thread
+ *                          interleaves the packets of its feeds, each at the
+ *                          feed's own rate, so their total rate is what one
+ *                          thread can sustain.
+ * @param[in] reactors      Number of reactor threads.
+ * @throw std::invalid_argument  if a number is 0.
+ * @throw std::runtime_error     if an epoll instance can't be created.
+ */
+fmtpSendEngine::fmtpSendEngine(const unsigned transmitters,
+                               const unsigned reactors)
+    :
+    transmitters(),
+    reactors(),
+    placement(),
+    feedmtx(),
+    feeds(),
+    running(false),
+    stopping(false),
+    timermtx(),
+    timer_cv(),
+    timeouts(),
+    timer_t(),
+    exitmtx(),
+    except()
+{
+    if (transmitters == 0 || reactors == 0) {
+        throw std::invalid_argument("fmtpSendEngine::fmtpSendEngine() no "
+                "transmit or reactor thread");
+    }
+    for (unsigned i = 0; i < transmitters; i++) {
+        Transmitter* const tx = new Transmitter();
+        tx->engine = this;
+        tx->last   = NULL;
+        this->transmitters.push_back(tx);
+    }
+    for (unsigned i = 0; i < reactors; i++) {
+        Reactor* const reactor = new Reactor();
+        reactor->engine = this;
+        reactor->epfd   = epoll_create1(EPOLL_CLOEXEC);
+        reactor->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        this->reactors.push_back(reactor);
+        if (reactor->epfd < 0 || reactor->wakefd < 0) {
+            closeAll();
+            throw std::runtime_error("fmtpSendEngine::fmtpSendEngine() "
+                    "couldn't create epoll instance");
+        }
+        struct epoll_event event = {};
+        event.events  = EPOLLIN;
+        event.data.fd = reactor->wakefd;
+        (void)epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakefd,
+                        &event);
+    }
+}
+
+
+/**
+ * Destroys the engine. Stops it first if it is running; failures are then
+ * ignored.
+ */
+fmtpSendEngine::~fmtpSendEngine()
+{
+    bool isRunning;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        isRunning = running;
+    }
+    if (isRunning) {
+        try {
+            Stop();
+        }
+        catch (...) {
+        }
+    }
+    closeAll();
+}
+
+
+/**
+ * Releases the thread states and closes the epoll instances.
+ */
+void fmtpSendEngine::closeAll()
+{
+    for (size_t i = 0; i < transmitters.size(); i++)
+        delete transmitters[i];
+    transmitters.clear();
+    for (size_t i = 0; i < reactors.size(); i++) {
+        if (reactors[i]->epfd >= 0)
+            (void)close(reactors[i]->epfd);
+        if (reactors[i]->wakefd >= 0)
+            (void)close(reactors[i]->wakefd);
+        delete reactors[i];
+    }
+    reactors.clear();
+}
+
+
+/**
+ * Adds a configured sender as a feed. The sender must not have been started
+ * and must outlive the engine's `Stop()`. If the engine is running, the feed
+ * is started immediately; otherwise it is started by `Start()`. The feed's
+ * own `Start()` must not be called, and its `Stop()` only to stop serving it
+ * before the engine stops.
+ *
+ * @param[in] feed  The sender.
+ * @throw std::invalid_argument  if the feed is NULL or was already added.
+ * @throw std::runtime_error     if the feed can't be started.
+ */
+void fmtpSendEngine::addFeed(fmtpSendv3* const feed)
+{
+    std::unique_lock<std::mutex> lock(feedmtx);
+    if (feed == NULL || feeds.count(feed)) {
+        throw std::invalid_argument("fmtpSendEngine::addFeed() invalid or "
+                "duplicate feed");
+    }
+    EngineFeed& entry = feeds[feed];
+    entry.transmitter = (feeds.size() - 1) % transmitters.size();
+    entry.reactor     = (feeds.size() - 1) % reactors.size();
+    entry.nextIndex   = feed->prodIndex;
+    entry.active      = false;
+    if (running) {
+        try {
+            attachFeed(feed);
+        }
+        catch (...) {
+            feeds.erase(feed);
+            throw;
+        }
+    }
+}
+
+
+/**
+ * Starts a feed and has the engine's threads serve it.
+ *
+ * @pre                 `feedmtx` is locked.
+ * @param[in] feed      The feed.
+ * @throw std::runtime_error  if the feed can't be started.
+ */
+void fmtpSendEngine::attachFeed(fmtpSendv3* const feed)
+{
+    EngineFeed& entry = feeds[feed];
+    feed->startHosted(this);
+    entry.active = true;
+    Conn conn = {feed, true, std::shared_ptr<ConnIO>()};
+    watch(reactors[entry.reactor], feed->tcpsend->getListenSock(), conn);
+}
+
+
+/**
+ * Stops serving a feed: its sockets are no longer waited for and its queued
+ * products and timeouts are dropped. Called by the feed when it stops,
+ * possibly on one of the engine's threads.
+ *
+ * @param[in] feed  The feed.
+ */
+void fmtpSendEngine::detachFeed(fmtpSendv3* const feed)
+{
+    Reactor* reactor;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        std::map<fmtpSendv3*, EngineFeed>::iterator it = feeds.find(feed);
+        if (it == feeds.end() || !it->second.active)
+            return;
+        it->second.active = false;
+        reactor = reactors[it->second.reactor];
+    }
+
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    std::map<int, Conn>::iterator it = reactor->conns.begin();
+    while (it != reactor->conns.end()) {
+        if (it->second.feed == feed) {
+            (void)epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, it->first, NULL);
+            reactor->conns.erase(it++);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+
+/**
+ * Returns whether the engine serves a feed.
+ *
+ * @param[in] feed  The feed.
+ * @return          Whether the feed is served.
+ */
+bool fmtpSendEngine::isActive(fmtpSendv3* const feed)
+{
+    std::unique_lock<std::mutex> lock(feedmtx);
+    std::map<fmtpSendv3*, EngineFeed>::const_iterator it = feeds.find(feed);
+    return it != feeds.end() && it->second.active;
+}
+
+
+/**
+ * Queues a product for multicasting by the feed's transmit thread. Products
+ * of the same feed are multicast in the order they are queued, so the index
+ * of a product is known when it is queued.
+ *
+ * @param[in] feed      The feed.
+ * @param[in] data      The product. Must stay valid until the feed's
+ *                      application is notified of the product's end.
+ * @param[in] dataSize  Size of the product in bytes.
+ * @param[in] metadata  Metadata of the product or 0.
+ * @param[in] metaSize  Size of the metadata in bytes.
+ * @return              Index the product will have.
+ * @throw std::invalid_argument  if the feed isn't served by the engine.
+ */
+uint32_t fmtpSendEngine::sendProduct(fmtpSendv3* const feed, void* const data,
+                                     const uint32_t dataSize,
+                                     void* const metadata,
+                                     const uint16_t metaSize)
+{
+    std::unique_lock<std::mutex> lock(feedmtx);
+    std::map<fmtpSendv3*, EngineFeed>::iterator it = feeds.find(feed);
+    if (it == feeds.end() || !it->second.active) {
+        throw std::invalid_argument("fmtpSendEngine::sendProduct() feed "
+                "isn't served");
+    }
+
+    Transmitter* const tx = transmitters[it->second.transmitter];
+    EngineJob job = {feed, data, dataSize, metadata, metaSize};
+    {
+        std::unique_lock<std::mutex> txlock(tx->mtx);
+        tx->feeds[feed].jobs.push_back(job);
+    }
+    tx->cv.notify_one();
+    return it->second.nextIndex++;
+}
+
+
+/**
+ * Sets where and how the engine's threads run: the transmit threads have the
+ * multicast role, the reactor threads the retransmission role and the timer
+ * thread the timer role. Must be called before `Start()`.
+ *
+ * @param[in] placement  The thread placement.
+ */
+void fmtpSendEngine::SetThreadPlacement(const ThreadPlacement& placement)
+{
+    this->placement = placement;
+}
+
+
+/**
+ * Starts the engine's threads and the feeds added so far. If a thread can't
+ * be created, the ones created before it are stopped again and the engine
+ * isn't running.
+ *
+ * @throw std::runtime_error  if the engine is already running or a thread or
+ *                            feed can't be started.
+ */
+void fmtpSendEngine::Start()
+{
+    std::unique_lock<std::mutex> lock(feedmtx);
+    if (running) {
+        throw std::runtime_error("fmtpSendEngine::Start() already running");
+    }
+
+    int retval = pthread_create(&timer_t, NULL, &fmtpSendEngine::timerWrapper,
+                                this);
+    if (retval != 0) {
+        throw std::runtime_error("fmtpSendEngine::Start() pthread_create() "
+                "timerWrapper error with retval = " + std::to_string(retval));
+    }
+    /* the threads created so far are stopped again if one can't be */
+    for (size_t i = 0; i < transmitters.size(); i++) {
+        retval = pthread_create(&transmitters[i]->thread, NULL,
+                                &fmtpSendEngine::transmitWrapper,
+                                transmitters[i]);
+        if (retval != 0) {
+            joinThreads(i, 0);
+            throw std::runtime_error("fmtpSendEngine::Start() "
+                    "pthread_create() transmitWrapper error with retval = " +
+                    std::to_string(retval));
+        }
+    }
+    for (size_t i = 0; i < reactors.size(); i++) {
+        retval = pthread_create(&reactors[i]->thread, NULL,
+                                &fmtpSendEngine::reactWrapper, reactors[i]);
+        if (retval != 0) {
+            joinThreads(transmitters.size(), i);
+            throw std::runtime_error("fmtpSendEngine::Start() "
+                    "pthread_create() reactWrapper error with retval = " +
+                    std::to_string(retval));
+        }
+    }
+    running = true;
+
+    for (std::map<fmtpSendv3*, EngineFeed>::iterator it = feeds.begin();
+         it != feeds.end(); ++it)
+        attachFeed(it->first);
+}
+
+
+/**
+ * Stops the engine's threads and then every feed. Products still queued are
+ * dropped. Doesn't return until all threads have stopped.
+ *
+ * @throw std::exception  the first failure of an engine thread or, if there
+ *                        was none, of a feed.
+ */
+void fmtpSendEngine::Stop()
+{
+    std::vector<fmtpSendv3*> stopped;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        if (!running)
+            return;
+        running = false;
+        for (std::map<fmtpSendv3*, EngineFeed>::iterator it = feeds.begin();
+             it != feeds.end(); ++it)
+            stopped.push_back(it->first);
+    }
+
+    joinThreads(transmitters.size(), reactors.size());
+
+    std::exception_ptr failure;
+    for (size_t i = 0; i < stopped.size(); i++) {
+        try {
+            stopped[i]->Stop();
+        }
+        catch (...) {
+            if (!failure)
+                failure = std::current_exception();
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(exitmtx);
+        if (except)
+            failure = except;
+        except = std::exception_ptr();
+    }
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+
+/**
+ * Stops and joins the timer thread and the given numbers of the first
+ * transmit and reactor threads. Products still queued are dropped.
+ *
+ * @param[in] ntransmitters  Number of transmit threads that were started.
+ * @param[in] nreactors      Number of reactor threads that were started.
+ */
+void fmtpSendEngine::joinThreads(const size_t ntransmitters,
+                                 const size_t nreactors)
+{
+    stopping = true;
+    {
+        std::unique_lock<std::mutex> lock(timermtx);
+        timer_cv.notify_all();
+    }
+    (void)pthread_join(timer_t, NULL);
+    for (size_t i = 0; i < ntransmitters; i++) {
+        {
+            std::unique_lock<std::mutex> lock(transmitters[i]->mtx);
+            transmitters[i]->cv.notify_all();
+        }
+        (void)pthread_join(transmitters[i]->thread, NULL);
+    }
+    for (size_t i = 0; i < transmitters.size(); i++)
+        transmitters[i]->feeds.clear();
+    for (size_t i = 0; i < nreactors; i++) {
+        const uint64_t one = 1;
+        uint64_t       count;
+        (void)write(reactors[i]->wakefd, &one, sizeof(one));
+        (void)pthread_join(reactors[i]->thread, NULL);
+        /* a restarted reactor mustn't be woken up again */
+        (void)read(reactors[i]->wakefd, &count, sizeof(count));
+    }
+    stopping = false;
+}
+
+
+/**
+ * Schedules the timeout of a product of a feed on the timer thread.
+ *
+ * @param[in] feed       The feed.
+ * @param[in] prodindex  Index of the product.
+ * @param[in] seconds    Time until the timeout in seconds.
+ */
+void fmtpSendEngine::scheduleTimeout(fmtpSendv3* const feed,
+                                     const uint32_t prodindex,
+                                     const double seconds)
+{
+    EngineTimeout timeout;
+    timeout.deadline  = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+    timeout.feed      = feed;
+    timeout.prodindex = prodindex;
+
+    std::unique_lock<std::mutex> lock(timermtx);
+    const bool earliest = timeouts.empty() ||
+        timeout.deadline < timeouts.top().deadline;
+    timeouts.push(timeout);
+    if (earliest)
+        timer_cv.notify_one();
+}
+
+
+/**
+ * Has a reactor wait for a socket to become readable. The socket of a
+ * receiver is made non-blocking.
+ *
+ * @param[in] reactor  The reactor.
+ * @param[in] sock     The socket.
+ * @param[in] conn     What the socket is.
+ * @throw std::runtime_error  if the socket can't be added.
+ */
+void fmtpSendEngine::watch(Reactor* const reactor, const int sock,
+                           const Conn& conn)
+{
+    if (conn.io) {
+        const int flags = fcntl(sock, F_GETFL);
+        if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw std::runtime_error("fmtpSendEngine::watch() couldn't make "
+                    "socket " + std::to_string(sock) + " non-blocking");
+        }
+        conn.io->events = EPOLLIN;
+    }
+
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    struct epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = sock;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, sock, &event) < 0) {
+        throw std::runtime_error("fmtpSendEngine::watch() epoll_ctl() "
+                "failed for socket " + std::to_string(sock));
+    }
+    reactor->conns[sock] = conn;
+}
+
+
+/**
+ * Has a reactor stop waiting for a socket. Must be called before the socket
+ * is closed.
+ *
+ * @param[in] reactor  The reactor.
+ * @param[in] sock     The socket.
+ */
+void fmtpSendEngine::unwatch(Reactor* const reactor, const int sock)
+{
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    if (reactor->conns.erase(sock))
+        (void)epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, sock, NULL);
+}
+
+
+/**
+ * Queues a message to a receiver of a feed on the receiver's connection,
+ * which the feed's reactor thread writes as the receiver reads. The reactor
+ * is woken up unless output is already pending.
+ *
+ * @param[in] feed     The feed.
+ * @param[in] sock     The receiver's socket.
+ * @param[in] header   FMTP header of the message in network byte order.
+ * @param[in] payload  Payload of the message.
+ * @param[in] paylen   Length of the payload in bytes.
+ * @return             Number of bytes queued, 0 if the receiver or the feed
+ *                     is no longer served.
+ */
+int fmtpSendEngine::queueUnicast(fmtpSendv3* const       feed,
+                                 const int               sock,
+                                 const FmtpHeader* const header,
+                                 const char* const       payload,
+                                 const size_t            paylen)
+{
+    Reactor* reactor;
+    {
+        std::unique_lock<std::mutex> lock(feedmtx);
+        std::map<fmtpSendv3*, EngineFeed>::const_iterator it =
+            feeds.find(feed);
+        if (it == feeds.end() || !it->second.active)
+            return 0;
+        reactor = reactors[it->second.reactor];
+    }
+
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    std::map<int, Conn>::const_iterator it = reactor->conns.find(sock);
+    if (it == reactor->conns.end() || !it->second.io)
+        return 0;
+    std::vector<char>& out = it->second.io->out;
+    const char* const  hdr = reinterpret_cast<const char*>(header);
+    out.insert(out.end(), hdr, hdr + FMTP_HEADER_LEN);
+    if (paylen)
+        out.insert(out.end(), payload, payload + paylen);
+
+    if (reactor->pending.empty()) {
+        const uint64_t one = 1;
+        (void)write(reactor->wakefd, &one, sizeof(one));
+    }
+    reactor->pending.insert(sock);
+    return FMTP_HEADER_LEN + paylen;
+}
+
+
+/**
+ * Reads what a receiver has sent, at most one buffer per call so that the
+ * receivers of a reactor take turns, and handles its complete messages. The
+ * start of a message that hasn't fully arrived is kept for the next call.
+ *
+ * @param[in] sock  The receiver's socket.
+ * @param[in] conn  The receiver's connection.
+ * @return          False if the receiver closed its connection.
+ * @throw std::runtime_error  if the connection is broken or a message is
+ *                            invalid.
+ */
+bool fmtpSendEngine::readConn(const int sock, const Conn& conn)
+{
+    char          buf[64 * 1024];
+    const ssize_t nbytes = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+
+    if (nbytes == 0)
+        return false;
+    if (nbytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return true;
+        throw std::runtime_error("fmtpSendEngine::readConn() recv() error: " +
+                std::string(strerror(errno)));
+    }
+
+    std::vector<char>& in = conn.io->in;
+    in.insert(in.end(), buf, buf + nbytes);
+    const size_t used = conn.feed->serveRetxBuffer(sock, in.data(),
+                                                   in.size());
+    in.erase(in.begin(), in.begin() + used);
+    return true;
+}
+
+
+/**
+ * Writes what is queued for a receiver as far as the receiver's socket takes
+ * it without blocking. Output to a throttled slow receiver is paced at the
+ * feed's throttle rate by the connection's token bucket; the reactor writes
+ * more once the bucket allows it. While output remains that the socket
+ * didn't take, the reactor waits for the socket to become writable, and
+ * while too much is queued, it stops reading the receiver's requests.
+ *
+ * @param[in] reactor  The reactor.
+ * @param[in] sock     The receiver's socket.
+ * @param[in] conn     The receiver's connection.
+ * @throw std::runtime_error  if the connection is broken.
+ */
+void fmtpSendEngine::flushConn(Reactor* const reactor, const int sock,
+                               const Conn& conn)
+{
+    ConnIO&        io   = *conn.io;
+    const uint64_t rate = conn.feed->retxRate(sock);
+    if (rate)
+        io.shaper.SetRate(rate);
+
+    std::unique_lock<std::mutex> lock(reactor->mtx);
+    if (reactor->conns.count(sock) == 0)
+        return; // no longer served
+    bool blocked = false;
+    while (io.outpos < io.out.size()) {
+        size_t len = io.out.size() - io.outpos;
+        if (rate) {
+            const TokenBucket::Clock::time_point now =
+                TokenBucket::Clock::now();
+            const TokenBucket::Clock::time_point ready =
+                io.bucket.ReadyTime(now);
+            if (ready > now) {
+                reactor->paced[sock] = ready;
+                break;
+            }
+            len = std::min(len, (size_t)MAX_FMTP_PACKET_LEN);
+        }
+        const ssize_t nbytes = send(sock, io.out.data() + io.outpos, len,
+                                    MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nbytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                blocked = true;
+                break;
+            }
+            throw std::runtime_error("fmtpSendEngine::flushConn() send() "
+                    "error: " + std::string(strerror(errno)));
+        }
+        io.outpos += nbytes;
+        if (rate)
+            io.bucket.Take(nbytes);
+    }
+
+    const size_t queued = io.out.size() - io.outpos;
+    if (queued == 0) {
+        io.out.clear();
+        io.outpos = 0;
+    }
+    else if (io.outpos > queued) {
+        io.out.erase(io.out.begin(), io.out.begin() + io.outpos);
+        io.outpos = 0;
+    }
+
+    uint32_t events = 0;
+    if (queued <= MAX_CONN_BACKLOG)
+        events |= EPOLLIN;
+    if (blocked)
+        events |= EPOLLOUT;
+    if (events != io.events) {
+        struct epoll_event event = {};
+        event.events  = events;
+        event.data.fd = sock;
+        if (epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, sock, &event) < 0) {
+            throw std::runtime_error("fmtpSendEngine::flushConn() "
+                    "epoll_ctl() failed for socket " + std::to_string(sock));
+        }
+        io.events = events;
+    }
+}
+
+
+/**
+ * Writes the queued output of a reactor's connections that may be written:
+ * those found writable, those with output queued since the last flush and
+ * the throttled ones whose token bucket allows more.
+ *
+ * @param[in] reactor  The reactor.
+ * @param[in] socks    Connections found writable. Cleared on return.
+ */
+void fmtpSendEngine::flushAll(Reactor* const reactor, std::set<int>& socks)
+{
+    {
+        std::unique_lock<std::mutex> lock(reactor->mtx);
+        socks.insert(reactor->pending.begin(), reactor->pending.end());
+        reactor->pending.clear();
+    }
+    const TokenBucket::Clock::time_point now = TokenBucket::Clock::now();
+    std::map<int, TokenBucket::Clock::time_point>::iterator due =
+        reactor->paced.begin();
+    while (due != reactor->paced.end()) {
+        if (due->second <= now) {
+            socks.insert(due->first);
+            reactor->paced.erase(due++);
+        }
+        else {
+            ++due;
+        }
+    }
+
+    for (std::set<int>::const_iterator it = socks.begin(); it != socks.end();
+         ++it) {
+        Conn conn;
+        {
+            std::unique_lock<std::mutex> lock(reactor->mtx);
+            std::map<int, Conn>::const_iterator entry =
+                reactor->conns.find(*it);
+            if (entry == reactor->conns.end() || !entry->second.io)
+                continue;
+            conn = entry->second;
+        }
+        try {
+            flushConn(reactor, *it, conn);
+        }
+        catch (const std::runtime_error& e) {
+            dropConn(reactor, *it, conn, e);
+        }
+    }
+    socks.clear();
+}
+
+
+/**
+ * Stops serving a receiver whose connection failed. If it was the last
+ * receiver of its feed, the feed stops itself.
+ *
+ * @param[in] reactor  The reactor.
+ * @param[in] sock     The receiver's socket.
+ * @param[in] conn     The receiver's connection.
+ * @param[in] e        The failure.
+ */
+void fmtpSendEngine::dropConn(Reactor* const reactor, const int sock,
+                              const Conn& conn, const std::runtime_error& e)
+{
+    unwatch(reactor, sock);
+    reactor->paced.erase(sock);
+    try {
+        conn.feed->dropReceiver(sock, e);
+    }
+    catch (const std::runtime_error& e) {
+        // it was the feed's last receiver, the feed has stopped
+    }
+}
+
+
+/**
+ * Records the first failure of an engine thread, which `Stop()` rethrows.
+ *
+ * @param[in] e  The failure.
+ */
+void fmtpSendEngine::fail(const std::exception_ptr& e)
+{
+    std::unique_lock<std::mutex> lock(exitmtx);
+    if (!except)
+        except = e;
+}
+
+
+/**
+ * Returns the next feed of a transmit thread whose packet may be sent: the
+ * first feed after the one served last whose token bucket allows a packet,
+ * so that ready feeds take turns.
+ *
+ * @pre                 `tx->mtx` is locked.
+ * @param[in]  tx       The transmit thread's state.
+ * @param[out] wake     Earliest time a feed that isn't ready will be, if
+ *                      earlier than its value on entry.
+ * @return              The feed or NULL if none is ready.
+ */
+fmtpSendv3* fmtpSendEngine::nextFeed(Transmitter* const tx,
+                                     TokenBucket::Clock::time_point& wake)
+{
+    const TokenBucket::Clock::time_point now = TokenBucket::Clock::now();
+    std::map<fmtpSendv3*, TxFeed>::iterator it =
+        tx->feeds.upper_bound(tx->last);
+
+    for (size_t i = 0; i < tx->feeds.size(); i++, ++it) {
+        if (it == tx->feeds.end())
+            it = tx->feeds.begin();
+        const TokenBucket::Clock::time_point ready =
+            it->first->bucket.ReadyTime(now);
+        if (ready <= now) {
+            tx->last = it->first;
+            return it->first;
+        }
+        if (ready < wake)
+            wake = ready;
+    }
+    return NULL;
+}
+
+
+/**
+ * The transmit thread. Multicasts the queued products of each of its feeds in
+ * order, one packet at a time: it sends the next packet of a feed whose token
+ * bucket allows one and otherwise waits until the earliest feed is ready or a
+ * product is queued. A feed that fails stops itself and is no longer served.
+ *
+ * @param[in] tx  The transmit thread's state.
+ */
+void fmtpSendEngine::transmit(Transmitter* const tx)
+{
+    placement.apply(ROLE_MCAST);
+    std::unique_lock<std::mutex> lock(tx->mtx);
+    while (!stopping) {
+        TokenBucket::Clock::time_point wake =
+            TokenBucket::Clock::time_point::max();
+        fmtpSendv3* const feed = nextFeed(tx, wake);
+        if (feed == NULL) {
+            if (wake == TokenBucket::Clock::time_point::max())
+                tx->cv.wait(lock);
+            else
+                tx->cv.wait_until(lock, wake);
+            continue;
+        }
+
+        /* only this thread removes entries, so `entry` stays valid */
+        TxFeed&    entry = tx->feeds[feed];
+        const bool begin = !entry.sending;
+        EngineJob  job   = {};
+        if (begin) {
+            job = entry.jobs.front();
+            entry.jobs.pop_front();
+        }
+        lock.unlock();
+
+        bool sending = false;
+        if (isActive(feed)) {
+            try {
+                sending = begin ?
+                    feed->beginProduct(job.data, job.dataSize, job.metadata,
+                                       job.metaSize) :
+                    feed->sendNextPacket();
+            }
+            catch (const std::runtime_error& e) {
+                try {
+                    feed->taskExit(e);
+                }
+                catch (const std::runtime_error& e) {
+                    // the feed has stopped itself and detached
+                }
+            }
+        }
+
+        lock.lock();
+        entry.sending = sending;
+        if (!sending && entry.jobs.empty())
+            tx->feeds.erase(feed);
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real transmit().
+ *
+ * @param[in] ptr  a pointer to the transmit thread's state.
+ */
+void* fmtpSendEngine::transmitWrapper(void* ptr)
+{
+    Transmitter* const tx = static_cast<Transmitter*>(ptr);
+    try {
+        tx->engine->transmit(tx);
+    }
+    catch (const std::exception& e) {
+        tx->engine->fail(std::current_exception());
+    }
+    return NULL;
+}
+
+
+/**
+ * The reactor thread. Waits for its sockets with epoll; accepts receivers on
+ * the listening socket of a feed, handles the messages of a receiver as they
+ * arrive and writes what is queued for a receiver as the receiver reads. No
+ * socket operation blocks, so one receiver can't hold up the others. The
+ * wait ends early when a throttled receiver may be written again.
+ *
+ * @param[in] reactor  The reactor thread's state.
+ */
+void fmtpSendEngine::react(Reactor* const reactor)
+{
+    const int          maxEvents = 64;
+    struct epoll_event events[maxEvents];
+    std::set<int>      writable;
+
+    placement.apply(ROLE_RETX);
+    while (!stopping) {
+        int timeout = -1;
+        if (!reactor->paced.empty()) {
+            TokenBucket::Clock::time_point next =
+                TokenBucket::Clock::time_point::max();
+            for (std::map<int, TokenBucket::Clock::time_point>::const_iterator
+                 it = reactor->paced.begin(); it != reactor->paced.end(); ++it)
+                next = std::min(next, it->second);
+            const TokenBucket::Clock::duration wait =
+                next - TokenBucket::Clock::now();
+            /* rounded up so that the connection is ready when woken up */
+            timeout = wait.count() <= 0 ? 0 : static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    wait).count() + 1);
+        }
+
+        const int nevents = epoll_wait(reactor->epfd, events, maxEvents,
+                                       timeout);
+        if (nevents < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("fmtpSendEngine::react() epoll_wait() "
+                    "failed");
+        }
+
+        for (int i = 0; i < nevents && !stopping; i++) {
+            const int sock = events[i].data.fd;
+            if (sock == reactor->wakefd) {
+                uint64_t count;
+                (void)read(reactor->wakefd, &count, sizeof(count));
+                continue;
+            }
+
+            Conn conn;
+            {
+                std::unique_lock<std::mutex> lock(reactor->mtx);
+                std::map<int, Conn>::const_iterator it =
+                    reactor->conns.find(sock);
+                if (it == reactor->conns.end())
+                    continue; // a detached feed or a removed receiver
+                conn = it->second;
+            }
+
+            if (conn.listening) {
+                int newsock;
+                try {
+                    newsock = conn.feed->acceptReceiver();
+                }
+                catch (const std::runtime_error& e) {
+                    try {
+                        conn.feed->taskExit(e);
+                    }
+                    catch (const std::runtime_error& e) {
+                        // the feed has stopped itself and detached
+                    }
+                    continue;
+                }
+                if (newsock < 0)
+                    continue;
+                conn.feed->lossmap.add(newsock);
+                Conn recvconn = {conn.feed, false,
+                                 std::make_shared<ConnIO>()};
+                try {
+                    watch(reactor, newsock, recvconn);
+                }
+                catch (const std::runtime_error& e) {
+                    unwatch(reactor, newsock);
+                    conn.feed->removeReceiver(newsock);
+                }
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT)
+                writable.insert(sock);
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                continue;
+            try {
+                if (!readConn(sock, conn)) {
+                    /* the receiver closed its connection */
+                    unwatch(reactor, sock);
+                    reactor->paced.erase(sock);
+                    conn.feed->removeReceiver(sock);
+                }
+            }
+            catch (const std::runtime_error& e) {
+                dropConn(reactor, sock, conn, e);
+            }
+        }
+
+        if (!stopping)
+            flushAll(reactor, writable);
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real react().
+ *
+ * @param[in] ptr  a pointer to the reactor thread's state.
+ */
+void* fmtpSendEngine::reactWrapper(void* ptr)
+{
+    Reactor* const reactor = static_cast<Reactor*>(ptr);
+    try {
+        reactor->engine->react(reactor);
+    }
+    catch (const std::exception& e) {
+        reactor->engine->fail(std::current_exception());
+    }
+    return NULL;
+}
+
+
+/**
+ * The timer thread. Times out the products of all feeds when their deadlines
+ * pass.
+ */
+void fmtpSendEngine::timer()
+{
+    placement.apply(ROLE_TIMER);
+    std::unique_lock<std::mutex> lock(timermtx);
+    while (!stopping) {
+        if (timeouts.empty()) {
+            timer_cv.wait(lock);
+            continue;
+        }
+        /* copied: a push can reallocate the queue during the wait */
+        const std::chrono::steady_clock::time_point deadline =
+            timeouts.top().deadline;
+        if (std::chrono::steady_clock::now() < deadline) {
+            timer_cv.wait_until(lock, deadline);
+            continue;
+        }
+
+        const EngineTimeout timeout = timeouts.top();
+        timeouts.pop();
+        lock.unlock();
+        if (isActive(timeout.feed)) {
+            try {
+                timeout.feed->timeoutProduct(timeout.prodindex);
+            }
+            catch (const std::runtime_error& e) {
+                timeout.feed->taskExit(e);
+            }
+        }
+        lock.lock();
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real timer().
+ *
+ * @param[in] ptr  a pointer to the engine.
+ */
+void* fmtpSendEngine::timerWrapper(void* ptr)
+{
+    fmtpSendEngine* const engine = static_cast<fmtpSendEngine*>(ptr);
+    try {
+        engine->timer();
+    }
+    catch (const std::exception& e) {
+        engine->fail(std::current_exception());
+    }
+    return NULL;
+}
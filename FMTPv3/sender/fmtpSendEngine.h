@@ -0,0 +1,374 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpSendEngine.h
+ *
+ * This file defines a multi-feed sender engine: a fixed pool of transmit,
+ * reactor and timer threads that serves any number of FMTP senders (feeds).
+ */
+
+#ifndef FMTP_SENDER_FMTPSENDENGINE_H_
+#define FMTP_SENDER_FMTPSENDENGINE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include "../RateShaper/RateShaper.h"
+#include "../RateShaper/TokenBucket.h"
+#include "ThreadPlacement.h"
+#include "fmtpSendv3.h"
+
+
+/** a product queued for a transmit thread */
+struct EngineJob
+{
+    fmtpSendv3*     feed;
+    void*           data;
+    uint32_t        dataSize;
+    void*           metadata;
+    uint16_t        metaSize;
+};
+
+/** a product timeout queued for the timer thread */
+struct EngineTimeout
+{
+    std::chrono::steady_clock::time_point deadline;
+    fmtpSendv3*     feed;
+    uint32_t        prodindex;
+
+    bool operator>(const EngineTimeout& that) const
+    {
+        return deadline > that.deadline;
+    }
+};
+
+/** the engine's view of a feed */
+struct EngineFeed
+{
+    unsigned        transmitter; /*!< index of the feed's transmit thread */
+    unsigned        reactor;     /*!< index of the feed's reactor thread */
+    uint32_t        nextIndex;   /*!< index of the next queued product */
+    bool            active;      /*!< whether the engine serves the feed */
+};
+
+
+/**
+ * Serves many FMTP senders with a fixed number of threads. Every feed keeps
+ * its own sockets, product-index space, retransmission entries and rate
+ * shaper, but instead of a coordinator, a timer and one thread per receiver
+ * of its own, it shares the engine's threads:
+ *   - transmit threads multicast the products queued by `sendProduct()`;
+ *     each feed is assigned to one of them, which keeps its products in
+ *     order and interleaves the packets of its feeds, pacing each feed with
+ *     the feed's own token bucket so that one feed's rate doesn't delay
+ *     another feed;
+ *   - reactor threads accept receivers and serve their requests, waiting for
+ *     the sockets of their feeds with epoll; a receiver's connection is
+ *     non-blocking with buffers of its own, so a receiver that is slow to
+ *     send or to read doesn't hold up the other receivers of the thread, and
+ *     retransmissions to a throttled slow receiver are paced at the feed's
+ *     throttle rate;
+ *   - a timer thread times the products of all feeds out.
+ */
+class fmtpSendEngine
+{
+public:
+    /**
+     * Constructs an engine.
+     *
+     * @param[in] transmitters  Number of transmit threads.
+     * @param[in] reactors      Number of reactor threads.
+     * @throw std::invalid_argument  if a number is 0.
+     */
+    explicit fmtpSendEngine(const unsigned transmitters = 1,
+                            const unsigned reactors = 1);
+    ~fmtpSendEngine();
+
+    /**
+     * Adds a configured, not yet started sender as a feed.
+     *
+     * @param[in] feed  The sender.
+     * @throw std::invalid_argument  if the feed was already added.
+     * @throw std::runtime_error     if the feed can't be started.
+     */
+    void     addFeed(fmtpSendv3* const feed);
+    /**
+     * Queues a product for multicasting by the feed's transmit thread.
+     *
+     * @param[in] feed      The feed.
+     * @param[in] data      The product. Must stay valid until the feed's
+     *                      application is notified of the product's end.
+     * @param[in] dataSize  Size of the product in bytes.
+     * @param[in] metadata  Metadata of the product or 0.
+     * @param[in] metaSize  Size of the metadata in bytes.
+     * @return              Index the product will have.
+     * @throw std::invalid_argument  if the feed isn't served by the engine.
+     */
+    uint32_t sendProduct(fmtpSendv3* const feed, void* const data,
+                         const uint32_t dataSize, void* const metadata = 0,
+                         const uint16_t metaSize = 0);
+    /**
+     * Sets where and how the engine's threads run. Must be called before
+     * `Start()`.
+     *
+     * @param[in] placement  The thread placement.
+     */
+    void     SetThreadPlacement(const ThreadPlacement& placement);
+    /**
+     * Starts the engine's threads and the feeds added so far.
+     *
+     * @throw std::runtime_error  if a thread or feed can't be started.
+     */
+    void     Start();
+    /**
+     * Stops the engine's threads and every feed.
+     *
+     * @throw std::exception  if a feed or an engine thread failed.
+     */
+    void     Stop();
+    /**
+     * Returns the number of threads the engine runs.
+     *
+     * @return  The number of threads.
+     */
+    unsigned threadCount() const {return transmitters.size() +
+                                          reactors.size() + 1;}
+
+private:
+    friend class fmtpSendv3;
+
+    /** the products of a feed queued for a transmit thread */
+    struct TxFeed
+    {
+        std::deque<EngineJob>   jobs;
+        bool                    sending; /*!< a product is being multicast */
+    };
+
+    /** a transmit thread and the feeds it has work for */
+    struct Transmitter
+    {
+        fmtpSendEngine*         engine;
+        pthread_t               thread;
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::map<fmtpSendv3*, TxFeed> feeds;
+        /* the feed whose packet was sent last */
+        fmtpSendv3*             last;
+    };
+
+    /** the buffers of a receiver's connection */
+    struct ConnIO
+    {
+        ConnIO() : in(), out(), outpos(0), events(0), shaper(),
+                   bucket(shaper, MAX_FMTP_PACKET_LEN) {}
+
+        /* bytes read that don't make a complete message yet */
+        std::vector<char>       in;
+        /* messages queued for the receiver, from `outpos` on */
+        std::vector<char>       out;
+        size_t                  outpos;
+        /* epoll events waited for */
+        uint32_t                events;
+        /* paces the messages to a throttled slow receiver */
+        RateShaper              shaper;
+        TokenBucket             bucket;
+    };
+
+    /** a socket waited for by a reactor thread */
+    struct Conn
+    {
+        fmtpSendv3*     feed;
+        bool            listening; /*!< accepts receivers */
+        /* buffers of a receiver's connection, NULL if `listening` */
+        std::shared_ptr<ConnIO> io;
+    };
+
+    /** a reactor thread and its sockets */
+    struct Reactor
+    {
+        fmtpSendEngine*         engine;
+        pthread_t               thread;
+        int                     epfd;
+        int                     wakefd;
+        /* protects `conns`, `pending` and the output of the connections */
+        std::mutex              mtx;
+        std::map<int, Conn>     conns;
+        /* connections with output queued since the last flush */
+        std::set<int>           pending;
+        /* throttled connections and when they may be written next; used by
+         * the reactor thread only */
+        std::map<int, TokenBucket::Clock::time_point> paced;
+    };
+
+    /**
+     * Starts a feed and has the engine's threads serve it.
+     *
+     * @pre                 `feedmtx` is locked.
+     * @param[in] feed      The feed.
+     * @throw std::runtime_error  if the feed can't be started.
+     */
+    void attachFeed(fmtpSendv3* const feed);
+    /**
+     * Stops serving a feed. Called by the feed when it stops.
+     *
+     * @param[in] feed  The feed.
+     */
+    void detachFeed(fmtpSendv3* const feed);
+    /**
+     * Returns whether the engine serves a feed.
+     *
+     * @param[in] feed  The feed.
+     * @return          Whether the feed is served.
+     */
+    bool isActive(fmtpSendv3* const feed);
+    /**
+     * Schedules the timeout of a product of a feed.
+     *
+     * @param[in] feed       The feed.
+     * @param[in] prodindex  Index of the product.
+     * @param[in] seconds    Time until the timeout in seconds.
+     */
+    void scheduleTimeout(fmtpSendv3* const feed, const uint32_t prodindex,
+                         const double seconds);
+    /**
+     * Has a reactor wait for a socket.
+     *
+     * @param[in] reactor  The reactor.
+     * @param[in] sock     The socket.
+     * @param[in] conn     What the socket is.
+     * @throw std::runtime_error  if the socket can't be added.
+     */
+    void watch(Reactor* const reactor, const int sock, const Conn& conn);
+    /**
+     * Has a reactor stop waiting for a socket.
+     *
+     * @param[in] reactor  The reactor.
+     * @param[in] sock     The socket.
+     */
+    void unwatch(Reactor* const reactor, const int sock);
+    /**
+     * Queues a message to a receiver of a feed on the receiver's connection.
+     *
+     * @param[in] feed     The feed.
+     * @param[in] sock     The receiver's socket.
+     * @param[in] header   Header in network byte order.
+     * @param[in] payload  Payload.
+     * @param[in] paylen   Length of the payload.
+     * @return             Number of bytes queued, 0 if the receiver is gone.
+     */
+    int  queueUnicast(fmtpSendv3* const feed, const int sock,
+                      const FmtpHeader* const header,
+                      const char* const payload, const size_t paylen);
+    /**
+     * Reads what a receiver has sent and handles its complete messages.
+     *
+     * @param[in] sock  The receiver's socket.
+     * @param[in] conn  The receiver's connection.
+     * @return          False if the receiver closed its connection.
+     * @throw std::runtime_error  if the connection is broken or a message is
+     *                            invalid.
+     */
+    bool readConn(const int sock, const Conn& conn);
+    /**
+     * Writes what is queued for a receiver without blocking.
+     *
+     * @param[in] reactor  The reactor.
+     * @param[in] sock     The receiver's socket.
+     * @param[in] conn     The receiver's connection.
+     * @throw std::runtime_error  if the connection is broken.
+     */
+    void flushConn(Reactor* const reactor, const int sock, const Conn& conn);
+    /**
+     * Writes the queued output of a reactor's connections that may be
+     * written.
+     *
+     * @param[in] reactor  The reactor.
+     * @param[in] socks    Connections found writable.
+     */
+    void flushAll(Reactor* const reactor, std::set<int>& socks);
+    /**
+     * Stops serving a receiver whose connection failed.
+     *
+     * @param[in] reactor  The reactor.
+     * @param[in] sock     The receiver's socket.
+     * @param[in] conn     The receiver's connection.
+     * @param[in] e        The failure.
+     */
+    void dropConn(Reactor* const reactor, const int sock, const Conn& conn,
+                  const std::runtime_error& e);
+    /**
+     * Records the first failure of an engine thread.
+     *
+     * @param[in] e  The failure.
+     */
+    void fail(const std::exception_ptr& e);
+    /**
+     * Stops and joins the timer thread and the first transmit and reactor
+     * threads.
+     *
+     * @param[in] ntransmitters  Number of transmit threads that were started.
+     * @param[in] nreactors      Number of reactor threads that were started.
+     */
+    void joinThreads(const size_t ntransmitters, const size_t nreactors);
+    /** releases the thread states and closes the epoll instances */
+    void closeAll();
+    /**
+     * Returns the next feed of a transmit thread whose packet may be sent.
+     *
+     * @pre                 `tx->mtx` is locked.
+     * @param[in]  tx       The transmit thread's state.
+     * @param[out] wake     Earliest time a feed that isn't ready will be, if
+     *                      earlier than its value on entry.
+     * @return              The feed or NULL if none is ready.
+     */
+    fmtpSendv3* nextFeed(Transmitter* const tx,
+                         TokenBucket::Clock::time_point& wake);
+    /** transmit thread */
+    void transmit(Transmitter* const tx);
+    /** a wrapper to call the actual fmtpSendEngine::transmit() */
+    static void* transmitWrapper(void* ptr);
+    /** reactor thread */
+    void react(Reactor* const reactor);
+    /** a wrapper to call the actual fmtpSendEngine::react() */
+    static void* reactWrapper(void* ptr);
+    /** timer thread */
+    void timer();
+    /** a wrapper to call the actual fmtpSendEngine::timer() */
+    static void* timerWrapper(void* ptr);
+    /* Prevent copying because it's meaningless */
+    fmtpSendEngine(fmtpSendEngine&);
+    fmtpSendEngine& operator=(const fmtpSendEngine&);
+
+    std::vector<Transmitter*>            transmitters;
+    std::vector<Reactor*>                reactors;
+    ThreadPlacement                      placement;
+    /* protects `feeds` and `running` */
+    std::mutex                           feedmtx;
+    std::map<fmtpSendv3*, EngineFeed>    feeds;
+    bool                                 running;
+    /* set when the threads are to exit */
+    std::atomic<bool>                    stopping;
+    std::mutex                           timermtx;
+    std::condition_variable              timer_cv;
+    std::priority_queue<EngineTimeout, std::vector<EngineTimeout>,
+                        std::greater<EngineTimeout> > timeouts;
+    pthread_t                            timer_t;
+    std::mutex                           exitmtx;
+    std::exception_ptr                   except;
+};
+
+#endif /* FMTP_SENDER_FMTPSENDENGINE_H_ */
@@ -29,14 +29,15 @@
 
 
 #include "fmtpSendv3.h"
+#include "fmtpSendEngine.h"
 
 #include <algorithm>
 #include <unistd.h>
-#include <fstream>
-#include <iostream>
 #include <math.h>
 #include <stdexcept>
 #include <system_error>
+#include <sys/socket.h>
+#include <vector>
 
 
 
@@ -92,7 +93,60 @@ fmtpSendv3::fmtpSendv3(const char*                 tcpAddr,
     exceptIsSet(false),
     coor_t(),
     timer_t(),
+    bucket(rateshaper, FMTP_HEADER_LEN + DATA_EXT_LEN + FMTP_DATA_LEN),
     tsnd(tsnd),
+    aggrmtx(),
+    aggr_cv(),
+    aggrMaxSize(0),
+    aggrMaxDelay(0),
+    aggrLen(0),
+    aggrCount(0),
+    aggrFirst(0),
+    aggrStart(),
+    aggrStop(false),
+    aggrRunning(false),
+    aggr_t(),
+    selfDescribing(false),
+    withDigest(false),
+    timestamps(false),
+    tsSampling(0),
+    tsDataCount(0),
+    counters(SEND_NCOUNTERS),
+    ackLatency(),
+    trace(NULL),
+    ratectrl(NULL),
+    ratectrlInterval(0),
+    ratectrlSignals(0),
+    ratectrlmtx(),
+    ratectrl_cv(),
+    ratectrlStop(false),
+    ratectrlRunning(false),
+    ratectrl_t(),
+    ratectrlSent(0),
+    ratectrlReqs(),
+    ratectrlTick(),
+    slowMaxRetxBytes(0),
+    slowMaxLatency(0),
+    slowAction(0),
+    slowThrottleRate(0),
+    slowInterval(0),
+    slowStrikes(0),
+    slowmtx(),
+    slow_cv(),
+    slowStop(false),
+    slowRunning(false),
+    slow_t(),
+    slowWindows(),
+    placement(),
+    engine(NULL),
+    sendingmtx(),
+    sending(false),
+    sendingIndex(0),
+    earlyRetxEnds(),
+    cursor(),
+    exporter(NULL),
+    exporterId(0),
+    logger(AsyncLog::get("FMTPv3_SENDER.log")),
     txdone(false),
     /* Coverity Scan #1: Fix #1: Initialize notifyprodidx, suppressor to 0 as product index*/
     notifyprodidx(0),
@@ -108,9 +162,12 @@ fmtpSendv3::fmtpSendv3(const char*                 tcpAddr,
  */
 fmtpSendv3::~fmtpSendv3()
 {
+    if (exporter)
+        exporter->removeCollector(exporterId);
     delete udpsend;
     delete tcpsend;
     delete sendMeta;
+    delete ratectrl;
 }
 
 
@@ -141,6 +198,67 @@ uint32_t fmtpSendv3::getNotify()
 }
 
 
+/**
+ * Returns what is known about every connected receiver: the statistics it
+ * reports (see fmtpRecvv3::SetStatsInterval()), the loss rates derived from
+ * them and the retransmissions it was served.
+ *
+ * @return    A snapshot of the per-receiver loss map.
+ */
+std::vector<ReceiverStats> fmtpSendv3::getLossMap()
+{
+    return lossmap.get();
+}
+
+
+/**
+ * Returns the sender's statistics. The counters are summed over the threads
+ * that incremented them, so taking a snapshot costs the sending and
+ * retransmitting threads nothing. The gauges hold the locks of the structures
+ * they count for a moment.
+ *
+ * @return    A snapshot of the statistics.
+ */
+SendStats fmtpSendv3::getStats()
+{
+    const std::vector<uint64_t> sums = counters.sums();
+    SendStats                   snap;
+
+    snap.prods      = sums[SEND_PRODS];
+    snap.prodbytes  = sums[SEND_PRODBYTES];
+    snap.mcastpkts  = sums[SEND_MCASTPKTS];
+    snap.mcastbytes = sums[SEND_MCASTBYTES];
+    snap.retxreqs   = sums[SEND_RETXREQS];
+    snap.bopreqs    = sums[SEND_BOPREQS];
+    snap.eopreqs    = sums[SEND_EOPREQS];
+    snap.retxpkts   = sums[SEND_RETXPKTS];
+    snap.retxbytes  = sums[SEND_RETXBYTES];
+    snap.retxrejs   = sums[SEND_RETXREJS];
+    snap.retxends   = sums[SEND_RETXENDS];
+    snap.acked      = sums[SEND_ACKED];
+    snap.timedout   = sums[SEND_TIMEDOUT];
+    snap.inflight   = sendMeta->size();
+    snap.receivers  = lossmap.size();
+    snap.timers     = timerDelayQ.size();
+    return snap;
+}
+
+
+/**
+ * Returns a histogram of the times from the submission of products of all
+ * sizes to their acknowledgement by every receiver.
+ *
+ * @return  The histograms of every size, merged.
+ */
+HistogramSnapshot fmtpSendv3::getAckLatency()
+{
+    HistogramSnapshot merged;
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++)
+        merged.merge(ackLatency[i].snapshot());
+    return merged;
+}
+
+
 /**
  * Returns the local port number.
  *
@@ -200,8 +318,10 @@ uint32_t fmtpSendv3::sendProduct(void* data, uint32_t dataSize)
  *                         data. May be 0, in which case `metaSize` must be 0
  *                         and no metadata is sent.
  * @param[in] metaSize     Size of the metadata in bytes. Must be less than or
- *                         equal 1442 bytes. May be 0, in which case no
- *                         metadata is sent.
+ *                         equal MAX_BOP_META_LEN bytes. Metadata longer than
+ *                         AVAIL_BOP_LEN bytes is sent in BOP continuation
+ *                         packets. May be 0, in which case no metadata is
+ *                         sent.
  * @param[in] perProdTimeoutRatio
  *                         the per-product timeout ratio to balance performance
  *                         and robustness (reliability).
@@ -216,45 +336,168 @@ uint32_t fmtpSendv3::sendProduct(void* data, uint32_t dataSize)
 uint32_t fmtpSendv3::sendProduct(void* data, uint32_t dataSize, void* metadata,
                                   uint16_t metaSize)
 {
+    const uint32_t index = prodIndex;
     try {
-        if (data == NULL)
-            throw std::runtime_error(
-                    "fmtpSendv3::sendProduct() data pointer is NULL");
-        if (dataSize > 0xFFFFFFFFu)
-            throw std::runtime_error(
-                    "fmtpSendv3::sendProduct() dataSize out of range");
-        if (metadata) {
-            if (AVAIL_BOP_LEN < metaSize)
-                throw std::runtime_error(
-                        "fmtpSendv3::SendBOPMessage(): metaSize too large");
+        if (beginProduct(data, dataSize, metadata, metaSize)) {
+            while (sendNextPacket())
+                ;
         }
-        else {
-            if (metaSize)
-                throw std::runtime_error(
-                        "fmtpSendv3::SendBOPMessage(): Non-zero metaSize");
-        }
-
-        /* Add a retransmission metadata entry */
-        RetxMetadata* senderProdMeta = addRetxMetadata(data, dataSize,
-                                                       metadata, metaSize);
-        // TODO: use latest MTU for file to be sent
-        // TcpSend::getMinPathMTU()
-        /* send out BOP message */
-        SendBOPMessage(dataSize, metadata, metaSize);
-        /* Send the data */
-        sendData(data, dataSize);
-        /* Send out EOP message */
-        sendEOPMessage();
-
-        /* Set the retransmission timeout parameters */
-        setTimerParameters(senderProdMeta);
-        /* start a new timer for this product in a separate thread */
-        timerDelayQ.push(prodIndex, senderProdMeta->retxTimeoutPeriod);
     }
     catch (std::runtime_error& e) {
         taskExit(e);
         std::rethrow_exception(except);
     }
+    return index;
+}
+
+
+/**
+ * Begins sending a product: validates it and either aggregates it, in which
+ * case it is done, or adds its retransmission entry and sets up `cursor` so
+ * that `sendNextPacket()` multicasts its packets. An engine calls this and
+ * `sendNextPacket()` on its transmit thread, so neither blocks to pace the
+ * packets of a feed it serves.
+ *
+ * @param[in] data      The data-product.
+ * @param[in] dataSize  The size of the data-product in bytes.
+ * @param[in] metadata  Application-specific metadata or 0.
+ * @param[in] metaSize  Size of the metadata in bytes.
+ * @return              Whether the product has packets to multicast.
+ * @throw std::runtime_error  if the product is invalid or an I/O error
+ *                            occurs.
+ */
+bool fmtpSendv3::beginProduct(void* data, uint32_t dataSize, void* metadata,
+                              uint16_t metaSize)
+{
+    const uint64_t submitted = timestamps ? wallClockNs() : 0;
+    if (data == NULL)
+        throw std::runtime_error(
+                "fmtpSendv3::sendProduct() data pointer is NULL");
+    if (dataSize > 0xFFFFFFFFu)
+        throw std::runtime_error(
+                "fmtpSendv3::sendProduct() dataSize out of range");
+    if (metadata) {
+        if (MAX_BOP_META_LEN < metaSize)
+            throw std::runtime_error(
+                    "fmtpSendv3::SendBOPMessage(): metaSize too large");
+    }
+    else {
+        if (metaSize)
+            throw std::runtime_error(
+                    "fmtpSendv3::SendBOPMessage(): Non-zero metaSize");
+    }
+    if (trace) {
+        trace->record(TRACE_SUBMITTED, prodIndex, dataSize);
+    }
+
+    /**
+     * The aggregation lock is only taken if aggregation is enabled, it
+     * keeps the flusher thread from multicasting a partially filled
+     * envelope while this product is being added to it or while the
+     * envelope is flushed ahead of this product. No product is aggregated
+     * while this one is multicast, so the envelope stays empty until then.
+     */
+    std::unique_lock<std::mutex> lock(aggrmtx, std::defer_lock);
+    if (aggrMaxSize) {
+        lock.lock();
+    }
+
+    if (aggrMaxSize && dataSize <= aggrMaxSize &&
+            AGGR_ENTRY_HEADER_LEN + metaSize + dataSize <= FMTP_DATA_LEN) {
+        aggregateProduct(data, dataSize, metadata, metaSize);
+        endProduct(dataSize);
+        return false;
+    }
+
+    /* aggregated products must precede this product on the wire */
+    if (aggrCount) {
+        sendAggregate();
+    }
+
+    /* Add a retransmission metadata entry */
+    cursor.meta      = addRetxMetadata(data, dataSize, metadata, metaSize);
+    cursor.submitted = submitted;
+    cursor.digest    = (selfDescribing && withDigest) ?
+                       metaDigest(metadata, metaSize) : 0;
+    cursor.stage     = CURSOR_BOP;
+    cursor.offset    = 0;
+    {
+        std::unique_lock<std::mutex> lock(sendingmtx);
+        sending      = true;
+        sendingIndex = prodIndex;
+    }
+    return true;
+}
+
+
+/**
+ * Multicasts the next packet of the product begun by `beginProduct()`: its
+ * BOP, then any BOP continuation packets, then its data blocks and at last
+ * its EOP, after which the product's timer is started and the product is
+ * done. The metadata is taken from the product's retransmission entry, so
+ * the application's copy needn't outlive `beginProduct()`.
+ *
+ * @return  Whether the product has more packets to multicast.
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+bool fmtpSendv3::sendNextPacket()
+{
+    RetxMetadata* const meta = cursor.meta;
+
+    switch (cursor.stage) {
+        case CURSOR_BOP:
+            // TODO: use latest MTU for file to be sent
+            // TcpSend::getMinPathMTU()
+            SendBOPMessage(meta->prodLength, meta->metadata, meta->metaSize,
+                           cursor.submitted);
+            cursor.stage  = CURSOR_BOP_CONT;
+            cursor.offset = MIN(meta->metaSize, AVAIL_BOP_LEN);
+            #ifdef TEST_BOP
+                /* no continuation without its BOP */
+                cursor.offset = meta->metaSize;
+            #endif
+            break;
+        case CURSOR_BOP_CONT:
+            cursor.offset += sendBOPContinuation(meta->metadata,
+                                                 meta->metaSize,
+                                                 cursor.offset);
+            break;
+        case CURSOR_DATA:
+            cursor.offset += sendData(meta->dataprod_p, meta->prodLength,
+                                      cursor.offset, cursor.digest);
+            break;
+        default:
+            /* Send out EOP message */
+            sendEOPMessage();
+            /* Set the retransmission timeout parameters */
+            setTimerParameters(meta);
+            /* start a new timer for this product */
+            scheduleTimeout(prodIndex, meta->retxTimeoutPeriod);
+            handleEarlyRetxEnds();
+            endProduct(meta->prodLength);
+            return false;
+    }
+
+    if (cursor.stage == CURSOR_BOP_CONT && cursor.offset >= meta->metaSize) {
+        cursor.stage  = CURSOR_DATA;
+        cursor.offset = 0;
+    }
+    if (cursor.stage == CURSOR_DATA && cursor.offset >= meta->prodLength) {
+        cursor.stage = CURSOR_EOP;
+    }
+    return true;
+}
+
+
+/**
+ * Counts a product that was sent and moves on to the next product index.
+ *
+ * @param[in] dataSize  The size of the data-product in bytes.
+ */
+void fmtpSendv3::endProduct(const uint32_t dataSize)
+{
+    counters.add(SEND_PRODS);
+    counters.add(SEND_PRODBYTES, dataSize);
 
 #ifdef MODBASE
     uint32_t tmpidx = prodIndex % MODBASE;
@@ -262,13 +505,426 @@ uint32_t fmtpSendv3::sendProduct(void* data, uint32_t dataSize, void* metadata,
     uint32_t tmpidx = prodIndex;
 #endif
 
-#ifdef DEBUG1
-    std::string debugmsg = "Product #" + std::to_string(tmpidx);
-    debugmsg += " has been sent.";
-    std::cout << debugmsg << std::endl;
-#endif
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Product #" + std::to_string(tmpidx);
+        debugmsg += " has been sent.";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    ++prodIndex;
+}
+
+
+/**
+ * Starts pacing a multicast packet. Only a sender that isn't served by an
+ * engine times the packet, see `endPacing()`.
+ *
+ * @param[in] size  Size of the packet in bytes.
+ */
+void fmtpSendv3::startPacing(const uint64_t size)
+{
+    /**
+     * linkspeed is initialized to 0. If SetSendRate() is never called,
+     * linkspeed will remain 0, which implies application itself doesn't
+     * need to take care of rate shaping. On the other hand, if app
+     * should shape its rate, SetSendRate() must be called first. Thus,
+     * linkspeed will be a non-zero value. By checking linkspeed, app
+     * can decide whether to do rate shaping.
+     */
+    if (linkspeed && !engine) {
+        rateshaper.CalcPeriod(size);
+    }
+}
+
+
+/**
+ * Paces a multicast packet that was just sent. A sender on its own sleeps
+ * for the rest of the packet's period. A feed served by an engine takes the
+ * packet from its token bucket instead: the engine's transmit thread doesn't
+ * send the feed's next packet before the bucket allows it and meanwhile
+ * sends the packets of other feeds.
+ *
+ * @param[in] size  Size of the packet in bytes.
+ */
+void fmtpSendv3::endPacing(const uint64_t size)
+{
+    if (linkspeed) {
+        if (engine) {
+            bucket.Take(size);
+        }
+        else {
+            rateshaper.Sleep();
+        }
+    }
+}
+
+
+/**
+ * Multicasts any small products waiting in a partially filled aggregate
+ * envelope. Applications that need the lowest latency for a burst of small
+ * products can call this after the last product of the burst instead of
+ * waiting for the flusher thread.
+ *
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+void fmtpSendv3::flushAggregate()
+{
+    try {
+        std::unique_lock<std::mutex> lock(aggrmtx);
+        if (aggrCount) {
+            sendAggregate();
+        }
+    }
+    catch (std::runtime_error& e) {
+        taskExit(e);
+        std::rethrow_exception(except);
+    }
+}
+
+
+/**
+ * Enables the aggregation of small products. Products whose size is at most
+ * `maxProdSize` and that fit, together with their metadata, into a single
+ * datagram are packed into a shared FMTP_AGGR_DATA envelope instead of being
+ * sent as separate BOP, data and EOP packets. The envelope is multicast when
+ * it is full, before the next product that isn't aggregated, or when its
+ * first product has waited `maxDelay` seconds. Must be called before
+ * `Start()`.
+ *
+ * @param[in] maxProdSize  Largest product, in bytes, to be aggregated. 0
+ *                         disables aggregation.
+ * @param[in] maxDelay     Longest time, in seconds, a product may wait in a
+ *                         partially filled envelope.
+ * @throw std::runtime_error  if `maxProdSize` can't fit into a datagram.
+ * @throw std::runtime_error  if `maxDelay` is negative.
+ */
+void fmtpSendv3::SetAggregation(uint32_t maxProdSize, double maxDelay)
+{
+    if (maxProdSize > FMTP_DATA_LEN - AGGR_ENTRY_HEADER_LEN)
+        throw std::runtime_error(
+                "fmtpSendv3::SetAggregation() maxProdSize too large");
+    if (maxDelay < 0)
+        throw std::runtime_error(
+                "fmtpSendv3::SetAggregation() negative maxDelay");
+
+    std::unique_lock<std::mutex> lock(aggrmtx);
+    aggrMaxSize  = maxProdSize;
+    aggrMaxDelay = maxDelay;
+}
+
+
+/**
+ * Makes every data packet a self-describing FMTP_MEM_DATA_EXT packet, which
+ * carries the size of its product and, optionally, a digest of the product's
+ * metadata. A receiver that missed the BOP can then store the data as it
+ * arrives and only fetch the BOP late, instead of discarding the data and
+ * requesting all of it again. The extension costs DATA_EXT_LEN bytes per
+ * packet but doesn't reduce the amount of data a packet carries. Must be
+ * called before `Start()`.
+ *
+ * @param[in] enable      Whether to send self-describing data packets.
+ * @param[in] withDigest  Whether the packets carry a metadata digest, which
+ *                        lets receivers verify the late BOP.
+ */
+void fmtpSendv3::SetSelfDescribingData(bool enable, bool withDigest)
+{
+    selfDescribing   = enable;
+    this->withDigest = enable && withDigest;
+}
+
+
+/**
+ * Makes BOPs and EOPs carry the time they were sent, and every `sampling`-th
+ * data packet too, as FMTP_TIMESTAMPED packets. A BOP carries the time its
+ * product was given to `sendProduct()`, so that receivers with a synchronized
+ * clock can measure the latency from there to the product's completion, and
+ * the network delay of the stamped packets. Data packets are only stamped if
+ * the timestamp doesn't make them larger than a full self-describing data
+ * packet. Receivers that predate timestamps discard stamped packets and have
+ * to recover them. Must be called before `Start()`.
+ *
+ * @param[in] enable    Whether to send timestamps.
+ * @param[in] sampling  Every how many data packets one is stamped, 0 for
+ *                      none.
+ */
+void fmtpSendv3::SetTimestamps(bool enable, uint32_t sampling)
+{
+    timestamps = enable;
+    tsSampling = enable ? sampling : 0;
+}
+
+
+/**
+ * Has a fault injector decide the fate of every multicast packet, so that
+ * loss, duplication and reordering can be reproduced on one host without
+ * rebuilding with TEST_BOP, TEST_EOP or TEST_DATA_MISS. Retransmissions go
+ * over TCP and aren't affected. Must be called before `Start()`.
+ *
+ * @param[in] injector  The fault injector or NULL for none. It must outlive
+ *                      the sender.
+ */
+void fmtpSendv3::SetFaultInjector(FaultInjector* injector)
+{
+    udpsend->SetFaultInjector(injector);
+}
+
+
+/**
+ * Records the lifecycle events of products into a trace: their submission,
+ * the multicast of their BOP and EOP, the blocks retransmitted, the
+ * RETX_ENDs of the receivers, the RETX_REJs sent and retransmission
+ * timeouts. Must be called before `Start()`.
+ *
+ * @param[in] trace  The trace or NULL for none. It must outlive the sender.
+ */
+void fmtpSendv3::SetTrace(ProductTrace* trace)
+{
+    this->trace = trace;
+}
+
+
+/**
+ * Sets the transport that opens the multicast socket and the socket
+ * receivers connect to, for example a SimNetwork instead of the host's
+ * sockets. Must be called before `Start()`.
+ *
+ * @param[in] transport  The transport. It must outlive the sender.
+ */
+void fmtpSendv3::SetTransport(Transport& transport)
+{
+    udpsend->SetTransport(transport);
+    tcpsend->SetTransport(transport);
+}
+
+
+/**
+ * Sets the level of the records written to the log. Records below the level
+ * cost a load and a branch.
+ *
+ * @param[in] level  The level.
+ */
+void fmtpSendv3::SetLogLevel(const LogLevel level)
+{
+    logger->setLevel(level);
+}
+
+
+/**
+ * Has an exporter serve the sender's statistics. The exporter takes a
+ * snapshot for every scrape, so serving costs the sending threads nothing.
+ *
+ * @param[in] exporter  The exporter. It must outlive the sender.
+ * @param[in] feed      Value of the "feed" label of the sender's metrics or
+ *                      empty for no label.
+ */
+void fmtpSendv3::SetMetricsExporter(MetricsExporter&  exporter,
+                                    const std::string& feed)
+{
+    const std::string labels = feed.empty() ? "" :
+                               MetricsWriter::label("feed", feed);
+    this->exporter = &exporter;
+    exporterId     = exporter.addCollector([this, labels](MetricsWriter& w) {
+        writeMetrics(w, labels);
+    });
+}
+
+
+/**
+ * Adds the sender's statistics to a scrape of the metrics exporter.
+ *
+ * @param[in] writer  The scrape.
+ * @param[in] labels  Labels of the sender's samples.
+ */
+void fmtpSendv3::writeMetrics(MetricsWriter& writer, const std::string& labels)
+{
+    const SendStats stats = getStats();
+
+    writer.counter("fmtp_sender_products_total", "Products sent.", labels,
+                   stats.prods);
+    writer.counter("fmtp_sender_product_bytes_total",
+                   "Bytes of data of the products sent.", labels,
+                   stats.prodbytes);
+    writer.counter("fmtp_sender_mcast_packets_total", "Packets multicast.",
+                   labels, stats.mcastpkts);
+    writer.counter("fmtp_sender_mcast_bytes_total",
+                   "Bytes multicast, FMTP headers included.", labels,
+                   stats.mcastbytes);
+    const char* const help = "Retransmission requests received.";
+    writer.counter("fmtp_sender_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "data")),
+                   stats.retxreqs);
+    writer.counter("fmtp_sender_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "bop")),
+                   stats.bopreqs);
+    writer.counter("fmtp_sender_retx_requests_total", help,
+                   MetricsWriter::join(labels,
+                           MetricsWriter::label("type", "eop")),
+                   stats.eopreqs);
+    writer.counter("fmtp_sender_retx_packets_total",
+                   "Data blocks retransmitted.", labels, stats.retxpkts);
+    writer.counter("fmtp_sender_retx_bytes_total",
+                   "Bytes of data retransmitted.", labels, stats.retxbytes);
+    writer.counter("fmtp_sender_retx_rejects_total",
+                   "Retransmission requests rejected.", labels,
+                   stats.retxrejs);
+    writer.counter("fmtp_sender_retx_ends_total",
+                   "Notices of completion received from receivers.", labels,
+                   stats.retxends);
+    writer.counter("fmtp_sender_products_acked_total",
+                   "Products acknowledged by every receiver.", labels,
+                   stats.acked);
+    writer.counter("fmtp_sender_products_timed_out_total",
+                   "Products released by their timeout.", labels,
+                   stats.timedout);
+    writer.gauge("fmtp_sender_products_in_flight",
+                 "Products awaiting acknowledgement.", labels, stats.inflight);
+    writer.gauge("fmtp_sender_receivers", "Connected receivers.", labels,
+                 stats.receivers);
+    writer.gauge("fmtp_sender_timers", "Pending product timeouts.", labels,
+                 stats.timers);
+    writer.gauge("fmtp_sender_rate_bps",
+                 "Multicast sending rate in bits per second, 0 if unshaped.",
+                 labels, getSendRate());
+
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+        const SizeClass sizeclass = static_cast<SizeClass>(i);
+        ackLatency[i].snapshot().write(writer, "fmtp_sender_ack_seconds",
+                "Time from the submission of a product to its "
+                "acknowledgement by every receiver.",
+                MetricsWriter::join(labels,
+                        MetricsWriter::label("size",
+                                sizeClassName(sizeclass))));
+    }
+}
+
+
+/**
+ * Enables the adjustment of the sending rate to the loss experienced by the
+ * receivers. Every `interval` seconds, the rate controller thread estimates
+ * the fraction of multicast packets lost by the worst receiver, either from
+ * the retransmission requests the receivers sent during the interval
+ * (RATECTRL_RETX) or from the loss and kernel-drop rates in their statistics
+ * reports (RATECTRL_DROPS; see fmtpRecvv3::SetStatsInterval()), or the larger
+ * of both. If the loss exceeds a threshold, the rate is decreased
+ * multiplicatively; otherwise it is increased additively. The rate is held
+ * while there is nothing to multicast. Must be called before `Start()`.
+ *
+ * @param[in] floor     Lowest rate in bits per second.
+ * @param[in] ceiling   Highest rate in bits per second.
+ * @param[in] interval  Control interval in seconds.
+ * @param[in] signals   Congestion signals to use: RATECTRL_RETX,
+ *                      RATECTRL_DROPS or both.
+ * @throw std::runtime_error  if the rate range is invalid, `interval` isn't
+ *                            positive or `signals` is empty.
+ */
+void fmtpSendv3::SetRateControl(uint64_t floor, uint64_t ceiling,
+                                double interval, int signals)
+{
+    if (interval <= 0 ||
+            !(signals & (RATECTRL_RETX | RATECTRL_DROPS))) {
+        throw std::runtime_error("fmtpSendv3::SetRateControl() invalid "
+                "interval or signals");
+    }
+    RateController* ctrl = new RateController(floor, ceiling);
+    delete ratectrl;
+    ratectrl         = ctrl;
+    ratectrlInterval = interval;
+    ratectrlSignals  = signals;
+    SetSendRate(ratectrl->SetRate(linkspeed ? linkspeed : floor));
+}
+
+
+/**
+ * Sets the parameters of the rate controller's control law. Must be called
+ * after `SetRateControl()` and before `Start()`.
+ *
+ * @param[in] increase   Rate increase in bits per second after an interval
+ *                       without congestion.
+ * @param[in] decrease   Factor the rate is multiplied by after an interval
+ *                       with congestion.
+ * @param[in] threshold  Loss fraction above which an interval counts as
+ *                       congested.
+ * @throw std::runtime_error  if rate control isn't enabled or an argument is
+ *                            invalid.
+ */
+void fmtpSendv3::SetRateControlLaw(uint64_t increase, double decrease,
+                                   double threshold)
+{
+    if (!ratectrl) {
+        throw std::runtime_error("fmtpSendv3::SetRateControlLaw() rate "
+                "control isn't enabled");
+    }
+    ratectrl->SetAIMD(increase, decrease, threshold);
+}
+
+
+/**
+ * Sets where and how the sender's threads run: the CPUs, the NUMA node and
+ * the scheduling class of the coordinator, timer, retransmission and control
+ * threads. The multicast packets are sent by the thread that calls
+ * sendProduct(); the application can place it with
+ * `placement.apply(ROLE_MCAST)`. A thread whose placement can't be applied
+ * fails like on any other error. Must be called before `Start()`.
+ *
+ * @param[in] placement  The thread placement.
+ */
+void fmtpSendv3::SetThreadPlacement(const ThreadPlacement& placement)
+{
+    this->placement = placement;
+}
+
 
-    return prodIndex++;
+/**
+ * Enables the detection of slow receivers. Every `interval` seconds, the
+ * slow-receiver monitor thread checks how many bytes were retransmitted to
+ * each receiver and how long, on average, it took to complete the products it
+ * completed during the interval. A receiver that exceeds a limit in `strikes`
+ * consecutive intervals is considered slow and one of the following actions
+ * is taken on it:
+ *   - SLOWRECV_FLAG:       it's only marked as slow in the loss map.
+ *   - SLOWRECV_THROTTLE:   its retransmissions are paced at `throttleRate`, so
+ *                          it can't take more than that share of the
+ *                          retransmission bandwidth.
+ *   - SLOWRECV_RELEGATE:   later products no longer wait for it; it gets
+ *                          them on a best-effort basis. The application is
+ *                          expected to move it to a slower feed.
+ *   - SLOWRECV_DISCONNECT: its connection is closed.
+ * The action is recorded in the receiver's loss-map entry, counted in
+ * getSlowRecvStats() and reported to the sending application through
+ * SendProxy::notify_of_slow_recv(). Must be called before `Start()`.
+ *
+ * @param[in] maxRetxBytes  Most bytes a receiver may have retransmitted per
+ *                          interval. 0 means no limit.
+ * @param[in] maxLatency    Longest mean time in seconds a receiver may take to
+ *                          complete a product. 0 means no limit.
+ * @param[in] action        Action taken on a slow receiver.
+ * @param[in] throttleRate  Retransmission rate in bits per second of a
+ *                          throttled receiver.
+ * @param[in] interval      Evaluation interval in seconds.
+ * @param[in] strikes       Number of consecutive intervals a receiver must
+ *                          exceed a limit in to be considered slow.
+ * @throw std::runtime_error  if there is no limit, the action is unknown, the
+ *                            throttle rate is below 1 Kbps, the interval
+ *                            isn't positive or `strikes` is 0.
+ */
+void fmtpSendv3::SetSlowRecvPolicy(uint64_t maxRetxBytes, double maxLatency,
+                                   int action, uint64_t throttleRate,
+                                   double interval, unsigned strikes)
+{
+    if ((maxRetxBytes == 0 && maxLatency <= 0) ||
+            action < SLOWRECV_FLAG || action > SLOWRECV_DISCONNECT ||
+            throttleRate < 1000 || interval <= 0 || strikes == 0) {
+        throw std::runtime_error("fmtpSendv3::SetSlowRecvPolicy() invalid "
+                "argument");
+    }
+    slowMaxRetxBytes = maxRetxBytes;
+    slowMaxLatency   = maxLatency;
+    slowAction       = action;
+    slowThrottleRate = throttleRate;
+    slowInterval     = interval;
+    slowStrikes      = strikes;
 }
 
 
@@ -301,13 +957,7 @@ void fmtpSendv3::SetSendRate(uint64_t speed)
  */
 void fmtpSendv3::Start()
 {
-    /* start listening to incoming connections */
-    tcpsend->Init();
-    /* initialize UDP connection */
-    udpsend->Init();
-
-    /* initializes a new SilenceSuppressor instance. */
-    suppressor = new SilenceSuppressor(PRODNUM * EXPTRUN);
+    startResources();
 
     int retval = pthread_create(&timer_t, NULL, &fmtpSendv3::timerWrapper, this);
     if(retval != 0) {
@@ -323,6 +973,96 @@ void fmtpSendv3::Start()
                 "fmtpSendv3::Start() pthread_create() coordinator error with"
                 " retval = " + std::to_string(retval));
     }
+
+    try {
+        startOptionalThreads();
+    }
+    catch (const std::runtime_error& e) {
+        (void)pthread_cancel(timer_t);
+        (void)pthread_cancel(coor_t);
+        throw;
+    }
+}
+
+
+/**
+ * Starts this instance as a feed of a multi-feed engine, which accepts its
+ * receivers, serves their requests and times its products out on its shared
+ * threads. Only the threads of optional features are started.
+ *
+ * @param[in] host  The engine.
+ * @throw std::runtime_error  if the sockets can't be initialized or a thread
+ *                            can't be created.
+ */
+void fmtpSendv3::startHosted(fmtpSendEngine* const host)
+{
+    engine = host;
+    startResources();
+    startOptionalThreads();
+}
+
+
+/**
+ * Initializes the sockets and the silence suppressor.
+ *
+ * @throw std::runtime_error  if a socket can't be initialized.
+ */
+void fmtpSendv3::startResources()
+{
+    /* start listening to incoming connections */
+    tcpsend->Init();
+    /* initialize UDP connection */
+    udpsend->Init();
+
+    /* initializes a new SilenceSuppressor instance. */
+    suppressor = new SilenceSuppressor(PRODNUM * EXPTRUN);
+}
+
+
+/**
+ * Starts the threads of the enabled optional features: aggregation, rate
+ * control and slow-receiver detection.
+ *
+ * @throw std::runtime_error  if a thread can't be created.
+ */
+void fmtpSendv3::startOptionalThreads()
+{
+    int retval;
+
+    if (aggrMaxSize) {
+        retval = pthread_create(&aggr_t, NULL, &fmtpSendv3::aggrFlusherWrapper,
+                                this);
+        if(retval != 0) {
+            throw std::runtime_error(
+                    "fmtpSendv3::Start() pthread_create() aggrFlusherWrapper "
+                    "error with retval = " + std::to_string(retval));
+        }
+        aggrRunning = true;
+    }
+
+    if (ratectrl) {
+        ratectrlTick = std::chrono::steady_clock::now();
+        retval = pthread_create(&ratectrl_t, NULL, &fmtpSendv3::rateCtrlWrapper,
+                                this);
+        if(retval != 0) {
+            throw std::runtime_error(
+                    "fmtpSendv3::Start() pthread_create() rateCtrlWrapper "
+                    "error with retval = " + std::to_string(retval));
+        }
+        ratectrlRunning = true;
+    }
+
+    if (slowAction) {
+        retval = pthread_create(&slow_t, NULL,
+                                &fmtpSendv3::slowRecvMonitorWrapper, this);
+        if(retval != 0) {
+            throw std::runtime_error(
+                    "fmtpSendv3::Start() pthread_create() "
+                    "slowRecvMonitorWrapper error with retval = " +
+                    std::to_string(retval));
+        }
+        slowRunning = true;
+    }
 }
 
 
@@ -334,13 +1074,50 @@ void fmtpSendv3::Start()
  */
 void fmtpSendv3::Stop()
 {
-    timerDelayQ.disable(); // will cause timer thread to exit
-    (void)pthread_cancel(coor_t);
-    /* cancels all the threads in list and empties the list */
-    retxThreadList.shutdown();
+    if (engine) {
+        /* the engine no longer serves this feed */
+        engine->detachFeed(this);
+    }
+    else {
+        timerDelayQ.disable(); // will cause timer thread to exit
+        (void)pthread_cancel(coor_t);
+        /* cancels all the threads in list and empties the list */
+        retxThreadList.shutdown();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(aggrmtx);
+        aggrStop = true;
+        aggr_cv.notify_all();
+    }
+    {
+        std::unique_lock<std::mutex> lock(ratectrlmtx);
+        ratectrlStop = true;
+        ratectrl_cv.notify_all();
+    }
+    {
+        std::unique_lock<std::mutex> lock(slowmtx);
+        slowStop = true;
+        slow_cv.notify_all();
+    }
 
-    (void)pthread_join(timer_t, NULL);
-    (void)pthread_join(coor_t, NULL);
+    if (!engine) {
+        (void)pthread_join(timer_t, NULL);
+        (void)pthread_join(coor_t, NULL);
+    }
+    /* the flusher thread can't join itself if it is the one stopping */
+    if (aggrRunning && !pthread_equal(aggr_t, pthread_self())) {
+        (void)pthread_join(aggr_t, NULL);
+        aggrRunning = false;
+    }
+    if (ratectrlRunning) {
+        (void)pthread_join(ratectrl_t, NULL);
+        ratectrlRunning = false;
+    }
+    if (slowRunning) {
+        (void)pthread_join(slow_t, NULL);
+        slowRunning = false;
+    }
 
     {
         std::unique_lock<std::mutex> lock(exitMutex);
@@ -394,11 +1171,19 @@ RetxMetadata* fmtpSendv3::addRetxMetadata(void* const data,
     /* Update current product pointer in RetxMetadata */
     senderProdMeta->dataprod_p       = (void*)data;
 
-    /* Get a full list of current connected sockets and add to unfinished set */
+    senderProdMeta->sendTime         = HRclock::now();
+
+    /**
+     * Get a full list of current connected sockets and add to unfinished set,
+     * except for relegated slow receivers.
+     */
     std::list<int> currSockList = tcpsend->getConnSockList();
     std::list<int>::iterator it;
-    for (it = currSockList.begin(); it != currSockList.end(); ++it)
-        senderProdMeta->unfinReceivers.insert(*it);
+    for (it = currSockList.begin(); it != currSockList.end(); ++it) {
+        if (slowAction != SLOWRECV_RELEGATE ||
+                lossmap.getSlowAction(*it) != SLOWRECV_RELEGATE)
+            senderProdMeta->unfinReceivers.insert(*it);
+    }
 
     /* Add current RetxMetadata into sendMetadata::indexMetaMap */
     sendMeta->addRetxMetadata(senderProdMeta);
@@ -407,6 +1192,353 @@ RetxMetadata* fmtpSendv3::addRetxMetadata(void* const data,
 }
 
 
+/**
+ * Appends a small product to the current aggregate envelope. The envelope is
+ * multicast first if the product doesn't fit into it, and right away if no
+ * further entry could fit after the product. Each aggregated product still
+ * gets its own retransmission entry and timer so that a receiver which lost
+ * the envelope can recover the product through the usual BOP_REQ/RETX_REQ
+ * path.
+ *
+ * @pre                 `aggrmtx` is locked.
+ * @param[in] data      The data-product.
+ * @param[in] dataSize  The size of the data-product in bytes.
+ * @param[in] metadata  Application-specific metadata.
+ * @param[in] metaSize  Size of the metadata in bytes.
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+void fmtpSendv3::aggregateProduct(void* data, uint32_t dataSize,
+                                  void* metadata, uint16_t metaSize)
+{
+    const uint16_t entryLen = AGGR_ENTRY_HEADER_LEN + metaSize + dataSize;
+
+    if (aggrLen + entryLen > FMTP_DATA_LEN) {
+        sendAggregate();
+    }
+
+    RetxMetadata* senderProdMeta = addRetxMetadata(data, dataSize, metadata,
+                                                   metaSize);
+
+    if (aggrCount == 0) {
+        aggrFirst = prodIndex;
+        aggrStart = HRclock::now();
+        /* wakes up the flusher to start the delay of this envelope */
+        aggr_cv.notify_one();
+    }
+
+    char* wire = aggrBuf + aggrLen;
+    const uint32_t prodsize = htonl(dataSize);
+    const uint16_t metasize = htons(metaSize);
+    (void)memcpy(wire, &prodsize, sizeof(prodsize));
+    wire += sizeof(prodsize);
+    (void)memcpy(wire, &metasize, sizeof(metasize));
+    wire += sizeof(metasize);
+    if (metaSize) {
+        (void)memcpy(wire, metadata, metaSize);
+        wire += metaSize;
+    }
+    (void)memcpy(wire, data, dataSize);
+    aggrLen += entryLen;
+    ++aggrCount;
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Product #" + std::to_string(prodIndex);
+        debugmsg += ": aggregated into envelope of product #";
+        debugmsg += std::to_string(aggrFirst);
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    if (aggrLen + AGGR_ENTRY_HEADER_LEN >= FMTP_DATA_LEN) {
+        sendAggregate();
+    }
+
+    setTimerParameters(senderProdMeta);
+    scheduleTimeout(prodIndex, senderProdMeta->retxTimeoutPeriod);
+}
+
+
+/**
+ * Multicasts the current aggregate envelope and empties it. The envelope is
+ * rate shaped like any other data packet.
+ *
+ * @pre                       `aggrmtx` is locked.
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+void fmtpSendv3::sendAggregate()
+{
+    FmtpHeader header;
+    header.prodindex  = htonl(aggrFirst);
+    header.seqnum     = htonl(aggrCount);
+    header.payloadlen = htons(aggrLen);
+    header.flags      = htons(FMTP_AGGR_DATA);
+
+    startPacing(sizeof(header) + aggrLen);
+    counters.add(SEND_MCASTPKTS);
+    counters.add(SEND_MCASTBYTES, sizeof(header) + aggrLen);
+    if (udpsend->SendData(&header, sizeof(header), aggrBuf, aggrLen) < 0) {
+        throw std::runtime_error(
+                "fmtpSendv3::sendAggregate() UdpSend::SendData() error");
+    }
+    endPacing(sizeof(header) + aggrLen);
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Envelope of product #" +
+            std::to_string(aggrFirst);
+        debugmsg += " (" + std::to_string(aggrCount);
+        debugmsg += " products) has been sent.";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    aggrLen   = 0;
+    aggrCount = 0;
+}
+
+
+/**
+ * The aggregate flusher thread. Multicasts a partially filled envelope once
+ * its first product has waited the configured maximum delay.
+ *
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+void fmtpSendv3::aggrFlusher()
+{
+    placement.apply(ROLE_CONTROL);
+    const HRclock::duration maxDelay =
+        std::chrono::duration_cast<HRclock::duration>(
+                std::chrono::duration<double>(aggrMaxDelay));
+    std::unique_lock<std::mutex> lock(aggrmtx);
+
+    while (!aggrStop) {
+        if (aggrCount == 0) {
+            aggr_cv.wait(lock);
+        }
+        else if (HRclock::now() >= aggrStart + maxDelay) {
+            sendAggregate();
+        }
+        else {
+            aggr_cv.wait_until(lock, aggrStart + maxDelay);
+        }
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real aggrFlusher().
+ *
+ * @param[in] ptr                a pointer to the fmtpSendv3 class.
+ */
+void* fmtpSendv3::aggrFlusherWrapper(void* ptr)
+{
+    fmtpSendv3* const sender = static_cast<fmtpSendv3*>(ptr);
+    try {
+        sender->aggrFlusher();
+    }
+    catch (std::runtime_error& e) {
+        sender->taskExit(e);
+    }
+    return NULL;
+}
+
+
+/**
+ * The rate control thread. Adjusts the sending rate once per control interval
+ * according to the congestion signal of the interval.
+ */
+void fmtpSendv3::rateCtrl()
+{
+    placement.apply(ROLE_CONTROL);
+    const std::chrono::steady_clock::duration interval =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(ratectrlInterval));
+    std::unique_lock<std::mutex> lock(ratectrlmtx);
+    std::chrono::steady_clock::time_point next = ratectrlTick + interval;
+
+    while (!ratectrlStop) {
+        if (ratectrl_cv.wait_until(lock, next) != std::cv_status::timeout)
+            continue;
+        next += interval;
+
+        const double loss = congestionSignal();
+        if (loss < 0)
+            continue; // nothing to judge the rate by
+        const uint64_t rate = ratectrl->Update(loss);
+        rateshaper.SetRate(rate);
+
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "Rate control: loss = " +
+                std::to_string(loss);
+            debugmsg += ", sending rate = " + std::to_string(rate) + " bps";
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+    }
+}
+
+
+/**
+ * The slow-receiver monitor thread. Once per evaluation interval, compares
+ * what every receiver did during the interval with the limits and takes the
+ * configured action on receivers that exceeded a limit too many intervals in
+ * a row.
+ */
+void fmtpSendv3::slowRecvMonitor()
+{
+    placement.apply(ROLE_CONTROL);
+    const std::chrono::steady_clock::duration interval =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(slowInterval));
+    std::unique_lock<std::mutex> lock(slowmtx);
+    std::chrono::steady_clock::time_point next =
+        std::chrono::steady_clock::now() + interval;
+
+    while (!slowStop) {
+        if (slow_cv.wait_until(lock, next) != std::cv_status::timeout)
+            continue;
+        next += interval;
+
+        const std::vector<ReceiverStats> receivers = lossmap.get();
+        std::map<int, SlowRecvWindow>    windows;
+        for (std::vector<ReceiverStats>::const_iterator it = receivers.begin();
+             it != receivers.end(); ++it) {
+            SlowRecvWindow  prev = {0, 0, 0, 0};
+            const std::map<int, SlowRecvWindow>::const_iterator found =
+                slowWindows.find(it->sock);
+            if (found != slowWindows.end())
+                prev = found->second;
+            SlowRecvWindow& curr = windows[it->sock];
+            curr.retxbytes   = it->retxbytes;
+            curr.completions = it->completions;
+            curr.latencysum  = it->latencysum;
+            curr.strikes     = 0;
+            if (it->slowaction)
+                continue; // already dealt with
+
+            const uint64_t completions = it->completions - prev.completions;
+            const bool tooManyBytes = slowMaxRetxBytes &&
+                (it->retxbytes - prev.retxbytes > slowMaxRetxBytes);
+            const bool tooSlow = (slowMaxLatency > 0) && completions &&
+                ((it->latencysum - prev.latencysum) / completions >
+                 slowMaxLatency);
+            if (!tooManyBytes && !tooSlow)
+                continue;
+
+            curr.strikes = prev.strikes + 1;
+            if (curr.strikes >= slowStrikes)
+                isolateSlowRecv(it->sock);
+        }
+        slowWindows.swap(windows);
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real slowRecvMonitor().
+ *
+ * @param[in] ptr                a pointer to the fmtpSendv3 class.
+ */
+void* fmtpSendv3::slowRecvMonitorWrapper(void* ptr)
+{
+    fmtpSendv3* const sender = static_cast<fmtpSendv3*>(ptr);
+    try {
+        sender->slowRecvMonitor();
+    }
+    catch (std::runtime_error& e) {
+        sender->taskExit(e);
+    }
+    return NULL;
+}
+
+
+/**
+ * Takes the configured action on a slow receiver: records it in the loss map,
+ * closes the receiver's connection if the action is SLOWRECV_DISCONNECT, and
+ * notifies the sending application. The connection is shut down rather than
+ * closed so that the receiver's retransmission thread cleans up as for any
+ * receiver that went offline.
+ *
+ * @param[in] sock  The receiver's socket.
+ */
+void fmtpSendv3::isolateSlowRecv(const int sock)
+{
+    if (!lossmap.setSlowAction(sock, slowAction))
+        return; // the receiver is gone
+
+    if (slowAction == SLOWRECV_DISCONNECT)
+        (void)shutdown(sock, SHUT_RDWR);
+
+    if (notifier)
+        notifier->notify_of_slow_recv(sock, slowAction);
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Slow receiver on socket " +
+            std::to_string(sock);
+        debugmsg += ": action " + std::to_string(slowAction) + " taken";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+}
+
+
+/**
+ * A wrapper function which is used to call the real rateCtrl().
+ *
+ * @param[in] ptr                a pointer to the fmtpSendv3 class.
+ */
+void* fmtpSendv3::rateCtrlWrapper(void* ptr)
+{
+    fmtpSendv3* const sender = static_cast<fmtpSendv3*>(ptr);
+    try {
+        sender->rateCtrl();
+    }
+    catch (std::runtime_error& e) {
+        sender->taskExit(e);
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns the fraction of multicast packets lost by the worst receiver since
+ * the previous call. With RATECTRL_RETX, a receiver's loss is the number of
+ * retransmission requests it sent relative to the number of packets multicast.
+ * With RATECTRL_DROPS, it's the larger of the loss and kernel-drop rates of
+ * the receiver's latest report, if the report arrived since the previous call.
+ *
+ * @return  The loss fraction or a negative value if nothing was multicast and
+ *          no receiver reported since the previous call.
+ */
+double fmtpSendv3::congestionSignal()
+{
+    const std::vector<ReceiverStats>      receivers = lossmap.get();
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    const uint64_t sent  = counters.sum(SEND_MCASTPKTS);
+    const uint64_t nsent = sent - ratectrlSent;
+    double         loss  = -1;
+    std::map<int, uint64_t> reqs;
+
+    for (std::vector<ReceiverStats>::const_iterator it = receivers.begin();
+         it != receivers.end(); ++it) {
+        reqs[it->sock] = it->retxreqsrecvd;
+        if ((ratectrlSignals & RATECTRL_RETX) && nsent) {
+            const std::map<int, uint64_t>::const_iterator prev =
+                ratectrlReqs.find(it->sock);
+            const uint64_t nreqs = it->retxreqsrecvd -
+                ((prev == ratectrlReqs.end()) ? 0 : prev->second);
+            loss = std::max(loss, std::min(1.0, double(nreqs) / nsent));
+        }
+        if ((ratectrlSignals & RATECTRL_DROPS) && it->reports &&
+                it->updated > ratectrlTick) {
+            loss = std::max(loss, std::max(it->lossrate, it->droprate));
+        }
+    }
+
+    ratectrlSent = sent;
+    ratectrlReqs.swap(reqs);
+    ratectrlTick = now;
+
+    return loss;
+}
+
+
 /**
  * The sender side coordinator thread. Listen for incoming TCP connection
  * requests in an infinite loop and assign a new socket for the corresponding
@@ -420,25 +1552,15 @@ void* fmtpSendv3::coordinator(void* ptr)
 {
     fmtpSendv3* sendptr = static_cast<fmtpSendv3*>(ptr);
     try {
+        sendptr->placement.apply(ROLE_COORD);
         while(1) {
-            int newtcpsockfd = sendptr->tcpsend->acceptConn();
-            /**
-             * Requests the application to verify a new receiver. Shuts down
-             * the connection if failing. Otherwise fork a new thread for the
-             * receiver. This access control process can be skipped if there
-             * is no application support (e.g. testApp).
-             */
-            if (sendptr->notifier) {
-                if (!sendptr->notifier->verify_new_recv(newtcpsockfd)) {
-                    sendptr->tcpsend->dismantleConn(newtcpsockfd);
-                    continue;
-                }
-            }
-            /* If new receiver accepted, measure its path MTU and update */
-            sendptr->tcpsend->updatePathMTU(newtcpsockfd);
+            int newtcpsockfd = sendptr->acceptReceiver();
+            if (newtcpsockfd < 0)
+                continue;
 
             int initState;
             pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &initState);
+            sendptr->lossmap.add(newtcpsockfd);
             sendptr->StartNewRetxThread(newtcpsockfd);
             int ignoredState;
             pthread_setcancelstate(initState, &ignoredState);
@@ -447,7 +1569,82 @@ void* fmtpSendv3::coordinator(void* ptr)
     catch (std::runtime_error& e) {
         sendptr->taskExit(e);
     }
-    return NULL;
+    return NULL;
+}
+
+
+/**
+ * Accepts a connection from a receiver. Requests the application to verify
+ * the new receiver and shuts the connection down if it fails. This access
+ * control process is skipped if there is no application support (e.g.
+ * testApp). Otherwise, measures the receiver's path MTU.
+ *
+ * @return  The receiver's socket or -1 if the receiver was rejected.
+ * @throw std::runtime_error  if the connection can't be accepted.
+ */
+int fmtpSendv3::acceptReceiver()
+{
+    int newtcpsockfd = tcpsend->acceptConn();
+    if (notifier) {
+        if (!notifier->verify_new_recv(newtcpsockfd)) {
+            tcpsend->dismantleConn(newtcpsockfd);
+            return -1;
+        }
+    }
+    /* If new receiver accepted, measure its path MTU and update */
+    tcpsend->updatePathMTU(newtcpsockfd);
+    return newtcpsockfd;
+}
+
+
+/**
+ * Forgets a receiver and closes its connection.
+ *
+ * @param[in] sock  The receiver's socket.
+ */
+void fmtpSendv3::removeReceiver(const int sock)
+{
+    tcpsend->rmSockInList(sock);
+    lossmap.remove(sock);
+    close(sock);
+}
+
+
+/**
+ * Handles a broken connection to a receiver by removing the receiver. If it
+ * was the last receiver, the sender fails with the error.
+ *
+ * @param[in] sock  The receiver's socket.
+ * @param[in] e     The error.
+ * @throw std::runtime_error  if it was the last receiver.
+ */
+void fmtpSendv3::dropReceiver(const int sock, const std::runtime_error& e)
+{
+    removeReceiver(sock);
+    std::list<int> socklist = tcpsend->getConnSockList();
+    if (socklist.empty()) {
+        /* this is the last receiver, should rethrow exception to report */
+        taskExit(e);
+        std::rethrow_exception(except);
+    }
+    // TODO: notify timer not to wait for the offline receiver
+    // TODO: notify application a receiver went offline?
+}
+
+
+/**
+ * Schedules the timeout of a product on the timer thread or, for a feed of a
+ * multi-feed engine, on the engine's timer thread.
+ *
+ * @param[in] prodindex  Index of the product.
+ * @param[in] seconds    Time until the timeout in seconds.
+ */
+void fmtpSendv3::scheduleTimeout(const uint32_t prodindex, const double seconds)
+{
+    if (engine)
+        engine->scheduleTimeout(this, prodindex, seconds);
+    else
+        timerDelayQ.push(prodindex, seconds);
 }
 
 
@@ -463,16 +1660,17 @@ void fmtpSendv3::handleRetxReq(FmtpHeader* const   recvheader,
                                RetxMetadata* const retxMeta,
                                const int           sock)
 {
+    counters.add(SEND_RETXREQS);
+    lossmap.countRetxReq(sock, retxMeta ? recvheader->payloadlen : 0);
     if (retxMeta) {
         retransmit(recvheader, retxMeta, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": RETX_REQ accepted, RETX_DATA sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
     else {
         /**
@@ -481,13 +1679,12 @@ void fmtpSendv3::handleRetxReq(FmtpHeader* const   recvheader,
          */
         rejRetxReq(recvheader->prodindex, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": RETX_REQ rejected, RETX_REJ sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
 }
 
@@ -506,6 +1703,26 @@ void fmtpSendv3::handleRetxEnd(FmtpHeader*   const recvheader,
                                const int           sock)
 {
     if (retxMeta) {
+        /**
+         * A receiver that recovered the tail of the product being multicast
+         * through retransmissions may finish it before its EOP is sent.
+         * Releasing it now would let the sending application free the data
+         * that is still being multicast.
+         */
+        {
+            std::unique_lock<std::mutex> lock(sendingmtx);
+            if (sending && sendingIndex == recvheader->prodindex) {
+                earlyRetxEnds.push_back(sock);
+                return;
+            }
+        }
+        if (trace) {
+            trace->record(TRACE_ACK, recvheader->prodindex, sock);
+        }
+        const HRclock::duration elapsed = HRclock::now() - retxMeta->sendTime;
+        const SizeClass sizeclass = sizeClassOf(retxMeta->prodLength);
+        lossmap.countCompletion(sock,
+                std::chrono::duration<double>(elapsed).count());
         /**
          * Remove the specific receiver from the unfinished receiver
          * set. Only if the product is removed by clearUnfinishedSet(),
@@ -518,6 +1735,10 @@ void fmtpSendv3::handleRetxEnd(FmtpHeader*   const recvheader,
              * since this receiver is the last one in the unfinished set,
              * notify the sending application.
              */
+            counters.add(SEND_ACKED);
+            ackLatency[sizeclass].record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            elapsed).count());
             if (notifier) {
                 notifier->notify_of_eop(recvheader->prodindex);
             }
@@ -539,6 +1760,93 @@ void fmtpSendv3::handleRetxEnd(FmtpHeader*   const recvheader,
 }
 
 
+/**
+ * Handles the RETX_ENDs that arrived while the product just sent was still
+ * being multicast, see handleRetxEnd().
+ */
+void fmtpSendv3::handleEarlyRetxEnds()
+{
+    std::vector<int> socks;
+    uint32_t         prodindex;
+    {
+        std::unique_lock<std::mutex> lock(sendingmtx);
+        sending   = false;
+        prodindex = sendingIndex;
+        socks.swap(earlyRetxEnds);
+    }
+    for (size_t i = 0; i < socks.size(); ++i) {
+        FmtpHeader header;
+        header.prodindex  = prodindex;
+        header.seqnum     = 0;
+        header.payloadlen = 0;
+        header.flags      = FMTP_RETX_END;
+        handleRetxEnd(&header, sendMeta->getMetadata(prodindex), socks[i]);
+        sendMeta->releaseMetadata(prodindex);
+    }
+}
+
+
+/**
+ * Handles the products beyond the first one acknowledged by a RETX_END that
+ * covers a run of aggregated products. The `seqnum` of such a notice is the
+ * number of consecutive products acknowledged, starting at its `prodindex`.
+ * A run longer than an envelope can hold isn't one a receiver sends, so it is
+ * ignored beyond its first product.
+ *
+ * @param[in] recvheader  The FMTP header of the notice.
+ * @param[in] sock        The receiver's socket.
+ */
+void fmtpSendv3::handleAggrRetxEnd(const FmtpHeader* const recvheader,
+                                   const int               sock)
+{
+    FmtpHeader header = *recvheader;
+
+    if (recvheader->seqnum > (uint32_t)AGGR_MAX_ENTRIES) {
+        logger->write(LOGLVL_WARNING, "fmtpSendv3::handleAggrRetxEnd(): "
+                "RETX_END for product #" +
+                std::to_string(recvheader->prodindex) + " covers " +
+                std::to_string(recvheader->seqnum) + " products, more than "
+                "an envelope holds; ignored.");
+        return;
+    }
+
+    for (uint32_t i = 1; i < recvheader->seqnum; ++i) {
+        header.prodindex = recvheader->prodindex + i;
+        RetxMetadata* retxMeta = sendMeta->getMetadata(header.prodindex);
+        handleRetxEnd(&header, retxMeta, sock);
+        sendMeta->releaseMetadata(header.prodindex);
+    }
+}
+
+
+/**
+ * Handles a statistics report from a receiver by updating the receiver's
+ * entry in the loss map. A report of unexpected size is skipped.
+ *
+ * @param[in] recvheader  The FMTP header of the report.
+ * @param[in] payload     The report.
+ * @param[in] sock        The receiver's socket.
+ */
+void fmtpSendv3::handleRecvStats(const FmtpHeader* const recvheader,
+                                 const char* const       payload,
+                                 const int               sock)
+{
+    RecvStatsMsg stats;
+
+    if (recvheader->payloadlen == RECV_STATS_LEN) {
+        (void)memcpy(&stats, payload, RECV_STATS_LEN);
+        lossmap.update(sock, stats);
+    }
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Statistics report #" +
+            std::to_string(recvheader->prodindex);
+        debugmsg += " received on socket " + std::to_string(sock);
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+}
+
+
 /**
  * Handles the RETX_BOP request from receiver. If the corresponding metadata
  * is still in the RetxMetadata map, then issue a BOP retransmission.
@@ -552,16 +1860,17 @@ void fmtpSendv3::handleBopReq(FmtpHeader* const  recvheader,
                                RetxMetadata* const retxMeta,
                                const int           sock)
 {
+    counters.add(SEND_BOPREQS);
+    lossmap.countRetxReq(sock, 0);
     if (retxMeta) {
         retransBOP(recvheader, retxMeta, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": BOP_REQ accepted, RETX_BOP sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
     else {
         /**
@@ -570,13 +1879,12 @@ void fmtpSendv3::handleBopReq(FmtpHeader* const  recvheader,
          */
         rejRetxReq(recvheader->prodindex, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": BOP_REQ rejected, RETX_REJ sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
 }
 
@@ -594,16 +1902,17 @@ void fmtpSendv3::handleEopReq(FmtpHeader* const  recvheader,
                                RetxMetadata* const retxMeta,
                                const int           sock)
 {
+    counters.add(SEND_EOPREQS);
+    lossmap.countRetxReq(sock, 0);
     if (retxMeta) {
         retransEOP(recvheader, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": EOP_REQ accepted, RETX_EOP sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
     else {
         /**
@@ -612,13 +1921,12 @@ void fmtpSendv3::handleEopReq(FmtpHeader* const  recvheader,
          */
         rejRetxReq(recvheader->prodindex, sock);
 
-        #ifdef DEBUG2
+        if (logger->enabled(LOGLVL_DEBUG)) {
             std::string debugmsg = "Product #" +
                 std::to_string(recvheader->prodindex);
             debugmsg += ": EOP_REQ rejected, RETX_REJ sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
     }
 }
 
@@ -644,102 +1952,236 @@ void fmtpSendv3::handleEopReq(FmtpHeader* const  recvheader,
  */
 void fmtpSendv3::RunRetxThread(int retxsockfd)
 {
-    FmtpHeader recvheader;
+    /* paces the retransmissions to a throttled slow receiver */
+    RateShaper retxshaper;
+
+    placement.apply(ROLE_RETX);
 
     while(1) {
-        /* Receive the message from tcp connection and parse the header */
-        int parsestate;
+        bool open;
         try {
-            parsestate = tcpsend->parseHeader(retxsockfd, &recvheader);
+            open = serveRetxMessage(retxsockfd, &retxshaper);
         }
         catch (const std::runtime_error& e) {
             /**
              * TcpSend::parseHeader() TcpBase::recvall() recv() returns -1,
-             * connection is broken.
+             * connection is broken. Rethrows if this is the last receiver,
+             * otherwise silently exits.
              */
-            close(retxsockfd);
-            tcpsend->rmSockInList(retxsockfd);
-            std::list<int> socklist = tcpsend->getConnSockList();
-            if (socklist.empty()) {
-                /* this is the last receiver, should rethrow exception to report */
-                taskExit(e);
-                std::rethrow_exception(except);
-            }
-            // TODO: notify timer not to wait for the offline receiver
-            /* if not last receiver, silently exit */
+            dropReceiver(retxsockfd, e);
             pthread_exit(NULL);
-            // TODO: notify application a receiver went offline?
         }
-        if (parsestate == 0) {
+        if (!open) {
             /* encountered EOF, header incomplete */
             throw std::runtime_error("fmtpSendv3::RunRetxThread() parseHeader"
                                      "error, incomplete header");
         }
+    }
+}
 
-        /* Acquires the product metadata as in exclusive use */
-        RetxMetadata* retxMeta = sendMeta->getMetadata(recvheader.prodindex);
 
-        try {
-            if (recvheader.flags == FMTP_RETX_REQ) {
-                #ifdef DEBUG2
-                    std::string debugmsg = "Product #" +
-                        std::to_string(recvheader.prodindex);
-                    debugmsg += ": RETX_REQ received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #endif
-                handleRetxReq(&recvheader, retxMeta, retxsockfd);
-            }
-            else if (recvheader.flags == FMTP_RETX_END) {
-                #ifdef DEBUG2
-                    std::string debugmsg = "Product #" +
-                        std::to_string(recvheader.prodindex);
-                    debugmsg += ": RETX_END received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #endif
-                handleRetxEnd(&recvheader, retxMeta, retxsockfd);
-            }
-            else if (recvheader.flags == FMTP_BOP_REQ) {
-                #ifdef DEBUG2
-                    std::string debugmsg = "Product #" +
-                        std::to_string(recvheader.prodindex);
-                    debugmsg += ": BOP_REQ received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #endif
-                handleBopReq(&recvheader, retxMeta, retxsockfd);
-            }
-            else if (recvheader.flags == FMTP_EOP_REQ) {
-                #ifdef DEBUG2
-                    std::string debugmsg = "Product #" +
-                        std::to_string(recvheader.prodindex);
-                    debugmsg += ": EOP_REQ received";
-                    std::cout << debugmsg << std::endl;
-                    WriteToLog(debugmsg);
-                #endif
-                handleEopReq(&recvheader, retxMeta, retxsockfd);
-            }
-        }
-        catch (const std::runtime_error& e) {
-            /* same as parseHeader(), if connection broken, take action */
-            close(retxsockfd);
-            tcpsend->rmSockInList(retxsockfd);
-            std::list<int> socklist = tcpsend->getConnSockList();
-            if (socklist.empty()) {
-                /* this is the last receiver, should rethrow exception to report */
-                taskExit(e);
-                std::rethrow_exception(except);
-            }
-            // TODO: notify timer not to wait for the offline receiver
-            /* if not last receiver, silently exit */
-            pthread_exit(NULL);
-            // TODO: notify application a receiver went offline?
+/**
+ * Reads one message from a receiver and handles it. Blocks until the whole
+ * message has arrived.
+ *
+ * @param[in] retxsockfd  The receiver's socket.
+ * @param[in] retxshaper  Paces the retransmissions to the receiver if it is a
+ *                        throttled slow receiver.
+ * @return                Whether a message was handled. False if the
+ *                        connection was closed before a complete header.
+ * @throw std::runtime_error  if the connection is broken.
+ */
+bool fmtpSendv3::serveRetxMessage(const int         retxsockfd,
+                                  RateShaper* const retxshaper)
+{
+    FmtpHeader recvheader;
+    char       payload[MAX_FMTP_PACKET_LEN];
+
+    /* Receive the message from tcp connection and parse the header */
+    if (tcpsend->parseHeader(retxsockfd, &recvheader) == 0)
+        return false;
+
+    const size_t paylen = retxMessageLen(recvheader) - FMTP_HEADER_LEN;
+    if (paylen > sizeof(payload) ||
+            tcpsend->recvPayload(retxsockfd, payload, paylen) < paylen) {
+        throw std::runtime_error("fmtpSendv3::serveRetxMessage() couldn't "
+                "read the payload of a message");
+    }
+
+    const uint64_t throttleRate = recvheader.flags == FMTP_RETX_REQ ?
+                                  retxRate(retxsockfd) : 0;
+    if (throttleRate) {
+        retxshaper->SetRate(throttleRate);
+        retxshaper->CalcPeriod(FMTP_HEADER_LEN + recvheader.payloadlen);
+    }
+    handleRetxMessage(&recvheader, payload, retxsockfd);
+    /* sleeps only after the metadata is released */
+    if (throttleRate)
+        retxshaper->Sleep();
+
+    return true;
+}
+
+
+/**
+ * Handles the complete messages of a receiver that an engine's reactor has
+ * read from the receiver's connection. What is sent back is queued on the
+ * connection by the engine, see sendToReceiver().
+ *
+ * @param[in] sock  The receiver's socket.
+ * @param[in] buf   Bytes read from the connection, starting with a message.
+ * @param[in] len   Number of bytes.
+ * @return          Number of bytes of the complete messages handled. The rest
+ *                  is the start of a message that hasn't fully arrived yet.
+ * @throw std::runtime_error  if a message is invalid or can't be answered.
+ */
+size_t fmtpSendv3::serveRetxBuffer(const int sock, const char* const buf,
+                                   const size_t len)
+{
+    size_t used = 0;
+
+    while (len - used >= FMTP_HEADER_LEN) {
+        FmtpHeader recvheader;
+        (void)memcpy(&recvheader, buf + used, FMTP_HEADER_LEN);
+        recvheader.prodindex  = ntohl(recvheader.prodindex);
+        recvheader.seqnum     = ntohl(recvheader.seqnum);
+        recvheader.payloadlen = ntohs(recvheader.payloadlen);
+        recvheader.flags      = ntohs(recvheader.flags);
+
+        const size_t msglen = retxMessageLen(recvheader);
+        if (msglen > FMTP_HEADER_LEN + MAX_FMTP_PACKET_LEN) {
+            throw std::runtime_error("fmtpSendv3::serveRetxBuffer() message "
+                    "too long");
         }
+        if (len - used < msglen)
+            break;
+        handleRetxMessage(&recvheader, buf + used + FMTP_HEADER_LEN, sock);
+        used += msglen;
+    }
+
+    return used;
+}
+
+
+/**
+ * Returns the length of a message from a receiver. Only a statistics report
+ * carries a payload, the payload length of a request is the amount of data
+ * requested.
+ *
+ * @param[in] recvheader  The FMTP header of the message.
+ * @return                Length of the message in bytes, header included.
+ */
+size_t fmtpSendv3::retxMessageLen(const FmtpHeader& recvheader)
+{
+    return FMTP_HEADER_LEN + (recvheader.flags == FMTP_RECV_STATS ?
+                              recvheader.payloadlen : 0);
+}
+
+
+/**
+ * Returns the rate that retransmissions to a receiver are throttled to.
+ *
+ * @param[in] sock  The receiver's socket.
+ * @return          The rate in bits per second or 0 if the receiver isn't a
+ *                  throttled slow receiver.
+ */
+uint64_t fmtpSendv3::retxRate(const int sock)
+{
+    return (slowAction == SLOWRECV_THROTTLE &&
+            lossmap.getSlowAction(sock) == SLOWRECV_THROTTLE) ?
+           slowThrottleRate : 0;
+}
+
+
+/**
+ * Handles one message from a receiver.
+ *
+ * @param[in] recvheader  The FMTP header of the message.
+ * @param[in] payload     The payload of the message, see retxMessageLen().
+ * @param[in] sock        The receiver's socket.
+ * @throw std::runtime_error  if the message can't be answered.
+ */
+void fmtpSendv3::handleRetxMessage(FmtpHeader* const recvheader,
+                                   const char* const payload,
+                                   const int         sock)
+{
+    /*
+     * Acquires the product metadata as in exclusive use. The prodindex of
+     * a statistics report isn't a product index.
+     */
+    const bool    isStats  = (recvheader->flags == FMTP_RECV_STATS);
+    RetxMetadata* retxMeta = isStats ? NULL :
+                             sendMeta->getMetadata(recvheader->prodindex);
 
-        /* Releases the product metadata in exclusive use */
-        sendMeta->releaseMetadata(recvheader.prodindex);
+    if (recvheader->flags == FMTP_RETX_REQ) {
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "Product #" +
+                std::to_string(recvheader->prodindex);
+            debugmsg += ": RETX_REQ received";
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+        handleRetxReq(recvheader, retxMeta, sock);
     }
+    else if (recvheader->flags == FMTP_RETX_END) {
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "Product #" +
+                std::to_string(recvheader->prodindex);
+            debugmsg += ": RETX_END received";
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+        counters.add(SEND_RETXENDS);
+        handleRetxEnd(recvheader, retxMeta, sock);
+        if (recvheader->seqnum > 1) {
+            handleAggrRetxEnd(recvheader, sock);
+        }
+    }
+    else if (recvheader->flags == FMTP_BOP_REQ) {
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "Product #" +
+                std::to_string(recvheader->prodindex);
+            debugmsg += ": BOP_REQ received";
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+        handleBopReq(recvheader, retxMeta, sock);
+    }
+    else if (recvheader->flags == FMTP_EOP_REQ) {
+        if (logger->enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "Product #" +
+                std::to_string(recvheader->prodindex);
+            debugmsg += ": EOP_REQ received";
+            logger->write(LOGLVL_DEBUG, debugmsg);
+        }
+        handleEopReq(recvheader, retxMeta, sock);
+    }
+    else if (isStats) {
+        handleRecvStats(recvheader, payload, sock);
+    }
+
+    /* Releases the product metadata in exclusive use */
+    if (!isStats)
+        sendMeta->releaseMetadata(recvheader->prodindex);
+}
+
+
+/**
+ * Sends a message to a receiver. A sender on its own sends it on the
+ * receiver's connection right away. A feed served by an engine has the
+ * engine queue it on the connection, which the engine's reactor writes as
+ * the receiver reads.
+ *
+ * @param[in] sock        The receiver's socket.
+ * @param[in] sendheader  FMTP header of the message in network byte order.
+ * @param[in] payload     Payload of the message.
+ * @param[in] paylen      Length of the payload in bytes.
+ * @return                Number of bytes sent or queued.
+ * @throw std::runtime_error  if an I/O error occurs.
+ */
+int fmtpSendv3::sendToReceiver(const int sock, FmtpHeader* const sendheader,
+                               char* const payload, const size_t paylen)
+{
+    if (engine)
+        return engine->queueUnicast(this, sock, sendheader, payload, paylen);
+    return tcpsend->sendData(sock, sendheader, payload, paylen);
 }
 
 
@@ -759,7 +2201,11 @@ void fmtpSendv3::rejRetxReq(const uint32_t prodindex, const int sock)
     sendheader.seqnum     = 0;
     sendheader.payloadlen = 0;
     sendheader.flags      = htons(FMTP_RETX_REJ);
-    tcpsend->sendData(sock, &sendheader, NULL, 0);
+    counters.add(SEND_RETXREJS);
+    sendToReceiver(sock, &sendheader, NULL, 0);
+    if (trace) {
+        trace->record(TRACE_REJECT, prodindex, sock);
+    }
 }
 
 
@@ -811,9 +2257,9 @@ void fmtpSendv3::retransmit(
 
             #if defined(DEBUG1) || defined(DEBUG2)
                 char tmp[1460] = {0};
-                int retval = tcpsend->sendData(sock, &sendheader, tmp, payLen);
+                int retval = sendToReceiver(sock, &sendheader, tmp, payLen);
             #else
-                int retval = tcpsend->sendData(sock, &sendheader,
+                int retval = sendToReceiver(sock, &sendheader,
                                 (char*)retxMeta->dataprod_p + start, payLen);
             #endif
 
@@ -821,6 +2267,11 @@ void fmtpSendv3::retransmit(
                 throw std::runtime_error(
                         "fmtpSendv3::retransmit() TcpSend::send() error");
             }
+            counters.add(SEND_RETXPKTS);
+            counters.add(SEND_RETXBYTES, payLen);
+            if (trace) {
+                trace->record(TRACE_RETX_DATA, recvheader->prodindex, start);
+            }
 
             #ifdef MODBASE
                 uint32_t tmpidx = recvheader->prodindex % MODBASE;
@@ -828,7 +2279,7 @@ void fmtpSendv3::retransmit(
                 uint32_t tmpidx = recvheader->prodindex;
             #endif
 
-            #ifdef DEBUG2
+            if (logger->enabled(LOGLVL_DEBUG)) {
                 std::string debugmsg = "Product #" +
                     std::to_string(tmpidx);
                 debugmsg += ": Data block (SeqNum = ";
@@ -836,9 +2287,8 @@ void fmtpSendv3::retransmit(
                 debugmsg += "), (PayLen = ";
                 debugmsg += std::to_string(payLen);
                 debugmsg += ") has been retransmitted";
-                std::cout << debugmsg << std::endl;
-                WriteToLog(debugmsg);
-            #endif
+                logger->write(LOGLVL_DEBUG, debugmsg);
+            }
         }
     }
 }
@@ -862,23 +2312,27 @@ void fmtpSendv3::retransBOP(
         const int                 sock)
 {
     FmtpHeader   sendheader;
-    BOPMsg        bopMsg;
+    const size_t BOPCONST = sizeof(uint32_t) + sizeof(uint16_t);
 
     /* Set the FMTP packet header. */
     sendheader.prodindex  = htonl(recvheader->prodindex);
     sendheader.seqnum     = 0;
-    sendheader.payloadlen = htons(retxMeta->metaSize +
-                                  (FMTP_DATA_LEN - AVAIL_BOP_LEN));
+    sendheader.payloadlen = htons(retxMeta->metaSize + BOPCONST);
     sendheader.flags      = htons(FMTP_RETX_BOP);
 
-    /* Set the FMTP BOP message. */
-    bopMsg.prodsize = htonl(retxMeta->prodLength);
-    bopMsg.metasize = htons(retxMeta->metaSize);
-    memcpy(&bopMsg.metadata, retxMeta->metadata, retxMeta->metaSize);
-
-    /** actual BOPmsg size may not be AVAIL_BOP_LEN, payloadlen is corret */
-    int retval = tcpsend->sendData(sock, &sendheader, (char*)(&bopMsg),
-                               ntohs(sendheader.payloadlen));
+    /**
+     * Set the FMTP BOP message. Unlike the multicast BOP, the retransmitted
+     * one always carries the whole metadata.
+     */
+    std::vector<char> bopMsg(BOPCONST + retxMeta->metaSize);
+    const uint32_t    prodsize = htonl(retxMeta->prodLength);
+    const uint16_t    metasize = htons(retxMeta->metaSize);
+    memcpy(bopMsg.data(), &prodsize, sizeof(prodsize));
+    memcpy(bopMsg.data() + sizeof(prodsize), &metasize, sizeof(metasize));
+    memcpy(bopMsg.data() + BOPCONST, retxMeta->metadata, retxMeta->metaSize);
+
+    int retval = sendToReceiver(sock, &sendheader, bopMsg.data(),
+                                   bopMsg.size());
     if (retval < 0) {
         throw std::runtime_error(
                 "fmtpSendv3::retransBOP() TcpSend::send() error");
@@ -890,13 +2344,12 @@ void fmtpSendv3::retransBOP(
         uint32_t tmpidx = recvheader->prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" +
             std::to_string(tmpidx);
         debugmsg += ": BOP has been retransmitted";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 }
 
 
@@ -921,7 +2374,7 @@ void fmtpSendv3::retransEOP(
     /** notice the flags field should be set to RETX_EOP other than EOP */
     sendheader.flags      = htons(FMTP_RETX_EOP);
 
-    int retval = tcpsend->sendData(sock, &sendheader, NULL, 0);
+    int retval = sendToReceiver(sock, &sendheader, NULL, 0);
     if (retval < 0) {
         throw std::runtime_error(
                 "fmtpSendv3::retransEOP() TcpSend::send() error");
@@ -933,13 +2386,12 @@ void fmtpSendv3::retransEOP(
         uint32_t tmpidx = recvheader->prodindex;
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" +
             std::to_string(tmpidx);
         debugmsg += ": EOP has been retransmitted";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 }
 
 
@@ -953,21 +2405,32 @@ void fmtpSendv3::retransEOP(
  *                           data. May be 0, in which case no metadata is sent.
  * @param[in] metaSize       Size of the metadata in bytes. May be 0, in which
  *                           case no metadata is sent.
+ * @param[in] submitted      When the product was given to `sendProduct()`, in
+ *                           nanoseconds since the Unix epoch. Only sent if
+ *                           timestamps are enabled.
  * @throw std::runtime_error  if the UdpSend::SendTo() fails.
  */
 void fmtpSendv3::SendBOPMessage(uint32_t prodSize, void* metadata,
-                                 const uint16_t metaSize)
+                                 const uint16_t metaSize,
+                                 const uint64_t submitted)
 {
     FmtpHeader   header;
     BOPMsg        bopMsg;
-    struct iovec  ioVec[4];
+    struct iovec  ioVec[5];
+    const int     stampLen = timestamps ? TIMESTAMP_LEN : 0;
+    const uint64_t stamp   = htobe64(submitted);
+
+    /* only the first part of long metadata is carried by the BOP itself */
+    const uint16_t bopMetaSize = MIN(metaSize, AVAIL_BOP_LEN);
 
     /* Set the FMTP packet header. */
     header.prodindex  = htonl(prodIndex);
     header.seqnum     = 0;
-    header.payloadlen = htons(metaSize + (uint16_t)(FMTP_DATA_LEN -
-                                                    AVAIL_BOP_LEN));
-    header.flags      = htons(FMTP_BOP);
+    header.payloadlen = htons(bopMetaSize + (uint16_t)(FMTP_DATA_LEN -
+                                                       AVAIL_BOP_LEN) +
+                              stampLen);
+    header.flags      = htons(timestamps ? FMTP_BOP | FMTP_TIMESTAMPED :
+                                           FMTP_BOP);
 
     ioVec[0].iov_base = &header;
     ioVec[0].iov_len  = sizeof(FmtpHeader);
@@ -981,7 +2444,10 @@ void fmtpSendv3::SendBOPMessage(uint32_t prodSize, void* metadata,
     ioVec[2].iov_len  = sizeof(bopMsg.metasize);
 
     ioVec[3].iov_base = metadata;
-    ioVec[3].iov_len  = metaSize;
+    ioVec[3].iov_len  = bopMetaSize;
+
+    ioVec[4].iov_base = (void*)&stamp;
+    ioVec[4].iov_len  = stampLen;
 
     #ifdef MODBASE
         uint32_t tmpidx = prodIndex % MODBASE;
@@ -990,38 +2456,98 @@ void fmtpSendv3::SendBOPMessage(uint32_t prodSize, void* metadata,
     #endif
 
 #ifdef TEST_BOP
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" + std::to_string(tmpidx);
         debugmsg += ": Test BOP missing (BOP not sent)";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 #else
     #ifdef MEASURE
         std::string measuremsg = "Product #" + std::to_string(tmpidx);
         measuremsg += ": Transmission start time (BOP), Prodsize = ";
         measuremsg += std::to_string(prodSize);
         measuremsg += " bytes";
-        std::cout << measuremsg << std::endl;
         /* set txdone to false in BOPHandler */
         txdone = false;
         start_t = std::chrono::high_resolution_clock::now();
-        WriteToLog(measuremsg);
+        logger->write(LOGLVL_INFO,
+                std::to_string(start_t.time_since_epoch().count()) +
+                " since epoch, " + measuremsg);
     #endif
 
     /* Send the BOP message on multicast socket */
-    udpsend->SendTo(ioVec, 4);
+    counters.add(SEND_MCASTPKTS);
+    counters.add(SEND_MCASTBYTES, sizeof(FmtpHeader) + sizeof(bopMsg.prodsize) +
+              sizeof(bopMsg.metasize) + bopMetaSize + stampLen);
+    udpsend->SendTo(ioVec, timestamps ? 5 : 4);
+    if (trace) {
+        trace->record(TRACE_BOP_SENT, prodIndex, prodSize);
+    }
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" + std::to_string(tmpidx);
         debugmsg += ": BOP has been sent";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 #endif
 }
 
 
+/**
+ * Multicasts a BOP continuation packet, which carries part of the metadata
+ * that didn't fit into the BOP. The packet carries the offset of its part in
+ * the seqnum field. Continuation packets are rate shaped like data packets.
+ *
+ * @param[in] metadata       Application-specific metadata.
+ * @param[in] metaSize       Size of the metadata in bytes.
+ * @param[in] offset         Offset of the first byte of the packet.
+ * @return                   Number of metadata bytes multicast.
+ * @throw std::runtime_error  if UdpSend::SendData() fails.
+ */
+uint16_t fmtpSendv3::sendBOPContinuation(void* metadata,
+                                         const uint16_t metaSize,
+                                         const uint32_t offset)
+{
+    FmtpHeader header;
+    const uint16_t payloadlen = MIN(metaSize - offset, (uint32_t)FMTP_DATA_LEN);
+
+    header.prodindex  = htonl(prodIndex);
+    header.seqnum     = htonl(offset);
+    header.payloadlen = htons(payloadlen);
+    header.flags      = htons(FMTP_BOP_CONT);
+
+    #ifdef TEST_BOP_CONT_MISS
+        if (offset == AVAIL_BOP_LEN)
+        {}
+        else {
+    #endif
+
+    startPacing(sizeof(header) + payloadlen);
+    counters.add(SEND_MCASTPKTS);
+    counters.add(SEND_MCASTBYTES, sizeof(header) + payloadlen);
+    if (udpsend->SendData(&header, sizeof(header),
+                          (char*)metadata + offset, payloadlen) < 0) {
+        throw std::runtime_error(
+                "fmtpSendv3::sendBOPContinuation() SendData() error");
+    }
+    endPacing(sizeof(header) + payloadlen);
+
+    #ifdef TEST_BOP_CONT_MISS
+        }
+    #endif
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Product #" + std::to_string(prodIndex);
+        debugmsg += ": BOP continuation (Offset = ";
+        debugmsg += std::to_string(offset);
+        debugmsg += ") has been sent.";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    return payloadlen;
+}
+
+
 /**
  * Sends the EOP message to the receiver to indicate the end of a product
  * transmission.
@@ -1031,11 +2557,13 @@ void fmtpSendv3::SendBOPMessage(uint32_t prodSize, void* metadata,
 void fmtpSendv3::sendEOPMessage()
 {
     FmtpHeader header;
+    uint64_t   stamp;
 
     header.prodindex  = htonl(prodIndex);
     header.seqnum     = 0;
-    header.payloadlen = 0;
-    header.flags      = htons(FMTP_EOP);
+    header.payloadlen = htons(timestamps ? TIMESTAMP_LEN : 0);
+    header.flags      = htons(timestamps ? FMTP_EOP | FMTP_TIMESTAMPED :
+                                           FMTP_EOP);
 
     #ifdef MODBASE
         uint32_t tmpidx = prodIndex % MODBASE;
@@ -1044,110 +2572,138 @@ void fmtpSendv3::sendEOPMessage()
     #endif
 
 #ifdef TEST_EOP
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" + std::to_string(tmpidx);
         debugmsg += ": EOP missing case (EOP not sent).";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 #else
-    udpsend->SendTo(&header, sizeof(header));
+    counters.add(SEND_MCASTPKTS);
+    if (timestamps) {
+        stamp = htobe64(wallClockNs());
+        counters.add(SEND_MCASTBYTES, sizeof(header) + sizeof(stamp));
+        (void)udpsend->SendData(&header, sizeof(header), &stamp,
+                                sizeof(stamp));
+    }
+    else {
+        counters.add(SEND_MCASTBYTES, sizeof(header));
+        udpsend->SendTo(&header, sizeof(header));
+    }
+    if (trace) {
+        trace->record(TRACE_EOP_SENT, prodIndex);
+    }
 
     #ifdef MEASURE
         std::string measuremsg = "Product #" + std::to_string(tmpidx);
         measuremsg += ": Transmission end time (EOP)";
-        std::cout << measuremsg << std::endl;
         /* set txdone to true in EOPHandler */
         txdone = true;
         end_t = std::chrono::high_resolution_clock::now();
-        WriteToLog(measuremsg);
+        measuremsg += ", Elapsed time: " + std::to_string(
+                std::chrono::duration_cast<std::chrono::duration<double>>(
+                end_t - start_t).count()) + " seconds.";
+        logger->write(LOGLVL_INFO,
+                std::to_string(end_t.time_since_epoch().count()) +
+                " since epoch, " + measuremsg);
     #endif
 
-    #ifdef DEBUG2
+    if (logger->enabled(LOGLVL_DEBUG)) {
         std::string debugmsg = "Product #" + std::to_string(tmpidx);
         debugmsg += ": EOP has been sent.";
-        std::cout << debugmsg << std::endl;
-        WriteToLog(debugmsg);
-    #endif
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 #endif
 }
 
 
 /**
- * Multicasts the data blocks of a data-product. A legal boundary check is
- * performed to make sure all the data blocks going out are multiples of
- * FMTP_DATA_LEN except the last block.
+ * Multicasts a data block of a data-product. All the blocks are FMTP_DATA_LEN
+ * bytes long except the last one.
  *
  * @param[in] data      The data-product.
  * @param[in] dataSize  The size of the data-product in bytes.
+ * @param[in] seqNum    Offset of the block in the data-product.
+ * @param[in] digest    Digest of the product's metadata, carried by
+ *                      self-describing data packets.
+ * @return              Number of data bytes multicast.
  * @throw std::runtime_error  if an I/O error occurs.
  */
-void fmtpSendv3::sendData(void* data, uint32_t dataSize)
+uint16_t fmtpSendv3::sendData(void* data, const uint32_t dataSize,
+                              const uint32_t seqNum, const uint32_t digest)
 {
     FmtpHeader header;
-    uint32_t datasize = dataSize;
-    uint32_t seqNum = 0;
+    const uint16_t type = selfDescribing ? FMTP_MEM_DATA_EXT : FMTP_MEM_DATA;
+    const uint16_t payloadlen = MIN(dataSize - seqNum, (uint32_t)FMTP_DATA_LEN);
     header.prodindex = htonl(prodIndex);
-    header.flags     = htons(FMTP_MEM_DATA);
+    data = (char*)data + seqNum;
+
+    /* header and extension of a self-describing data packet */
+    char     headBuf[FMTP_HEADER_LEN + DATA_EXT_LEN];
+    DataExt  ext;
+    ext.prodsize   = htonl(dataSize);
+    ext.metadigest = htonl(digest);
+    (void)memcpy(headBuf + FMTP_HEADER_LEN, &ext, DATA_EXT_LEN);
+    const size_t headLen = selfDescribing ? sizeof(headBuf) : sizeof(header);
+
+    /* a timestamp mustn't make the datagram exceed the largest one */
+    const bool stamped = tsSampling && ++tsDataCount % tsSampling == 0 &&
+            headLen + payloadlen + TIMESTAMP_LEN <=
+            FMTP_HEADER_LEN + DATA_EXT_LEN + FMTP_DATA_LEN;
+    const int  stampLen = stamped ? TIMESTAMP_LEN : 0;
+
+    header.seqnum     = htonl(seqNum);
+    header.payloadlen = htons(headLen - FMTP_HEADER_LEN + payloadlen +
+                              stampLen);
+    header.flags      = htons(stamped ? type | FMTP_TIMESTAMPED : type);
+    (void)memcpy(headBuf, &header, sizeof(header));
+
+    #ifdef TEST_DATA_MISS
+        if (seqNum == DROPSEQ)
+        {}
+        else {
+    #endif
 
-    /* check if there is more data to send */
-    while (datasize > 0) {
-        uint16_t payloadlen = datasize < FMTP_DATA_LEN ?
-                              datasize : FMTP_DATA_LEN;
+    //TODO: use Rateshaper to replace tc?
+    startPacing(headLen + payloadlen + stampLen);
+    counters.add(SEND_MCASTPKTS);
+    counters.add(SEND_MCASTBYTES, headLen + payloadlen + stampLen);
+    if (stamped) {
+        const uint64_t stamp = htobe64(wallClockNs());
+        struct iovec   ioVec[3];
+        ioVec[0].iov_base = headBuf;
+        ioVec[0].iov_len  = headLen;
+        ioVec[1].iov_base = data;
+        ioVec[1].iov_len  = payloadlen;
+        ioVec[2].iov_base = (void*)&stamp;
+        ioVec[2].iov_len  = sizeof(stamp);
+        (void)udpsend->SendTo(ioVec, 3);
+    }
+    else if(udpsend->SendData(headBuf, headLen, data,
+                              (size_t)payloadlen) < 0) {
+        throw std::runtime_error(
+                "fmtpSendv3::sendProduct::SendData() error");
+    }
+    endPacing(headLen + payloadlen + stampLen);
 
-        header.seqnum     = htonl(seqNum);
-        header.payloadlen = htons(payloadlen);
+    #ifdef MODBASE
+        uint32_t tmpidx = prodIndex % MODBASE;
+    #else
+        uint32_t tmpidx = prodIndex;
+    #endif
 
-        #ifdef TEST_DATA_MISS
-            if (seqNum == DROPSEQ)
-            {}
-            else {
-        #endif
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Product #" + std::to_string(tmpidx);
+        debugmsg += ": Data block (SeqNum = ";
+        debugmsg += std::to_string(seqNum);
+        debugmsg += ") has been sent.";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
 
-        /**
-         * linkspeed is initialized to 0. If SetSendRate() is never called,
-         * linkspeed will remain 0, which implies application itself doesn't
-         * need to take care of rate shaping. On the other hand, if app
-         * should shape its rate, SetSendRate() must be called first. Thus,
-         * linkspeed will be a non-zero value. By checking linkspeed, app
-         * can decide whether to do rate shaping.
-         */
-        //TODO: use Rateshaper to replace tc?
-        if (linkspeed) {
-            rateshaper.CalcPeriod(sizeof(header) + payloadlen);
+    #ifdef TEST_DATA_MISS
         }
-        if(udpsend->SendData(&header, sizeof(header), data,
-                             (size_t)payloadlen) < 0) {
-            throw std::runtime_error(
-                    "fmtpSendv3::sendProduct::SendData() error");
-        }
-        if (linkspeed) {
-            rateshaper.Sleep();
-        }
-
-        #ifdef MODBASE
-            uint32_t tmpidx = prodIndex % MODBASE;
-        #else
-            uint32_t tmpidx = prodIndex;
-        #endif
-
-        #ifdef DEBUG2
-            std::string debugmsg = "Product #" + std::to_string(tmpidx);
-            debugmsg += ": Data block (SeqNum = ";
-            debugmsg += std::to_string(seqNum);
-            debugmsg += ") has been sent.";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
-
-        #ifdef TEST_DATA_MISS
-            }
-        #endif
+    #endif
 
-        datasize -= payloadlen;
-        data      = (char*)data + payloadlen;
-        seqNum   += payloadlen;
-    }
+    return payloadlen;
 }
 
 
@@ -1193,15 +2749,10 @@ void fmtpSendv3::StartNewRetxThread(int newtcpsockfd)
          * If a new thread can't be created, the newly created socket needs to
          * be closed and removed from the TcpSend::connSockList.
          */
-        tcpsend->rmSockInList(newtcpsockfd);
-        close(newtcpsockfd);
+        removeReceiver(newtcpsockfd);
 
-        #ifdef DEBUG2
-            std::string debugmsg = "Error: fmtpSendv3::StartNewRetxThread() \
-                                    creating new thread failed";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
+        logger->write(LOGLVL_ERROR, "fmtpSendv3::StartNewRetxThread() "
+                "creating new thread failed");
     }
     else {
         /** track all the newly created retx threads for later termination */
@@ -1230,8 +2781,7 @@ void* fmtpSendv3::StartRetxThread(void* ptr)
         int exitStatus;
         pthread_t t = pthread_self();
 
-        newptr->retxmitterptr->tcpsend->rmSockInList(newptr->retxsockfd);
-        close(newptr->retxsockfd);
+        newptr->retxmitterptr->removeReceiver(newptr->retxsockfd);
         newptr->retxmitterptr->retxThreadList.remove(t);
         pthread_exit(&exitStatus);
     }
@@ -1274,6 +2824,7 @@ void fmtpSendv3::taskExit(const std::runtime_error& e)
  */
 void fmtpSendv3::timerThread()
 {
+    placement.apply(ROLE_TIMER);
     while (1) {
         uint32_t prodindex;
         try {
@@ -1284,51 +2835,69 @@ void fmtpSendv3::timerThread()
             return;
         }
 
-        #ifdef MODBASE
-            uint32_t tmpidx = prodindex % MODBASE;
-        #else
-            uint32_t tmpidx = prodindex;
-        #endif
-
-        #ifdef DEBUG2
-            std::string debugmsg = "Timer: Product #" +
-                std::to_string(tmpidx);
-            debugmsg += " has waken up";
-            std::cout << debugmsg << std::endl;
-            WriteToLog(debugmsg);
-        #endif
-
-        /* Set the FMTP packet header (EOP message). */
-        FmtpHeader          EOPmsg;
-        EOPmsg.prodindex  = htonl(prodindex);
-        EOPmsg.seqnum     = 0;
-        EOPmsg.payloadlen = 0;
-        EOPmsg.flags      = htons(FMTP_RETX_EOP);
-        /* notify all unACKed receivers with an EOP. */
-        sendMeta->notifyUnACKedRcvrs(prodindex, &EOPmsg, tcpsend);
-
-        const bool isRemoved = sendMeta->rmRetxMetadata(prodindex);
+        timeoutProduct(prodindex);
+    }
+}
+
+
+/**
+ * Handles the timeout of a product: notifies the receivers that haven't
+ * acknowledged it with an EOP, removes its retransmission entry and notifies
+ * the sending application.
+ *
+ * @param[in] prodindex  Index of the product.
+ */
+void fmtpSendv3::timeoutProduct(const uint32_t prodindex)
+{
+    #ifdef MODBASE
+        uint32_t tmpidx = prodindex % MODBASE;
+    #else
+        uint32_t tmpidx = prodindex;
+    #endif
+
+    if (logger->enabled(LOGLVL_DEBUG)) {
+        std::string debugmsg = "Timer: Product #" +
+            std::to_string(tmpidx);
+        debugmsg += " has waken up";
+        logger->write(LOGLVL_DEBUG, debugmsg);
+    }
+
+    /* Set the FMTP packet header (EOP message). */
+    FmtpHeader          EOPmsg;
+    EOPmsg.prodindex  = htonl(prodindex);
+    EOPmsg.seqnum     = 0;
+    EOPmsg.payloadlen = 0;
+    EOPmsg.flags      = htons(FMTP_RETX_EOP);
+    /* notify all unACKed receivers with an EOP. */
+    sendMeta->notifyUnACKedRcvrs(prodindex, &EOPmsg, tcpsend);
+
+    const bool isRemoved = sendMeta->rmRetxMetadata(prodindex);
+    /**
+     * Only if the product is removed by this remove call, notify the
+     * sending application. Since timer and retx thread access the
+     * RetxMetadata exclusively, notify_of_eop() will be called only once.
+     */
+    if (isRemoved) {
+        counters.add(SEND_TIMEDOUT);
+        if (trace) {
+            trace->record(TRACE_TIMEOUT, prodindex);
+        }
+    }
+    if (notifier && isRemoved) {
+        notifier->notify_of_eop(prodindex);
+    }
+    else if (isRemoved) {
+        suppressor->remove(prodindex);
         /**
-         * Only if the product is removed by this remove call, notify the
-         * sending application. Since timer and retx thread access the
-         * RetxMetadata exclusively, notify_of_eop() will be called only once.
+         * Updates the most recently acknowledged product and notifies
+         * a dummy notification handler (getNotify()).
          */
-        if (notifier && isRemoved) {
-            notifier->notify_of_eop(prodindex);
-        }
-        else if (isRemoved) {
-            suppressor->remove(prodindex);
-            /**
-             * Updates the most recently acknowledged product and notifies
-             * a dummy notification handler (getNotify()).
-             */
-            {
-                std::unique_lock<std::mutex> lock(notifyprodmtx);
-                notifyprodidx = prodindex;
-            }
-            notify_cv.notify_one();
-            memrelease_cv.notify_one();
+        {
+            std::unique_lock<std::mutex> lock(notifyprodmtx);
+            notifyprodidx = prodindex;
         }
+        notify_cv.notify_one();
+        memrelease_cv.notify_one();
     }
 }
 
@@ -1352,58 +2921,3 @@ void* fmtpSendv3::timerWrapper(void* ptr)
     }
     return NULL;
 }
-
-
-/**
- * Write a line of log record into the log file. If the log file doesn't exist,
- * create a new one and then append to it.
- *
- * @param[in] content       The content of the log record to be written.
- */
-void fmtpSendv3::WriteToLog(const std::string& content)
-{
-    time_t rawtime;
-    struct tm *timeinfo;
-    char buf[30];
-
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(buf, 30, "%Y-%m-%d %I:%M:%S  ", timeinfo);
-    std::string time(buf);
-
-    /* code block only effective for measurement code */
-    #ifdef MEASURE
-    std::string hrclk;
-    std::string nanosec;
-    if (txdone) {
-        hrclk = std::to_string(end_t.time_since_epoch().count())
-            + " since epoch, ";
-    }
-    else {
-        hrclk = std::to_string(start_t.time_since_epoch().count())
-            + " since epoch, ";
-    }
-
-    if (txdone) {
-        std::chrono::duration<double> timespan =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end_t - start_t);
-        nanosec = ", Elapsed time: " + std::to_string(timespan.count());
-        nanosec += " seconds.";
-    }
-    #endif
-    /* code block ends */
-
-    std::ofstream logfile("FMTPv3_SENDER.log",
-            std::ofstream::out | std::ofstream::app);
-    #ifdef MEASURE
-        if (txdone) {
-            logfile << time << hrclk << content << nanosec << std::endl;
-        }
-        else {
-            logfile << time << hrclk << content << std::endl;
-        }
-    #else
-        logfile << time << content << std::endl;
-    #endif
-    logfile.close();
-}
@@ -35,23 +35,37 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <atomic>
+#include <condition_variable>
 #include <exception>
 #include <list>
 #include <map>
 #include <set>
+#include <vector>
 
+#include "LatencyHistogram.h"
+#include "LossMap.h"
+#include "MetricsExporter.h"
+#include "PerThreadCounters.h"
 #include "ProdIndexDelayQueue.h"
+#include "ProductTrace.h"
+#include "AsyncLog.h"
 #include "../RateShaper/RateShaper.h"
+#include "../RateShaper/TokenBucket.h"
+#include "RateController.h"
 #include "RetxThreads.h"
 #include "SendProxy.h"
 #include "senderMetadata.h"
 #include "../SilenceSuppressor/SilenceSuppressor.h"
+#include "FaultInjector.h"
 #include "TcpSend.h"
+#include "ThreadPlacement.h"
+#include "Transport.h"
 #include "UdpSend.h"
 #include "fmtpBase.h"
 
 
 class fmtpSendv3;
+class fmtpSendEngine;
 
 /**
  * To contain multiple types of necessary information and transfer to the
@@ -80,12 +94,69 @@ struct StartTimerThreadInfo
 };
 
 
+/**
+ * What the slow-receiver monitor remembers about a receiver from one
+ * evaluation to the next.
+ */
+struct SlowRecvWindow
+{
+    uint64_t        retxbytes;   /*!< retransmitted bytes at the last check */
+    uint64_t        completions; /*!< completed products at the last check */
+    double          latencysum;  /*!< total completion latency at the last check */
+    unsigned        strikes;     /*!< consecutive intervals over a threshold */
+};
+
+
+/**
+ * A product being multicast one packet at a time, see
+ * fmtpSendv3::sendNextPacket().
+ */
+struct ProdCursor
+{
+    RetxMetadata*   meta;      /*!< retransmission entry of the product */
+    uint64_t        submitted; /*!< when the product was submitted */
+    uint32_t        digest;    /*!< metadata digest of the data packets */
+    int             stage;     /*!< next kind of packet, a CURSOR_* value */
+    uint32_t        offset;    /*!< offset of the next metadata or data byte */
+};
+
+
+/**
+ * A snapshot of the sender's statistics, see fmtpSendv3::getStats(). The
+ * counters are cumulative since the sender was constructed.
+ */
+struct SendStats
+{
+    uint64_t        prods;       /*!< products sent */
+    uint64_t        prodbytes;   /*!< bytes of data of the products sent */
+    uint64_t        mcastpkts;   /*!< packets multicast */
+    uint64_t        mcastbytes;  /*!< bytes multicast, FMTP headers included */
+    uint64_t        retxreqs;    /*!< RETX_REQs received */
+    uint64_t        bopreqs;     /*!< BOP_REQs received */
+    uint64_t        eopreqs;     /*!< EOP_REQs received */
+    uint64_t        retxpkts;    /*!< data blocks retransmitted */
+    uint64_t        retxbytes;   /*!< bytes of data retransmitted */
+    uint64_t        retxrejs;    /*!< RETX_REJs sent */
+    uint64_t        retxends;    /*!< RETX_ENDs received */
+    uint64_t        acked;       /*!< products acknowledged by every receiver */
+    uint64_t        timedout;    /*!< products released by their timeout */
+    /* gauges, current at the time of the snapshot */
+    uint32_t        inflight;    /*!< products awaiting acknowledgement */
+    uint32_t        receivers;   /*!< connected receivers */
+    uint32_t        timers;      /*!< pending product timeouts */
+};
+
+
 /**
  * sender side class handling the multicasting, restransmission and timeout.
  */
 class fmtpSendv3
 {
 public:
+    /** congestion signals that drive the rate controller */
+    static const int RATECTRL_RETX  = 0x1; /*!< retx requests received */
+    static const int RATECTRL_DROPS = 0x2; /*!< loss reported by receivers */
+
     explicit fmtpSendv3(
                  const char*           tcpAddr,
                  const unsigned short  tcpPort,
@@ -113,18 +184,347 @@ public:
     uint32_t       releaseMem();
     /* ----------- testapp-specific APIs end ----------- */
 
+    /**
+     * Multicasts any small products waiting in a partially filled aggregate
+     * envelope. Returns immediately if there are none.
+     *
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    void           flushAggregate();
+    /**
+     * Returns what is known about every connected receiver.
+     *
+     * @return  A snapshot of the per-receiver loss map.
+     */
+    std::vector<ReceiverStats> getLossMap();
+    /**
+     * Returns the number of receivers each slow-receiver action was taken on.
+     *
+     * @return  The counts.
+     */
+    SlowRecvStats  getSlowRecvStats() {return lossmap.getSlowStats();}
+    /**
+     * Returns the sender's statistics. May be called by any thread at any
+     * time; the threads that send and retransmit aren't slowed down by it.
+     *
+     * @return  A snapshot of the statistics.
+     */
+    SendStats      getStats();
+    /**
+     * Returns a histogram of the times from the submission of products to
+     * their acknowledgement by every receiver. May be called by any thread at
+     * any time.
+     *
+     * @param[in] sizeclass  Size of the products.
+     * @return               A snapshot of the histogram in nanoseconds.
+     */
+    HistogramSnapshot getAckLatency(const SizeClass sizeclass)
+        {return ackLatency[sizeclass].snapshot();}
+    /**
+     * Returns a histogram of the times from the submission of products of all
+     * sizes to their acknowledgement by every receiver.
+     *
+     * @return  A snapshot of the histogram in nanoseconds.
+     */
+    HistogramSnapshot getAckLatency();
     unsigned short getTcpPortNum();
+    /** returns the current multicast sending rate in bits per second */
+    uint64_t       getSendRate() const {return rateshaper.GetRate();}
     uint32_t       getNextProdIndex() const {return prodIndex;}
     uint32_t       sendProduct(void* data, uint32_t dataSize);
     uint32_t       sendProduct(void* data, uint32_t dataSize, void* metadata,
                                uint16_t metaSize);
+    /**
+     * Enables the aggregation of small products. Must be called before
+     * `Start()`.
+     *
+     * @param[in] maxProdSize  Largest product, in bytes, to be packed into a
+     *                         shared datagram. 0 disables aggregation.
+     * @param[in] maxDelay     Longest time, in seconds, a product may wait in
+     *                         a partially filled envelope.
+     * @throw std::runtime_error  if `maxProdSize` can't fit into a datagram.
+     */
+    void           SetAggregation(uint32_t maxProdSize, double maxDelay);
+    /**
+     * Enables the adjustment of the sending rate to the loss experienced by
+     * the receivers (additive increase, multiplicative decrease). Must be
+     * called before `Start()`. The rate starts at the one given to
+     * `SetSendRate()`, if any, clamped to the range.
+     *
+     * @param[in] floor     Lowest rate in bits per second.
+     * @param[in] ceiling   Highest rate in bits per second.
+     * @param[in] interval  Control interval in seconds.
+     * @param[in] signals   Congestion signals to use: RATECTRL_RETX,
+     *                      RATECTRL_DROPS or both.
+     * @throw std::runtime_error  if an argument is invalid.
+     */
+    void           SetRateControl(uint64_t floor, uint64_t ceiling,
+                                  double interval = 0.1,
+                                  int signals = RATECTRL_RETX | RATECTRL_DROPS);
+    /**
+     * Sets the parameters of the rate controller's control law. Must be called
+     * after `SetRateControl()` and before `Start()`.
+     *
+     * @param[in] increase   Rate increase in bits per second after an interval
+     *                       without congestion.
+     * @param[in] decrease   Factor the rate is multiplied by after an interval
+     *                       with congestion.
+     * @param[in] threshold  Loss fraction above which an interval counts as
+     *                       congested.
+     * @throw std::runtime_error  if rate control isn't enabled or an argument
+     *                            is invalid.
+     */
+    void           SetRateControlLaw(uint64_t increase, double decrease,
+                                     double threshold);
     void           SetSendRate(uint64_t speed);
+    /**
+     * Enables the detection of slow receivers. Must be called before
+     * `Start()`.
+     *
+     * @param[in] maxRetxBytes  Most bytes a receiver may have retransmitted
+     *                          per interval. 0 means no limit.
+     * @param[in] maxLatency    Longest mean time in seconds a receiver may take
+     *                          to complete a product. 0 means no limit.
+     * @param[in] action        Action taken on a slow receiver: SLOWRECV_FLAG,
+     *                          SLOWRECV_THROTTLE, SLOWRECV_RELEGATE or
+     *                          SLOWRECV_DISCONNECT.
+     * @param[in] throttleRate  Retransmission rate in bits per second of a
+     *                          throttled receiver.
+     * @param[in] interval      Evaluation interval in seconds.
+     * @param[in] strikes       Number of consecutive intervals a receiver must
+     *                          exceed a limit in to be considered slow.
+     * @throw std::runtime_error  if an argument is invalid.
+     */
+    /**
+     * Sets where and how the sender's threads run. Must be called before
+     * `Start()`.
+     *
+     * @param[in] placement  The thread placement.
+     */
+    void           SetThreadPlacement(const ThreadPlacement& placement);
+    void           SetSlowRecvPolicy(uint64_t maxRetxBytes, double maxLatency,
+                                     int action,
+                                     uint64_t throttleRate = 1000000,
+                                     double interval = 1.0,
+                                     unsigned strikes = 3);
+    /**
+     * Makes every data packet carry the product size, and optionally a digest
+     * of the metadata, so receivers that missed the BOP can store the data
+     * right away. Must be called before `Start()`.
+     *
+     * @param[in] enable      Whether to send self-describing data packets.
+     * @param[in] withDigest  Whether the packets carry a metadata digest.
+     */
+    void           SetSelfDescribingData(bool enable, bool withDigest = true);
+    /**
+     * Makes BOPs and EOPs, and optionally sampled data packets, carry the
+     * time they were sent so receivers can measure one-way latencies. Must be
+     * called before `Start()`.
+     *
+     * @param[in] enable    Whether to send timestamps.
+     * @param[in] sampling  Every how many data packets one is stamped, 0 for
+     *                      none.
+     */
+    void           SetTimestamps(bool enable, uint32_t sampling = 0);
+    /**
+     * Has a fault injector drop, duplicate or reorder the multicast packets
+     * before they are sent. Retransmissions aren't affected. Must be called
+     * before `Start()`.
+     *
+     * @param[in] injector  The fault injector or NULL for none. It must
+     *                      outlive the sender.
+     */
+    void           SetFaultInjector(FaultInjector* injector);
+    /**
+     * Records the lifecycle events of products into a trace. Must be called
+     * before `Start()`.
+     *
+     * @param[in] trace  The trace or NULL for none. It must outlive the
+     *                   sender.
+     */
+    void           SetTrace(ProductTrace* trace);
+    /**
+     * Sets the transport that opens the multicast socket and the socket
+     * receivers connect to. Must be called before `Start()`.
+     *
+     * @param[in] transport  The transport. It must outlive the sender.
+     */
+    void           SetTransport(Transport& transport);
+    /**
+     * Has an exporter serve the sender's statistics, see `getStats()`. May be
+     * called at any time, once.
+     *
+     * @param[in] exporter  The exporter. It must outlive the sender.
+     * @param[in] feed      Value of the "feed" label of the sender's metrics
+     *                      or empty for no label.
+     */
+    void           SetMetricsExporter(MetricsExporter& exporter,
+                                      const std::string& feed = "");
+    /**
+     * Sets the level of the records written to the sender's log,
+     * "FMTPv3_SENDER.log" in the working directory. Debug records trace every
+     * product and retransmission. May be called at any time. The log is
+     * shared by the senders of the process.
+     *
+     * @param[in] level  The level.
+     */
+    void           SetLogLevel(const LogLevel level);
     /** Sender side start point, the first function to be called */
     void           Start();
     /** Sender side stop point */
     void           Stop();
 
 private:
+    /* indexes of `counters` */
+    enum {
+        SEND_PRODS,
+        SEND_PRODBYTES,
+        SEND_MCASTPKTS,
+        SEND_MCASTBYTES,
+        SEND_RETXREQS,
+        SEND_BOPREQS,
+        SEND_EOPREQS,
+        SEND_RETXPKTS,
+        SEND_RETXBYTES,
+        SEND_RETXREJS,
+        SEND_RETXENDS,
+        SEND_ACKED,
+        SEND_TIMEDOUT,
+        SEND_NCOUNTERS
+    };
+
+    /* the next kind of packet of a product being multicast */
+    enum {
+        CURSOR_BOP,
+        CURSOR_BOP_CONT,
+        CURSOR_DATA,
+        CURSOR_EOP
+    };
+
+    /* a multi-feed engine runs the timer and retransmission work of its feeds */
+    friend class fmtpSendEngine;
+
+    /**
+     * Begins sending a product. A product that is aggregated is done, the
+     * packets of any other one are multicast by `sendNextPacket()`.
+     *
+     * @param[in] data      The data-product.
+     * @param[in] dataSize  The size of the data-product in bytes.
+     * @param[in] metadata  Application-specific metadata or 0.
+     * @param[in] metaSize  Size of the metadata in bytes.
+     * @return              Whether the product has packets to multicast.
+     * @throw std::runtime_error  if the product is invalid or an I/O error
+     *                            occurs.
+     */
+    bool beginProduct(void* data, uint32_t dataSize, void* metadata,
+                      uint16_t metaSize);
+    /**
+     * Multicasts the next packet of the product begun by `beginProduct()`.
+     *
+     * @return  Whether the product has more packets to multicast.
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    bool sendNextPacket();
+    /**
+     * Counts a product that was sent and moves on to the next index.
+     *
+     * @param[in] dataSize  The size of the data-product in bytes.
+     */
+    void endProduct(const uint32_t dataSize);
+    /**
+     * Starts pacing a multicast packet, see `endPacing()`.
+     *
+     * @param[in] size  Size of the packet in bytes.
+     */
+    void startPacing(const uint64_t size);
+    /**
+     * Paces a multicast packet that was just sent.
+     *
+     * @param[in] size  Size of the packet in bytes.
+     */
+    void endPacing(const uint64_t size);
+
+    /**
+     * Accepts a connection from a receiver and has the application verify it.
+     *
+     * @return  The receiver's socket or -1 if the receiver was rejected.
+     * @throw std::runtime_error  if the connection can't be accepted.
+     */
+    int acceptReceiver();
+    /**
+     * Forgets a receiver and closes its connection.
+     *
+     * @param[in] sock  The receiver's socket.
+     */
+    void removeReceiver(const int sock);
+    /**
+     * Removes a receiver whose connection broke.
+     *
+     * @param[in] sock  The receiver's socket.
+     * @param[in] e     The error.
+     * @throw std::runtime_error  if it was the last receiver.
+     */
+    void dropReceiver(const int sock, const std::runtime_error& e);
+    /**
+     * Schedules the timeout of a product.
+     *
+     * @param[in] prodindex  Index of the product.
+     * @param[in] seconds    Time until the timeout in seconds.
+     */
+    void scheduleTimeout(const uint32_t prodindex, const double seconds);
+    /**
+     * Handles the timeout of a product.
+     *
+     * @param[in] prodindex  Index of the product.
+     */
+    void timeoutProduct(const uint32_t prodindex);
+    /**
+     * Reads one message from a receiver and handles it.
+     *
+     * @param[in] retxsockfd  The receiver's socket.
+     * @param[in] retxshaper  Paces the retransmissions to a throttled slow
+     *                        receiver.
+     * @return                False if the connection was closed.
+     * @throw std::runtime_error  if the connection is broken.
+     */
+    bool serveRetxMessage(const int retxsockfd, RateShaper* const retxshaper);
+    /**
+     * Handles the complete messages read by an engine from a receiver.
+     *
+     * @param[in] sock  The receiver's socket.
+     * @param[in] buf   Bytes read, starting with a message.
+     * @param[in] len   Number of bytes.
+     * @return          Number of bytes handled.
+     * @throw std::runtime_error  if a message is invalid.
+     */
+    size_t serveRetxBuffer(const int sock, const char* const buf,
+                           const size_t len);
+    /**
+     * Returns the rate that retransmissions to a receiver are throttled to.
+     *
+     * @param[in] sock  The receiver's socket.
+     * @return          Rate in bits/sec or 0 if not throttled.
+     */
+    uint64_t retxRate(const int sock);
+    /**
+     * Starts this instance as a feed of a multi-feed engine.
+     *
+     * @param[in] host  The engine.
+     * @throw std::runtime_error  if the instance can't be started.
+     */
+    void startHosted(fmtpSendEngine* const host);
+    /**
+     * Initializes the sockets and the silence suppressor.
+     *
+     * @throw std::runtime_error  if a socket can't be initialized.
+     */
+    void startResources();
+    /**
+     * Starts the threads of the enabled optional features.
+     *
+     * @throw std::runtime_error  if a thread can't be created.
+     */
+    void startOptionalThreads();
     /**
      * Adds and entry for a data-product to the retransmission set.
      *
@@ -135,9 +535,48 @@ private:
      */
     RetxMetadata* addRetxMetadata(void* const data, const uint32_t dataSize,
                                   void* const metadata, const uint16_t metaSize);
+    /**
+     * Appends a small product to the current aggregate envelope, multicasting
+     * the envelope first if the product doesn't fit into it.
+     *
+     * @pre                 `aggrmtx` is locked.
+     * @param[in] data      The data-product.
+     * @param[in] dataSize  The size of the data-product in bytes.
+     * @param[in] metadata  Application-specific metadata.
+     * @param[in] metaSize  Size of the metadata in bytes.
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    void aggregateProduct(void* data, uint32_t dataSize, void* metadata,
+                          uint16_t metaSize);
+    /** aggregate flusher thread */
+    void aggrFlusher();
+    /** a wrapper to call the actual fmtpSendv3::aggrFlusher() */
+    static void* aggrFlusherWrapper(void* ptr);
+    /**
+     * Takes the configured action on a slow receiver.
+     *
+     * @param[in] sock  The receiver's socket.
+     */
+    void isolateSlowRecv(const int sock);
+    /** slow-receiver monitor thread */
+    void slowRecvMonitor();
+    /** a wrapper to call the actual fmtpSendv3::slowRecvMonitor() */
+    static void* slowRecvMonitorWrapper(void* ptr);
+    /** rate control thread */
+    void rateCtrl();
+    /** a wrapper to call the actual fmtpSendv3::rateCtrl() */
+    static void* rateCtrlWrapper(void* ptr);
     static uint32_t blockIndex(uint32_t start) {return start/FMTP_DATA_LEN;}
     /** new coordinator thread */
     static void* coordinator(void* ptr);
+    /**
+     * Returns the fraction of multicast packets lost by the worst receiver
+     * since the previous call, according to the enabled congestion signals.
+     *
+     * @return  The loss fraction or a negative value if nothing was multicast
+     *          and no receiver reported since the previous call.
+     */
+    double congestionSignal();
     /**
      * Handles a retransmission request.
      *
@@ -148,7 +587,8 @@ private:
                        RetxMetadata* const retxMeta, const int sock);
     /**
      * Handles a notice from a receiver that a data-product has been completely
-     * received.
+     * received. A notice for the product that is still being multicast is
+     * handled once its EOP has been sent.
      *
      * @param[in] recvheader  The FMTP header of the notice.
      * @param[in] retxMeta    The associated retransmission entry.
@@ -156,6 +596,57 @@ private:
      */
     void handleRetxEnd(FmtpHeader* const  recvheader,
                        RetxMetadata* const retxMeta, const int sock);
+    /**
+     * Handles the products beyond the first one acknowledged by a RETX_END
+     * that covers a run of aggregated products.
+     *
+     * @param[in] recvheader  The FMTP header of the notice.
+     * @param[in] sock        The receiver's socket.
+     */
+    void handleAggrRetxEnd(const FmtpHeader* const recvheader, const int sock);
+    /**
+     * Handles the RETX_ENDs that arrived while the product just sent was
+     * still being multicast.
+     */
+    void handleEarlyRetxEnds();
+    /**
+     * Handles a statistics report from a receiver.
+     *
+     * @param[in] recvheader  The FMTP header of the report.
+     * @param[in] payload     The report.
+     * @param[in] sock        The receiver's socket.
+     */
+    void handleRecvStats(const FmtpHeader* const recvheader,
+                         const char* const payload, const int sock);
+    /**
+     * Handles one message from a receiver.
+     *
+     * @param[in] recvheader  The FMTP header of the message.
+     * @param[in] payload     The payload of the message.
+     * @param[in] sock        The receiver's socket.
+     * @throw std::runtime_error  if the message can't be answered.
+     */
+    void handleRetxMessage(FmtpHeader* const recvheader,
+                           const char* const payload, const int sock);
+    /**
+     * Returns the length of a message from a receiver, header included.
+     *
+     * @param[in] recvheader  The FMTP header of the message.
+     */
+    static size_t retxMessageLen(const FmtpHeader& recvheader);
+    /**
+     * Sends a message to a receiver or queues it on the receiver's
+     * connection if the feed is served by an engine.
+     *
+     * @param[in] sock        The receiver's socket.
+     * @param[in] sendheader  Header in network byte order.
+     * @param[in] payload     Payload.
+     * @param[in] paylen      Length of the payload.
+     * @return                Number of bytes sent or queued.
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    int sendToReceiver(const int sock, FmtpHeader* const sendheader,
+                       char* const payload, const size_t paylen);
     /**
      * Handles a notice from a receiver that BOP for a product is missing.
      *
@@ -176,6 +667,13 @@ private:
                       RetxMetadata* const retxMeta, const int sock);
     /** new timer thread */
     void RunRetxThread(int retxsockfd);
+    /**
+     * Adds the sender's statistics to a scrape of the metrics exporter.
+     *
+     * @param[in] writer  The scrape.
+     * @param[in] labels  Labels of the sender's samples.
+     */
+    void writeMetrics(MetricsWriter& writer, const std::string& labels);
     /**
      * Rejects a retransmission request from a receiver.
      *
@@ -208,17 +706,41 @@ private:
      * @param[in] sock        The receiver's socket.
      */
     void retransEOP(const FmtpHeader* const  recvheader, const int sock);
+    /**
+     * Multicasts the current aggregate envelope and empties it.
+     *
+     * @pre                       `aggrmtx` is locked.
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    void sendAggregate();
     void SendBOPMessage(uint32_t prodSize, void* metadata,
-                        const uint16_t metaSize);
+                        const uint16_t metaSize, const uint64_t submitted);
     /**
-     * Multicasts the data of a data-product.
+     * Multicasts a BOP continuation packet, which carries part of the
+     * metadata that didn't fit into the BOP.
+     *
+     * @param[in] metadata  Application-specific metadata.
+     * @param[in] metaSize  Size of the metadata in bytes.
+     * @param[in] offset    Offset of the first byte of the packet.
+     * @return              Number of metadata bytes multicast.
+     * @throw std::runtime_error  if an I/O error occurs.
+     */
+    uint16_t sendBOPContinuation(void* metadata, const uint16_t metaSize,
+                                 const uint32_t offset);
+    void sendEOPMessage();
+    /**
+     * Multicasts a data block of a data-product.
      *
      * @param[in] data      The data-product.
      * @param[in] dataSize  The size of the data-product in bytes.
+     * @param[in] seqNum    Offset of the block in the data-product.
+     * @param[in] digest    Digest of the product's metadata, carried by
+     *                      self-describing data packets.
+     * @return              Number of data bytes multicast.
      * @throw std::runtime_error  if an I/O error occurs.
      */
-    void sendEOPMessage();
-    void sendData(void* data, uint32_t dataSize);
+    uint16_t sendData(void* data, const uint32_t dataSize,
+                      const uint32_t seqNum, const uint32_t digest);
     /**
      * Sets the retransmission timeout parameters in a retransmission entry.
      *
@@ -235,7 +757,6 @@ private:
     /* Prevent copying because it's meaningless */
     fmtpSendv3(fmtpSendv3&);
     fmtpSendv3& operator=(const fmtpSendv3&);
-    void WriteToLog(const std::string& content);
 
 
     uint32_t            prodIndex;
@@ -252,12 +773,16 @@ private:
     pthread_t           timer_t;
     /** tracks all the dynamically created retx threads */
     RetxThreads         retxThreadList;
+    /* per-receiver statistics and loss rates, see getLossMap() */
+    LossMap             lossmap;
     std::mutex          linkmtx;
     uint64_t            linkspeed;
     std::mutex          exitMutex;
     std::exception_ptr  except;
     bool                exceptIsSet;
     RateShaper          rateshaper;
+    /* paces the packets instead of `rateshaper` when served by an engine */
+    TokenBucket         bucket;
     std::mutex          notifyprodmtx;
     std::mutex          notifycvmtx;
     uint32_t            notifyprodidx;
@@ -267,6 +792,79 @@ private:
     SilenceSuppressor*  suppressor;
     /* sender maximum retransmission timeout */
     double              tsnd;
+    /* aggregation of small products, see SetAggregation() */
+    std::mutex          aggrmtx;
+    std::condition_variable aggr_cv;
+    /* largest product to aggregate, 0 disables aggregation */
+    uint32_t            aggrMaxSize;
+    double              aggrMaxDelay;
+    char                aggrBuf[FMTP_DATA_LEN];
+    uint16_t            aggrLen;
+    uint32_t            aggrCount;
+    /* product index of the first product in the envelope */
+    uint32_t            aggrFirst;
+    HRclock::time_point aggrStart;
+    bool                aggrStop;
+    bool                aggrRunning;
+    pthread_t           aggr_t;
+    /* self-describing data packets, see SetSelfDescribingData() */
+    bool                selfDescribing;
+    bool                withDigest;
+    /* sender timestamps, see SetTimestamps() */
+    bool                timestamps;
+    uint32_t            tsSampling;
+    uint32_t            tsDataCount;
+    /* counters of getStats(), indexed by SEND_* */
+    PerThreadCounters   counters;
+    /* submit-to-acknowledgement latencies, indexed by SizeClass */
+    LatencyHistogram    ackLatency[NUM_SIZE_CLASSES];
+    /* lifecycle events of products, see SetTrace(), NULL if disabled */
+    ProductTrace*       trace;
+    /* rate control, see SetRateControl(), NULL if disabled */
+    RateController*     ratectrl;
+    double              ratectrlInterval;
+    int                 ratectrlSignals;
+    std::mutex          ratectrlmtx;
+    std::condition_variable ratectrl_cv;
+    bool                ratectrlStop;
+    bool                ratectrlRunning;
+    pthread_t           ratectrl_t;
+    /* state of the previous control interval, used by congestionSignal() */
+    uint64_t            ratectrlSent;
+    std::map<int, uint64_t> ratectrlReqs;
+    std::chrono::steady_clock::time_point ratectrlTick;
+    /* slow-receiver detection, see SetSlowRecvPolicy(), 0 action if disabled */
+    uint64_t            slowMaxRetxBytes;
+    double              slowMaxLatency;
+    int                 slowAction;
+    uint64_t            slowThrottleRate;
+    double              slowInterval;
+    unsigned            slowStrikes;
+    std::mutex          slowmtx;
+    std::condition_variable slow_cv;
+    bool                slowStop;
+    bool                slowRunning;
+    pthread_t           slow_t;
+    std::map<int, SlowRecvWindow> slowWindows;
+    /* where and how the threads run, see SetThreadPlacement() */
+    ThreadPlacement     placement;
+    /* the multi-feed engine serving this feed or NULL */
+    fmtpSendEngine*     engine;
+    /*
+     * the product being multicast by sendProduct() and the receivers whose
+     * RETX_END for it arrived before its EOP was sent, see handleRetxEnd()
+     */
+    std::mutex          sendingmtx;
+    bool                sending;
+    uint32_t            sendingIndex;
+    std::vector<int>    earlyRetxEnds;
+    /* the product whose packets sendNextPacket() multicasts */
+    ProdCursor          cursor;
+    /* the exporter serving the statistics or NULL, see SetMetricsExporter() */
+    MetricsExporter*    exporter;
+    int                 exporterId;
+    /* the log, written by a thread of its own, see SetLogLevel() */
+    std::shared_ptr<AsyncLog> logger;
 
 
     /* member variables for measurement use only */
@@ -180,6 +180,19 @@ RetxMetadata* senderMetadata::getMetadata(uint32_t prodindex)
 }
 
 
+/**
+ * Returns the number of products that have been sent and not yet been
+ * acknowledged by every receiver or timed out.
+ *
+ * @return    The number of retransmission entries.
+ */
+size_t senderMetadata::size()
+{
+    std::unique_lock<std::mutex> lock(indexMetaMapLock);
+    return indexMetaMap.size();
+}
+
+
 /**
  * Sends all unACKed receivers an EOP. This is to make sure the unACKed
  * receivers did not miss the whole last file.
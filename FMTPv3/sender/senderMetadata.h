@@ -58,6 +58,8 @@ struct RetxMetadata {
     void*          dataprod_p;        /*!< pointer to the data product */
     /* unfinished receiver set indexed by socket id */
     std::set<int>  unfinReceivers;
+    /* when the product was handed to the sender, for completion latency */
+    HRclock::time_point sendTime;
     /* indicates the RetxMetadata is in use */
     bool           inuse;
     /* indicates the RetxMetadata should be removed */
@@ -84,6 +86,7 @@ struct RetxMetadata {
         metaSize(meta.metaSize),
         retxTimeoutPeriod(meta.retxTimeoutPeriod),
         unfinReceivers(meta.unfinReceivers),
+        sendTime(meta.sendTime),
         inuse(meta.inuse),
         remove(meta.remove)
     {
@@ -111,6 +114,8 @@ public:
                             TcpSend* tcpsend);
     bool releaseMetadata(uint32_t prodindex);
     bool rmRetxMetadata(uint32_t prodindex);
+    /** returns the number of products awaiting acknowledgement */
+    size_t size();
 
 private:
     /* first: prodindex; second: pointer to metadata of the specified prodindex */
@@ -0,0 +1,1409 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FmtpPcapAnalyzer.cpp
+ *
+ * Offline analysis of an FMTPv3 session from a packet capture (pcap or
+ * pcapng, as written by tcpdump, dumpcap or wireshark) of its multicast
+ * traffic and of the TCP connections between the sender and its receivers.
+ * The capture is read as a stream, one packet at a time, so it can be of any
+ * size, and "-" reads it from the standard input (e.g. from zcat). Only
+ * IPv4 is understood and IP fragments are skipped.
+ *
+ * Every UDP datagram sent to a multicast group (the one of -g, if given) is
+ * taken as an FMTP multicast packet. Every TCP connection (the ones with the
+ * sender's port -p, if given) is reassembled in both directions and parsed
+ * into FMTP messages; a receiver is the endpoint that opened the connection,
+ * or the one that sends requests if the capture started after the handshake,
+ * and is named by its address and port. From these the analyzer rebuilds
+ * the timeline of every product and of every receiver's part in it:
+ *
+ *   - when the BOP and the EOP were multicast, which bytes of the product the
+ *     multicast left out at the capture point, and the duplicated and
+ *     reordered multicast packets;
+ *   - which bytes every receiver requested (its loss map), whether it asked
+ *     for the BOP or the EOP, how much was retransmitted to it and whether a
+ *     request was rejected;
+ *   - when every receiver acknowledged the product with a RETX_END, and from
+ *     that the completion latency (from the multicast BOP to the RETX_END) of
+ *     the receiver and of the product (its last receiver).
+ *
+ * The retransmission amplification of a product is the number of its bytes
+ * that were multicast, not counting duplicates, plus those retransmitted to
+ * all receivers, divided by its size; 1 means nothing was retransmitted.
+ *
+ * The state of a product is written out and dropped a second of capture time
+ * after every connected receiver has acknowledged it and its EOP has been
+ * seen, or once nothing has happened to it for the window (-w), so that
+ * memory only holds the products in flight. Data retransmitted to a receiver
+ * after its RETX_END, for a request the multicast made moot, is reported as
+ * wasted. Packets of a product that was written out
+ * are counted as late and otherwise ignored. The capture point matters: at
+ * the sender, the multicast has no losses and the receivers' loss maps come
+ * from their requests; at a receiver, the multicast losses are that
+ * receiver's.
+ *
+ * Usage: FmtpPcapAnalyzer [-g group[:port]] [-p port] [-w window]
+ *                         [-P products.csv] [-R receivers.csv] capture
+ *   -g  the multicast group and, optionally, port of the session
+ *       (default: any multicast datagram that parses as FMTP)
+ *   -p  the sender's TCP port (default: any TCP connection that parses as
+ *       FMTP)
+ *   -w  seconds of capture time after which an idle product is written out
+ *       (default 30)
+ *   -P  writes a CSV line per product to the file
+ *   -R  writes a CSV line per product and receiver, its loss map, to the file
+ * A JSON summary is printed on the standard output. Times in the CSV files
+ * are in seconds since the first packet of the capture.
+ */
+
+#include "fmtpBase.h"
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+/* bytes of out-of-order TCP data buffered per direction before giving up */
+static const size_t   MAX_OOO_BYTES = 8 << 20;
+/* how many written-out products are remembered to recognize late packets */
+static const size_t   MAX_RETIRED   = 1 << 20;
+/* interval of the search for idle products in nanoseconds of capture time */
+static const int64_t  SWEEP_NS      = 1000000000;
+/*
+ * how long a complete product is kept for the retransmissions that were
+ * already under way when its last receiver acknowledged it
+ */
+static const int64_t  LINGER_NS     = 1000000000;
+
+static const uint32_t PCAP_MAGIC    = 0xa1b2c3d4;
+static const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+static const uint32_t PCAPNG_SHB    = 0x0a0d0d0a;
+static const uint32_t PCAPNG_BOM    = 0x1a2b3c4d;
+
+
+static uint16_t get16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+
+static uint32_t get32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+
+static uint64_t get64(const uint8_t* p)
+{
+    return (uint64_t)get32(p) << 32 | get32(p + 4);
+}
+
+
+static std::string ipString(const uint32_t addr)
+{
+    struct in_addr in;
+    in.s_addr = htonl(addr);
+    return inet_ntoa(in);
+}
+
+
+/* one captured packet; the data is valid until the next one is read */
+struct Packet {
+    int64_t        tsNs;      /*!< nanoseconds since the epoch */
+    int            linktype;
+    const uint8_t* data;
+    uint32_t       caplen;
+};
+
+
+/**
+ * Reads the packets of a pcap or pcapng file in order. Either format may be
+ * in either byte order, and a pcapng file may have several sections and
+ * interfaces of different link types and timestamp resolutions.
+ */
+class CaptureReader {
+public:
+    explicit CaptureReader(const std::string& path)
+        : file(path == "-" ? stdin : fopen(path.c_str(), "rb")),
+          ng(false), swapped(false), linktype(0), tsUnits(1000000)
+    {
+        if (file == NULL)
+            throw std::runtime_error("Couldn't open " + path);
+        (void)setvbuf(file, NULL, _IOFBF, 1 << 20);
+        uint32_t magic;
+        if (!read(&magic, sizeof(magic)))
+            throw std::runtime_error(path + " is empty");
+        if (magic == PCAPNG_SHB) {
+            ng = true;
+            readSection();
+        }
+        else {
+            if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS)
+                swapped = false;
+            else if (swap32(magic) == PCAP_MAGIC ||
+                    swap32(magic) == PCAP_MAGIC_NS)
+                swapped = true;
+            else
+                throw std::runtime_error(path +
+                        " is neither a pcap nor a pcapng file");
+            tsUnits = (fix32(magic) == PCAP_MAGIC_NS) ? 1000000000 :
+                1000000;
+            uint8_t hdr[20];
+            if (!read(hdr, sizeof(hdr)))
+                throw std::runtime_error("Truncated pcap header");
+            linktype = fix32(field32(hdr + 16)) & 0xffff;
+        }
+    }
+
+    ~CaptureReader() {
+        if (file != stdin)
+            (void)fclose(file);
+    }
+
+    /* returns false at the end of the capture */
+    bool next(Packet& pkt) {
+        return ng ? nextBlock(pkt) : nextRecord(pkt);
+    }
+
+private:
+    struct Interface {
+        int      linktype;
+        uint64_t tsUnits;     /*!< timestamp units per second */
+    };
+
+    static uint32_t swap32(const uint32_t v) { return __builtin_bswap32(v); }
+    static uint32_t field32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    uint32_t fix32(const uint32_t v) const { return swapped ? swap32(v) : v; }
+    uint16_t fix16(const uint16_t v) const {
+        return swapped ? __builtin_bswap16(v) : v;
+    }
+    uint32_t at32(const size_t off) const { return fix32(field32(&buf[off])); }
+    uint16_t at16(const size_t off) const {
+        uint16_t v;
+        memcpy(&v, &buf[off], sizeof(v));
+        return fix16(v);
+    }
+
+    bool read(void* dst, const size_t n) {
+        const size_t got = fread(dst, 1, n, file);
+        if (got != 0 && got != n)
+            throw std::runtime_error("Truncated capture");
+        return got == n;
+    }
+
+    static int64_t toNs(const uint64_t ts, const uint64_t units) {
+        return (int64_t)(ts / units) * 1000000000 +
+            (int64_t)((long double)(ts % units) * 1e9 / units);
+    }
+
+    bool nextRecord(Packet& pkt) {
+        uint8_t hdr[16];
+        if (!read(hdr, sizeof(hdr)))
+            return false;
+        const uint32_t caplen = fix32(field32(hdr + 8));
+        if (caplen > (256u << 20))
+            throw std::runtime_error("Corrupt pcap record");
+        buf.resize(caplen);
+        if (caplen && !read(buf.data(), caplen))
+            throw std::runtime_error("Truncated pcap record");
+        pkt.tsNs     = (int64_t)fix32(field32(hdr)) * 1000000000 +
+            (int64_t)fix32(field32(hdr + 4)) * (1000000000 / tsUnits);
+        pkt.linktype = linktype;
+        pkt.data     = buf.data();
+        pkt.caplen   = caplen;
+        return true;
+    }
+
+    /*
+     * Reads the rest of a section header block whose type has been read and
+     * sets the byte order of the section.
+     */
+    void readSection() {
+        uint8_t hdr[8];
+        if (!read(hdr, sizeof(hdr)))
+            throw std::runtime_error("Truncated pcapng section header");
+        const uint32_t bom = field32(hdr + 4);
+        if (bom == PCAPNG_BOM)
+            swapped = false;
+        else if (swap32(bom) == PCAPNG_BOM)
+            swapped = true;
+        else
+            throw std::runtime_error("Corrupt pcapng section header");
+        const uint32_t len = fix32(field32(hdr));
+        if (len < 28 || len % 4 || len > (1u << 20))
+            throw std::runtime_error("Corrupt pcapng section header");
+        buf.resize(len - 12);
+        if (!read(buf.data(), buf.size()))
+            throw std::runtime_error("Truncated pcapng section header");
+        interfaces.clear();
+    }
+
+    void addInterface() {
+        Interface ifc;
+        ifc.linktype = at16(0);
+        ifc.tsUnits  = 1000000;
+        for (size_t off = 8; off + 4 <= buf.size() - 4; ) {
+            const uint16_t code = at16(off);
+            const uint16_t len  = at16(off + 2);
+            if (code == 0 || off + 4 + len > buf.size())
+                break;
+            if (code == 9 && len >= 1) {            /* if_tsresol */
+                const uint8_t res = buf[off + 4];
+                ifc.tsUnits = 1;
+                for (int i = 0; i < (res & 0x7f); i++)
+                    ifc.tsUnits *= (res & 0x80) ? 2 : 10;
+            }
+            off += 4 + ((len + 3) & ~3u);
+        }
+        interfaces.push_back(ifc);
+    }
+
+    bool nextBlock(Packet& pkt) {
+        for (;;) {
+            uint32_t type;
+            if (!read(&type, sizeof(type)))
+                return false;
+            if (type == PCAPNG_SHB) {
+                readSection();
+                continue;
+            }
+            uint32_t len;
+            if (!read(&len, sizeof(len)))
+                throw std::runtime_error("Truncated pcapng block");
+            type = fix32(type);
+            len  = fix32(len);
+            if (len < 12 || len % 4 || len > (256u << 20))
+                throw std::runtime_error("Corrupt pcapng block");
+            /* the body and the trailing length */
+            buf.resize(len - 8);
+            if (!read(buf.data(), buf.size()))
+                throw std::runtime_error("Truncated pcapng block");
+            const size_t body = buf.size() - 4;
+
+            if (type == 1 && body >= 8) {                       /* IDB */
+                addInterface();
+            }
+            else if ((type == 6 || type == 2) && body >= 20) {  /* EPB, PB */
+                const uint32_t id = (type == 6) ? at32(0) : at16(0);
+                if (id >= interfaces.size())
+                    throw std::runtime_error("Packet of an unknown interface");
+                const uint64_t ts = (uint64_t)at32(4) << 32 | at32(8);
+                pkt.tsNs     = toNs(ts, interfaces[id].tsUnits);
+                pkt.linktype = interfaces[id].linktype;
+                pkt.data     = &buf[20];
+                pkt.caplen   = std::min<uint32_t>(at32(12), body - 20);
+                lastTsNs     = pkt.tsNs;
+                return true;
+            }
+            else if (type == 3 && body >= 4) {                  /* SPB */
+                if (interfaces.empty())
+                    throw std::runtime_error("Packet of an unknown interface");
+                /* a simple packet block has no timestamp of its own */
+                pkt.tsNs     = lastTsNs;
+                pkt.linktype = interfaces[0].linktype;
+                pkt.data     = &buf[4];
+                pkt.caplen   = std::min<uint32_t>(at32(0), body - 4);
+                return true;
+            }
+        }
+    }
+
+    FILE*                  file;
+    bool                   ng;
+    bool                   swapped;
+    int                    linktype;     /*!< of a pcap file */
+    uint64_t               tsUnits;      /*!< of a pcap file */
+    std::vector<Interface> interfaces;   /*!< of the pcapng section */
+    std::vector<uint8_t>   buf;
+    int64_t                lastTsNs = 0;
+};
+
+
+/**
+ * A set of byte ranges [start, end) of a product, kept merged.
+ */
+class RangeSet {
+public:
+    /* adds a range and returns how many of its bytes weren't in the set */
+    uint32_t add(uint32_t start, uint32_t end) {
+        if (start >= end)
+            return 0;
+        const uint32_t len = end - start;
+        uint32_t       old = 0;
+        std::map<uint32_t, uint32_t>::iterator it = ranges.upper_bound(start);
+        if (it != ranges.begin()) {
+            --it;
+            if (it->second < start)
+                ++it;
+        }
+        while (it != ranges.end() && it->first <= end) {
+            old  += std::min(end, it->second) - std::max(start, it->first);
+            start = std::min(start, it->first);
+            end   = std::max(end, it->second);
+            it    = ranges.erase(it);
+        }
+        ranges[start] = end;
+        total += len - old;
+        return len - old;
+    }
+
+    uint64_t bytes() const { return total; }
+    bool     empty() const { return ranges.empty(); }
+
+    /* the ranges as "start-end" separated by spaces */
+    std::string str() const {
+        std::ostringstream out;
+        for (std::map<uint32_t, uint32_t>::const_iterator it = ranges.begin();
+                it != ranges.end(); ++it)
+            out << (it == ranges.begin() ? "" : " ") << it->first << "-"
+                << it->second;
+        return out.str();
+    }
+
+    /* the ranges of [0, size) that aren't in the set */
+    RangeSet complement(const uint32_t size) const {
+        RangeSet missing;
+        uint32_t pos = 0;
+        for (std::map<uint32_t, uint32_t>::const_iterator it = ranges.begin();
+                it != ranges.end() && pos < size; ++it) {
+            missing.add(pos, std::min(it->first, size));
+            pos = std::max(pos, it->second);
+        }
+        missing.add(pos, size);
+        return missing;
+    }
+
+private:
+    std::map<uint32_t, uint32_t> ranges;
+    uint64_t                     total = 0;
+};
+
+
+/* the part of a receiver in a product */
+struct RecvProd {
+    RangeSet lost;             /*!< bytes the receiver requested */
+    uint32_t reqs      = 0;
+    bool     bopReq    = false;
+    bool     eopReq    = false;
+    uint64_t retxBytes = 0;
+    uint64_t wasted    = 0;    /*!< retransmitted after the RETX_END */
+    bool     rejected  = false;
+    int64_t  firstReq  = -1;
+    int64_t  endTs     = -1;   /*!< of the RETX_END */
+};
+
+
+/* what is known of a product */
+struct ProdState {
+    uint32_t  index;
+    int64_t   firstTs   = -1;
+    int64_t   bopTs     = -1;
+    int64_t   eopTs     = -1;
+    int64_t   lastTs    = -1;
+    int64_t   doneTs    = -1;   /*!< when it became complete */
+    bool      sizeKnown = false;
+    uint32_t  size      = 0;
+    uint16_t  metasize  = 0;
+    bool      aggregated = false;
+    RangeSet  mcast;            /*!< bytes multicast at the capture point */
+    uint32_t  highest   = 0;    /*!< end of the highest multicast block */
+    uint64_t  mcastPkts = 0;
+    uint64_t  mcastBytes = 0;
+    uint64_t  dups      = 0;
+    uint64_t  reordered = 0;
+    std::map<int, RecvProd> recvs;
+};
+
+
+/* a receiver: one TCP connection to the sender */
+struct Receiver {
+    std::string         name;
+    bool                active    = true;
+    uint64_t            acked     = 0;
+    uint64_t            lossy     = 0;    /*!< products it requested data of */
+    uint64_t            reqs      = 0;
+    uint64_t            bopReqs   = 0;
+    uint64_t            eopReqs   = 0;
+    uint64_t            lostBytes = 0;
+    uint64_t            retxBytes = 0;
+    uint64_t            wasted    = 0;
+    uint64_t            retxEops  = 0;
+    uint64_t            rejs      = 0;
+    bool                haveStats = false;
+    RecvStatsMsg        stats;            /*!< the last report, host order */
+    std::vector<double> latencies;        /*!< completion latencies in ms */
+};
+
+
+/* one direction of a TCP connection */
+struct TcpStream {
+    bool        started = false;
+    bool        aligned = false;   /*!< buf starts at a message boundary */
+    uint32_t    next    = 0;       /*!< sequence number of the next byte */
+    std::string buf;
+    std::map<uint32_t, std::string> ooo;
+    size_t      oooBytes = 0;
+};
+
+
+struct Connection {
+    uint32_t  addr[2];
+    uint16_t  port[2];
+    TcpStream dir[2];        /*!< dir[i] is sent by endpoint i */
+    int       recvSide = -1; /*!< the endpoint that is the receiver */
+    int       recv     = -1; /*!< index of the receiver */
+};
+
+
+/* the p-quantile of sorted values */
+static double quantile(const std::vector<double>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[i ? i - 1 : 0];
+}
+
+
+/* the summary of values as a JSON object; sorts them */
+static std::string statsJson(std::vector<double>& values)
+{
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (size_t i = 0; i < values.size(); i++)
+        sum += values[i];
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\"count\": " << values.size()
+         << ", \"mean\": " << (values.empty() ? 0 : sum / values.size())
+         << ", \"p50\": " << quantile(values, 0.5)
+         << ", \"p90\": " << quantile(values, 0.9)
+         << ", \"p99\": " << quantile(values, 0.99)
+         << ", \"max\": " << quantile(values, 1) << "}";
+    return json.str();
+}
+
+
+static bool isMcastType(const uint16_t flags)
+{
+    return flags == FMTP_BOP || flags == FMTP_EOP || flags == FMTP_MEM_DATA ||
+        flags == FMTP_MEM_DATA_EXT || flags == FMTP_BOP_CONT ||
+        flags == FMTP_AGGR_DATA;
+}
+
+
+/* whether a message of the flags is sent by a receiver */
+static bool isRecvType(const uint16_t flags)
+{
+    return flags == FMTP_RETX_REQ || flags == FMTP_BOP_REQ ||
+        flags == FMTP_EOP_REQ || flags == FMTP_RETX_END ||
+        flags == FMTP_RECV_STATS;
+}
+
+
+/*
+ * Whether a header on a TCP connection is plausible. A receiver's requests
+ * carry the requested length in payloadlen but no payload.
+ */
+static bool tcpHeaderOk(const uint16_t flags, const uint16_t payloadlen)
+{
+    switch (flags) {
+    case FMTP_RETX_REQ:
+    case FMTP_BOP_REQ:
+    case FMTP_EOP_REQ:
+    case FMTP_RETX_END:
+    case FMTP_RETX_BOP:   return true;
+    case FMTP_RECV_STATS: return payloadlen == RECV_STATS_LEN;
+    case FMTP_RETX_DATA:  return payloadlen <= FMTP_DATA_LEN;
+    case FMTP_RETX_EOP:
+    case FMTP_RETX_REJ:   return payloadlen == 0;
+    default:              return false;
+    }
+}
+
+
+class Analyzer {
+public:
+    Analyzer(const uint32_t group, const uint16_t groupPort,
+             const uint16_t sendPort, const double window,
+             std::ostream* prodCsv, std::ostream* recvCsv)
+        : group(group), groupPort(groupPort), sendPort(sendPort),
+          windowNs(window * 1e9), prodCsv(prodCsv), recvCsv(recvCsv)
+    {
+        if (prodCsv)
+            *prodCsv << "prodindex,size,metasize,aggregated,first_s,bop_s,"
+                "eop_s,mcast_pkts,mcast_bytes,dup_pkts,reordered_pkts,"
+                "mcast_missing_bytes,mcast_missing_ranges,receivers,acked,"
+                "retx_reqs,retx_bytes,rejected,amplification,completion_ms"
+                << std::endl;
+        if (recvCsv)
+            *recvCsv << "prodindex,receiver,retx_reqs,lost_bytes,lost_ranges,"
+                "bop_req,eop_req,retx_bytes,wasted_retx_bytes,rejected,first_req_s,end_s,"
+                "completion_ms" << std::endl;
+    }
+
+    void packet(const Packet& pkt) {
+        if (firstTs < 0)
+            firstTs = nextSweep = pkt.tsNs;
+        nowTs = pkt.tsNs;
+        npkts++;
+        nbytes += pkt.caplen;
+
+        const uint8_t* ip;
+        uint32_t       len;
+        if (!linkToIp(pkt, ip, len)) {
+            skipped.nonIp++;
+        }
+        else {
+            ipPacket(ip, len);
+        }
+        if (nowTs >= nextSweep) {
+            sweep();
+            nextSweep = nowTs + SWEEP_NS;
+        }
+    }
+
+    /* writes out the remaining products and prints the summary */
+    void finish(std::ostream& out) {
+        std::vector<uint32_t> left;
+        for (auto& entry : prods)
+            left.push_back(entry.first);
+        std::sort(left.begin(), left.end());
+        for (size_t i = 0; i < left.size(); i++)
+            retire(left[i]);
+        /* data after a hole that never got filled */
+        for (auto& entry : conns)
+            for (int i = 0; i < 2; i++)
+                gapBytes += entry.second.dir[i].oooBytes;
+
+        std::ostringstream json;
+        json << std::setprecision(6);
+        json << "{\"capture\": {\"packets\": " << npkts
+             << ", \"bytes\": " << nbytes
+             << ", \"start_s\": " << std::fixed << std::setprecision(6)
+             << (firstTs < 0 ? 0 : firstTs / 1e9)
+             << std::defaultfloat << std::setprecision(6)
+             << ", \"duration_s\": " << (firstTs < 0 ? 0 :
+                     (nowTs - firstTs) / 1e9)
+             << ", \"non_ipv4\": " << skipped.nonIp
+             << ", \"fragments\": " << skipped.fragments
+             << ", \"truncated\": " << skipped.truncated
+             << ", \"non_fmtp\": " << skipped.nonFmtp << "}"
+             << ", \"multicast\": {\"packets\": " << mcastPkts
+             << ", \"data_bytes\": " << mcastBytes
+             << ", \"duplicates\": " << mcastDups
+             << ", \"reordered\": " << mcastReordered
+             << ", \"late\": " << mcastLate << "}"
+             << ", \"tcp\": {\"connections\": " << conns.size()
+             << ", \"messages\": " << tcpMsgs
+             << ", \"retx_bytes\": " << retxBytes
+             << ", \"wasted_retx_bytes\": " << wasted
+             << ", \"desyncs\": " << desyncs
+             << ", \"gap_bytes\": " << gapBytes
+             << ", \"late\": " << tcpLate << "}"
+             << ", \"products\": {\"count\": " << nprods
+             << ", \"bytes\": " << prodBytes
+             << ", \"acked_by_all\": " << ackedByAll
+             << ", \"without_bop\": " << withoutBop
+             << ", \"mcast_incomplete\": " << mcastIncomplete
+             << ", \"mcast_missing_bytes\": " << mcastMissing
+             << ", \"with_retx\": " << withRetx
+             << ", \"rejected\": " << rejected
+             << ", \"amplification\": " << statsJson(amplification)
+             << ", \"completion_ms\": " << statsJson(completion) << "}"
+             << ", \"receivers\": [";
+        for (size_t i = 0; i < receivers.size(); i++) {
+            Receiver& r = receivers[i];
+            json << (i ? ", " : "") << "{\"receiver\": \"" << r.name << "\""
+                 << ", \"acked\": " << r.acked
+                 << ", \"products_with_loss\": " << r.lossy
+                 << ", \"retx_reqs\": " << r.reqs
+                 << ", \"bop_reqs\": " << r.bopReqs
+                 << ", \"eop_reqs\": " << r.eopReqs
+                 << ", \"lost_bytes\": " << r.lostBytes
+                 << ", \"retx_bytes\": " << r.retxBytes
+                 << ", \"wasted_retx_bytes\": " << r.wasted
+                 << ", \"retx_eops\": " << r.retxEops
+                 << ", \"rejected\": " << r.rejs
+                 << ", \"completion_ms\": " << statsJson(r.latencies);
+            if (r.haveStats)
+                json << ", \"last_stats\": {\"mcast_pkts\": "
+                     << r.stats.mcastpkts
+                     << ", \"kernel_drops\": " << r.stats.kerneldrops
+                     << ", \"recovered\": " << r.stats.recovered
+                     << ", \"retx_reqs\": " << r.stats.retxreqs
+                     << ", \"rtt_us\": " << r.stats.rtt << "}";
+            json << "}";
+        }
+        json << "]}";
+        out << json.str() << std::endl;
+    }
+
+private:
+    bool linkToIp(const Packet& pkt, const uint8_t*& ip, uint32_t& len) {
+        const uint8_t* p   = pkt.data;
+        uint32_t       n   = pkt.caplen;
+        uint16_t       eth = 0;
+        switch (pkt.linktype) {
+        case 1:                                     /* Ethernet */
+            if (n < 14)
+                return false;
+            eth = get16(p + 12);
+            p += 14;
+            n -= 14;
+            while ((eth == 0x8100 || eth == 0x88a8 || eth == 0x9100) &&
+                    n >= 4) {
+                eth = get16(p + 2);
+                p += 4;
+                n -= 4;
+            }
+            break;
+        case 113:                                   /* Linux cooked */
+            if (n < 16)
+                return false;
+            eth = get16(p + 14);
+            p += 16;
+            n -= 16;
+            break;
+        case 276:                                   /* Linux cooked v2 */
+            if (n < 20)
+                return false;
+            eth = get16(p);
+            p += 20;
+            n -= 20;
+            break;
+        case 0:                                     /* BSD loopback */
+        case 108: {
+            if (n < 4)
+                return false;
+            uint32_t family;
+            memcpy(&family, p, sizeof(family));
+            eth = (family == 2 || family == 0x02000000) ? 0x0800 : 0;
+            p += 4;
+            n -= 4;
+            break;
+        }
+        case 12:                                    /* raw IP */
+        case 14:
+        case 101:
+        case 228:
+            eth = 0x0800;
+            break;
+        default:
+            return false;
+        }
+        if (eth != 0x0800 || n < 20 || (p[0] >> 4) != 4)
+            return false;
+        ip  = p;
+        len = n;
+        return true;
+    }
+
+    void ipPacket(const uint8_t* ip, uint32_t caplen) {
+        const uint32_t hlen  = (ip[0] & 0x0f) * 4;
+        const uint32_t total = get16(ip + 2);
+        if (hlen < 20 || total < hlen) {
+            skipped.nonIp++;
+            return;
+        }
+        if (get16(ip + 6) & 0x3fff) {
+            skipped.fragments++;
+            return;
+        }
+        /* the payload as sent and the part of it that was captured */
+        const uint32_t len  = total - hlen;
+        const uint32_t have = std::min(caplen, total) > hlen ?
+            std::min(caplen, total) - hlen : 0;
+        const uint8_t* l4   = ip + hlen;
+        const uint32_t src  = get32(ip + 12);
+        const uint32_t dst  = get32(ip + 16);
+
+        if (ip[9] == 17 && have >= 8) {
+            if ((dst >> 28) != 0xe || (group && dst != group) ||
+                    (groupPort && get16(l4 + 2) != groupPort)) {
+                skipped.nonFmtp++;
+                return;
+            }
+            mcastDatagram(l4 + 8, len - 8, have - 8);
+        }
+        else if (ip[9] == 6 && have >= 20) {
+            tcpSegment(src, dst, l4, len, have);
+        }
+        else {
+            skipped.nonFmtp++;
+        }
+    }
+
+    /* returns the state of a product, or NULL if it was written out */
+    ProdState* product(const uint32_t index) {
+        auto it = prods.find(index);
+        if (it == prods.end()) {
+            if (retiredSet.count(index))
+                return NULL;
+            it = prods.emplace(index, ProdState()).first;
+            it->second.index   = index;
+            it->second.firstTs = nowTs;
+        }
+        it->second.lastTs = nowTs;
+        return &it->second;
+    }
+
+    void mcastDatagram(const uint8_t* msg, const uint32_t len,
+            const uint32_t have) {
+        if (have < FMTP_HEADER_LEN) {
+            skipped.truncated++;
+            return;
+        }
+        const uint32_t index      = get32(msg);
+        const uint32_t seqnum     = get32(msg + 4);
+        uint16_t       payloadlen = get16(msg + 8);
+        uint16_t       flags      = get16(msg + 10);
+        if ((uint32_t)FMTP_HEADER_LEN + payloadlen != len) {
+            skipped.nonFmtp++;
+            return;
+        }
+        /* a sender timestamp ends the payload */
+        if (flags & FMTP_TIMESTAMPED) {
+            flags &= ~FMTP_TIMESTAMPED;
+            if (payloadlen < TIMESTAMP_LEN)
+                flags = 0;
+            payloadlen -= TIMESTAMP_LEN;
+        }
+        if (!isMcastType(flags)) {
+            skipped.nonFmtp++;
+            return;
+        }
+        const uint8_t* payload = msg + FMTP_HEADER_LEN;
+        const uint32_t avail   = have - FMTP_HEADER_LEN;
+        mcastPkts++;
+
+        if (flags == FMTP_AGGR_DATA) {
+            aggregate(index, seqnum, payload, std::min<uint32_t>(avail,
+                    payloadlen));
+            return;
+        }
+        ProdState* prod = product(index);
+        if (prod == NULL) {
+            mcastLate++;
+            return;
+        }
+        prod->mcastPkts++;
+
+        if (flags == FMTP_BOP) {
+            if (prod->bopTs >= 0) {
+                prod->dups++;
+                mcastDups++;
+            }
+            else {
+                prod->bopTs = nowTs;
+            }
+            if (avail >= 6) {
+                prod->sizeKnown = true;
+                prod->size      = get32(payload);
+                prod->metasize  = get16(payload + 4);
+            }
+        }
+        else if (flags == FMTP_EOP) {
+            if (prod->eopTs >= 0) {
+                prod->dups++;
+                mcastDups++;
+            }
+            else {
+                prod->eopTs = nowTs;
+            }
+        }
+        else if (flags == FMTP_MEM_DATA || flags == FMTP_MEM_DATA_EXT) {
+            uint32_t datalen = payloadlen;
+            if (flags == FMTP_MEM_DATA_EXT) {
+                if (payloadlen < DATA_EXT_LEN)
+                    return;
+                datalen -= DATA_EXT_LEN;
+                if (avail >= 4) {
+                    prod->sizeKnown = true;
+                    prod->size      = get32(payload);
+                }
+            }
+            if (datalen && prod->mcast.add(seqnum, seqnum + datalen) == 0) {
+                prod->dups++;
+                mcastDups++;
+            }
+            else if (seqnum < prod->highest) {
+                prod->reordered++;
+                mcastReordered++;
+            }
+            prod->highest = std::max(prod->highest, seqnum + datalen);
+            prod->mcastBytes += datalen;
+            mcastBytes       += datalen;
+        }
+    }
+
+    /* an aggregate envelope of `count` products starting at `index` */
+    void aggregate(const uint32_t index, const uint32_t count,
+            const uint8_t* p, const uint32_t len) {
+        uint32_t off = 0;
+        for (uint32_t i = 0; i < count && off + AGGR_ENTRY_HEADER_LEN <= len;
+                i++) {
+            const uint32_t size     = get32(p + off);
+            const uint16_t metasize = get16(p + off + 4);
+            off += AGGR_ENTRY_HEADER_LEN + metasize + size;
+            ProdState* prod = product(index + i);
+            if (prod == NULL) {
+                mcastLate++;
+                continue;
+            }
+            prod->mcastPkts++;
+            if (prod->bopTs >= 0) {
+                prod->dups++;
+                mcastDups++;
+                continue;
+            }
+            prod->aggregated = true;
+            prod->sizeKnown  = true;
+            prod->size       = size;
+            prod->metasize   = metasize;
+            prod->bopTs      = prod->eopTs = nowTs;
+            prod->mcast.add(0, size);
+            prod->highest     = size;
+            prod->mcastBytes += size;
+            mcastBytes       += size;
+        }
+    }
+
+    Connection& connection(const uint32_t src, const uint16_t sport,
+            const uint32_t dst, const uint16_t dport, int& side) {
+        const bool lower = src < dst || (src == dst && sport < dport);
+        const uint64_t a = (uint64_t)(lower ? src : dst) << 16 |
+            (lower ? sport : dport);
+        const uint64_t b = (uint64_t)(lower ? dst : src) << 16 |
+            (lower ? dport : sport);
+        std::pair<uint64_t, uint64_t> key(a, b);
+        auto it = conns.find(key);
+        if (it == conns.end()) {
+            it = conns.emplace(key, Connection()).first;
+            Connection& conn = it->second;
+            conn.addr[0] = lower ? src : dst;
+            conn.port[0] = lower ? sport : dport;
+            conn.addr[1] = lower ? dst : src;
+            conn.port[1] = lower ? dport : sport;
+        }
+        side = lower ? 0 : 1;
+        return it->second;
+    }
+
+    /* makes endpoint `side` of the connection a receiver */
+    void setReceiver(Connection& conn, const int side) {
+        if (conn.recvSide >= 0)
+            return;
+        conn.recvSide = side;
+        conn.recv     = receivers.size();
+        receivers.push_back(Receiver());
+        receivers.back().name = ipString(conn.addr[side]) + ":" +
+            std::to_string(conn.port[side]);
+    }
+
+    void tcpSegment(const uint32_t src, const uint32_t dst,
+            const uint8_t* tcp, const uint32_t len, const uint32_t have) {
+        const uint16_t sport = get16(tcp);
+        const uint16_t dport = get16(tcp + 2);
+        if (sendPort && sport != sendPort && dport != sendPort) {
+            skipped.nonFmtp++;
+            return;
+        }
+        const uint32_t hlen  = (tcp[12] >> 4) * 4;
+        const uint8_t  flags = tcp[13];
+        if (hlen < 20 || hlen > len) {
+            skipped.nonFmtp++;
+            return;
+        }
+        int         side;
+        Connection& conn = connection(src, sport, dst, dport, side);
+        TcpStream&  s    = conn.dir[side];
+        const uint32_t seq = get32(tcp + 4);
+
+        /* the receiver connects to the sender */
+        if ((flags & 0x12) == 0x02)
+            setReceiver(conn, sendPort ? (sport == sendPort ? 1 - side : side)
+                                       : side);
+        else if (sendPort)
+            setReceiver(conn, sport == sendPort ? 1 - side : side);
+        if (flags & 0x02) {
+            s.started = true;
+            s.aligned = true;
+            s.next    = seq + 1;
+            s.buf.clear();
+        }
+        if (flags & 0x05) {                           /* FIN or RST */
+            if (conn.recv >= 0 && receivers[conn.recv].active) {
+                receivers[conn.recv].active = false;
+                checkAll();
+            }
+        }
+
+        const uint32_t datalen = len - hlen;
+        if (datalen == 0)
+            return;
+        if (have < len) {
+            /* the data is lost to the capture; skip over it */
+            skipped.truncated++;
+            if (!s.started) {
+                s.started = true;
+                s.next    = seq;
+            }
+            if ((int32_t)(seq + datalen - s.next) > 0) {
+                gap(s, seq + datalen);
+            }
+            return;
+        }
+        if (!s.started) {
+            s.started = true;
+            s.aligned = false;
+            s.next    = seq;
+        }
+        const std::string data((const char*)tcp + hlen, datalen);
+        const int32_t     ahead = seq - s.next;
+        if (ahead > 0) {
+            if (s.ooo.find(seq) == s.ooo.end()) {
+                s.ooo[seq]  = data;
+                s.oooBytes += datalen;
+            }
+            if (s.oooBytes > MAX_OOO_BYTES)
+                gap(s, s.ooo.begin()->first);
+        }
+        else {
+            append(conn, side, seq, data);
+        }
+        drain(conn, side);
+    }
+
+    /* gives up on the bytes of a direction before `seq` */
+    void gap(TcpStream& s, const uint32_t seq) {
+        gapBytes += (uint32_t)(seq - s.next);
+        s.next    = seq;
+        s.aligned = false;
+        s.buf.clear();
+    }
+
+    void drain(Connection& conn, const int side) {
+        TcpStream& s = conn.dir[side];
+        while (!s.ooo.empty()) {
+            auto it = s.ooo.begin();
+            /* sequence numbers wrap, so the first key needn't be next */
+            for (auto j = s.ooo.begin(); j != s.ooo.end(); ++j)
+                if ((int32_t)(j->first - s.next) <
+                        (int32_t)(it->first - s.next))
+                    it = j;
+            if ((int32_t)(it->first - s.next) > 0)
+                break;
+            const uint32_t    seq  = it->first;
+            const std::string data = it->second;
+            s.oooBytes -= data.size();
+            s.ooo.erase(it);
+            append(conn, side, seq, data);
+        }
+    }
+
+    /* appends a segment that starts at or before the next expected byte */
+    void append(Connection& conn, const int side, const uint32_t seq,
+            const std::string& data) {
+        TcpStream&     s    = conn.dir[side];
+        const uint32_t skip = s.next - seq;
+        if (skip >= data.size())
+            return;                                 /* a retransmission */
+        if (!s.aligned) {
+            /* a capture that starts mid-stream: wait for a segment that
+             * starts with a plausible header */
+            if (skip != 0 || data.size() < (size_t)FMTP_HEADER_LEN ||
+                    !tcpHeaderOk(get16((const uint8_t*)data.data() + 10),
+                                 get16((const uint8_t*)data.data() + 8))) {
+                s.next += data.size() - skip;
+                return;
+            }
+            s.aligned = true;
+            s.buf.clear();
+        }
+        s.buf.append(data, skip, std::string::npos);
+        s.next += data.size() - skip;
+        parse(conn, side);
+    }
+
+    void parse(Connection& conn, const int side) {
+        TcpStream& s   = conn.dir[side];
+        size_t     off = 0;
+        while (s.buf.size() - off >= (size_t)FMTP_HEADER_LEN) {
+            const uint8_t* msg = (const uint8_t*)s.buf.data() + off;
+            const uint16_t payloadlen = get16(msg + 8);
+            const uint16_t flags      = get16(msg + 10);
+            if (!tcpHeaderOk(flags, payloadlen)) {
+                desyncs++;
+                s.aligned = false;
+                s.buf.clear();
+                return;
+            }
+            const bool   fromRecv = isRecvType(flags);
+            const size_t msglen   = FMTP_HEADER_LEN +
+                ((fromRecv && flags != FMTP_RECV_STATS) ? 0 : payloadlen);
+            if (s.buf.size() - off < msglen)
+                break;
+            if (conn.recvSide < 0)
+                setReceiver(conn, fromRecv ? side : 1 - side);
+            message(conn.recv, get32(msg), get32(msg + 4), payloadlen, flags,
+                    msg + FMTP_HEADER_LEN);
+            off += msglen;
+        }
+        s.buf.erase(0, off);
+    }
+
+    void message(const int recv, const uint32_t index, const uint32_t seqnum,
+            const uint16_t payloadlen, const uint16_t flags,
+            const uint8_t* payload) {
+        tcpMsgs++;
+        Receiver& r = receivers[recv];
+
+        if (flags == FMTP_RECV_STATS) {
+            r.haveStats         = true;
+            r.stats.mcastpkts   = get64(payload);
+            r.stats.kerneldrops = get64(payload + 8);
+            r.stats.recovered   = get64(payload + 16);
+            r.stats.retxreqs    = get64(payload + 24);
+            r.stats.rtt         = get32(payload + 44);
+            return;
+        }
+        if (flags == FMTP_RETX_END) {
+            const uint32_t count = seqnum > 1 ? seqnum : 1;
+            for (uint32_t i = 0; i < count; i++) {
+                ProdState* prod = product(index + i);
+                if (prod == NULL) {
+                    tcpLate++;
+                    continue;
+                }
+                RecvProd& rp = prod->recvs[recv];
+                if (rp.endTs < 0)
+                    rp.endTs = nowTs;
+                check(*prod);
+            }
+            return;
+        }
+
+        ProdState* prod = product(index);
+        if (prod == NULL) {
+            tcpLate++;
+            return;
+        }
+        RecvProd& rp = prod->recvs[recv];
+        switch (flags) {
+        case FMTP_RETX_REQ:
+            rp.reqs++;
+            r.reqs++;
+            if (rp.firstReq < 0)
+                rp.firstReq = nowTs;
+            rp.lost.add(seqnum, seqnum + payloadlen);
+            break;
+        case FMTP_BOP_REQ:
+            rp.bopReq = true;
+            r.bopReqs++;
+            if (rp.firstReq < 0)
+                rp.firstReq = nowTs;
+            break;
+        case FMTP_EOP_REQ:
+            rp.eopReq = true;
+            r.eopReqs++;
+            if (rp.firstReq < 0)
+                rp.firstReq = nowTs;
+            break;
+        case FMTP_RETX_DATA:
+            rp.retxBytes += payloadlen;
+            r.retxBytes  += payloadlen;
+            retxBytes    += payloadlen;
+            if (rp.endTs >= 0) {
+                rp.wasted += payloadlen;
+                r.wasted  += payloadlen;
+                wasted    += payloadlen;
+            }
+            break;
+        case FMTP_RETX_BOP:
+            if (payloadlen >= 6) {
+                prod->sizeKnown = true;
+                prod->size      = get32(payload);
+                prod->metasize  = get16(payload + 4);
+            }
+            break;
+        case FMTP_RETX_EOP:
+            r.retxEops++;
+            break;
+        case FMTP_RETX_REJ:
+            rp.rejected = true;
+            r.rejs++;
+            break;
+        }
+    }
+
+    /* notes when the product becomes complete */
+    void check(ProdState& prod) {
+        if (prod.eopTs < 0 || prod.doneTs >= 0 || receivers.empty())
+            return;
+        for (size_t i = 0; i < receivers.size(); i++) {
+            if (!receivers[i].active)
+                continue;
+            auto it = prod.recvs.find(i);
+            if (it == prod.recvs.end() || it->second.endTs < 0)
+                return;
+        }
+        prod.doneTs = nowTs;
+    }
+
+    /* checks every product, e.g. after a receiver has gone */
+    void checkAll() {
+        for (auto& entry : prods)
+            check(entry.second);
+    }
+
+    /* writes out the products that are complete or idle */
+    void sweep() {
+        std::vector<uint32_t> idle;
+        for (auto& entry : prods)
+            if ((entry.second.doneTs >= 0 &&
+                    nowTs - entry.second.doneTs > LINGER_NS) ||
+                    nowTs - entry.second.lastTs > windowNs)
+                idle.push_back(entry.first);
+        std::sort(idle.begin(), idle.end());
+        for (size_t i = 0; i < idle.size(); i++)
+            retire(idle[i]);
+    }
+
+    double relS(const int64_t ts) const {
+        return ts < 0 ? -1 : (ts - firstTs) / 1e9;
+    }
+
+    /* accounts for a product, writes it out and drops its state */
+    void retire(const uint32_t index) {
+        auto it = prods.find(index);
+        if (it == prods.end())
+            return;
+        ProdState& prod = it->second;
+
+        nprods++;
+        prodBytes += prod.size;
+        if (prod.bopTs < 0)
+            withoutBop++;
+        RangeSet missing;
+        if (prod.sizeKnown)
+            missing = prod.mcast.complement(prod.size);
+        if (!missing.empty()) {
+            mcastIncomplete++;
+            mcastMissing += missing.bytes();
+        }
+
+        uint64_t reqs = 0, retx = 0;
+        int      acked = 0;
+        bool     rej = false;
+        int64_t  lastEnd = -1;
+        for (auto& entry : prod.recvs) {
+            RecvProd& rp = entry.second;
+            Receiver& r  = receivers[entry.first];
+            reqs += rp.reqs;
+            retx += rp.retxBytes;
+            rej  |= rp.rejected;
+            if (!rp.lost.empty() || rp.bopReq || rp.eopReq) {
+                r.lossy++;
+                r.lostBytes += rp.lost.bytes();
+            }
+            double latency = -1;
+            if (rp.endTs >= 0) {
+                acked++;
+                r.acked++;
+                lastEnd = std::max(lastEnd, rp.endTs);
+                if (prod.bopTs >= 0) {
+                    latency = (rp.endTs - prod.bopTs) / 1e6;
+                    r.latencies.push_back(latency);
+                }
+            }
+            if (recvCsv)
+                *recvCsv << prod.index << "," << r.name << "," << rp.reqs
+                         << "," << rp.lost.bytes() << "," << rp.lost.str()
+                         << "," << rp.bopReq << "," << rp.eopReq << ","
+                         << rp.retxBytes << "," << rp.wasted << ","
+                         << rp.rejected << ","
+                         << relS(rp.firstReq) << "," << relS(rp.endTs) << ","
+                         << latency << "\n";
+        }
+        if (reqs || retx)
+            withRetx++;
+        if (rej)
+            rejected++;
+        size_t unacked = prod.recvs.size() - acked;
+        for (size_t i = 0; i < receivers.size(); i++)
+            unacked += receivers[i].active && !prod.recvs.count(i);
+        if (acked > 0 && unacked == 0)
+            ackedByAll++;
+
+        double amp = -1;
+        if (prod.sizeKnown && prod.size > 0) {
+            amp = (double)(prod.mcast.bytes() + retx) / prod.size;
+            amplification.push_back(amp);
+        }
+        double latency = -1;
+        if (lastEnd >= 0 && prod.bopTs >= 0) {
+            latency = (lastEnd - prod.bopTs) / 1e6;
+            completion.push_back(latency);
+        }
+        if (prodCsv)
+            *prodCsv << prod.index << "," << prod.size << "," << prod.metasize
+                     << "," << prod.aggregated << "," << relS(prod.firstTs)
+                     << "," << relS(prod.bopTs) << "," << relS(prod.eopTs)
+                     << "," << prod.mcastPkts << "," << prod.mcastBytes << ","
+                     << prod.dups << "," << prod.reordered << ","
+                     << missing.bytes() << "," << missing.str() << ","
+                     << prod.recvs.size() << "," << acked << "," << reqs
+                     << "," << retx << "," << rej << "," << amp << ","
+                     << latency << "\n";
+
+        prods.erase(it);
+        retiredSet.insert(index);
+        retired.push_back(index);
+        if (retired.size() > MAX_RETIRED) {
+            retiredSet.erase(retired.front());
+            retired.pop_front();
+        }
+    }
+
+    struct PairHash {
+        size_t operator()(const std::pair<uint64_t, uint64_t>& p) const {
+            return std::hash<uint64_t>()(p.first * 0x9e3779b97f4a7c15ULL ^
+                                         p.second);
+        }
+    };
+
+    const uint32_t group;
+    const uint16_t groupPort;
+    const uint16_t sendPort;
+    const int64_t  windowNs;
+    std::ostream*  prodCsv;
+    std::ostream*  recvCsv;
+
+    int64_t  firstTs   = -1;
+    int64_t  nowTs     = 0;
+    int64_t  nextSweep = 0;
+
+    std::unordered_map<uint32_t, ProdState> prods;
+    std::unordered_set<uint32_t>            retiredSet;
+    std::deque<uint32_t>                    retired;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, Connection, PairHash>
+                                            conns;
+    std::vector<Receiver>                   receivers;
+
+    uint64_t npkts = 0, nbytes = 0;
+    struct {
+        uint64_t nonIp = 0, fragments = 0, truncated = 0, nonFmtp = 0;
+    } skipped;
+    uint64_t mcastPkts = 0, mcastBytes = 0, mcastDups = 0,
+             mcastReordered = 0, mcastLate = 0;
+    uint64_t tcpMsgs = 0, retxBytes = 0, wasted = 0, desyncs = 0, gapBytes = 0,
+             tcpLate = 0;
+    uint64_t nprods = 0, prodBytes = 0, ackedByAll = 0, withoutBop = 0,
+             mcastIncomplete = 0, mcastMissing = 0, withRetx = 0,
+             rejected = 0;
+    std::vector<double> amplification;
+    std::vector<double> completion;
+};
+
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [-g group[:port]] [-p port] "
+              "[-w window] [-P products.csv] [-R receivers.csv] capture"
+              << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t    group     = 0;
+    uint16_t    groupPort = 0;
+    uint16_t    sendPort  = 0;
+    double      window    = 30;
+    std::string prodPath;
+    std::string recvPath;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:p:w:P:R:")) != -1) {
+        switch (opt) {
+        case 'g': {
+            const std::string spec(optarg);
+            const size_t      colon = spec.find(':');
+            struct in_addr    in;
+            if (inet_aton(spec.substr(0, colon).c_str(), &in) == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            group = ntohl(in.s_addr);
+            if (colon != std::string::npos)
+                groupPort = atoi(spec.c_str() + colon + 1);
+            break;
+        }
+        case 'p': sendPort = atoi(optarg); break;
+        case 'w': window   = atof(optarg); break;
+        case 'P': prodPath = optarg; break;
+        case 'R': recvPath = optarg; break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1 || window <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::ofstream prodCsv, recvCsv;
+        if (!prodPath.empty()) {
+            prodCsv.open(prodPath);
+            if (!prodCsv)
+                throw std::runtime_error("Couldn't create " + prodPath);
+        }
+        if (!recvPath.empty()) {
+            recvCsv.open(recvPath);
+            if (!recvCsv)
+                throw std::runtime_error("Couldn't create " + recvPath);
+        }
+        CaptureReader reader(argv[optind]);
+        Analyzer      analyzer(group, groupPort, sendPort, window,
+                               prodPath.empty() ? NULL : &prodCsv,
+                               recvPath.empty() ? NULL : &recvCsv);
+        Packet        pkt;
+        while (reader.next(pkt))
+            analyzer.packet(pkt);
+        analyzer.finish(std::cout);
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
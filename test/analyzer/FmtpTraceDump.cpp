@@ -0,0 +1,100 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FmtpTraceDump.cpp
+ *
+ * Converts product traces written by ProductTrace::write(), e.g. those of a
+ * sender and of its receivers, into one JSON file in the Chrome trace format,
+ * which chrome://tracing and https://ui.perfetto.dev open. Every trace is a
+ * process named after the trace, its recording threads are its threads,
+ * every event is an instant event of its thread and every product is an
+ * asynchronous slice of the process from its first to its last event. Times
+ * are relative to the earliest event of all the traces, so traces of
+ * different hosts line up as well as the hosts' clocks do.
+ *
+ * Usage: FmtpTraceDump [-o output.json] [-p prodindex] trace...
+ *   -o  writes the JSON to the file instead of the standard output
+ *   -p  only converts the events of the product
+ */
+
+#include "ProductTrace.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [-o output.json] [-p prodindex] "
+              "trace..." << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string outPath;
+    bool        onlyOne   = false;
+    uint32_t    prodindex = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:p:")) != -1) {
+        switch (opt) {
+        case 'o': outPath = optarg; break;
+        case 'p': onlyOne = true; prodindex = strtoul(optarg, NULL, 0); break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::vector<std::string>             names;
+        std::vector<std::vector<TraceEvent> > traces;
+        uint64_t                             base = UINT64_MAX;
+        for (int i = optind; i < argc; i++) {
+            std::string             name;
+            std::vector<TraceEvent> all;
+            std::vector<TraceEvent> events;
+            ProductTrace::read(argv[i], name, all);
+            for (size_t j = 0; j < all.size(); j++) {
+                if (!onlyOne || all[j].prodindex == prodindex) {
+                    events.push_back(all[j]);
+                    if (all[j].ns < base)
+                        base = all[j].ns;
+                }
+            }
+            names.push_back(name);
+            traces.push_back(events);
+        }
+
+        std::ofstream file;
+        if (!outPath.empty()) {
+            file.open(outPath.c_str());
+            if (!file)
+                throw std::runtime_error("Couldn't create " + outPath);
+        }
+        std::ostream& out = outPath.empty() ? std::cout : file;
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        for (size_t i = 0; i < traces.size(); i++)
+            ProductTrace::writeChromeEvents(out, names[i], i + 1, traces[i],
+                                            base, i == 0);
+        out << "\n]}" << std::endl;
+        if (!out)
+            throw std::runtime_error("Couldn't write the trace");
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,1147 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FmtpBench.cpp
+ *
+ * End-to-end loopback benchmark of FMTPv3. One sender multicasts products to
+ * N receivers on the loopback interface; the receivers run as threads of this
+ * process or, with -p, as child processes. Optionally, every receiver gets
+ * its multicast packets through a relay that drops them according to a loss
+ * model. When every product has been released by the sender, the benchmark
+ * prints one JSON object with the goodput, the completion latency of the
+ * products (from the call of sendProduct() to the receiver's EOP
+ * notification), the retransmission ratio and the CPU time per byte. With
+ * -f, the sender's multicast packets also pass a FaultInjector configured
+ * by SPEC (see FaultInjector::Configure()), seeded with the seed unless
+ * SPEC sets one. With -N, the receivers threads get the multicast packets
+ * over the links of a simulated network (see SimNetwork) instead, which also
+ * applies the loss model and allows more receivers.
+ *
+ * The sender and the receivers can also run on different hosts or network
+ * namespaces (see test/netns): with -x PORT, only the sender runs, listening
+ * on ADDR:PORT for the receivers, and prints the sender's view; with -R
+ * HOST:PORT, only a receiver runs, connecting to the sender there, and prints
+ * its own results. -a sets the address of the local interface, by default
+ * 127.0.0.1; both sides must agree on -n.
+ *
+ * With -M ADDR, the statistics of the sender and of the receiver threads are
+ * served in the Prometheus format while the benchmark runs, on a TCP socket
+ * at ADDR ("host:port") or a Unix-domain socket ("unix:path"); receiver i
+ * has the label feed="rI".
+ *
+ * Usage: FmtpBench [-n products] [-s size] [-r rate] [-c receivers]
+ *                  [-l loss] [-f spec] [-N link] [-t timeout] [-S seed] [-p]
+ *                  [-a addr] [-x port | -R host:port] [-M addr]
+ *   size  fixed:BYTES | uniform:MIN:MAX | exp:MEAN   (default fixed:100000)
+ *   loss  none | bernoulli:P | burst:P:LEN            (default none)
+ *   link  BPS:DELAY[:QUEUE]  bandwidth in bits per second (0 for unlimited),
+ *         delay in seconds and queue in bytes of every receiver's link
+ * The rate is in bits per second (default 500000000). A burst loss starts at
+ * a packet with probability P and lasts LEN packets on average.
+ */
+
+#include "fmtpSendv3.h"
+#include "fmtpRecvv3.h"
+#include "MetricsExporter.h"
+#include "SimNetwork.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static const char*          IF_ADDR    = "127.0.0.1";
+static const char*          SEND_GROUP = "239.255.22.1";
+static const unsigned short SEND_PORT  = 5200;
+/* receiver i of a lossy run listens on 239.255.23.(i + 1):(5201 + i) */
+static const char*          RELAY_NET  = "239.255.23.";
+
+typedef std::chrono::steady_clock Clock;
+
+
+/* nanoseconds on the steady clock, which all processes of the host share */
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+}
+
+
+/* CPU time of this process in nanoseconds */
+static int64_t cpuNs()
+{
+    struct rusage usage;
+    (void)getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+}
+
+
+/* splits "a:b:c" into its fields */
+static std::vector<std::string> split(const std::string& spec)
+{
+    std::vector<std::string> fields;
+    std::istringstream       in(spec);
+    std::string              field;
+    while (std::getline(in, field, ':'))
+        fields.push_back(field);
+    return fields;
+}
+
+
+/* the distribution of the product sizes */
+class SizeModel {
+public:
+    explicit SizeModel(const std::string& spec) : spec(spec) {
+        const std::vector<std::string> f = split(spec);
+        if (f.size() == 2 && f[0] == "fixed") {
+            kind = FIXED;
+            a = b = atof(f[1].c_str());
+        }
+        else if (f.size() == 3 && f[0] == "uniform") {
+            kind = UNIFORM;
+            a = atof(f[1].c_str());
+            b = atof(f[2].c_str());
+        }
+        else if (f.size() == 2 && f[0] == "exp") {
+            kind = EXP;
+            a = atof(f[1].c_str());
+            b = 10 * a; // clipped so that the buffer is bounded
+        }
+        else {
+            kind = FIXED;
+            a = b = 0;
+        }
+        if (a < 1 || b < a)
+            throw std::invalid_argument("Invalid size model: " + spec);
+    }
+
+    uint32_t max() const {return static_cast<uint32_t>(b);}
+
+    uint32_t next(std::minstd_rand& gen) const {
+        double size = a;
+        if (kind == UNIFORM) {
+            size = std::uniform_real_distribution<double>(a, b)(gen);
+        }
+        else if (kind == EXP) {
+            size = std::min(b, std::max(1.0,
+                    std::exponential_distribution<double>(1 / a)(gen)));
+        }
+        return static_cast<uint32_t>(size);
+    }
+
+    const std::string spec;
+
+private:
+    enum {FIXED, UNIFORM, EXP} kind;
+    double a;
+    double b;
+};
+
+
+/* decides which multicast packets a relay drops */
+class LossModel {
+public:
+    explicit LossModel(const std::string& spec)
+        : spec(spec), p(0), len(1), inBurst(false) {
+        const std::vector<std::string> f = split(spec);
+        if (f.size() == 1 && f[0] == "none") {
+        }
+        else if (f.size() == 2 && f[0] == "bernoulli") {
+            p = atof(f[1].c_str());
+        }
+        else if (f.size() == 3 && f[0] == "burst") {
+            p = atof(f[1].c_str());
+            len = atof(f[2].c_str());
+        }
+        else {
+            p = -1;
+        }
+        if (p < 0 || p > 1 || len < 1)
+            throw std::invalid_argument("Invalid loss model: " + spec);
+    }
+
+    bool lossy() const {return p > 0;}
+
+    /* the model as a FaultInjector specification */
+    std::string faults() const {
+        if (!lossy())
+            return "";
+        std::ostringstream spec;
+        spec << std::setprecision(17);
+        if (len > 1)
+            spec << "burst=" << p << ":" << 1 / len;
+        else
+            spec << "loss=" << p;
+        return spec.str();
+    }
+
+    /* Gilbert model: a burst ends after each packet with probability 1/len */
+    bool drop(std::minstd_rand& gen) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        if (inBurst)
+            inBurst = uniform(gen) >= 1 / len;
+        else
+            inBurst = uniform(gen) < p;
+        return inBurst;
+    }
+
+    const std::string spec;
+
+private:
+    double p;
+    double len;
+    bool   inBurst;
+};
+
+
+/* forwards the sender's multicast packets to one receiver's group */
+class LossRelay {
+public:
+    LossRelay(const LossModel& model, const int index, const unsigned seed)
+        : model(model), index(index), seed(seed), forwarded(0), dropped(0),
+          stop(false), in(-1), out(-1) {}
+
+    ~LossRelay() {
+        if (in >= 0)
+            close(in);
+        if (out >= 0)
+            close(out);
+    }
+
+    /* joins the sender's group, so that no packet is missed */
+    void open() {
+        in = socket(AF_INET, SOCK_DGRAM, 0);
+        out = socket(AF_INET, SOCK_DGRAM, 0);
+        if (in < 0 || out < 0)
+            throw std::runtime_error("LossRelay::open() socket() failed");
+
+        const int       reuseaddr = 1;
+        int             rcvbuf    = 16 * 1024 * 1024;
+        struct timeval  timeout   = {0, 100000};
+        struct sockaddr_in addr = {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SEND_PORT);
+        addr.sin_addr.s_addr = inet_addr(SEND_GROUP);
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(SEND_GROUP);
+        mreq.imr_interface.s_addr = inet_addr(IF_ADDR);
+        if (setsockopt(in, SOL_SOCKET, SO_REUSEADDR, &reuseaddr,
+                       sizeof(reuseaddr)) ||
+                bind(in, (struct sockaddr*)&addr, sizeof(addr)) ||
+                setsockopt(in, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                           sizeof(mreq)) ||
+                setsockopt(in, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                           sizeof(rcvbuf)) ||
+                setsockopt(in, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout)))
+            throw std::runtime_error("LossRelay::open() couldn't join group");
+
+        struct in_addr ifaddr;
+        ifaddr.s_addr = inet_addr(IF_ADDR);
+        if (setsockopt(out, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr,
+                       sizeof(ifaddr)))
+            throw std::runtime_error("LossRelay::open() IP_MULTICAST_IF "
+                    "failed");
+    }
+
+    void run() {
+        struct sockaddr_in dest = {};
+        dest.sin_family      = AF_INET;
+        dest.sin_port        = htons(SEND_PORT + 1 + index);
+        dest.sin_addr.s_addr = inet_addr(group(index).c_str());
+
+        std::minstd_rand gen(seed + index);
+        /* self-describing and timestamped packets exceed the usual size */
+        char             buf[FMTP_HEADER_LEN + DATA_EXT_LEN + FMTP_DATA_LEN];
+        while (!stop) {
+            const ssize_t nbytes = recv(in, buf, sizeof(buf), 0);
+            if (nbytes <= 0)
+                continue;
+            if (model.drop(gen)) {
+                dropped++;
+                continue;
+            }
+            (void)sendto(out, buf, nbytes, 0, (struct sockaddr*)&dest,
+                         sizeof(dest));
+            forwarded++;
+        }
+    }
+
+    static std::string group(const int index) {
+        return RELAY_NET + std::to_string(index + 1);
+    }
+
+    LossModel             model;
+    const int             index;
+    const unsigned        seed;
+    std::atomic<uint64_t> forwarded;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool>     stop;
+
+private:
+    int in;
+    int out;
+};
+
+
+/* counts the products the sender has released */
+class BenchSendProxy : public SendProxy {
+public:
+    BenchSendProxy() : released(0) {}
+    void notify_of_eop(uint32_t /*prodindex*/) {released++;}
+    bool verify_new_recv(int /*newsock*/) {return true;}
+
+    std::atomic<uint32_t> released;
+};
+
+
+/* what a receiver measured; sent as is from a child process */
+struct RecvResult {
+    uint32_t completed;
+    uint32_t missed;
+    uint64_t bytes;        /*!< bytes of the completed products */
+    int64_t  firstSendNs;  /*!< earliest send time of a product */
+    int64_t  lastEopNs;    /*!< latest completion */
+    int64_t  cpuNs;        /*!< CPU time of the receiving process */
+    uint64_t mcastpkts;
+    uint64_t kerneldrops;
+    uint32_t nlatencies;   /*!< number of latencies that follow */
+};
+
+
+/**
+ * A receiver and the proxy that timestamps its products. The send time of a
+ * product travels in its metadata.
+ */
+class BenchReceiver : public RecvProxy {
+public:
+    BenchReceiver(const int index, const bool lossy, const uint32_t maxSize,
+                  const uint64_t rate)
+        : index(index), lossy(lossy), rate(rate), buf(maxSize),
+          receiver(NULL), completed(0), missed(0), bytes(0),
+          firstSendNs(INT64_MAX), lastEopNs(0) {}
+
+    ~BenchReceiver() {delete receiver;}
+
+    void notify_of_bop(const uint32_t prodIndex, size_t prodSize,
+                       void* metadata, unsigned metaSize, void** data) {
+        int64_t sent = 0;
+        if (metadata && metaSize == sizeof(sent))
+            (void)memcpy(&sent, metadata, sizeof(sent));
+        std::unique_lock<std::mutex> lock(mtx);
+        pending[prodIndex] = std::make_pair(sent, prodSize);
+        *data = buf.data();
+    }
+
+    void notify_of_eop(uint32_t prodIndex) {
+        const int64_t now = nowNs();
+        std::unique_lock<std::mutex> lock(mtx);
+        std::map<uint32_t, std::pair<int64_t, size_t> >::iterator it =
+            pending.find(prodIndex);
+        if (it != pending.end()) {
+            latencies.push_back((now - it->second.first) / 1000.0);
+            firstSendNs = std::min(firstSendNs, it->second.first);
+            bytes += it->second.second;
+            pending.erase(it);
+        }
+        lastEopNs = now;
+        completed++;
+    }
+
+    void notify_of_missed_prod(uint32_t prodIndex) {
+        std::unique_lock<std::mutex> lock(mtx);
+        pending.erase(prodIndex);
+        missed++;
+    }
+
+    /*
+     * connects to the sender and receives on a thread of its own, over a
+     * simulated network if one is given, timestamping received packets if
+     * asked to and tracing products if given a trace
+     */
+    void start(const std::string& sendAddr, const unsigned short tcpPort,
+               const std::string& ifAddr, SimNetwork* network = NULL,
+               MetricsExporter* exporter = NULL,
+               const bool timestamps = false, ProductTrace* trace = NULL) {
+        receiver = lossy && !network ?
+            new fmtpRecvv3(sendAddr, tcpPort, LossRelay::group(index),
+                           SEND_PORT + 1 + index, this, ifAddr) :
+            new fmtpRecvv3(sendAddr, tcpPort, SEND_GROUP, SEND_PORT, this,
+                           ifAddr);
+        if (network)
+            receiver->SetTransport(*network);
+        if (exporter)
+            receiver->SetMetricsExporter(*exporter,
+                                         "r" + std::to_string(index));
+        receiver->SetLinkSpeed(rate);
+        receiver->SetRxTimestamps(timestamps);
+        receiver->SetTrace(trace);
+        thread = std::thread([this] {
+            try {
+                receiver->Start();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "receiver " << index << ": " << e.what()
+                          << std::endl;
+            }
+        });
+    }
+
+    /* waits until every product is completed or missed */
+    bool wait(const uint32_t nprods, const Clock::time_point deadline) {
+        while (completed + missed < nprods) {
+            if (Clock::now() > deadline)
+                return false;
+            usleep(1000);
+        }
+        return true;
+    }
+
+    void stop() {
+        if (receiver) {
+            receiver->Stop();
+            thread.join();
+        }
+    }
+
+    RecvResult result() {
+        const McastRecvStats stats = receiver->getMcastStats();
+        std::unique_lock<std::mutex> lock(mtx);
+        RecvResult r;
+        r.completed   = completed;
+        r.missed      = missed;
+        r.bytes       = bytes;
+        r.firstSendNs = firstSendNs;
+        r.lastEopNs   = lastEopNs;
+        r.cpuNs       = 0;
+        r.mcastpkts   = stats.mcastpkts;
+        r.kerneldrops = stats.kerneldrops;
+        r.nlatencies  = latencies.size();
+        return r;
+    }
+
+    std::vector<double> getLatencies() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return latencies;
+    }
+
+    /* the receiver's own BOP-to-completion latencies */
+    HistogramSnapshot getCompletion() {
+        return receiver->getLatency(LATENCY_COMPLETION);
+    }
+
+    /* the receiver's submission-to-completion latencies */
+    HistogramSnapshot getEndToEnd() {
+        return receiver->getLatency(LATENCY_END_TO_END);
+    }
+
+    /* the receiver's one-way delays of multicast packets */
+    HistogramSnapshot getPacketDelay(const PacketDelay which) {
+        return receiver->getPacketDelay(which);
+    }
+
+private:
+    const int             index;
+    const bool            lossy;
+    const uint64_t        rate;
+    std::vector<char>     buf;
+    fmtpRecvv3*           receiver;
+    std::thread           thread;
+    std::mutex            mtx;
+    std::map<uint32_t, std::pair<int64_t, size_t> > pending;
+    std::vector<double>   latencies;  /*!< microseconds */
+    std::atomic<uint32_t> completed;
+    std::atomic<uint32_t> missed;
+    uint64_t              bytes;
+    int64_t               firstSendNs;
+    int64_t               lastEopNs;
+};
+
+
+/* reads or writes exactly `len` bytes of a pipe */
+static bool readAll(const int fd, void* const buf, const size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t n = read(fd, static_cast<char*>(buf) + done, len - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool writeAll(const int fd, const void* const buf, const size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t n = write(fd, static_cast<const char*>(buf) + done,
+                                len - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+
+/**
+ * Runs a receiver in a child process: reads the sender's port from the
+ * command pipe, receives every product, writes the result and the latencies
+ * to the result pipe and exits when the command pipe is closed.
+ */
+static void runChild(BenchReceiver& recv, const uint32_t nprods,
+                     const double timeout, const int cmdfd, const int resfd)
+{
+    unsigned short port;
+    if (!readAll(cmdfd, &port, sizeof(port)))
+        _exit(1);
+    const int64_t cpu0 = cpuNs();
+    recv.start(IF_ADDR, port, IF_ADDR);
+    (void)recv.wait(nprods, Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(timeout)));
+    RecvResult r = recv.result();
+    r.cpuNs = cpuNs() - cpu0;
+    const std::vector<double> latencies = recv.getLatencies();
+    if (!writeAll(resfd, &r, sizeof(r)) ||
+            !writeAll(resfd, latencies.data(),
+                      latencies.size() * sizeof(double)))
+        _exit(1);
+    char c;
+    (void)read(cmdfd, &c, 1);
+    recv.stop();
+    /* the receiver's threads may still hold the sender's connection */
+    _exit(0);
+}
+
+
+/* returns the p-quantile of sorted samples */
+static double quantile(const std::vector<double>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[i ? i - 1 : 0];
+}
+
+
+/* the summary of sorted latencies as a JSON object */
+static std::string latencyJson(const std::vector<double>& sorted)
+{
+    double sum = 0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\"count\": " << sorted.size()
+         << ", \"mean\": " << (sorted.empty() ? 0 : sum / sorted.size())
+         << ", \"p50\": " << quantile(sorted, 0.5)
+         << ", \"p90\": " << quantile(sorted, 0.9)
+         << ", \"p99\": " << quantile(sorted, 0.99)
+         << ", \"p999\": " << quantile(sorted, 0.999)
+         << ", \"max\": " << quantile(sorted, 1) << "}";
+    return json.str();
+}
+
+
+/* the summary of a histogram of nanoseconds as a JSON object in microseconds */
+static std::string histogramJson(const HistogramSnapshot& hist)
+{
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\"count\": " << hist.getCount()
+         << ", \"mean\": " << hist.getMean() / 1e3
+         << ", \"p50\": " << hist.getPercentile(50) / 1e3
+         << ", \"p90\": " << hist.getPercentile(90) / 1e3
+         << ", \"p99\": " << hist.getPercentile(99) / 1e3
+         << ", \"p999\": " << hist.getPercentile(99.9) / 1e3
+         << ", \"max\": " << hist.getMax() / 1e3 << "}";
+    return json.str();
+}
+
+
+/**
+ * Runs a receiver of a sender that runs elsewhere (-R) until it has received
+ * every product or the timeout expires and prints its results as one JSON
+ * object. It then stays connected until the timeout expires or it is
+ * terminated, so that the sender sees every receiver until it is done.
+ * Latencies are only meaningful if both share the steady clock, as processes
+ * of one host do, whatever their network namespace. Exits with 0, or 2 if
+ * the timeout expired.
+ */
+static void runRemoteReceiver(const std::string& sender,
+                             const std::string& ifAddr, const uint32_t nprods,
+                             const uint32_t maxSize, const uint64_t rate,
+                             const double timeout, const int stampEvery)
+{
+    const size_t colon = sender.rfind(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument("Invalid sender: " + sender);
+    const std::string    sendAddr = sender.substr(0, colon);
+    const unsigned short port = atoi(sender.substr(colon + 1).c_str());
+
+    BenchReceiver recv(0, false, maxSize, rate);
+    const int64_t cpu0  = cpuNs();
+    const int64_t start = nowNs();
+    const Clock::time_point deadline = Clock::now() +
+        std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(timeout));
+    recv.start(sendAddr, port, ifAddr, NULL, NULL, stampEvery >= 0);
+    const bool timedOut = !recv.wait(nprods, deadline);
+    RecvResult r = recv.result();
+    r.cpuNs = cpuNs() - cpu0;
+    std::vector<double> latencies = recv.getLatencies();
+    std::sort(latencies.begin(), latencies.end());
+
+    const int64_t span = r.lastEopNs - r.firstSendNs;
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\n  \"config\": {\"products\": " << nprods << ", \"sender\": \""
+         << sender << "\", \"address\": \"" << ifAddr << "\", \"mode\": "
+         "\"receiver\"},\n";
+    json << "  \"timed_out\": " << (timedOut ? "true" : "false") << ",\n";
+    json << "  \"elapsed_s\": " << (nowNs() - start) / 1e9 << ",\n";
+    json << "  \"completed\": " << r.completed << ",\n";
+    json << "  \"missed\": " << r.missed << ",\n";
+    json << "  \"bytes_delivered\": " << r.bytes << ",\n";
+    /* from the first product's sending to the last product's reception */
+    json << "  \"goodput_bps\": " << (r.completed && span > 0 ?
+            r.bytes * 8e9 / span : 0) << ",\n";
+    json << "  \"latency_us\": " << latencyJson(latencies) << ",\n";
+    if (stampEvery >= 0)
+        json << "  \"end_to_end_us\": " << histogramJson(recv.getEndToEnd())
+             << ",\n  \"network_delay_us\": "
+             << histogramJson(recv.getPacketDelay(DELAY_NETWORK))
+             << ",\n  \"host_delay_us\": "
+             << histogramJson(recv.getPacketDelay(DELAY_HOST)) << ",\n";
+    json << "  \"mcast_pkts\": " << r.mcastpkts << ",\n";
+    json << "  \"kernel_drops\": " << r.kerneldrops << ",\n";
+    json << "  \"cpu_ns_per_byte\": " << (r.bytes ?
+            (double)r.cpuNs / r.bytes : 0) << "\n}";
+    std::cout << json.str() << std::endl;
+    while (Clock::now() < deadline)
+        usleep(100000);
+    /* the receiver's threads may still hold the sender's connection */
+    _exit(timedOut ? 2 : 0);
+}
+
+
+/**
+ * Runs a sender for receivers that run elsewhere (-x): waits for `nrecvs`
+ * receivers to connect to ADDR:PORT, multicasts the products on the
+ * interface of ADDR, waits until every product is released and prints the
+ * sender's view of the run as one JSON object. The receivers' own results
+ * are printed by them. Exits with 0, or 2 if the timeout expired.
+ */
+static void runRemoteSender(const std::string& ifAddr,
+                           const unsigned short port, const int nrecvs,
+                           const uint32_t nprods, const SizeModel& sizes,
+                           const uint64_t rate, const std::string& faultSpec,
+                           const double timeout, const unsigned seed,
+                           const int stampEvery)
+{
+    BenchSendProxy sendProxy;
+    fmtpSendv3 sender(ifAddr.c_str(), port, SEND_GROUP, SEND_PORT,
+                      &sendProxy, 1, ifAddr, 0, 30.0);
+    sender.SetSendRate(rate);
+    sender.SetTimestamps(stampEvery >= 0, stampEvery >= 0 ? stampEvery : 0);
+    FaultInjector faults(seed);
+    if (!faultSpec.empty()) {
+        faults.Configure(faultSpec);
+        sender.SetFaultInjector(&faults);
+    }
+    sender.Start();
+
+    const Clock::time_point deadline = Clock::now() +
+        std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(timeout));
+    while (sender.getLossMap().size() < (size_t)nrecvs) {
+        if (Clock::now() > deadline)
+            throw std::runtime_error("Receivers didn't connect");
+        usleep(10000);
+    }
+    usleep(100000);
+
+    std::vector<char> data(sizes.max());
+    std::minstd_rand  gen(seed);
+    uint64_t          bytesSent = 0;
+    const int64_t     cpu0      = cpuNs();
+    const int64_t     start     = nowNs();
+    for (uint32_t i = 0; i < nprods; i++) {
+        const uint32_t size = sizes.next(gen);
+        int64_t        sent = nowNs();
+        sender.sendProduct(data.data(), size, &sent, sizeof(sent));
+        bytesSent += size;
+    }
+    bool timedOut = false;
+    while (sendProxy.released < nprods) {
+        if (Clock::now() > deadline) {
+            timedOut = true;
+            break;
+        }
+        usleep(1000);
+    }
+    const int64_t end = nowNs();
+
+    uint64_t retxBytes = 0;
+    const std::vector<ReceiverStats> lossmap = sender.getLossMap();
+    for (size_t i = 0; i < lossmap.size(); i++)
+        retxBytes += lossmap[i].retxbytes;
+
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\n  \"config\": {\"products\": " << nprods
+         << ", \"size\": \"" << sizes.spec << "\", \"rate_bps\": " << rate
+         << ", \"receivers\": " << nrecvs << ", \"faults\": \"" << faultSpec
+         << "\", \"address\": \"" << ifAddr << ":" << port
+         << "\", \"mode\": \"sender\", \"seed\": " << seed << "},\n";
+    json << "  \"timed_out\": " << (timedOut ? "true" : "false") << ",\n";
+    json << "  \"elapsed_s\": " << (end - start) / 1e9 << ",\n";
+    json << "  \"bytes_sent\": " << bytesSent << ",\n";
+    json << "  \"retx_bytes\": " << retxBytes << ",\n";
+    json << "  \"retx_ratio\": " << (bytesSent ?
+            (double)retxBytes / bytesSent / nrecvs : 0) << ",\n";
+    json << "  \"cpu_ns_per_byte\": " << (bytesSent ?
+            (double)(cpuNs() - cpu0) / bytesSent : 0) << ",\n";
+    json << "  \"ack_latency_us\": " << histogramJson(sender.getAckLatency())
+         << ",\n";
+    /* as last reported by the receivers */
+    json << "  \"per_receiver\": [";
+    for (size_t i = 0; i < lossmap.size(); i++) {
+        const ReceiverStats& r = lossmap[i];
+        json << (i ? ",\n    " : "\n    ") << "{\"addr\": \"" << r.addr
+             << "\", \"completions\": " << r.completions
+             << ", \"mcast_pkts\": " << r.mcastpkts
+             << ", \"kernel_drops\": " << r.kerneldrops
+             << ", \"retx_reqs\": " << r.retxreqsrecvd
+             << ", \"retx_bytes\": " << r.retxbytes
+             << ", \"loss_rate\": " << r.lossrate
+             << ", \"rtt_us\": " << r.rtt << "}";
+    }
+    json << "\n  ]\n}";
+    std::cout << json.str() << std::endl;
+    /* the sender would wait for receivers that are gone */
+    _exit(timedOut ? 2 : 0);
+}
+
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [-n products] [-s size] [-r rate] "
+              "[-c receivers] [-l loss] [-f spec] [-N link] [-t timeout] "
+              "[-S seed] [-p]\n"
+              "       [-a addr] [-x port | -R host:port] [-M addr] "
+              "[-T every] [-D prefix]\n"
+              "  size  fixed:BYTES | uniform:MIN:MAX | exp:MEAN\n"
+              "  loss  none | bernoulli:P | burst:P:LEN\n"
+              "  link  BPS:DELAY[:QUEUE]\n"
+              "  every timestamp BOPs, EOPs and every N-th data packet "
+              "(0: none)\n"
+              "  prefix  writes product traces to PREFIX.sender.trace and "
+              "PREFIX.rN.trace" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t    nprods    = 1000;
+    std::string sizeSpec  = "fixed:100000";
+    uint64_t    rate      = 500000000;
+    int         nrecvs    = 1;
+    std::string lossSpec  = "none";
+    std::string faultSpec;
+    std::string linkSpec;
+    double      timeout   = 60;
+    unsigned    seed      = 1;
+    bool        processes = false;
+    std::string ifAddr    = IF_ADDR;
+    int         listenPort = -1;
+    std::string remoteSender;
+    std::string metricsAddr;
+    int         stampEvery = -1;
+    std::string tracePrefix;
+
+    int opt;
+    while ((opt = getopt(argc, argv,
+                              "n:s:r:c:l:f:N:t:S:pa:x:R:M:T:D:")) != -1) {
+        switch (opt) {
+        case 'n': nprods   = strtoul(optarg, NULL, 0); break;
+        case 's': sizeSpec = optarg; break;
+        case 'r': rate     = strtoull(optarg, NULL, 0); break;
+        case 'c': nrecvs   = atoi(optarg); break;
+        case 'l': lossSpec = optarg; break;
+        case 'f': faultSpec = optarg; break;
+        case 'N': linkSpec = optarg; break;
+        case 't': timeout  = atof(optarg); break;
+        case 'S': seed     = strtoul(optarg, NULL, 0); break;
+        case 'p': processes = true; break;
+        case 'a': ifAddr   = optarg; break;
+        case 'x': listenPort = atoi(optarg); break;
+        case 'R': remoteSender = optarg; break;
+        case 'M': metricsAddr = optarg; break;
+        case 'T': stampEvery = atoi(optarg); break;
+        case 'D': tracePrefix = optarg; break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    /* without a simulated network, every lossy receiver has a group */
+    if (nprods == 0 || rate == 0 || nrecvs <= 0 ||
+            nrecvs > (linkSpec.empty() ? 250 : 1000) || timeout <= 0 ||
+            (processes && !linkSpec.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* the local receivers' options don't apply to remote ones */
+    const bool remote = listenPort >= 0 || !remoteSender.empty();
+    if ((listenPort >= 0 && !remoteSender.empty()) || listenPort > 65535 ||
+            (remote && (processes || !linkSpec.empty() ||
+                        lossSpec != "none" || !metricsAddr.empty() ||
+                        !tracePrefix.empty())) ||
+            (processes && !tracePrefix.empty()) ||
+            (!remote && ifAddr != IF_ADDR)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        const SizeModel sizes(sizeSpec);
+        const LossModel loss(lossSpec);
+
+        if (!remoteSender.empty())
+            runRemoteReceiver(remoteSender, ifAddr, nprods, sizes.max(), rate,
+                              timeout, stampEvery);
+        if (listenPort >= 0)
+            runRemoteSender(ifAddr, listenPort, nrecvs, nprods, sizes, rate,
+                            faultSpec, timeout, seed, stampEvery);
+
+        SimNetwork* network = NULL;
+        if (!linkSpec.empty()) {
+            const std::vector<std::string> f = split(linkSpec);
+            if (f.size() < 2 || f.size() > 3)
+                throw std::invalid_argument("Invalid link: " + linkSpec);
+            SimLink link;
+            link.bandwidth = strtoull(f[0].c_str(), NULL, 0);
+            link.delay     = atof(f[1].c_str());
+            link.queue     = f.size() > 2 ? strtoul(f[2].c_str(), NULL, 0) : 0;
+            link.faults    = loss.faults();
+            network = new SimNetwork(seed);
+            network->SetDefaultLink(link);
+        }
+
+        std::vector<BenchReceiver*> recvs;
+        for (int i = 0; i < nrecvs; i++)
+            recvs.push_back(new BenchReceiver(i, loss.lossy(), sizes.max(),
+                                              rate));
+
+        /* children are forked before this process has any other thread */
+        std::vector<pid_t> pids;
+        std::vector<int>   cmdfds;
+        std::vector<int>   resfds;
+        if (processes) {
+            for (int i = 0; i < nrecvs; i++) {
+                int cmd[2];
+                int res[2];
+                if (pipe(cmd) || pipe(res))
+                    throw std::runtime_error("pipe() failed");
+                const pid_t pid = fork();
+                if (pid < 0)
+                    throw std::runtime_error("fork() failed");
+                if (pid == 0) {
+                    /* or earlier children wouldn't see their pipes close */
+                    for (size_t j = 0; j < cmdfds.size(); j++) {
+                        close(cmdfds[j]);
+                        close(resfds[j]);
+                    }
+                    close(cmd[1]);
+                    close(res[0]);
+                    runChild(*recvs[i], nprods, timeout, cmd[0], res[1]);
+                }
+                close(cmd[0]);
+                close(res[1]);
+                pids.push_back(pid);
+                cmdfds.push_back(cmd[1]);
+                resfds.push_back(res[0]);
+            }
+        }
+
+        std::vector<LossRelay*>  relays;
+        std::vector<std::thread> relayThreads;
+        if (loss.lossy() && !network) {
+            for (int i = 0; i < nrecvs; i++) {
+                relays.push_back(new LossRelay(loss, i, seed));
+                relays.back()->open();
+                relayThreads.push_back(std::thread(&LossRelay::run,
+                                                   relays.back()));
+            }
+        }
+
+        /*
+         * after the children are forked; outlives the sender and the
+         * receivers since they are never destroyed
+         */
+        MetricsExporter* exporter = metricsAddr.empty() ? NULL :
+                                    new MetricsExporter(metricsAddr);
+        /* likewise, since the receivers' threads may still record */
+        std::vector<ProductTrace*> traces;
+        if (!tracePrefix.empty()) {
+            traces.push_back(new ProductTrace("sender"));
+            for (int i = 0; i < nrecvs; i++)
+                traces.push_back(new ProductTrace("receiver r" +
+                                                  std::to_string(i)));
+        }
+
+        BenchSendProxy sendProxy;
+        fmtpSendv3 sender(IF_ADDR, 0, SEND_GROUP, SEND_PORT, &sendProxy, 1,
+                          IF_ADDR, 0, 30.0);
+        sender.SetSendRate(rate);
+        sender.SetTimestamps(stampEvery >= 0,
+                             stampEvery >= 0 ? stampEvery : 0);
+        if (network)
+            sender.SetTransport(*network);
+        if (exporter)
+            sender.SetMetricsExporter(*exporter);
+        if (!traces.empty())
+            sender.SetTrace(traces[0]);
+        FaultInjector faults(seed);
+        if (!faultSpec.empty()) {
+            faults.Configure(faultSpec);
+            sender.SetFaultInjector(&faults);
+        }
+        sender.Start();
+        const unsigned short port = sender.getTcpPortNum();
+
+        if (processes) {
+            for (int i = 0; i < nrecvs; i++) {
+                if (!writeAll(cmdfds[i], &port, sizeof(port)))
+                    throw std::runtime_error("Couldn't start receiver " +
+                                             std::to_string(i));
+            }
+        }
+        else {
+            for (int i = 0; i < nrecvs; i++)
+                recvs[i]->start(IF_ADDR, port, IF_ADDR, network, exporter,
+                                stampEvery >= 0,
+                                traces.empty() ? NULL : traces[i + 1]);
+        }
+        /* wait until every receiver has connected */
+        const Clock::time_point connectBy = Clock::now() +
+            std::chrono::seconds(10);
+        while (sender.getLossMap().size() < (size_t)nrecvs) {
+            if (Clock::now() > connectBy)
+                throw std::runtime_error("Receivers didn't connect");
+            usleep(10000);
+        }
+        usleep(100000);
+
+        /* the content of the products doesn't matter */
+        std::vector<char>  data(sizes.max());
+        std::minstd_rand   gen(seed);
+        uint64_t           bytesSent = 0;
+        const int64_t      cpu0      = cpuNs();
+        const int64_t      start     = nowNs();
+        for (uint32_t i = 0; i < nprods; i++) {
+            const uint32_t size = sizes.next(gen);
+            int64_t        sent = nowNs();
+            sender.sendProduct(data.data(), size, &sent, sizeof(sent));
+            bytesSent += size;
+        }
+
+        const Clock::time_point deadline = Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(timeout));
+        bool timedOut = false;
+        while (sendProxy.released < nprods) {
+            if (Clock::now() > deadline) {
+                timedOut = true;
+                break;
+            }
+            usleep(1000);
+        }
+
+        std::vector<RecvResult> results(nrecvs);
+        std::vector<double>     latencies;
+        HistogramSnapshot       completion;
+        HistogramSnapshot       endToEnd;
+        HistogramSnapshot       delays[NUM_PACKET_DELAYS];
+        if (processes) {
+            for (int i = 0; i < nrecvs; i++) {
+                if (!readAll(resfds[i], &results[i], sizeof(results[i])))
+                    throw std::runtime_error("Receiver " +
+                                             std::to_string(i) + " failed");
+                std::vector<double> l(results[i].nlatencies);
+                if (!readAll(resfds[i], l.data(), l.size() * sizeof(double)))
+                    throw std::runtime_error("Receiver " +
+                                             std::to_string(i) + " failed");
+                latencies.insert(latencies.end(), l.begin(), l.end());
+            }
+        }
+        else {
+            for (int i = 0; i < nrecvs; i++) {
+                timedOut |= !recvs[i]->wait(nprods, deadline);
+                results[i] = recvs[i]->result();
+                const std::vector<double> l = recvs[i]->getLatencies();
+                latencies.insert(latencies.end(), l.begin(), l.end());
+                completion.merge(recvs[i]->getCompletion());
+                endToEnd.merge(recvs[i]->getEndToEnd());
+                for (int j = 0; j < NUM_PACKET_DELAYS; j++)
+                    delays[j].merge(recvs[i]->getPacketDelay(
+                            static_cast<PacketDelay>(j)));
+            }
+        }
+        const int64_t end     = nowNs();
+        const int64_t cpuSelf = cpuNs() - cpu0;
+
+        /* before the receivers disconnect and their entries are removed */
+        uint64_t retxBytes = 0;
+        const std::vector<ReceiverStats> lossmap = sender.getLossMap();
+        for (size_t i = 0; i < lossmap.size(); i++)
+            retxBytes += lossmap[i].retxbytes;
+        const SendStats sendStats = sender.getStats();
+
+        for (int i = 0; i < nrecvs; i++) {
+            if (processes) {
+                close(cmdfds[i]);
+                (void)waitpid(pids[i], NULL, 0);
+            }
+            else {
+                recvs[i]->stop();
+            }
+        }
+        for (size_t i = 0; i < relays.size(); i++) {
+            relays[i]->stop = true;
+            relayThreads[i].join();
+        }
+        for (size_t i = 0; i < traces.size(); i++)
+            traces[i]->write(tracePrefix + "." + (i ? "r" +
+                             std::to_string(i - 1) : "sender") + ".trace");
+
+        uint64_t delivered = 0;
+        int64_t  cpuRecvs  = 0;
+        int64_t  lastEop   = start;
+        for (int i = 0; i < nrecvs; i++) {
+            delivered += results[i].bytes;
+            cpuRecvs  += results[i].cpuNs;
+            lastEop    = std::max(lastEop, results[i].lastEopNs);
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::ostringstream json;
+        json << std::setprecision(6);
+        json << "{\n  \"config\": {\"products\": " << nprods
+             << ", \"size\": \"" << sizes.spec << "\", \"rate_bps\": "
+             << rate << ", \"receivers\": " << nrecvs << ", \"loss\": \""
+             << loss.spec << "\", \"faults\": \"" << faultSpec
+             << "\", \"link\": \"" << linkSpec << "\", \"mode\": \""
+             << (processes ? "processes" : "threads") << "\", \"seed\": "
+             << seed << "},\n";
+        json << "  \"timed_out\": " << (timedOut ? "true" : "false") << ",\n";
+        json << "  \"elapsed_s\": " << (end - start) / 1e9 << ",\n";
+        json << "  \"bytes_sent\": " << bytesSent << ",\n";
+        json << "  \"bytes_delivered\": " << delivered << ",\n";
+        /* until the last product was received, not released */
+        json << "  \"goodput_bps\": " << (lastEop > start ?
+                delivered * 8e9 / nrecvs / (lastEop - start) : 0) << ",\n";
+        json << "  \"latency_us\": " << latencyJson(latencies) << ",\n";
+        /* as measured by the receivers, which processes keep to themselves */
+        if (!processes)
+            json << "  \"completion_us\": " << histogramJson(completion)
+                 << ",\n";
+        if (!processes && stampEvery >= 0)
+            json << "  \"end_to_end_us\": " << histogramJson(endToEnd)
+                 << ",\n  \"network_delay_us\": "
+                 << histogramJson(delays[DELAY_NETWORK])
+                 << ",\n  \"host_delay_us\": "
+                 << histogramJson(delays[DELAY_HOST]) << ",\n";
+        json << "  \"retx_bytes\": " << retxBytes << ",\n";
+        json << "  \"retx_ratio\": " << (bytesSent ?
+                (double)retxBytes / bytesSent / nrecvs : 0) << ",\n";
+        if (!faultSpec.empty()) {
+            const FaultStats injected = faults.getStats();
+            json << "  \"injected\": {\"packets\": " << injected.packets
+                 << ", \"dropped\": " << injected.dropped
+                 << ", \"duplicated\": " << injected.duplicated
+                 << ", \"delayed\": " << injected.delayed << "},\n";
+        }
+        if (network) {
+            /* links are numbered as receivers joined, so they're summed */
+            SimLinkStats total;
+            for (unsigned i = 0; i < network->receiverCount(); i++) {
+                const SimLinkStats link = network->getLinkStats(i);
+                total.delivered  += link.delivered;
+                total.lost       += link.lost;
+                total.overflowed += link.overflowed;
+            }
+            json << "  \"network\": {\"delivered\": " << total.delivered
+                 << ", \"lost\": " << total.lost << ", \"overflowed\": "
+                 << total.overflowed << "},\n";
+        }
+        json << "  \"sender\": {\"mcast_pkts\": " << sendStats.mcastpkts
+             << ", \"retx_reqs\": " << sendStats.retxreqs
+             << ", \"retx_pkts\": " << sendStats.retxpkts
+             << ", \"retx_rejs\": " << sendStats.retxrejs
+             << ", \"acked\": " << sendStats.acked
+             << ", \"timed_out\": " << sendStats.timedout
+             << ", \"ack_latency_us\": "
+             << histogramJson(sender.getAckLatency()) << "},\n";
+        json << "  \"cpu_ns_per_byte\": {";
+        if (processes) {
+            json << "\"sender\": " << (delivered ?
+                    (double)cpuSelf / delivered : 0)
+                 << ", \"receivers\": " << (delivered ?
+                    (double)cpuRecvs / delivered : 0)
+                 << ", \"total\": " << (delivered ?
+                    (double)(cpuSelf + cpuRecvs) / delivered : 0);
+        }
+        else {
+            json << "\"total\": " << (delivered ?
+                    (double)cpuSelf / delivered : 0);
+        }
+        json << "},\n  \"per_receiver\": [";
+        for (int i = 0; i < nrecvs; i++) {
+            const RecvResult& r = results[i];
+            const int64_t span = r.lastEopNs - r.firstSendNs;
+            json << (i ? ",\n    " : "\n    ") << "{\"completed\": "
+                 << r.completed << ", \"missed\": " << r.missed
+                 << ", \"goodput_bps\": " << (r.completed && span > 0 ?
+                         r.bytes * 8e9 / span : 0)
+                 << ", \"mcast_pkts\": " << r.mcastpkts
+                 << ", \"kernel_drops\": " << r.kerneldrops;
+            if (!relays.empty())
+                json << ", \"relay_dropped\": " << relays[i]->dropped;
+            json << "}";
+        }
+        json << "\n  ]\n}";
+        std::cout << json.str() << std::endl;
+        /* the sender would wait for receivers that are gone */
+        _exit(timedOut ? 2 : 0);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        _exit(1);
+    }
+}
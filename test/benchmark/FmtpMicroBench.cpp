@@ -0,0 +1,403 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FmtpMicroBench.cpp
+ *
+ * Microbenchmarks of the data structures on the hot paths of FMTPv3: the
+ * receiver's segment tracking, the sender's retransmission metadata, the
+ * product-index delay queue, the rate shaper, the header conversion and the
+ * statistics counters. Run
+ * by "make check" with a short minimum time; for regression tracking, run it
+ * by hand with e.g. --benchmark_out=micro.json --benchmark_repetitions=5.
+ */
+
+#include "AsyncLog.h"
+#include "fmtpBase.h"
+#include "LatencyHistogram.h"
+#include "PerThreadCounters.h"
+#include "ProdIndexDelayQueue.h"
+#include "ProdSegMNG.h"
+#include "ProductTrace.h"
+#include "RateShaper/RateShaper.h"
+#include "TcpSend.h"
+#include "senderMetadata.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+
+/* size of a product tracked by ProdSegMNG: 690 full data blocks */
+static const uint32_t PROD_SIZE = 690 * FMTP_DATA_LEN;
+
+
+/* the data blocks of a product in the order they are multicast */
+static std::vector<uint32_t> blocksInOrder()
+{
+    std::vector<uint32_t> seqnums;
+    for (uint32_t seqnum = 0; seqnum < PROD_SIZE; seqnum += FMTP_DATA_LEN)
+        seqnums.push_back(seqnum);
+    return seqnums;
+}
+
+
+/**
+ * Tracks the blocks of one product after another. `arrival` is the order in
+ * which the blocks arrive; `recovered` are the blocks that are lost on the
+ * multicast path and arrive afterwards through retransmission.
+ */
+static void trackProducts(benchmark::State& state,
+                          const std::vector<uint32_t>& arrival,
+                          const std::vector<uint32_t>& recovered)
+{
+    ProdSegMNG tracker;
+    uint32_t   prodindex = 0;
+
+    for (auto _ : state) {
+        tracker.addProd(prodindex, PROD_SIZE);
+        for (size_t i = 0; i < arrival.size(); i++)
+            tracker.set(prodindex, arrival[i], FMTP_DATA_LEN);
+        for (size_t i = 0; i < recovered.size(); i++)
+            tracker.set(prodindex, recovered[i], FMTP_DATA_LEN);
+        if (!tracker.delIfComplete(prodindex))
+            state.SkipWithError("product incomplete");
+        prodindex++;
+    }
+    state.SetItemsProcessed(state.iterations() *
+                            (arrival.size() + recovered.size()));
+}
+
+
+static void BM_ProdSegMNG_InOrder(benchmark::State& state)
+{
+    trackProducts(state, blocksInOrder(), std::vector<uint32_t>());
+}
+BENCHMARK(BM_ProdSegMNG_InOrder);
+
+
+/* the argument is the loss in per mille */
+static void BM_ProdSegMNG_Lossy(benchmark::State& state)
+{
+    const std::vector<uint32_t> blocks = blocksInOrder();
+    std::vector<uint32_t>       arrival;
+    std::vector<uint32_t>       recovered;
+    std::minstd_rand            gen(1);
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (gen() % 1000 < (unsigned)state.range(0))
+            recovered.push_back(blocks[i]);
+        else
+            arrival.push_back(blocks[i]);
+    }
+    trackProducts(state, arrival, recovered);
+}
+BENCHMARK(BM_ProdSegMNG_Lossy)->Arg(10)->Arg(100);
+
+
+/* the argument is the distance by which blocks are displaced */
+static void BM_ProdSegMNG_Reordered(benchmark::State& state)
+{
+    std::vector<uint32_t> arrival = blocksInOrder();
+    std::minstd_rand      gen(1);
+
+    for (size_t i = 0; i + 1 < arrival.size(); i++) {
+        const size_t j = std::min(arrival.size() - 1,
+                                  i + gen() % (state.range(0) + 1));
+        std::swap(arrival[i], arrival[j]);
+    }
+    trackProducts(state, arrival, std::vector<uint32_t>());
+}
+BENCHMARK(BM_ProdSegMNG_Reordered)->Arg(2)->Arg(16);
+
+
+/**
+ * Runs the retransmission metadata of one product after another through its
+ * life with a number of connected receivers: it is added, looked up and
+ * released by a retransmission thread, and every receiver acknowledges it.
+ */
+static void BM_SenderMetadata_Lifecycle(benchmark::State& state)
+{
+    const int          nrecvs = state.range(0);
+    TcpSend            tcpsend("127.0.0.1", 0);
+    std::vector<int>   clients;
+    std::vector<int>   socks;
+    struct sockaddr_in addr = {};
+
+    tcpsend.Init();
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(tcpsend.getPortNum());
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    for (int i = 0; i < nrecvs; i++) {
+        const int client = socket(AF_INET, SOCK_STREAM, 0);
+        if (client < 0 ||
+                connect(client, (struct sockaddr*)&addr, sizeof(addr))) {
+            state.SkipWithError("couldn't connect");
+            return;
+        }
+        clients.push_back(client);
+        socks.push_back(tcpsend.acceptConn());
+    }
+
+    senderMetadata metadata;
+    uint32_t       prodindex = 0;
+    for (auto _ : state) {
+        RetxMetadata* meta = new RetxMetadata();
+        meta->prodindex = prodindex;
+        meta->unfinReceivers.insert(socks.begin(), socks.end());
+        metadata.addRetxMetadata(meta);
+
+        RetxMetadata* found = metadata.getMetadata(prodindex);
+        benchmark::DoNotOptimize(found);
+        metadata.releaseMetadata(prodindex);
+        bool removed = false;
+        for (int i = 0; i < nrecvs; i++)
+            removed = metadata.clearUnfinishedSet(prodindex, socks[i],
+                                                  &tcpsend);
+        if (!removed)
+            state.SkipWithError("metadata not removed");
+        /* the entry was destructed but not freed */
+        ::operator delete(meta);
+        prodindex++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    for (int i = 0; i < nrecvs; i++) {
+        tcpsend.dismantleConn(socks[i]);
+        close(clients[i]);
+    }
+}
+BENCHMARK(BM_SenderMetadata_Lifecycle)->Arg(1)->Arg(16)->Arg(128);
+
+
+/* the argument is the number of product-indexes queued at once */
+static void BM_ProdIndexDelayQueue_PushPop(benchmark::State& state)
+{
+    ProdIndexDelayQueue queue;
+    const uint32_t      n = state.range(0);
+    uint32_t            index = 0;
+
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < n; i++)
+            queue.push(index + i, 0);
+        for (uint32_t i = 0; i < n; i++)
+            benchmark::DoNotOptimize(queue.pop());
+        index += n;
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ProdIndexDelayQueue_PushPop)->Arg(1)->Arg(64)->Arg(4096);
+
+
+/**
+ * Shapes full-sized packets at a rate and reports how far the achieved rate
+ * is from it, in percent. The argument is the rate in Mbps.
+ */
+static void BM_RateShaper_Accuracy(benchmark::State& state)
+{
+    const uint64_t rate = state.range(0) * 1000000ULL;
+    RateShaper     shaper;
+    uint64_t       bytes = 0;
+
+    shaper.SetRate(rate);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        shaper.CalcPeriod(MAX_FMTP_PACKET_LEN);
+        shaper.Sleep();
+        bytes += MAX_FMTP_PACKET_LEN;
+    }
+    const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    const double achieved = bytes * 8 / seconds;
+    state.counters["achieved_bps"] = achieved;
+    state.counters["error_pct"]    = 100 * (achieved - rate) / rate;
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_RateShaper_Accuracy)->Arg(100)->Arg(1000)->Arg(10000)
+    ->UseRealTime();
+
+
+/* encodes a header into a packet buffer the way the sender does */
+static void BM_Header_Encode(benchmark::State& state)
+{
+    char     packet[MAX_FMTP_PACKET_LEN];
+    uint32_t seqnum = 0;
+
+    for (auto _ : state) {
+        FmtpHeader header;
+        header.prodindex  = htonl(42);
+        header.seqnum     = htonl(seqnum);
+        header.payloadlen = htons(FMTP_DATA_LEN);
+        header.flags      = htons(FMTP_MEM_DATA);
+        (void)memcpy(packet, &header, sizeof(header));
+        benchmark::DoNotOptimize(packet);
+        seqnum += FMTP_DATA_LEN;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Header_Encode);
+
+
+/* decodes the header of a packet the way the receiver does */
+static void BM_Header_Decode(benchmark::State& state)
+{
+    char       packet[MAX_FMTP_PACKET_LEN] = {};
+    FmtpHeader header;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(packet);
+        const unsigned char* wire = (const unsigned char*)packet;
+        header.prodindex  = ntohl(*(const uint32_t*)wire);
+        wire += sizeof(header.prodindex);
+        header.seqnum     = ntohl(*(const uint32_t*)wire);
+        wire += sizeof(header.seqnum);
+        header.payloadlen = ntohs(*(const uint16_t*)wire);
+        wire += sizeof(header.payloadlen);
+        header.flags      = ntohs(*(const uint16_t*)wire);
+        benchmark::DoNotOptimize(header);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Header_Decode);
+
+
+
+/*
+ * counts a packet and its bytes the way the sender and receiver do, from
+ * every benchmark thread at once
+ */
+static void BM_PerThreadCounters_Add(benchmark::State& state)
+{
+    static PerThreadCounters counters(2);
+
+    for (auto _ : state) {
+        counters.add(0);
+        counters.add(1, FMTP_DATA_LEN);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerThreadCounters_Add)->ThreadRange(1, 8);
+
+
+/* the same with counters shared by the threads, for comparison */
+static void BM_SharedAtomic_Add(benchmark::State& state)
+{
+    static std::atomic<uint64_t> pkts(0);
+    static std::atomic<uint64_t> bytes(0);
+
+    for (auto _ : state) {
+        pkts.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(FMTP_DATA_LEN, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SharedAtomic_Add)->ThreadRange(1, 8);
+
+
+
+/*
+ * logs a per-packet debug record the way the receiver does; records the
+ * writer can't keep up with are dropped, not waited for
+ */
+static void BM_AsyncLog_Write(benchmark::State& state)
+{
+    static AsyncLog log("/dev/null");
+    log.setLevel(LOGLVL_DEBUG);
+    uint32_t        seqnum = 0;
+
+    for (auto _ : state) {
+        if (log.enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "[MCAST DATA] Product #1234: Data block "
+                "received from multicast. SeqNum = ";
+            debugmsg += std::to_string(seqnum);
+            debugmsg += ", Paylen = 1448";
+            log.write(LOGLVL_DEBUG, debugmsg);
+        }
+        seqnum += FMTP_DATA_LEN;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AsyncLog_Write)->ThreadRange(1, 8);
+
+
+/* the same record below the log level */
+static void BM_AsyncLog_Disabled(benchmark::State& state)
+{
+    static AsyncLog log("/dev/null");
+    log.setLevel(LOGLVL_INFO);
+    uint32_t        seqnum = 0;
+
+    for (auto _ : state) {
+        if (log.enabled(LOGLVL_DEBUG)) {
+            std::string debugmsg = "[MCAST DATA] Product #1234: Data block "
+                "received from multicast. SeqNum = ";
+            debugmsg += std::to_string(seqnum);
+            log.write(LOGLVL_DEBUG, debugmsg);
+        }
+        benchmark::DoNotOptimize(seqnum += FMTP_DATA_LEN);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AsyncLog_Disabled);
+
+
+/* the record appended by opening, writing and closing the file, as before */
+static void BM_Ofstream_Append(benchmark::State& state)
+{
+    uint32_t seqnum = 0;
+
+    for (auto _ : state) {
+        std::string debugmsg = "[MCAST DATA] Product #1234: Data block "
+            "received from multicast. SeqNum = ";
+        debugmsg += std::to_string(seqnum);
+        debugmsg += ", Paylen = 1448";
+        std::ofstream logfile("/dev/null",
+                std::ofstream::out | std::ofstream::app);
+        logfile << debugmsg << std::endl;
+        logfile.close();
+        seqnum += FMTP_DATA_LEN;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Ofstream_Append);
+
+
+/* the completion latency a receiver records for every product */
+static void BM_LatencyHistogram_Record(benchmark::State& state)
+{
+    static LatencyHistogram hist;
+    std::minstd_rand        gen;
+    std::exponential_distribution<double> latency(1 / 5e6);
+
+    for (auto _ : state)
+        hist.record(static_cast<uint64_t>(latency(gen)));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LatencyHistogram_Record)->ThreadRange(1, 8);
+
+
+/* an event traced by a sender or receiver with tracing enabled */
+static void BM_ProductTrace_Record(benchmark::State& state)
+{
+    static ProductTrace trace("bench");
+    uint32_t            seqnum = 0;
+
+    for (auto _ : state)
+        trace.record(TRACE_RETX_REQ, 1, seqnum++);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProductTrace_Record)->ThreadRange(1, 8);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,538 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FmtpReplay.cpp
+ *
+ * Trace-driven replay of a feed through FMTPv3 on the loopback interface.
+ * Every line of the trace describes one product: its size, its metadata size,
+ * the time since the previous product in milliseconds and its priority. The
+ * trace is read as it is replayed, so it can be of any length, and "-" reads
+ * it from the standard input. Lines that don't start with a number, such as
+ * a header or comments, are skipped. Each product is sent at its time in the
+ * trace divided by the speed-up factor (-x), so that -x 10 offers ten times
+ * the real load and -x 0.5 half of it; a product whose time has passed while
+ * the sender was busy is sent at once.
+ *
+ * Every product has a buffer of its own, filled with zeros and freed when the
+ * sender releases the product, as a product queue would. The receivers run
+ * as threads of this process. At every report interval (-i), one JSON object
+ * is printed on a line of its own with the products submitted and released
+ * so far, the backlog (products submitted but not yet released) and its
+ * bytes, how far the sender lags behind the trace, the high-water marks of
+ * the backlog bytes and of the resident memory, and the completion latency
+ * (from the call of sendProduct() to the release of the product by the
+ * sender) of the products released during the interval. A final object sums
+ * up the run, with the latency per priority. The protocol itself has no
+ * priorities; they only classify the products in the report.
+ *
+ * Usage: FmtpReplay [-x speedup] [-c receivers] [-r rate] [-i interval]
+ *                   [-C columns] [-n products] [-t timeout] trace
+ *   columns  the 0-based columns of the size, the metadata size, the
+ *            inter-arrival time and the priority, separated by commas, with
+ *            "-" for a column the trace doesn't have (default 0,1,2,3). The
+ *            traces of testSendApp are replayed with -C 0,-,2,-.
+ * The rate is in bits per second (default 500000000). -n stops after that
+ * many products (default: the whole trace). -t is how long to wait in seconds
+ * for the last products to be released (default 60).
+ */
+
+#include "fmtpSendv3.h"
+#include "fmtpRecvv3.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+static const char*          IF_ADDR    = "127.0.0.1";
+static const char*          SEND_GROUP = "239.255.24.1";
+static const unsigned short SEND_PORT  = 5240;
+
+typedef std::chrono::steady_clock Clock;
+
+
+/* nanoseconds on the steady clock */
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+}
+
+
+/* the high-water mark of the resident memory of this process in KiB */
+static long maxRssKb()
+{
+    struct rusage usage;
+    (void)getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+/* one product of the trace */
+struct TraceRecord {
+    uint32_t size;
+    uint16_t metaSize;
+    double   iatMs;     /*!< milliseconds since the previous product */
+    int      priority;
+};
+
+
+/**
+ * Reads the products of a trace one at a time. A column index of -1 means
+ * the trace doesn't have that column, whose value is then 0.
+ */
+class TraceReader {
+public:
+    TraceReader(std::istream& in, const std::vector<int>& columns)
+        : in(in), columns(columns), lineno(0) {}
+
+    /* returns false at the end of the trace */
+    bool next(TraceRecord& rec) {
+        std::string line;
+        while (std::getline(in, line)) {
+            lineno++;
+            const size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || !isdigit(line[first]))
+                continue;
+            std::vector<std::string> fields;
+            std::istringstream       ss(line);
+            std::string              field;
+            while (std::getline(ss, field, ','))
+                fields.push_back(field);
+            rec.size     = column(fields, 0);
+            rec.metaSize = std::min<double>(column(fields, 1),
+                                            MAX_BOP_META_LEN);
+            rec.iatMs    = std::max(0.0, column(fields, 2));
+            rec.priority = column(fields, 3);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    double column(const std::vector<std::string>& fields, const int which) {
+        const int col = columns[which];
+        if (col < 0)
+            return 0;
+        if ((size_t)col >= fields.size())
+            throw std::runtime_error("Line " + std::to_string(lineno) +
+                    " of the trace has no column " + std::to_string(col));
+        return atof(fields[col].c_str());
+    }
+
+    std::istream&          in;
+    const std::vector<int> columns;
+    uint64_t               lineno;
+};
+
+
+/* the p-quantile of sorted values */
+static double quantile(const std::vector<double>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[i ? i - 1 : 0];
+}
+
+
+/* the summary of latencies as a JSON object; sorts them */
+static std::string latencyJson(std::vector<double>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (size_t i = 0; i < latencies.size(); i++)
+        sum += latencies[i];
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\"count\": " << latencies.size()
+         << ", \"mean\": " << (latencies.empty() ? 0 :
+                 sum / latencies.size())
+         << ", \"p50\": " << quantile(latencies, 0.5)
+         << ", \"p90\": " << quantile(latencies, 0.9)
+         << ", \"p99\": " << quantile(latencies, 0.99)
+         << ", \"max\": " << quantile(latencies, 1) << "}";
+    return json.str();
+}
+
+
+/**
+ * Owns the buffers of the products the sender hasn't released yet and
+ * records their completion latencies.
+ */
+class ReplaySendProxy : public SendProxy {
+public:
+    ReplaySendProxy() : submitted(0), released(0), retained(0),
+                        retainedMax(0) {}
+
+    /*
+     * registers a product before it is sent, since it may be released before
+     * sendProduct() returns
+     */
+    void submit(const uint32_t prodIndex, char* const data,
+                const uint32_t size, const int priority) {
+        std::unique_lock<std::mutex> lock(mtx);
+        Product& prod  = inflight[prodIndex];
+        prod.data.reset(data);
+        prod.size      = size;
+        prod.priority  = priority;
+        prod.submitNs  = nowNs();
+        retained      += size;
+        retainedMax    = std::max(retainedMax, retained);
+        submitted++;
+    }
+
+    void notify_of_eop(uint32_t prodIndex) {
+        const int64_t now = nowNs();
+        std::unique_lock<std::mutex> lock(mtx);
+        std::unordered_map<uint32_t, Product>::iterator it =
+            inflight.find(prodIndex);
+        if (it == inflight.end())
+            return;
+        const double latency = (now - it->second.submitNs) / 1000.0;
+        interval.push_back(latency);
+        byPriority[it->second.priority].push_back(latency);
+        retained -= it->second.size;
+        inflight.erase(it);
+        released++;
+    }
+
+    bool verify_new_recv(int /*newsock*/) {return true;}
+
+    /* a snapshot of the counters; takes the latencies of the interval */
+    void sample(uint64_t& nsubmitted, uint64_t& nreleased, uint64_t& bytes,
+                uint64_t& bytesMax, std::vector<double>& latencies) {
+        std::unique_lock<std::mutex> lock(mtx);
+        nsubmitted = submitted;
+        nreleased  = released;
+        bytes      = retained;
+        bytesMax   = retainedMax;
+        latencies.clear();
+        latencies.swap(interval);
+    }
+
+    uint64_t getReleased() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return released;
+    }
+
+    std::map<int, std::vector<double> > getLatencies() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return byPriority;
+    }
+
+private:
+    struct Product {
+        std::unique_ptr<char[]> data;
+        uint32_t                size;
+        int                     priority;
+        int64_t                 submitNs;
+    };
+
+    std::mutex                            mtx;
+    std::unordered_map<uint32_t, Product> inflight;
+    std::vector<double>                   interval;   /*!< microseconds */
+    std::map<int, std::vector<double> >   byPriority; /*!< microseconds */
+    uint64_t                              submitted;
+    uint64_t                              released;
+    uint64_t                              retained;   /*!< bytes */
+    uint64_t                              retainedMax;
+};
+
+
+/* a receiver that stores every product in a buffer of its own */
+class ReplayReceiver : public RecvProxy {
+public:
+    explicit ReplayReceiver(const uint64_t rate)
+        : completed(0), missed(0), rate(rate), receiver(NULL) {}
+
+    ~ReplayReceiver() {
+        stop();
+        delete receiver;
+    }
+
+    void notify_of_bop(const uint32_t prodIndex, size_t prodSize,
+                       void* /*metadata*/, unsigned /*metaSize*/,
+                       void** data) {
+        char* const buf = new char[prodSize ? prodSize : 1];
+        std::unique_lock<std::mutex> lock(mtx);
+        products[prodIndex].reset(buf);
+        *data = buf;
+    }
+
+    void notify_of_eop(uint32_t prodIndex) {
+        std::unique_lock<std::mutex> lock(mtx);
+        products.erase(prodIndex);
+        completed++;
+    }
+
+    void notify_of_missed_prod(uint32_t prodIndex) {
+        std::unique_lock<std::mutex> lock(mtx);
+        products.erase(prodIndex);
+        missed++;
+    }
+
+    void start(const unsigned short tcpPort) {
+        receiver = new fmtpRecvv3(IF_ADDR, tcpPort, SEND_GROUP, SEND_PORT,
+                                  this, IF_ADDR);
+        receiver->SetLinkSpeed(rate);
+        thread = std::thread([this] {
+            try {
+                receiver->Start();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "receiver: " << e.what() << std::endl;
+            }
+        });
+    }
+
+    void stop() {
+        if (thread.joinable()) {
+            receiver->Stop();
+            thread.join();
+        }
+    }
+
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> missed;
+
+private:
+    const uint64_t        rate;
+    fmtpRecvv3*           receiver;
+    std::thread           thread;
+    std::mutex            mtx;
+    std::unordered_map<uint32_t, std::unique_ptr<char[]> > products;
+};
+
+
+/* parses "0,1,2,3" into column indices, "-" being -1 */
+static std::vector<int> parseColumns(const std::string& spec)
+{
+    std::vector<int>   columns;
+    std::istringstream ss(spec);
+    std::string        field;
+    while (std::getline(ss, field, ','))
+        columns.push_back(field == "-" ? -1 : atoi(field.c_str()));
+    if (columns.size() < 3 || columns.size() > 4 || columns[0] < 0 ||
+            columns[2] < 0)
+        throw std::invalid_argument("Invalid columns: " + spec);
+    columns.resize(4, -1);
+    return columns;
+}
+
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [-x speedup] [-c receivers] "
+              "[-r rate] [-i interval] [-C columns] [-n products] "
+              "[-t timeout] trace" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    double      speedup  = 1;
+    int         nrecvs   = 1;
+    uint64_t    rate     = 500000000;
+    double      interval = 1;
+    std::string colSpec  = "0,1,2,3";
+    uint64_t    maxProds = 0;
+    double      timeout  = 60;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "x:c:r:i:C:n:t:")) != -1) {
+        switch (opt) {
+        case 'x': speedup  = atof(optarg); break;
+        case 'c': nrecvs   = atoi(optarg); break;
+        case 'r': rate     = strtoull(optarg, NULL, 0); break;
+        case 'i': interval = atof(optarg); break;
+        case 'C': colSpec  = optarg; break;
+        case 'n': maxProds = strtoull(optarg, NULL, 0); break;
+        case 't': timeout  = atof(optarg); break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1 || speedup <= 0 || nrecvs < 1 || interval <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        const std::string path(argv[optind]);
+        std::ifstream     file;
+        if (path != "-") {
+            file.open(path);
+            if (!file)
+                throw std::runtime_error("Couldn't open " + path);
+        }
+        TraceReader trace(path == "-" ? std::cin : file,
+                          parseColumns(colSpec));
+
+        ReplaySendProxy sendProxy;
+        fmtpSendv3 sender(IF_ADDR, 0, SEND_GROUP, SEND_PORT, &sendProxy, 1,
+                          IF_ADDR, 0, 30.0);
+        sender.SetSendRate(rate);
+        sender.Start();
+
+        std::vector<std::unique_ptr<ReplayReceiver> > recvs;
+        for (int i = 0; i < nrecvs; i++) {
+            recvs.emplace_back(new ReplayReceiver(rate));
+            recvs.back()->start(sender.getTcpPortNum());
+        }
+        const Clock::time_point connectBy = Clock::now() +
+            std::chrono::seconds(10);
+        while (sender.getLossMap().size() < (size_t)nrecvs) {
+            if (Clock::now() > connectBy)
+                throw std::runtime_error("Receivers didn't connect");
+            usleep(10000);
+        }
+
+        const int64_t        start = nowNs();
+        std::atomic<int64_t> lagNs(0);
+        std::atomic<bool>    done(false);
+        std::thread reporter([&] {
+            const int64_t step = interval * 1e9;
+            int64_t       next = start + step;
+            while (!done) {
+                std::this_thread::sleep_for(
+                        std::chrono::nanoseconds(next - nowNs()));
+                next += step;
+                uint64_t submitted, released, bytes, bytesMax;
+                std::vector<double> latencies;
+                sendProxy.sample(submitted, released, bytes, bytesMax,
+                                 latencies);
+                std::ostringstream json;
+                json << std::setprecision(6);
+                json << "{\"t_s\": " << (nowNs() - start) / 1e9
+                     << ", \"submitted\": " << submitted
+                     << ", \"released\": " << released
+                     << ", \"backlog\": " << submitted - released
+                     << ", \"backlog_bytes\": " << bytes
+                     << ", \"lag_s\": " << lagNs / 1e9
+                     << ", \"retained_bytes_hwm\": " << bytesMax
+                     << ", \"rss_hwm_kb\": " << maxRssKb()
+                     << ", \"latency_us\": " << latencyJson(latencies)
+                     << "}";
+                std::cout << json.str() << std::endl;
+            }
+        });
+
+        /* the time of the current product in the compressed trace */
+        double      traceNs = 0;
+        uint64_t    nprods  = 0;
+        uint64_t    bytes   = 0;
+        double      maxLag  = 0;
+        TraceRecord rec;
+        try {
+            while ((maxProds == 0 || nprods < maxProds) && trace.next(rec)) {
+                traceNs += rec.iatMs * 1e6 / speedup;
+                const int64_t due = start + (int64_t)traceNs;
+                const int64_t now = nowNs();
+                if (due > now)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(
+                                due - now));
+                lagNs  = std::max<int64_t>(0, nowNs() - due);
+                maxLag = std::max<double>(maxLag, lagNs);
+
+                char* const data = new char[rec.size ? rec.size : 1]();
+                std::vector<char> metadata(rec.metaSize);
+                sendProxy.submit(sender.getNextProdIndex(), data, rec.size,
+                                 rec.priority);
+                sender.sendProduct(data, rec.size,
+                                   rec.metaSize ? metadata.data() : NULL,
+                                   rec.metaSize);
+                nprods++;
+                bytes += rec.size;
+            }
+        }
+        catch (...) {
+            /* or the reporter's destruction would terminate the process */
+            done = true;
+            reporter.join();
+            throw;
+        }
+        const int64_t sentNs = nowNs();
+
+        const Clock::time_point deadline = Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(timeout));
+        bool timedOut = false;
+        while (sendProxy.getReleased() < nprods) {
+            if (Clock::now() > deadline) {
+                timedOut = true;
+                break;
+            }
+            usleep(1000);
+        }
+        done = true;
+        reporter.join();
+
+        uint64_t completed = 0, missed = 0;
+        for (int i = 0; i < nrecvs; i++) {
+            completed += recvs[i]->completed;
+            missed    += recvs[i]->missed;
+        }
+        uint64_t submitted, released, retained, retainedMax;
+        std::vector<double> unused;
+        sendProxy.sample(submitted, released, retained, retainedMax, unused);
+        std::map<int, std::vector<double> > byPriority =
+            sendProxy.getLatencies();
+        std::vector<double> all;
+        for (std::map<int, std::vector<double> >::iterator it =
+                byPriority.begin(); it != byPriority.end(); ++it)
+            all.insert(all.end(), it->second.begin(), it->second.end());
+
+        std::ostringstream json;
+        json << std::setprecision(6);
+        json << "{\"summary\": {\"speedup\": " << speedup
+             << ", \"receivers\": " << nrecvs << ", \"rate_bps\": " << rate
+             << ", \"timed_out\": " << (timedOut ? "true" : "false")
+             << ", \"products\": " << nprods << ", \"bytes\": " << bytes
+             << ", \"released\": " << released
+             << ", \"completed\": " << completed
+             << ", \"missed\": " << missed
+             << ", \"send_s\": " << (sentNs - start) / 1e9
+             << ", \"offered_bps\": " << (traceNs > 0 ?
+                     bytes * 8e9 / traceNs : 0)
+             << ", \"max_lag_s\": " << maxLag / 1e9
+             << ", \"retained_bytes_hwm\": " << retainedMax
+             << ", \"rss_hwm_kb\": " << maxRssKb()
+             << ", \"latency_us\": " << latencyJson(all)
+             << ", \"latency_us_by_priority\": {";
+        for (std::map<int, std::vector<double> >::iterator it =
+                byPriority.begin(); it != byPriority.end(); ++it)
+            json << (it == byPriority.begin() ? "" : ", ") << "\""
+                 << it->first << "\": " << latencyJson(it->second);
+        json << "}}}";
+        std::cout << json.str() << std::endl;
+
+        for (int i = 0; i < nrecvs; i++)
+            recvs[i]->stop();
+        /* the sender would wait for unreleased products */
+        _exit(timedOut ? 2 : 0);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
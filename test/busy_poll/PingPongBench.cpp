@@ -0,0 +1,192 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: PingPongBench.cpp
+ *
+ * Ping-pong latency benchmark of the FMTPv3 receive modes. Two FMTP sessions
+ * run over loopback in opposite directions: the initiator multicasts a small
+ * product, the responder multicasts it back as soon as its receiver completes
+ * it, and the initiator's receiver times the round trip. The benchmark runs
+ * once with the default blocking receivers and once with receivers in the
+ * busy-poll mode, and prints the round-trip time percentiles of both. The
+ * busy-poll mode only pays off if each receiver has a core to itself, so give
+ * the CPUs to pin the two receivers to on a machine with enough cores.
+ *
+ * Usage: PingPongBench [iterations [prodsize [cpuA cpuB]]]
+ */
+
+#include "fmtpSendv3.h"
+#include "fmtpRecvv3.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static const char*          IF_ADDR   = "127.0.0.1";
+static const char*          PING_ADDR = "239.255.21.1";
+static const char*          PONG_ADDR = "239.255.21.2";
+static const unsigned short BASE_PORT = 5190;
+
+
+/* does nothing, products are acknowledged by the receivers anyway */
+class BenchSendProxy : public SendProxy {
+public:
+    void notify_of_eop(uint32_t /*prodindex*/) {}
+    bool verify_new_recv(int /*newsock*/) {return true;}
+};
+
+
+/**
+ * Receives products into a scratch buffer. The responder's proxy sends every
+ * completed product back; the initiator's proxy records its completion.
+ */
+class BenchRecvProxy : public RecvProxy {
+public:
+    BenchRecvProxy(const size_t prodsize, fmtpSendv3* const reply)
+        : buf(prodsize), reply(reply), completed(0) {}
+    void notify_of_bop(const uint32_t /*prodIndex*/, size_t /*prodSize*/,
+                       void* /*metadata*/, unsigned /*metaSize*/,
+                       void** data) {
+        *data = buf.data();
+    }
+    void notify_of_eop(uint32_t /*prodIndex*/) {
+        if (reply)
+            reply->sendProduct(buf.data(), buf.size());
+        completed.fetch_add(1, std::memory_order_release);
+    }
+    void notify_of_missed_prod(uint32_t /*prodIndex*/) {}
+
+    std::vector<char>     buf;
+    fmtpSendv3* const     reply;
+    std::atomic<uint32_t> completed;
+};
+
+
+/* runs a receiver until it's stopped */
+static void runReceiver(fmtpRecvv3* const receiver)
+{
+    try {
+        receiver->Start();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "receiver: " << e.what() << std::endl;
+    }
+}
+
+
+/**
+ * Runs the ping-pong in one receive mode.
+ *
+ * @param[in] mode        Index of the mode, selects the ports.
+ * @param[in] busypoll    Whether the receivers busy-poll.
+ * @param[in] iterations  Number of round trips.
+ * @param[in] prodsize    Product size in bytes.
+ * @param[in] cpuA        CPU of the initiator's receiver in busy-poll mode.
+ * @param[in] cpuB        CPU of the responder's receiver in busy-poll mode.
+ * @return                Round-trip times in microseconds.
+ */
+static std::vector<double> pingPong(const int mode, const bool busypoll,
+                                    const int iterations,
+                                    const size_t prodsize, const int cpuA,
+                                    const int cpuB)
+{
+    const unsigned short pingPort = BASE_PORT + 2 * mode;
+    const unsigned short pongPort = pingPort + 1;
+    BenchSendProxy sendProxy;
+
+    fmtpSendv3 ping(IF_ADDR, 0, PING_ADDR, pingPort, &sendProxy, 1, IF_ADDR,
+                    0, 30.0);
+    fmtpSendv3 pong(IF_ADDR, 0, PONG_ADDR, pongPort, &sendProxy, 1, IF_ADDR,
+                    0, 30.0);
+    ping.Start();
+    pong.Start();
+
+    BenchRecvProxy responder(prodsize, &pong);
+    BenchRecvProxy initiator(prodsize, NULL);
+    fmtpRecvv3 recvB(IF_ADDR, ping.getTcpPortNum(), PING_ADDR, pingPort,
+                     &responder, IF_ADDR);
+    fmtpRecvv3 recvA(IF_ADDR, pong.getTcpPortNum(), PONG_ADDR, pongPort,
+                     &initiator, IF_ADDR);
+    if (busypoll) {
+        recvB.SetBusyPoll(cpuB);
+        recvA.SetBusyPoll(cpuA);
+    }
+    std::thread threadB(runReceiver, &recvB);
+    std::thread threadA(runReceiver, &recvA);
+    sleep(1);
+
+    std::vector<char>   prod(prodsize);
+    std::vector<double> rtts;
+    for (int i = 0; i < iterations; i++) {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        ping.sendProduct(prod.data(), prod.size());
+        while (initiator.completed.load(std::memory_order_acquire) <=
+                (uint32_t)i) {
+            if (std::chrono::steady_clock::now() - start >
+                    std::chrono::seconds(1))
+                throw std::runtime_error("pingPong() round trip timed out");
+        }
+        rtts.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+
+    recvA.Stop();
+    recvB.Stop();
+    threadA.join();
+    threadB.join();
+    ping.Stop();
+    pong.Stop();
+    return rtts;
+}
+
+
+/* prints the percentiles of the round-trip times of a mode */
+static void report(const std::string& mode, std::vector<double> rtts)
+{
+    std::sort(rtts.begin(), rtts.end());
+    const size_t n = rtts.size();
+    std::cout << mode << " min " << rtts[0] << " p50 " << rtts[n / 2]
+              << " p90 " << rtts[n * 9 / 10] << " p99 " << rtts[n * 99 / 100]
+              << " max " << rtts[n - 1] << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    const int    iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    const size_t prodsize   = argc > 2 ? atoi(argv[2]) : 100;
+    const int    cpuA       = argc > 4 ? atoi(argv[3]) : -1;
+    const int    cpuB       = argc > 4 ? atoi(argv[4]) : -1;
+
+    if (iterations <= 0 || prodsize == 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [iterations [prodsize [cpuA cpuB]]]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "# " << iterations << " round trips of " << prodsize
+              << "-byte products, times in microseconds" << std::endl;
+    try {
+        report("blocking ", pingPong(0, false, iterations, prodsize, cpuA,
+                                     cpuB));
+        report("busy-poll", pingPong(1, true, iterations, prodsize, cpuA,
+                                     cpuB));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        _exit(1);
+    }
+    /* the senders would wait for receivers that are gone */
+    _exit(0);
+}
@@ -0,0 +1,187 @@
+#!/bin/bash
+#
+# Copyright 2015 University Corporation for Atmospheric Research. All rights
+# reserved. See the the file COPYRIGHT in the top-level source-directory for
+# licensing conditions.
+#
+# Multi-receiver scale test of FMTPv3 over the kernel's network stack. One
+# sender and N receivers run as FmtpBench processes, each in a network
+# namespace of its own, joined by veth pairs to a bridge in another
+# namespace. The host's own namespace is left alone. Every receiver's link
+# can be impaired with tc netem (delay, loss, rate, ...), which is applied
+# to the bridge side of its veth pair and therefore to everything the
+# receiver gets from the sender: multicast and retransmissions alike. The
+# receivers join the group with IP_ADD_MEMBERSHIP on their own interface, so
+# the multicast path and TCP's behavior on the unicast channel are the real
+# ones.
+#
+# The JSON object printed by every process is kept in the output directory
+# (sender.json, recv-I.json) and combined into results.json. Must run as
+# root. Exits with 0, or 1 if the sender or a receiver failed or timed out.
+#
+# Usage: netns_scale.sh [-c receivers] [-n products] [-s size] [-r rate]
+#                       [-f spec] [-t timeout] [-e netem] [-E I:netem]...
+#                       [-b bench] [-o dir] [-k]
+#   -e  netem arguments of every receiver's link, e.g.
+#       "delay 20ms 2ms loss 0.5% rate 200mbit" (default: none)
+#   -E  netem arguments of the link of receiver I (1..N) instead
+#   -b  path of FmtpBench (default: ../benchmark/FmtpBench next to this script)
+#   -o  output directory (default: netns-results)
+#   -k  keep the namespaces afterwards; the next run removes them
+# -n, -s, -r, -f and -t are passed to FmtpBench.
+
+set -u
+
+NRECVS=4
+NPRODS=1000
+SIZE=fixed:100000
+RATE=500000000
+FAULTS=
+TIMEOUT=120
+NETEM=
+BENCH=$(dirname "$0")/../benchmark/FmtpBench
+OUTDIR=netns-results
+KEEP=0
+declare -A RECV_NETEM
+
+PREFIX=fmtp
+SUBNET=10.77
+PORT=38800
+
+usage() {
+    sed -n '/^# Usage:/,/^# -n, -s/s/^# \{0,1\}//p' "$0" >&2
+    exit 1
+}
+
+while getopts c:n:s:r:f:t:e:E:b:o:k opt; do
+    case $opt in
+    c) NRECVS=$OPTARG;;
+    n) NPRODS=$OPTARG;;
+    s) SIZE=$OPTARG;;
+    r) RATE=$OPTARG;;
+    f) FAULTS=$OPTARG;;
+    t) TIMEOUT=$OPTARG;;
+    e) NETEM=$OPTARG;;
+    E) RECV_NETEM[${OPTARG%%:*}]=${OPTARG#*:};;
+    b) BENCH=$OPTARG;;
+    o) OUTDIR=$OPTARG;;
+    k) KEEP=1;;
+    *) usage;;
+    esac
+done
+if [ $# -ge $OPTIND ] || [ "$NRECVS" -lt 1 ] || [ "$NRECVS" -gt 250 ]; then
+    usage
+fi
+if [ "$(id -u)" -ne 0 ]; then
+    echo "$0: must run as root" >&2
+    exit 1
+fi
+if [ ! -x "$BENCH" ]; then
+    echo "$0: $BENCH not found; build it with make" >&2
+    exit 1
+fi
+BENCH=$(cd "$(dirname "$BENCH")" && pwd)/$(basename "$BENCH")
+
+# Receiver I is at $SUBNET.0.(I+1), the sender at $SUBNET.0.1
+addr() {
+    echo $SUBNET.0.$(($1 + 1))
+}
+
+cleanup() {
+    local ns
+    for ns in $(ip netns list | awk '{print $1}' | grep "^$PREFIX-"); do
+        ip netns pids "$ns" 2>/dev/null | xargs -r kill -9 2>/dev/null
+        ip netns delete "$ns"
+    done
+}
+
+# Adds namespace $1 with interface eth0 at address $2, attached to the bridge
+# by a veth pair whose bridge side is $3
+add_host() {
+    ip netns add "$1"
+    ip link add eth0 netns "$1" type veth peer name "$3" netns $PREFIX-br
+    ip -n "$1" addr add "$2/16" dev eth0
+    ip -n "$1" link set lo up
+    ip -n "$1" link set eth0 up
+    ip -n "$1" route add 224.0.0.0/4 dev eth0
+    ip -n $PREFIX-br link set "$3" master br0 up
+}
+
+setup() {
+    local i netem
+
+    ip netns add $PREFIX-br
+    ip -n $PREFIX-br link add br0 type bridge
+    # without a querier, snooping would stop forwarding the group
+    ip -n $PREFIX-br link set br0 type bridge mcast_snooping 0
+    ip -n $PREFIX-br link set br0 up
+
+    add_host $PREFIX-s "$(addr 0)" veth-s
+    for i in $(seq 1 "$NRECVS"); do
+        add_host $PREFIX-r$i "$(addr "$i")" veth-r$i
+        netem=${RECV_NETEM[$i]:-$NETEM}
+        if [ -n "$netem" ]; then
+            # shellcheck disable=SC2086
+            ip netns exec $PREFIX-br tc qdisc add dev veth-r$i root netem \
+                $netem || return 1
+        fi
+    done
+}
+
+# Prints the JSON objects of the run as one
+combine() {
+    local i
+
+    echo "{"
+    echo "\"sender\": $(cat "$OUTDIR/sender.json" 2>/dev/null || echo null),"
+    echo "\"receivers\": ["
+    for i in $(seq 1 "$NRECVS"); do
+        [ "$i" -gt 1 ] && echo ","
+        echo "{\"index\": $i, \"netem\": \"${RECV_NETEM[$i]:-$NETEM}\","
+        echo "\"result\": $(cat "$OUTDIR/recv-$i.json" 2>/dev/null ||
+                           echo null)}"
+    done
+    echo "]"
+    echo "}"
+}
+
+cleanup
+trap cleanup EXIT
+[ $KEEP -eq 1 ] && trap - EXIT
+setup || exit 1
+mkdir -p "$OUTDIR"
+rm -f "$OUTDIR"/*.json
+
+BENCH_ARGS=(-n "$NPRODS" -s "$SIZE" -r "$RATE" -t "$TIMEOUT")
+SEND_ARGS=("${BENCH_ARGS[@]}" -c "$NRECVS" -a "$(addr 0)" -x $PORT)
+[ -n "$FAULTS" ] && SEND_ARGS+=(-f "$FAULTS")
+
+ip netns exec $PREFIX-s "$BENCH" "${SEND_ARGS[@]}" \
+    >"$OUTDIR/sender.json" 2>"$OUTDIR/sender.err" &
+SENDER=$!
+sleep 1
+
+RECVS=()
+for i in $(seq 1 "$NRECVS"); do
+    ip netns exec $PREFIX-r$i "$BENCH" "${BENCH_ARGS[@]}" -a "$(addr "$i")" \
+        -R "$(addr 0):$PORT" \
+        >"$OUTDIR/recv-$i.json" 2>"$OUTDIR/recv-$i.err" &
+    RECVS+=($!)
+done
+
+status=0
+wait $SENDER || status=1
+# The receivers stay connected until their timeout; their results are out
+for i in $(seq 1 "$NRECVS"); do
+    while kill -0 "${RECVS[$((i - 1))]}" 2>/dev/null &&
+            ! grep -q '^}' "$OUTDIR/recv-$i.json"; do
+        sleep 0.1
+    done
+    grep -q '"timed_out": false' "$OUTDIR/recv-$i.json" || status=1
+    kill "${RECVS[$((i - 1))]}" 2>/dev/null
+done
+wait
+
+combine >"$OUTDIR/results.json"
+echo "Results in $OUTDIR/results.json" >&2
+exit $status
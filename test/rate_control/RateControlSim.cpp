@@ -0,0 +1,220 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: RateControlSim.cpp
+ *
+ * Loopback simulation of the FMTPv3 multicast rate controller. A sender
+ * multicasts products to one group, a relay forwards them to a second group
+ * through a bottleneck, and a receiver listens on the second group. The
+ * bottleneck is a token bucket that drops whatever exceeds its capacity and,
+ * optionally, a random fraction of the packets. The program prints the
+ * sending rate over time, which should climb to the capacity and then
+ * oscillate around it. Random loss above the controller's threshold (1% by
+ * default) drives the rate down to the floor, as with any loss-based AIMD.
+ *
+ * Usage: RateControlSim [capacity_bps [seconds [loss]]]
+ */
+
+#include "fmtpSendv3.h"
+#include "fmtpRecvv3.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+static const char*          IF_ADDR    = "127.0.0.1";
+static const char*          SEND_GROUP = "239.255.20.1";
+static const unsigned short SEND_PORT  = 5180;
+static const char*          RECV_GROUP = "239.255.20.2";
+static const unsigned short RECV_PORT  = 5181;
+static const uint32_t       PROD_SIZE  = 1000000;
+
+
+/* gives every product the same scratch buffer, the content doesn't matter */
+class SimRecvProxy : public RecvProxy {
+public:
+    SimRecvProxy() : buf(PROD_SIZE), completed(0) {}
+    void notify_of_bop(const uint32_t /*prodIndex*/, size_t /*prodSize*/,
+                       void* /*metadata*/, unsigned /*metaSize*/,
+                       void** data) {
+        *data = buf.data();
+    }
+    void notify_of_eop(uint32_t /*prodIndex*/) {completed++;}
+    void notify_of_missed_prod(uint32_t /*prodIndex*/) {}
+
+    std::vector<char>     buf;
+    std::atomic<uint32_t> completed;
+};
+
+
+/* forwards datagrams from the sender's group to the receiver's group */
+class Bottleneck {
+public:
+    Bottleneck(double capacity, double loss)
+        : capacity(capacity), loss(loss), offered(0), forwarded(0),
+          dropped(0), stop(false) {}
+
+    void run() {
+        int in = socket(AF_INET, SOCK_DGRAM, 0);
+        int out = socket(AF_INET, SOCK_DGRAM, 0);
+        if (in < 0 || out < 0)
+            throw std::runtime_error("Bottleneck::run() socket() failed");
+
+        struct sockaddr_in addr = {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SEND_PORT);
+        addr.sin_addr.s_addr = inet_addr(SEND_GROUP);
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(SEND_GROUP);
+        mreq.imr_interface.s_addr = inet_addr(IF_ADDR);
+        int rcvbuf = 4 * 1024 * 1024;
+        struct timeval timeout = {0, 100000};
+        if (bind(in, (struct sockaddr*)&addr, sizeof(addr)) ||
+                setsockopt(in, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                           sizeof(mreq)) ||
+                setsockopt(in, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                           sizeof(rcvbuf)) ||
+                setsockopt(in, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout)))
+            throw std::runtime_error("Bottleneck::run() couldn't join group");
+
+        struct in_addr ifaddr;
+        ifaddr.s_addr = inet_addr(IF_ADDR);
+        if (setsockopt(out, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr,
+                       sizeof(ifaddr)))
+            throw std::runtime_error("Bottleneck::run() IP_MULTICAST_IF "
+                    "failed");
+        struct sockaddr_in dest = {};
+        dest.sin_family      = AF_INET;
+        dest.sin_port        = htons(RECV_PORT);
+        dest.sin_addr.s_addr = inet_addr(RECV_GROUP);
+
+        std::minstd_rand                       gen(1);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        const double depth  = 64 * 1024; // bucket depth in bytes
+        double       tokens = depth;
+        std::chrono::steady_clock::time_point last =
+            std::chrono::steady_clock::now();
+        char buf[MAX_FMTP_PACKET_LEN];
+
+        while (!stop) {
+            ssize_t nbytes = recv(in, buf, sizeof(buf), 0);
+            if (nbytes <= 0)
+                continue;
+            offered += nbytes;
+            std::chrono::steady_clock::time_point now =
+                std::chrono::steady_clock::now();
+            tokens = std::min(depth, tokens + capacity / 8 *
+                    std::chrono::duration<double>(now - last).count());
+            last = now;
+            if (tokens < nbytes || uniform(gen) < loss) {
+                dropped++;
+                continue;
+            }
+            tokens -= nbytes;
+            (void)sendto(out, buf, nbytes, 0, (struct sockaddr*)&dest,
+                         sizeof(dest));
+            forwarded += nbytes;
+        }
+        close(in);
+        close(out);
+    }
+
+    const double          capacity;
+    const double          loss;
+    std::atomic<uint64_t> offered;
+    std::atomic<uint64_t> forwarded;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool>     stop;
+};
+
+
+int main(int argc, char** argv)
+{
+    const double capacity = argc > 1 ? atof(argv[1]) : 100e6;
+    const int    seconds  = argc > 2 ? atoi(argv[2]) : 20;
+    const double loss     = argc > 3 ? atof(argv[3]) : 0;
+    const uint64_t floor   = capacity / 10;
+    const uint64_t ceiling = capacity * 4;
+
+    Bottleneck bottleneck(capacity, loss);
+    std::thread relay(&Bottleneck::run, &bottleneck);
+
+    fmtpSendv3 sender(IF_ADDR, 0, SEND_GROUP, SEND_PORT, NULL, 1, IF_ADDR, 0,
+                      30.0);
+    sender.SetRateControl(floor, ceiling, 0.1);
+    sender.Start();
+
+    SimRecvProxy recvProxy;
+    fmtpRecvv3   receiver(IF_ADDR, sender.getTcpPortNum(), RECV_GROUP,
+                          RECV_PORT, &recvProxy, IF_ADDR);
+    receiver.SetStatsInterval(0.1);
+    std::thread recv([&receiver] {
+        try {
+            receiver.Start();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "receiver: " << e.what() << std::endl;
+        }
+    });
+    sleep(1);
+
+    std::vector<char>  prod(PROD_SIZE);
+    std::atomic<bool>  done(false);
+    std::thread send([&] {
+        while (!done)
+            sender.sendProduct(prod.data(), prod.size());
+    });
+
+    std::cout << "# capacity " << capacity / 1e6 << " Mbps, random loss "
+              << loss << ", rate range " << floor / 1e6 << "-"
+              << ceiling / 1e6 << " Mbps" << std::endl;
+    std::cout << "# time(s) rate(Mbps) offered(Mbps) forwarded(Mbps) "
+                 "dropped loss" << std::endl;
+    double   sum = 0;
+    int      n = 0;
+    uint64_t lastoff = 0;
+    uint64_t lastfwd = 0;
+    for (int i = 1; i <= 2 * seconds; i++) {
+        usleep(500000);
+        const uint64_t off  = bottleneck.offered;
+        const uint64_t fwd  = bottleneck.forwarded;
+        const double   rate = sender.getSendRate();
+        const std::vector<ReceiverStats> stats = sender.getLossMap();
+        std::cout << i / 2.0 << " " << rate / 1e6 << " "
+                  << (off - lastoff) * 16 / 1e6 << " "
+                  << (fwd - lastfwd) * 16 / 1e6 << " " << bottleneck.dropped
+                  << " " << (stats.empty() ? 0 : stats[0].lossrate)
+                  << std::endl;
+        if (i > seconds) {
+            sum += (off - lastoff) * 16.0;
+            n++;
+        }
+        lastoff = off;
+        lastfwd = fwd;
+    }
+    std::cout << "# mean offered rate over the second half: " << sum / n / 1e6
+              << " Mbps (" << 100 * sum / n / capacity << "% of capacity), "
+              << recvProxy.completed << " products completed" << std::endl;
+
+    done = true;
+    send.join();
+    receiver.Stop();
+    recv.join();
+    bottleneck.stop = true;
+    relay.join();
+    sender.Stop();
+    _exit(0);
+}
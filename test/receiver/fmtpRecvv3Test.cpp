@@ -0,0 +1,465 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpRecvv3Test.cpp
+ *
+ * This file tests class `fmtpRecvv3` against a scripted sender on a
+ * simulated network.
+ */
+
+#include "fmtpRecvEngine.h"
+#include "fmtpRecvv3.h"
+#include "SimNetwork.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char           GROUP[]  = "239.0.0.2";
+const unsigned short PORT     = 5174;
+const uint16_t       PRODSIZE = 1000;
+const uint32_t       MAXSIZE  = 4 * FMTP_DATA_LEN;
+const char           DATA     = 0x5a;
+const char           POISON   = (char)0xee;
+
+/* Reuses a product as soon as it's complete, like a receiving application. */
+class Proxy : public RecvProxy
+{
+public:
+    Proxy()
+        : product(PRODSIZE), received(), metadata(), onEop(), mutex(),
+          cond(), size(0), bops(0), completed(0) {}
+
+    void notify_of_bop(const uint32_t /*iProd*/, size_t prodSize,
+                       void* metadata, unsigned metaSize, void** data)
+    {
+        if (product.size() < prodSize)
+            product.resize(prodSize);
+        size  = prodSize;
+        *data = product.data();
+        std::unique_lock<std::mutex> lock(mutex);
+        this->metadata.assign((char*)metadata, (char*)metadata + metaSize);
+        ++bops;
+        cond.notify_all();
+    }
+    void notify_of_eop(uint32_t /*iProd*/)
+    {
+        received.assign(product.begin(), product.begin() + size);
+        (void)memset(product.data(), POISON, product.size());
+        if (onEop)
+            onEop();
+        std::unique_lock<std::mutex> lock(mutex);
+        ++completed;
+        cond.notify_all();
+    }
+    void notify_of_missed_prod(uint32_t /*prodIndex*/) {}
+    bool waitBops(const unsigned count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, std::chrono::seconds(10),
+                             [this, count] {return bops >= count;});
+    }
+    bool waitCompleted(const unsigned count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, std::chrono::seconds(10),
+                             [this, count] {return completed >= count;});
+    }
+
+    std::vector<char>     product;
+    /* the last product as it was completed */
+    std::vector<char>     received;
+    /* the metadata of the last product whose BOP was notified */
+    std::vector<char>     metadata;
+    /* called once the product has been reused */
+    std::function<void()> onEop;
+
+private:
+    std::mutex              mutex;
+    std::condition_variable cond;
+    size_t                  size;
+    unsigned                bops;
+    unsigned                completed;
+};
+
+// The fixture for testing class fmtpRecvv3.
+class fmtpRecvv3Test : public ::testing::Test {
+ protected:
+  fmtpRecvv3Test()
+      : network(),
+        listenSock(listenLoopback()),
+        proxy(),
+        receiver("127.0.0.1", portOf(listenSock), GROUP, PORT, &proxy,
+                 "127.0.0.1"),
+        receiving(),
+        sock(-1),
+        mcastSock(network.openMcastSend(GROUP, PORT, 1, "127.0.0.1")) {
+    receiver.SetTransport(network);
+  }
+
+  ~fmtpRecvv3Test() {
+    if (receiving.joinable()) {
+      receiver.Stop();
+      receiving.join();
+    }
+    (void)close(sock);
+    (void)close(listenSock);
+    (void)close(mcastSock);
+  }
+
+  static int listenLoopback() {
+    struct sockaddr_in addr;
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+            listen(sock, 1))
+        throw std::runtime_error("Couldn't listen on the loopback interface");
+    return sock;
+  }
+
+  static unsigned short portOf(const int sock) {
+    struct sockaddr_in addr;
+    socklen_t          len = sizeof(addr);
+    (void)getsockname(sock, (struct sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+  }
+
+  // Starts the receiver and waits until it has joined the group.
+  void startReceiver() {
+    receiving = std::thread([this] {
+        try {
+            receiver.Start();
+        }
+        catch (const std::exception& e) {
+            ADD_FAILURE() << e.what();
+        }
+    });
+    sock = accept(listenSock, NULL, NULL);
+    ASSERT_GE(sock, 0);
+    while (network.receiverCount() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Multicasts a packet.
+  void multicast(const uint32_t prodindex, const uint32_t seqnum,
+                 const uint16_t flags, const void* payload,
+                 const uint16_t payloadlen) {
+    std::vector<char> packet(FMTP_HEADER_LEN + payloadlen);
+    encode(packet.data(), prodindex, seqnum, flags, payloadlen);
+    (void)memcpy(packet.data() + FMTP_HEADER_LEN, payload, payloadlen);
+    ASSERT_EQ((ssize_t)packet.size(),
+              send(mcastSock, packet.data(), packet.size(), 0));
+  }
+
+  // Multicasts a packet that ends with a sender timestamp.
+  void multicastStamped(const uint32_t prodindex, const uint32_t seqnum,
+                        const uint16_t flags, const void* payload,
+                        const uint16_t payloadlen, const uint64_t sent) {
+    std::vector<char> stamped(payloadlen + TIMESTAMP_LEN);
+    const uint64_t    stamp = htobe64(sent);
+    (void)memcpy(stamped.data(), payload, payloadlen);
+    (void)memcpy(stamped.data() + payloadlen, &stamp, sizeof(stamp));
+    multicast(prodindex, seqnum, flags | FMTP_TIMESTAMPED, stamped.data(),
+              stamped.size());
+  }
+
+  // Multicasts the BOP of a product without metadata.
+  void multicastBOP(const uint32_t prodindex, const uint32_t prodsize) {
+    char bop[6];
+    const uint32_t size = htonl(prodsize);
+    (void)memcpy(bop, &size, sizeof(size));
+    (void)memset(bop + sizeof(size), 0, 2);
+    multicast(prodindex, 0, FMTP_BOP, bop, sizeof(bop));
+  }
+
+  // Multicasts a self-describing data block.
+  void multicastExt(const uint32_t prodindex, const uint32_t seqnum,
+                    const uint32_t prodsize, const void* data,
+                    const uint16_t datalen) {
+    std::vector<char> payload(DATA_EXT_LEN + datalen);
+    DataExt ext;
+    ext.prodsize   = htonl(prodsize);
+    ext.metadigest = 0;
+    (void)memcpy(payload.data(), &ext, DATA_EXT_LEN);
+    (void)memcpy(payload.data() + DATA_EXT_LEN, data, datalen);
+    multicast(prodindex, seqnum, FMTP_MEM_DATA_EXT, payload.data(),
+              payload.size());
+  }
+
+  // Sends the BOP of a product without metadata over TCP.
+  void unicastBOP(const uint32_t prodindex, const uint32_t prodsize) {
+    char bop[6];
+    const uint32_t size = htonl(prodsize);
+    (void)memcpy(bop, &size, sizeof(size));
+    (void)memset(bop + sizeof(size), 0, 2);
+    unicast(prodindex, 0, FMTP_RETX_BOP, bop, sizeof(bop));
+  }
+
+  // Returns whether a request arrives within a timeout.
+  bool awaitRequest(const int timeout) {
+    struct pollfd pfd;
+    pfd.fd     = sock;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, timeout) == 1;
+  }
+
+  // Receives the next request of the receiver.
+  FmtpHeader recvRequest() {
+    FmtpHeader header;
+    if (recv(sock, &header, sizeof(header), MSG_WAITALL) !=
+            (ssize_t)sizeof(header))
+        throw std::runtime_error("Couldn't receive request");
+    header.prodindex  = ntohl(header.prodindex);
+    header.seqnum     = ntohl(header.seqnum);
+    header.payloadlen = ntohs(header.payloadlen);
+    header.flags      = ntohs(header.flags);
+    return header;
+  }
+
+  // Sends a message to the receiver.
+  void unicast(const uint32_t prodindex, const uint32_t seqnum,
+               const uint16_t flags, const void* payload,
+               const uint16_t payloadlen) {
+    std::vector<char> packet(FMTP_HEADER_LEN + payloadlen);
+    encode(packet.data(), prodindex, seqnum, flags, payloadlen);
+    (void)memcpy(packet.data() + FMTP_HEADER_LEN, payload, payloadlen);
+    ASSERT_EQ((ssize_t)packet.size(),
+              send(sock, packet.data(), packet.size(), 0));
+  }
+
+  static void encode(char* const buf, const uint32_t prodindex,
+                     const uint32_t seqnum, const uint16_t flags,
+                     const uint16_t payloadlen) {
+    FmtpHeader header;
+    header.prodindex  = htonl(prodindex);
+    header.seqnum     = htonl(seqnum);
+    header.payloadlen = htons(payloadlen);
+    header.flags      = htons(flags);
+    (void)memcpy(buf, &header, FMTP_HEADER_LEN);
+  }
+
+  SimNetwork  network;
+  int         listenSock;
+  Proxy       proxy;
+  fmtpRecvv3  receiver;
+  std::thread receiving;
+  int         sock;
+  int         mcastSock;
+};
+
+// A multicast packet that arrives after the product was completed through
+// retransmissions isn't written to the product the application got back.
+TEST_F(fmtpRecvv3Test, LateMulticastAfterRetxCompletion) {
+    std::vector<char> data(PRODSIZE, DATA);
+    startReceiver();
+
+    multicastBOP(0, PRODSIZE);
+    multicast(0, 0, FMTP_EOP, NULL, 0);  // the data block is lost
+    FmtpHeader request;
+    do {
+        request = recvRequest();
+    } while (request.flags != FMTP_RETX_REQ);
+    EXPECT_EQ(0U, request.prodindex);
+
+    proxy.onEop = [this, &data] {
+        // a duplicate of the lost block arrives late
+        multicast(0, 0, FMTP_MEM_DATA, data.data(), PRODSIZE);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    };
+    unicast(0, 0, FMTP_RETX_DATA, data.data(), PRODSIZE);
+    ASSERT_TRUE(proxy.waitCompleted(1));
+
+    unsigned written = 0;
+    for (size_t i = 0; i < proxy.product.size(); i++)
+        if (proxy.product[i] != POISON)
+            ++written;
+    EXPECT_EQ(0U, written);
+}
+
+// A retransmitted BOP that doesn't match a staged product discards the
+// staged data, so the whole product is requested again.
+TEST_F(fmtpRecvv3Test, MismatchedBOPOfStagedProduct) {
+    const uint32_t    prodsize = 3 * FMTP_DATA_LEN;
+    std::vector<char> data(prodsize);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char)(i % 251);
+    receiver.SetLinkSpeed(12000);  // the timer waits for over 3 s
+    startReceiver();
+
+    // the first block of what the receiver stages as a 2-block product
+    multicastExt(0, 0, 2 * FMTP_DATA_LEN, data.data(), FMTP_DATA_LEN);
+    FmtpHeader request;
+    do {
+        request = recvRequest();
+    } while (request.flags != FMTP_BOP_REQ);
+    EXPECT_EQ(0U, request.prodindex);
+    unicastBOP(0, prodsize);
+
+    // the receiver must ask for the data and EOP of the actual product
+    bool eop = false;
+    while (!eop) {
+        ASSERT_TRUE(awaitRequest(2000));
+        request = recvRequest();
+        ASSERT_EQ(0U, request.prodindex);
+        if (request.flags == FMTP_RETX_REQ) {
+            for (uint32_t off = request.seqnum;
+                    off < request.seqnum + request.payloadlen;
+                    off += FMTP_DATA_LEN) {
+                const uint16_t len = std::min<uint32_t>(FMTP_DATA_LEN,
+                                                        prodsize - off);
+                unicast(0, off, FMTP_RETX_DATA, data.data() + off, len);
+            }
+        }
+        else if (request.flags == FMTP_EOP_REQ) {
+            unicast(0, 0, FMTP_RETX_EOP, NULL, 0);
+            eop = true;
+        }
+    }
+    ASSERT_TRUE(proxy.waitCompleted(1));
+    EXPECT_TRUE(proxy.received == data);
+}
+
+// Metadata that spans BOP continuations is requested again when a
+// continuation is lost, and the retransmitted BOP carries all of it.
+TEST_F(fmtpRecvv3Test, LostBOPContinuation) {
+    const uint16_t    metasize = AVAIL_BOP_LEN + 2 * FMTP_DATA_LEN + 100;
+    std::vector<char> metadata(metasize);
+    for (size_t i = 0; i < metadata.size(); i++)
+        metadata[i] = (char)(i % 253);
+    std::vector<char> data(PRODSIZE, DATA);
+    startReceiver();
+
+    std::vector<char> bop(sizeof(uint32_t) + sizeof(uint16_t) + metasize);
+    const uint32_t    size = htonl(PRODSIZE);
+    const uint16_t    meta = htons(metasize);
+    (void)memcpy(bop.data(), &size, sizeof(size));
+    (void)memcpy(bop.data() + sizeof(size), &meta, sizeof(meta));
+    (void)memcpy(bop.data() + sizeof(size) + sizeof(meta), metadata.data(),
+                 metasize);
+    multicast(0, 0, FMTP_BOP, bop.data(), FMTP_DATA_LEN);
+    // the continuation at AVAIL_BOP_LEN is lost
+    const uint32_t off = AVAIL_BOP_LEN + FMTP_DATA_LEN;
+    multicast(0, off, FMTP_BOP_CONT, metadata.data() + off, FMTP_DATA_LEN);
+
+    FmtpHeader request;
+    do {
+        request = recvRequest();
+    } while (request.flags != FMTP_BOP_REQ);
+    EXPECT_EQ(0U, request.prodindex);
+    unicast(0, 0, FMTP_RETX_BOP, bop.data(), bop.size());
+    ASSERT_TRUE(proxy.waitBops(1));
+    // the product is tracked once its EOP is requested
+    do {
+        request = recvRequest();
+    } while (request.flags != FMTP_EOP_REQ);
+
+    multicast(0, 0, FMTP_MEM_DATA, data.data(), PRODSIZE);
+    multicast(0, 0, FMTP_EOP, NULL, 0);
+    ASSERT_TRUE(proxy.waitCompleted(1));
+    EXPECT_TRUE(proxy.metadata == metadata);
+    EXPECT_TRUE(proxy.received == data);
+}
+
+// The sender timestamp that ends a timestamped packet isn't part of the
+// product, and the product's end-to-end latency is measured from it.
+TEST_F(fmtpRecvv3Test, TimestampedPackets) {
+    std::vector<char> data(PRODSIZE, DATA);
+    char              bop[6];
+    const uint32_t    size = htonl(PRODSIZE);
+    (void)memcpy(bop, &size, sizeof(size));
+    (void)memset(bop + sizeof(size), 0, 2);
+    startReceiver();
+
+    const uint64_t sent = wallClockNs();
+    multicastStamped(0, 0, FMTP_BOP, bop, sizeof(bop), sent);
+    multicastStamped(0, 0, FMTP_MEM_DATA, data.data(), PRODSIZE, sent);
+    multicastStamped(0, 0, FMTP_EOP, NULL, 0, sent);
+    ASSERT_TRUE(proxy.waitCompleted(1));
+    EXPECT_TRUE(proxy.received == data);
+
+    const HistogramSnapshot endToEnd = receiver.getLatency(LATENCY_END_TO_END);
+    EXPECT_EQ(1U, endToEnd.getCount());
+    EXPECT_LE(endToEnd.getMax(), wallClockNs() - sent);
+}
+
+// Packets without a timestamp are taken whole, even if they end with bytes
+// that could be one, and don't feed the end-to-end latency.
+TEST_F(fmtpRecvv3Test, UntimestampedPackets) {
+    std::vector<char> data(PRODSIZE, DATA);
+    const uint64_t    stamp = htobe64(wallClockNs());
+    (void)memcpy(data.data() + PRODSIZE - TIMESTAMP_LEN, &stamp,
+                 sizeof(stamp));
+    startReceiver();
+
+    multicastBOP(0, PRODSIZE);
+    multicast(0, 0, FMTP_MEM_DATA, data.data(), PRODSIZE);
+    multicast(0, 0, FMTP_EOP, NULL, 0);
+    ASSERT_TRUE(proxy.waitCompleted(1));
+    EXPECT_TRUE(proxy.received == data);
+
+    EXPECT_EQ(1U, receiver.getLatency(LATENCY_COMPLETION).getCount());
+    EXPECT_EQ(0U, receiver.getLatency(LATENCY_END_TO_END).getCount());
+}
+
+// A feed served by an engine keeps receiving multicast products while a
+// message from its sender has only partly arrived.
+TEST_F(fmtpRecvv3Test, PartialRetxMessageOnEngine) {
+    std::vector<char> data(PRODSIZE, DATA);
+    fmtpRecvEngine    engine(1);
+    engine.Start();
+    engine.addFeed(&receiver);
+    sock = accept(listenSock, NULL, NULL);
+    ASSERT_GE(sock, 0);
+    while (network.receiverCount() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    multicastBOP(0, PRODSIZE);
+    multicast(0, 0, FMTP_EOP, NULL, 0);  // the data block is lost
+    FmtpHeader request;
+    do {
+        request = recvRequest();
+    } while (request.flags != FMTP_RETX_REQ);
+
+    std::vector<char> retx(FMTP_HEADER_LEN + PRODSIZE);
+    encode(retx.data(), 0, 0, FMTP_RETX_DATA, PRODSIZE);
+    (void)memcpy(retx.data() + FMTP_HEADER_LEN, data.data(), PRODSIZE);
+    const size_t half = retx.size() / 2;
+    ASSERT_EQ((ssize_t)half, send(sock, retx.data(), half, 0));
+
+    multicastBOP(1, PRODSIZE);
+    multicast(1, 0, FMTP_MEM_DATA, data.data(), PRODSIZE);
+    multicast(1, 0, FMTP_EOP, NULL, 0);
+    ASSERT_TRUE(proxy.waitCompleted(1));
+
+    ASSERT_EQ((ssize_t)(retx.size() - half),
+              send(sock, retx.data() + half, retx.size() - half, 0));
+    ASSERT_TRUE(proxy.waitCompleted(2));
+    EXPECT_TRUE(proxy.received == data);
+    EXPECT_NO_THROW(engine.Stop());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
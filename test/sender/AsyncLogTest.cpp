@@ -0,0 +1,131 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: AsyncLogTest.cpp
+ *
+ * This file tests class `AsyncLog`.
+ */
+
+#include "AsyncLog.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int NTHREADS = 8;
+const int NRECORDS = 2000;
+
+// The fixture for testing class AsyncLog.
+class AsyncLogTest : public ::testing::Test {
+ protected:
+  AsyncLogTest()
+      : dir("/tmp/AsyncLogTest." + std::to_string(getpid())),
+        path(dir + "/test.log") {}
+
+  ~AsyncLogTest() {
+    (void)unlink(path.c_str());
+    (void)rmdir(dir.c_str());
+  }
+
+  std::vector<std::string> lines() {
+    std::vector<std::string> result;
+    std::ifstream            file(path.c_str());
+    std::string              line;
+    while (std::getline(file, line))
+      result.push_back(line);
+    return result;
+  }
+
+  const std::string dir;
+  const std::string path;
+};
+
+TEST_F(AsyncLogTest, ParseLevel) {
+    EXPECT_EQ(LOGLVL_ERROR, AsyncLog::parseLevel("error"));
+    EXPECT_EQ(LOGLVL_WARNING, AsyncLog::parseLevel("WARNING"));
+    EXPECT_EQ(LOGLVL_DEBUG, AsyncLog::parseLevel("3"));
+    EXPECT_THROW(AsyncLog::parseLevel("verbose"), std::invalid_argument);
+}
+
+TEST_F(AsyncLogTest, Levels) {
+    AsyncLog log(path);
+    EXPECT_EQ(LOGLVL_INFO, log.getLevel());
+    EXPECT_FALSE(log.enabled(LOGLVL_DEBUG));
+    EXPECT_FALSE(log.write(LOGLVL_DEBUG, "hidden"));
+    EXPECT_TRUE(log.write(LOGLVL_WARNING, "first"));
+    log.setLevel(LOGLVL_DEBUG);
+    EXPECT_TRUE(log.write(LOGLVL_DEBUG, "second"));
+    log.flush();
+    // The directory is created on the first record
+    const std::vector<std::string> written = lines();
+    ASSERT_EQ(2, written.size());
+    EXPECT_NE(std::string::npos, written[0].find("  WARNING  first"));
+    EXPECT_NE(std::string::npos, written[1].find("  DEBUG    second"));
+    EXPECT_EQ(0, log.getDropped());
+}
+
+TEST_F(AsyncLogTest, Truncation) {
+    AsyncLog log(path);
+    log.write(LOGLVL_ERROR, std::string(1000, 'x'));
+    log.flush();
+    const std::vector<std::string> written = lines();
+    ASSERT_EQ(1, written.size());
+    EXPECT_GT(1000, written[0].size());
+    EXPECT_EQ('x', written[0][written[0].size() - 1]);
+}
+
+TEST_F(AsyncLogTest, ManyThreads) {
+    {
+        AsyncLog                 log(path, 64);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < NTHREADS; i++)
+            threads.push_back(std::thread([&log, i] {
+                for (int j = 0; j < NRECORDS; j++)
+                    log.write(LOGLVL_INFO, std::to_string(i) + " " +
+                              std::to_string(j));
+            }));
+        for (int i = 0; i < NTHREADS; i++)
+            threads[i].join();
+        log.flush();
+        // Every record is either written or counted as dropped
+        uint64_t records = 0;
+        const std::vector<std::string> written = lines();
+        for (size_t i = 0; i < written.size(); i++)
+            if (written[i].find("log records dropped") == std::string::npos)
+                records++;
+        EXPECT_EQ(NTHREADS * NRECORDS, records + log.getDropped());
+    }
+}
+
+TEST_F(AsyncLogTest, Shared) {
+    std::shared_ptr<AsyncLog> first = AsyncLog::get(path);
+    std::shared_ptr<AsyncLog> second = AsyncLog::get(path);
+    EXPECT_EQ(first.get(), second.get());
+    first->setLevel(LOGLVL_ERROR);
+    EXPECT_FALSE(second->enabled(LOGLVL_WARNING));
+}
+
+TEST_F(AsyncLogTest, PendingRecordsAreWritten) {
+    {
+        AsyncLog log(path);
+        for (int i = 0; i < 100; i++)
+            log.write(LOGLVL_INFO, std::to_string(i));
+    }
+    EXPECT_EQ(100, lines().size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: FaultInjectorTest.cpp
+ *
+ * This file tests class `FaultInjector`.
+ */
+
+#include "FaultInjector.h"
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// The fixture for testing class FaultInjector.
+class FaultInjectorTest : public ::testing::Test {
+ protected:
+  static FmtpHeader packet(uint32_t prodindex, uint16_t flags,
+                           uint32_t seqnum = 0) {
+    FmtpHeader header = {prodindex, seqnum, 0, flags};
+    return header;
+  }
+
+  // Returns the actions for a product of BOP, 100 data packets and EOP.
+  static std::vector<FaultAction> run(FaultInjector& injector) {
+    std::vector<FaultAction> actions;
+    actions.push_back(injector.decide(packet(0, FMTP_BOP)));
+    for (uint32_t i = 0; i < 100; i++)
+      actions.push_back(injector.decide(packet(0, FMTP_MEM_DATA, i * 1000)));
+    actions.push_back(injector.decide(packet(0, FMTP_EOP)));
+    return actions;
+  }
+
+  FaultInjector injector;
+};
+
+TEST_F(FaultInjectorTest, NoFaultsByDefault) {
+    const std::vector<FaultAction> actions = run(injector);
+    for (size_t i = 0; i < actions.size(); i++)
+        EXPECT_EQ(FAULT_PASS, actions[i]);
+    EXPECT_EQ(102U, injector.getStats().packets);
+    EXPECT_EQ(0U, injector.getStats().dropped);
+}
+
+TEST_F(FaultInjectorTest, InvalidSettings) {
+    EXPECT_THROW(injector.SetLoss(1.5), std::invalid_argument);
+    EXPECT_THROW(injector.SetBurstLoss(0.1, 0), std::invalid_argument);
+    EXPECT_THROW(injector.SetReorder(0.1, 0), std::invalid_argument);
+    EXPECT_THROW(injector.Configure("loss"), std::invalid_argument);
+    EXPECT_THROW(injector.Configure("loss=x"), std::invalid_argument);
+    EXPECT_THROW(injector.Configure("drop=3:foo"), std::invalid_argument);
+    EXPECT_THROW(injector.Configure("jitter=1"), std::invalid_argument);
+}
+
+TEST_F(FaultInjectorTest, SameSeedSameFaults) {
+    FaultInjector other(7);
+    injector.Configure("seed=7,loss=0.1,dup=0.05,reorder=0.05:2");
+    other.Configure("loss=0.1,dup=0.05,reorder=0.05:2");
+    EXPECT_EQ(run(injector), run(other));
+    EXPECT_GT(injector.getStats().dropped, 0U);
+
+    other.SetSeed(8);
+    EXPECT_NE(run(injector), run(other));
+}
+
+TEST_F(FaultInjectorTest, TargetedLoss) {
+    injector.Configure("drop=0:bop,drop=0:data:5000,eop=1");
+    const std::vector<FaultAction> actions = run(injector);
+    EXPECT_EQ(FAULT_DROP, actions[0]);
+    EXPECT_EQ(FAULT_DROP, actions[6]);
+    EXPECT_EQ(FAULT_DROP, actions[101]);
+    EXPECT_EQ(3U, injector.getStats().dropped);
+
+    // a target drops one packet only
+    EXPECT_EQ(FAULT_PASS, injector.decide(packet(0, FMTP_BOP)));
+}
+
+TEST_F(FaultInjectorTest, TimestampedPackets) {
+    injector.Configure("drop=0:bop,drop=0:data:5000");
+    EXPECT_EQ(FAULT_DROP, injector.decide(packet(0,
+            FMTP_BOP | FMTP_TIMESTAMPED)));
+    EXPECT_EQ(FAULT_DROP, injector.decide(packet(0,
+            FMTP_MEM_DATA_EXT | FMTP_TIMESTAMPED, 5000)));
+}
+
+// Bursts of the Gilbert-Elliott model last 1/toGood packets on average.
+TEST_F(FaultInjectorTest, BurstLength) {
+    injector.SetBurstLoss(0.01, 0.2);
+    unsigned bursts = 0;
+    unsigned lost = 0;
+    bool     inBurst = false;
+
+    for (uint32_t i = 0; i < 100000; i++) {
+        const bool drop = injector.decide(packet(i, FMTP_MEM_DATA)) ==
+                FAULT_DROP;
+        if (drop && !inBurst)
+            bursts++;
+        lost += drop;
+        inBurst = drop;
+    }
+    EXPECT_GT(bursts, 500U);
+    EXPECT_NEAR(5.0, (double)lost / bursts, 1.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
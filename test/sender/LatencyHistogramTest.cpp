@@ -0,0 +1,135 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LatencyHistogramTest.cpp
+ *
+ * This file tests classes `HistogramSnapshot` and `LatencyHistogram`.
+ */
+
+#include "LatencyHistogram.h"
+#include "MetricsExporter.h"
+#include "gtest/gtest.h"
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int      NTHREADS = 8;
+const uint64_t NVALUES  = 100000;
+
+// The fixture for testing classes HistogramSnapshot and LatencyHistogram.
+class LatencyHistogramTest : public ::testing::Test {
+};
+
+TEST_F(LatencyHistogramTest, Empty) {
+    HistogramSnapshot hist;
+    EXPECT_EQ(0, hist.getCount());
+    EXPECT_EQ(0, hist.getMin());
+    EXPECT_EQ(0, hist.getMax());
+    EXPECT_EQ(0, hist.getMean());
+    EXPECT_EQ(0, hist.getPercentile(99));
+}
+
+TEST_F(LatencyHistogramTest, Buckets) {
+    // Every bucket starts right after the previous one
+    EXPECT_EQ(0, HistogramSnapshot::bucketOf(0));
+    for (size_t i = 1; i < HistogramSnapshot::NBUCKETS; i++) {
+        const uint64_t lowest = HistogramSnapshot::highestOf(i - 1) + 1;
+        EXPECT_EQ(i, HistogramSnapshot::bucketOf(lowest));
+        EXPECT_EQ(i, HistogramSnapshot::bucketOf(
+                HistogramSnapshot::highestOf(i)));
+    }
+    EXPECT_EQ(HistogramSnapshot::NBUCKETS - 1,
+              HistogramSnapshot::bucketOf(UINT64_MAX));
+}
+
+TEST_F(LatencyHistogramTest, Precision) {
+    for (uint64_t ns = 1; ns < (uint64_t(1) << 42); ns = ns * 3 + 7) {
+        const uint64_t highest = HistogramSnapshot::highestOf(
+                HistogramSnapshot::bucketOf(ns));
+        EXPECT_LE(ns, highest);
+        EXPECT_GE(ns / 32, highest - ns);
+    }
+}
+
+TEST_F(LatencyHistogramTest, Percentiles) {
+    HistogramSnapshot hist;
+    for (uint64_t ns = 1; ns <= 1000; ns++)
+        hist.record(ns * 1000);
+    EXPECT_EQ(1000, hist.getCount());
+    EXPECT_EQ(1000, hist.getMin());
+    EXPECT_EQ(1000000, hist.getMax());
+    EXPECT_DOUBLE_EQ(500500, hist.getMean());
+    EXPECT_NEAR(1000, hist.getPercentile(0), 1000 / 32);
+    EXPECT_NEAR(500000, hist.getPercentile(50), 500000 / 32);
+    EXPECT_NEAR(990000, hist.getPercentile(99), 990000 / 32);
+    EXPECT_EQ(1000000, hist.getPercentile(100));
+}
+
+TEST_F(LatencyHistogramTest, Merge) {
+    HistogramSnapshot first;
+    HistogramSnapshot second;
+    first.record(10);
+    first.record(20);
+    second.record(5000);
+    first.merge(second);
+    EXPECT_EQ(3, first.getCount());
+    EXPECT_EQ(10, first.getMin());
+    EXPECT_EQ(5000, first.getMax());
+    EXPECT_EQ(5030, first.getSum());
+    EXPECT_EQ(2, first.countAtMost(20));
+}
+
+TEST_F(LatencyHistogramTest, ManyThreads) {
+    LatencyHistogram         hist;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++)
+        threads.push_back(std::thread([&hist, i] {
+            for (uint64_t j = 1; j <= NVALUES; j++)
+                hist.record(j * (i + 1));
+        }));
+    for (int i = 0; i < NTHREADS; i++)
+        threads[i].join();
+    const HistogramSnapshot snap = hist.snapshot();
+    EXPECT_EQ(NTHREADS * NVALUES, snap.getCount());
+    EXPECT_EQ(1, snap.getMin());
+    EXPECT_EQ(NTHREADS * NVALUES, snap.getMax());
+    EXPECT_EQ(NTHREADS * (NTHREADS + 1) / 2 * NVALUES * (NVALUES + 1) / 2,
+              snap.getSum());
+}
+
+TEST_F(LatencyHistogramTest, Write) {
+    HistogramSnapshot hist;
+    hist.record(50000);       // 50 us
+    hist.record(2000000);     // 2 ms
+    hist.record(120000000000); // 2 minutes
+    MetricsWriter writer;
+    hist.write(writer, "x_seconds", "X.", "");
+    const std::string text = writer.str();
+    EXPECT_NE(std::string::npos, text.find("x_seconds_bucket{le=\"0.0001\"} 1\n"));
+    EXPECT_NE(std::string::npos, text.find("x_seconds_bucket{le=\"0.0025\"} 2\n"));
+    EXPECT_NE(std::string::npos, text.find("x_seconds_bucket{le=\"60\"} 2\n"));
+    EXPECT_NE(std::string::npos, text.find("x_seconds_bucket{le=\"+Inf\"} 3\n"));
+    EXPECT_NE(std::string::npos, text.find("x_seconds_count 3\n"));
+}
+
+TEST_F(LatencyHistogramTest, SizeClasses) {
+    EXPECT_EQ(SIZE_16KIB, sizeClassOf(0));
+    EXPECT_EQ(SIZE_16KIB, sizeClassOf(16384));
+    EXPECT_EQ(SIZE_256KIB, sizeClassOf(16385));
+    EXPECT_EQ(SIZE_4MIB, sizeClassOf(4194304));
+    EXPECT_EQ(SIZE_LARGE, sizeClassOf(4194305));
+    EXPECT_STREQ("256KiB", sizeClassName(SIZE_256KIB));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
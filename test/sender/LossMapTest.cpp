@@ -0,0 +1,117 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: LossMapTest.cpp
+ *
+ * This file tests class `LossMap`.
+ */
+
+#include "LossMap.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <vector>
+
+namespace {
+
+// The fixture for testing class LossMap.
+class LossMapTest : public ::testing::Test {
+ protected:
+  // Returns a report in network byte order.
+  RecvStatsMsg report(uint64_t mcastpkts, uint64_t kerneldrops,
+                      uint64_t retxreqs) {
+    RecvStatsMsg stats = {};
+    stats.mcastpkts   = htobe64(mcastpkts);
+    stats.kerneldrops = htobe64(kerneldrops);
+    stats.retxreqs    = htobe64(retxreqs);
+    stats.rtt         = htonl(250);
+    return stats;
+  }
+
+  LossMap map;
+};
+
+TEST_F(LossMapTest, ConstructDestruct) {
+    ASSERT_EQ(0, map.get().size());
+}
+
+TEST_F(LossMapTest, AddRemove) {
+    map.add(3);
+    map.add(4);
+    ASSERT_EQ(2, map.get().size());
+    map.remove(3);
+    std::vector<ReceiverStats> entries = map.get();
+    ASSERT_EQ(1, entries.size());
+    EXPECT_EQ(4, entries[0].sock);
+}
+
+TEST_F(LossMapTest, UnknownReceiverIgnored) {
+    map.update(5, report(100, 0, 0));
+    map.countRetxReq(5, 1000);
+    ASSERT_EQ(0, map.get().size());
+}
+
+TEST_F(LossMapTest, Update) {
+    map.add(3);
+    map.update(3, report(100, 0, 0));
+    ReceiverStats entry = map.get()[0];
+    EXPECT_EQ(1, entry.reports);
+    EXPECT_EQ(100, entry.mcastpkts);
+    EXPECT_EQ(250, entry.rtt);
+    EXPECT_EQ(0, entry.lossrate);
+}
+
+TEST_F(LossMapTest, RatesCoverLastInterval) {
+    map.add(3);
+    map.update(3, report(100, 0, 0));
+    map.update(3, report(190, 30, 10));
+    ReceiverStats entry = map.get()[0];
+    EXPECT_DOUBLE_EQ(0.1, entry.lossrate);
+    EXPECT_DOUBLE_EQ(0.25, entry.droprate);
+    map.update(3, report(290, 30, 10));
+    entry = map.get()[0];
+    EXPECT_EQ(0, entry.lossrate);
+    EXPECT_EQ(0, entry.droprate);
+}
+
+TEST_F(LossMapTest, CountRetxReq) {
+    map.add(3);
+    map.countRetxReq(3, 1000);
+    map.countRetxReq(3, 0);
+    ReceiverStats entry = map.get()[0];
+    EXPECT_EQ(2, entry.retxreqsrecvd);
+    EXPECT_EQ(1000, entry.retxbytes);
+}
+
+TEST_F(LossMapTest, CountCompletion) {
+    map.add(3);
+    map.countCompletion(3, 0.5);
+    map.countCompletion(3, 0.25);
+    map.countCompletion(4, 1.0);
+    ReceiverStats entry = map.get()[0];
+    EXPECT_EQ(2, entry.completions);
+    EXPECT_DOUBLE_EQ(0.75, entry.latencysum);
+}
+
+TEST_F(LossMapTest, SlowAction) {
+    map.add(3);
+    EXPECT_EQ(0, map.getSlowAction(3));
+    EXPECT_TRUE(map.setSlowAction(3, SLOWRECV_RELEGATE));
+    EXPECT_FALSE(map.setSlowAction(4, SLOWRECV_DISCONNECT));
+    EXPECT_EQ(SLOWRECV_RELEGATE, map.getSlowAction(3));
+    EXPECT_EQ(0, map.getSlowAction(4));
+    map.remove(3);
+    SlowRecvStats stats = map.getSlowStats();
+    EXPECT_EQ(1, stats.relegated);
+    EXPECT_EQ(0, stats.disconnected);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,178 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: MetricsExporterTest.cpp
+ *
+ * This file tests classes `MetricsWriter` and `MetricsExporter`.
+ */
+
+#include "MetricsExporter.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The fixture for testing classes MetricsWriter and MetricsExporter.
+class MetricsExporterTest : public ::testing::Test {
+ protected:
+  // Sends a request to a connected socket and returns the whole response.
+  std::string request(int sock, const std::string& req) {
+    EXPECT_EQ((ssize_t)req.size(), write(sock, req.data(), req.size()));
+    std::string response;
+    char        buf[4096];
+    ssize_t     n;
+    while ((n = read(sock, buf, sizeof(buf))) > 0)
+      response.append(buf, n);
+    close(sock);
+    return response;
+  }
+
+  std::string get(unsigned short port, const std::string& path) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(0, connect(sock, (struct sockaddr*)&addr, sizeof(addr)));
+    return request(sock, "GET " + path + " HTTP/1.1\r\nHost: x\r\n\r\n");
+  }
+
+  static void collect(MetricsWriter& writer) {
+    writer.counter("fmtp_test_packets_total", "Packets.", "", 42);
+  }
+};
+
+TEST_F(MetricsExporterTest, FamiliesAreGrouped) {
+    MetricsWriter writer;
+    writer.counter("a_total", "A.", MetricsWriter::label("feed", "1"), 1);
+    writer.gauge("b", "B.", "", 0.5);
+    writer.counter("a_total", "A.", MetricsWriter::label("feed", "2"), 2);
+    EXPECT_EQ("# HELP a_total A.\n"
+              "# TYPE a_total counter\n"
+              "a_total{feed=\"1\"} 1\n"
+              "a_total{feed=\"2\"} 2\n"
+              "# HELP b B.\n"
+              "# TYPE b gauge\n"
+              "b 0.5\n", writer.str());
+}
+
+TEST_F(MetricsExporterTest, Labels) {
+    EXPECT_EQ("x=\"a\\\"b\\\\c\\nd\"", MetricsWriter::label("x", "a\"b\\c\nd"));
+    EXPECT_EQ("a=\"1\",b=\"2\"", MetricsWriter::join("a=\"1\"", "b=\"2\""));
+    EXPECT_EQ("b=\"2\"", MetricsWriter::join("", "b=\"2\""));
+    EXPECT_EQ("a=\"1\"", MetricsWriter::join("a=\"1\"", ""));
+}
+
+TEST_F(MetricsExporterTest, LargeValuesAreExact) {
+    MetricsWriter writer;
+    writer.counter("c_total", "C.", "", 18446744073709551615u);
+    writer.gauge("g", "G.", "", 1e6);
+    const std::string text = writer.str();
+    EXPECT_NE(std::string::npos, text.find("c_total 18446744073709551615\n"));
+    EXPECT_NE(std::string::npos, text.find("g 1000000\n"));
+}
+
+TEST_F(MetricsExporterTest, Histogram) {
+    MetricsWriter writer;
+    std::vector<std::pair<double, uint64_t> > buckets;
+    buckets.push_back(std::make_pair(0.001, 1));
+    buckets.push_back(std::make_pair(0.5, 3));
+    writer.histogram("h_seconds", "H.", MetricsWriter::label("size", "4MiB"),
+                     buckets, 1.25, 4);
+    writer.histogram("h_seconds", "H.", "", buckets, 0, 3);
+    EXPECT_EQ("# HELP h_seconds H.\n"
+              "# TYPE h_seconds histogram\n"
+              "h_seconds_bucket{size=\"4MiB\",le=\"0.001\"} 1\n"
+              "h_seconds_bucket{size=\"4MiB\",le=\"0.5\"} 3\n"
+              "h_seconds_bucket{size=\"4MiB\",le=\"+Inf\"} 4\n"
+              "h_seconds_sum{size=\"4MiB\"} 1.25\n"
+              "h_seconds_count{size=\"4MiB\"} 4\n"
+              "h_seconds_bucket{le=\"0.001\"} 1\n"
+              "h_seconds_bucket{le=\"0.5\"} 3\n"
+              "h_seconds_bucket{le=\"+Inf\"} 3\n"
+              "h_seconds_sum 0\n"
+              "h_seconds_count 3\n", writer.str());
+}
+
+TEST_F(MetricsExporterTest, InvalidAddress) {
+    EXPECT_THROW(MetricsExporter("localhost"), std::invalid_argument);
+    EXPECT_THROW(MetricsExporter("127.0.0.1:99999"), std::invalid_argument);
+    EXPECT_THROW(MetricsExporter("unix:"), std::invalid_argument);
+}
+
+TEST_F(MetricsExporterTest, ServeTcp) {
+    MetricsExporter exporter("127.0.0.1:0");
+    ASSERT_NE(0, exporter.getPort());
+    exporter.addCollector(collect);
+    const std::string response = get(exporter.getPort(), "/metrics");
+    EXPECT_EQ(0, response.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos,
+              response.find("Content-Type: text/plain; version=0.0.4"));
+    EXPECT_NE(std::string::npos,
+              response.find("\r\n\r\n# HELP fmtp_test_packets_total"));
+    EXPECT_NE(std::string::npos, response.find("fmtp_test_packets_total 42\n"));
+}
+
+TEST_F(MetricsExporterTest, RefusedRequests) {
+    MetricsExporter exporter("127.0.0.1:0");
+    EXPECT_EQ(0, get(exporter.getPort(), "/other").find("HTTP/1.1 404"));
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(exporter.getPort());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(sock, (struct sockaddr*)&addr, sizeof(addr)));
+    EXPECT_EQ(0, request(sock, "POST /metrics HTTP/1.1\r\n\r\n").find(
+            "HTTP/1.1 405"));
+}
+
+TEST_F(MetricsExporterTest, RemoveCollector) {
+    MetricsExporter exporter("127.0.0.1:0");
+    const int id = exporter.addCollector(collect);
+    exporter.addCollector([](MetricsWriter& writer) {
+        writer.gauge("fmtp_test_gauge", "Gauge.", "", 7);
+    });
+    EXPECT_NE(std::string::npos, exporter.scrape().find("packets_total 42"));
+    exporter.removeCollector(id);
+    const std::string text = exporter.scrape();
+    EXPECT_EQ(std::string::npos, text.find("packets_total"));
+    EXPECT_NE(std::string::npos, text.find("fmtp_test_gauge 7\n"));
+}
+
+TEST_F(MetricsExporterTest, ServeUnix) {
+    const std::string path = "/tmp/MetricsExporterTest." +
+                             std::to_string(getpid());
+    {
+        MetricsExporter exporter("unix:" + path);
+        EXPECT_EQ(0, exporter.getPort());
+        exporter.addCollector(collect);
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+        ASSERT_EQ(0, connect(sock, (struct sockaddr*)&addr, sizeof(addr)));
+        const std::string response = request(sock,
+                "GET /metrics HTTP/1.0\r\n\r\n");
+        EXPECT_NE(std::string::npos,
+                  response.find("fmtp_test_packets_total 42\n"));
+    }
+    EXPECT_NE(0, access(path.c_str(), F_OK));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
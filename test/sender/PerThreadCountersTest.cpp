@@ -0,0 +1,154 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: PerThreadCountersTest.cpp
+ *
+ * This file tests class `PerThreadCounters`.
+ */
+
+#include "PerThreadCounters.h"
+#include "gtest/gtest.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int      NTHREADS = 8;
+const uint64_t NADDS    = 100000;
+
+// The fixture for testing class PerThreadCounters.
+class PerThreadCountersTest : public ::testing::Test {
+};
+
+TEST_F(PerThreadCountersTest, ConstructDestruct) {
+    PerThreadCounters counters(3);
+    std::vector<uint64_t> sums = counters.sums();
+    ASSERT_EQ(3, sums.size());
+    EXPECT_EQ(0, sums[0]);
+    EXPECT_EQ(0, counters.sum(2));
+}
+
+TEST_F(PerThreadCountersTest, InvalidSize) {
+    EXPECT_THROW(PerThreadCounters(0), std::invalid_argument);
+}
+
+TEST_F(PerThreadCountersTest, SingleThread) {
+    PerThreadCounters counters(2);
+    counters.add(0);
+    counters.add(0);
+    counters.add(1, 1000);
+    EXPECT_EQ(2, counters.sum(0));
+    EXPECT_EQ(1000, counters.sum(1));
+}
+
+TEST_F(PerThreadCountersTest, ManyThreads) {
+    PerThreadCounters        counters(2);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++)
+        threads.push_back(std::thread([&counters] {
+            for (uint64_t j = 0; j < NADDS; j++) {
+                counters.add(0);
+                counters.add(1, 3);
+            }
+        }));
+    for (int i = 0; i < NTHREADS; i++)
+        threads[i].join();
+    // The counts of ended threads remain
+    EXPECT_EQ(NTHREADS * NADDS, counters.sum(0));
+    EXPECT_EQ(NTHREADS * NADDS * 3, counters.sum(1));
+}
+
+TEST_F(PerThreadCountersTest, ManyShortThreads) {
+    PerThreadCounters counters(2);
+    // Every thread's block is retired when it ends
+    for (int i = 0; i < 1000; i++) {
+        std::thread thread([&counters] {
+            counters.add(0);
+            counters.add(1, 2);
+        });
+        thread.join();
+        EXPECT_EQ(i + 1, counters.sum(0));
+    }
+    std::vector<uint64_t> sums = counters.sums();
+    EXPECT_EQ(1000, sums[0]);
+    EXPECT_EQ(2000, sums[1]);
+}
+
+TEST_F(PerThreadCountersTest, SetDestroyedBeforeThread) {
+    std::mutex              mutex;
+    std::condition_variable cond;
+    int                     step = 0;
+    PerThreadCounters*      counters = new PerThreadCounters(1);
+    std::thread             thread([&] {
+        counters->add(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        step = 1;
+        cond.notify_all();
+        while (step != 2)
+            cond.wait(lock);
+        // Uses another set after the first one is gone
+        PerThreadCounters other(1);
+        other.add(0, 5);
+        EXPECT_EQ(5, other.sum(0));
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (step != 1)
+            cond.wait(lock);
+        EXPECT_EQ(1, counters->sum(0));
+        delete counters;
+        step = 2;
+        cond.notify_all();
+    }
+    thread.join();
+}
+
+TEST_F(PerThreadCountersTest, ReadWhileAdding) {
+    PerThreadCounters counters(1);
+    std::thread       adder([&counters] {
+        for (uint64_t j = 0; j < NADDS; j++)
+            counters.add(0);
+    });
+    uint64_t last = 0;
+    for (int i = 0; i < 1000; i++) {
+        const uint64_t sum = counters.sum(0);
+        EXPECT_LE(last, sum);
+        last = sum;
+    }
+    adder.join();
+    EXPECT_EQ(NADDS, counters.sum(0));
+}
+
+TEST_F(PerThreadCountersTest, SetsAreSeparate) {
+    PerThreadCounters first(1);
+    PerThreadCounters second(1);
+    for (int i = 0; i < 10; i++) {
+        first.add(0);
+        second.add(0, 2);
+    }
+    EXPECT_EQ(10, first.sum(0));
+    EXPECT_EQ(20, second.sum(0));
+    {
+        // A set constructed where another was destroyed starts at zero
+        PerThreadCounters third(1);
+        third.add(0);
+        EXPECT_EQ(1, third.sum(0));
+    }
+    PerThreadCounters fourth(1);
+    EXPECT_EQ(0, fourth.sum(0));
+    fourth.add(0);
+    EXPECT_EQ(1, fourth.sum(0));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,152 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: ProductTraceTest.cpp
+ *
+ * This file tests class `ProductTrace`.
+ */
+
+#include "ProductTrace.h"
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int NTHREADS = 4;
+
+// The fixture for testing class ProductTrace.
+class ProductTraceTest : public ::testing::Test {
+ protected:
+  ProductTraceTest()
+      : path("/tmp/ProductTraceTest." + std::to_string(getpid())) {}
+
+  ~ProductTraceTest() {
+    (void)unlink(path.c_str());
+  }
+
+  const std::string path;
+};
+
+TEST_F(ProductTraceTest, InvalidCapacity) {
+    EXPECT_THROW(ProductTrace("test", 0), std::invalid_argument);
+}
+
+TEST_F(ProductTraceTest, Record) {
+    ProductTrace trace("test");
+    trace.record(TRACE_BOP_RECVD, 7, 100000);
+    trace.record(TRACE_FIRST_GAP, 7, 2840);
+    trace.record(TRACE_EOP_RECVD, 7);
+    const std::vector<TraceEvent> events = trace.snapshot();
+    ASSERT_EQ(3, events.size());
+    EXPECT_EQ(TRACE_BOP_RECVD, events[0].type);
+    EXPECT_EQ(7U, events[0].prodindex);
+    EXPECT_EQ(100000U, events[0].arg);
+    EXPECT_EQ(2840U, events[1].arg);
+    EXPECT_EQ(TRACE_EOP_RECVD, events[2].type);
+    EXPECT_LE(events[0].ns, events[2].ns);
+}
+
+// A full ring keeps the latest events.
+TEST_F(ProductTraceTest, Overwrite) {
+    ProductTrace trace("test", 10);
+    for (uint32_t i = 0; i < 100; i++)
+        trace.record(TRACE_SUBMITTED, i);
+    const std::vector<TraceEvent> events = trace.snapshot();
+    ASSERT_EQ(16, events.size());
+    EXPECT_EQ(84U, events[0].prodindex);
+    EXPECT_EQ(99U, events[15].prodindex);
+}
+
+TEST_F(ProductTraceTest, ManyThreads) {
+    ProductTrace             trace("test", 1024);
+    std::atomic<bool>        stop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++)
+        threads.push_back(std::thread([&trace, i] {
+            for (uint32_t j = 0; j < 10000; j++)
+                trace.record(TRACE_RETX_REQ, i, j);
+        }));
+    // Snapshots taken meanwhile have only whole events
+    std::thread reader([&trace, &stop] {
+        while (!stop) {
+            const std::vector<TraceEvent> events = trace.snapshot();
+            for (size_t i = 0; i < events.size(); i++)
+                ASSERT_EQ(TRACE_RETX_REQ, events[i].type);
+        }
+    });
+    for (int i = 0; i < NTHREADS; i++)
+        threads[i].join();
+    stop = true;
+    reader.join();
+
+    const std::vector<TraceEvent> events = trace.snapshot();
+    ASSERT_EQ(NTHREADS * 1024, events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_LE(events[i].arg, 9999U);
+        EXPECT_GE(events[i].arg, 10000U - 1024);
+        if (i) {
+            EXPECT_LE(events[i - 1].ns, events[i].ns);
+        }
+    }
+}
+
+TEST_F(ProductTraceTest, WriteRead) {
+    ProductTrace trace("receiver r0");
+    trace.record(TRACE_BOP_RECVD, 1, 5000);
+    trace.record(TRACE_ACK, 1, 1);
+    trace.write(path);
+
+    std::string             name;
+    std::vector<TraceEvent> events;
+    ProductTrace::read(path, name, events);
+    EXPECT_EQ("receiver r0", name);
+    const std::vector<TraceEvent> expected = trace.snapshot();
+    ASSERT_EQ(expected.size(), events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_EQ(expected[i].ns, events[i].ns);
+        EXPECT_EQ(expected[i].prodindex, events[i].prodindex);
+        EXPECT_EQ(expected[i].arg, events[i].arg);
+        EXPECT_EQ(expected[i].type, events[i].type);
+        EXPECT_EQ(expected[i].tid, events[i].tid);
+    }
+
+    EXPECT_THROW(ProductTrace::read("/nonexistent", name, events),
+                 std::runtime_error);
+}
+
+TEST_F(ProductTraceTest, ChromeEvents) {
+    std::vector<TraceEvent> events;
+    TraceEvent bop = {1000000, 3, 4096, TRACE_BOP_SENT, 0, 42};
+    TraceEvent ack = {1002500, 3, 9, TRACE_ACK, 0, 42};
+    events.push_back(bop);
+    events.push_back(ack);
+
+    std::ostringstream out;
+    ProductTrace::writeChromeEvents(out, "sender", 1, events, 1000000, true);
+    const std::string json = out.str();
+    EXPECT_NE(std::string::npos, json.find("\"args\": {\"name\": \"sender\"}"));
+    EXPECT_NE(std::string::npos, json.find("{\"name\": \"BOP_SENT\", \"cat\": "
+            "\"fmtp\", \"ph\": \"i\", \"s\": \"t\", \"ts\": 0.000, \"pid\": 1, "
+            "\"tid\": 42, \"args\": {\"product\": 3, \"size\": 4096}}"));
+    EXPECT_NE(std::string::npos, json.find("\"ts\": 2.500"));
+    EXPECT_NE(std::string::npos, json.find("\"ph\": \"b\", \"id2\": "
+            "{\"local\": 3}"));
+    EXPECT_NE(std::string::npos, json.find("\"ph\": \"e\""));
+    EXPECT_EQ(0, json.find("\n{"));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: RateControllerTest.cpp
+ *
+ * This file tests class `RateController`.
+ */
+
+#include "RateController.h"
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+
+namespace {
+
+// The fixture for testing class RateController.
+class RateControllerTest : public ::testing::Test {
+ protected:
+  RateControllerTest() : ctrl(10000000, 100000000) {
+    ctrl.SetAIMD(1000000, 0.5, 0.01);
+  }
+
+  RateController ctrl;
+};
+
+TEST_F(RateControllerTest, StartsAtFloor) {
+    EXPECT_EQ(10000000, ctrl.GetRate());
+}
+
+TEST_F(RateControllerTest, InvalidRange) {
+    EXPECT_THROW(RateController(100, 1000000), std::runtime_error);
+    EXPECT_THROW(RateController(2000000, 1000000), std::runtime_error);
+    EXPECT_THROW(ctrl.SetAIMD(1000000, 1.0, 0.01), std::runtime_error);
+}
+
+TEST_F(RateControllerTest, AdditiveIncrease) {
+    EXPECT_EQ(11000000, ctrl.Update(0));
+    EXPECT_EQ(12000000, ctrl.Update(0.01));
+}
+
+TEST_F(RateControllerTest, MultiplicativeDecrease) {
+    ctrl.SetRate(80000000);
+    EXPECT_EQ(40000000, ctrl.Update(0.05));
+}
+
+TEST_F(RateControllerTest, Clamped) {
+    ctrl.SetRate(100000000);
+    EXPECT_EQ(100000000, ctrl.Update(0));
+    ctrl.SetRate(12000000);
+    EXPECT_EQ(10000000, ctrl.Update(1));
+    EXPECT_EQ(100000000, ctrl.SetRate(200000000));
+}
+
+// A bottleneck loses whatever exceeds its capacity. The rate must climb to the
+// capacity and then stay around it.
+TEST_F(RateControllerTest, ConvergesToBottleneck) {
+    const double capacity = 60000000;
+    double       sum = 0;
+    int          n = 0;
+
+    for (int i = 0; i < 400; i++) {
+        const double rate = ctrl.GetRate();
+        const double loss = (rate > capacity) ? 1 - capacity / rate : 0;
+        ctrl.Update(loss);
+        if (i >= 200) {
+            EXPECT_GE(ctrl.GetRate(), capacity / 2 - 1);
+            EXPECT_LE(ctrl.GetRate(), capacity * 1.02 + 1000000);
+            sum += ctrl.GetRate();
+            n++;
+        }
+    }
+    EXPECT_GT(sum / n, 0.7 * capacity);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: SimNetworkTest.cpp
+ *
+ * This file tests class `SimNetwork`.
+ */
+
+#include "SimNetwork.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+// The fixture for testing class SimNetwork.
+class SimNetworkTest : public ::testing::Test {
+ protected:
+  // Sends a data packet of a product to the network.
+  static void send(int sock, uint32_t prodindex) {
+    FmtpHeader header = {htonl(prodindex), 0, htons(1), htons(FMTP_MEM_DATA)};
+    char packet[FMTP_HEADER_LEN + 1] = {};
+    memcpy(packet, &header, FMTP_HEADER_LEN);
+    ASSERT_EQ((ssize_t)sizeof(packet), ::send(sock, packet, sizeof(packet), 0));
+  }
+
+  // Receives a packet and returns its product-index, or -1 on timeout.
+  static int64_t recv(int sock, int timeoutMs = 1000) {
+    struct pollfd pfd = {sock, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) != 1)
+      return -1;
+    FmtpHeader header;
+    if (::recv(sock, &header, sizeof(header), 0) < (ssize_t)FMTP_HEADER_LEN)
+      return -1;
+    return ntohl(header.prodindex);
+  }
+
+  SimNetwork network;
+};
+
+TEST_F(SimNetworkTest, EveryReceiverGetsEveryPacket) {
+    const int out = network.openMcastSend("239.255.0.1", 5000, 1, "127.0.0.1");
+    const int in1 = network.openMcastRecv("239.255.0.1", 5000, "127.0.0.1");
+    const int in2 = network.openMcastRecv("239.255.0.1", 5000, "127.0.0.1");
+    const int other = network.openMcastRecv("239.255.0.2", 5000, "127.0.0.1");
+    EXPECT_EQ(3U, network.receiverCount());
+    for (uint32_t i = 0; i < 10; i++)
+        send(out, i);
+    for (uint32_t i = 0; i < 10; i++) {
+        EXPECT_EQ(i, recv(in1));
+        EXPECT_EQ(i, recv(in2));
+    }
+    EXPECT_EQ(-1, recv(other, 100));
+    EXPECT_EQ(10U, network.getLinkStats(0).delivered);
+    EXPECT_THROW(network.getLinkStats(3), std::out_of_range);
+    close(out); close(in1); close(in2); close(other);
+}
+
+TEST_F(SimNetworkTest, LinksHaveTheirOwnLossAndDelay) {
+    SimLink lossy;
+    lossy.faults = "drop=3:data";
+    SimLink slow;
+    slow.delay = 0.2;
+    SimLink invalid;
+    invalid.faults = "loss";
+    network.SetLink(0, lossy);
+    network.SetLink(1, slow);
+    EXPECT_THROW(network.SetLink(2, invalid), std::invalid_argument);
+
+    const int out = network.openMcastSend("239.255.0.1", 5000, 1, "127.0.0.1");
+    const int in1 = network.openMcastRecv("239.255.0.1", 5000, "127.0.0.1");
+    const int in2 = network.openMcastRecv("239.255.0.1", 5000, "127.0.0.1");
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 5; i++)
+        send(out, i);
+    EXPECT_EQ(0, recv(in1));
+    EXPECT_EQ(1, recv(in1));
+    EXPECT_EQ(2, recv(in1));
+    EXPECT_EQ(4, recv(in1));
+    EXPECT_EQ(0, recv(in2));
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              std::chrono::milliseconds(190));
+    EXPECT_EQ(1U, network.getLinkStats(0).lost);
+    EXPECT_EQ(0U, network.getLinkStats(1).lost);
+    close(out); close(in1); close(in2);
+}
+
+// A link sends at its bandwidth and drops what exceeds its queue.
+TEST_F(SimNetworkTest, BandwidthAndQueue) {
+    SimLink link;
+    link.bandwidth = 1000000;
+    link.queue     = 5 * (FMTP_HEADER_LEN + 1);
+    network.SetDefaultLink(link);
+
+    const int out = network.openMcastSend("239.255.0.1", 5000, 1, "127.0.0.1");
+    const int in = network.openMcastRecv("239.255.0.1", 5000, "127.0.0.1");
+    for (uint32_t i = 0; i < 20; i++)
+        send(out, i);
+    unsigned received = 0;
+    while (recv(in, 200) >= 0)
+        received++;
+    const SimLinkStats stats = network.getLinkStats(0);
+    EXPECT_EQ(received, stats.delivered);
+    EXPECT_GT(stats.overflowed, 0U);
+    EXPECT_EQ(20U, stats.delivered + stats.overflowed);
+    close(out); close(in);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,190 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpSendEngineTest.cpp
+ *
+ * This file tests class `fmtpSendEngine` on a simulated network.
+ */
+
+#include "fmtpSendEngine.h"
+#include "SimNetwork.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t PRODSIZE  = 50 * FMTP_DATA_LEN;
+const uint64_t SLOW_RATE = 1000000;
+const uint64_t FAST_RATE = 200000000;
+
+class Proxy : public SendProxy
+{
+public:
+    Proxy() : mutex(), cond(), accepted(0) {}
+
+    void notify_of_eop(uint32_t /*prodindex*/) {}
+    bool verify_new_recv(int /*newsock*/)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++accepted;
+        cond.notify_all();
+        return true;
+    }
+    void waitAccepted(const unsigned count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (accepted < count)
+            cond.wait(lock);
+    }
+
+private:
+    std::mutex              mutex;
+    std::condition_variable cond;
+    unsigned                accepted;
+};
+
+// The fixture for testing class fmtpSendEngine.
+class fmtpSendEngineTest : public ::testing::Test {
+ protected:
+  fmtpSendEngineTest()
+      : product(PRODSIZE, 0x5a),
+        proxy(),
+        network(),
+        slow("127.0.0.1", 0, "239.0.0.3", 5175, &proxy),
+        fast("127.0.0.1", 0, "239.0.0.4", 5176, &proxy),
+        engine(1, 1) {
+    slow.SetTransport(network);
+    fast.SetTransport(network);
+    slow.SetSendRate(SLOW_RATE);
+    fast.SetSendRate(FAST_RATE);
+  }
+
+  // Returns when the EOP of a product arrives on a multicast socket.
+  static Clock::time_point awaitEOP(const int sock) {
+    char       packet[MAX_FMTP_PACKET_LEN];
+    FmtpHeader header;
+    do {
+        if (recv(sock, packet, sizeof(packet), 0) < (ssize_t)FMTP_HEADER_LEN)
+            return Clock::time_point::max();
+        (void)memcpy(&header, packet, FMTP_HEADER_LEN);
+    } while (ntohs(header.flags) != FMTP_EOP);
+    return Clock::now();
+  }
+
+  // Connects a receiver to a feed and returns its socket.
+  int connectReceiver(fmtpSendv3& feed, const unsigned count) {
+    struct sockaddr_in addr;
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(feed.getTcpPortNum());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 ||
+            connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        throw std::runtime_error("Couldn't connect to the sender");
+    proxy.waitAccepted(count);
+    return sock;
+  }
+
+  // Sends a request for the first `size` bytes of product 0.
+  static void requestRetx(const int sock, const uint16_t size) {
+    FmtpHeader req;
+    req.prodindex  = htonl(0);
+    req.seqnum     = htonl(0);
+    req.payloadlen = htons(size);
+    req.flags      = htons(FMTP_RETX_REQ);
+    ASSERT_EQ((ssize_t)sizeof(req), send(sock, &req, sizeof(req), 0));
+  }
+
+  std::vector<char> product;
+  Proxy             proxy;
+  SimNetwork        network;
+  fmtpSendv3        slow;
+  fmtpSendv3        fast;
+  fmtpSendEngine    engine;
+};
+
+// Two feeds on the same transmit thread are each sent at their own rate: the
+// product of the fast feed isn't held up behind the one of the slow feed, and
+// the slow feed isn't slowed down further by the fast one.
+TEST_F(fmtpSendEngineTest, FeedsDontDelayEachOther) {
+    const int slowSock = network.openMcastRecv("239.0.0.3", 5175, "127.0.0.1");
+    const int fastSock = network.openMcastRecv("239.0.0.4", 5176, "127.0.0.1");
+    engine.addFeed(&slow);
+    engine.addFeed(&fast);
+    engine.Start();
+
+    Clock::time_point slowEnd;
+    Clock::time_point fastEnd;
+    std::thread slowRecv([&] {slowEnd = awaitEOP(slowSock);});
+    std::thread fastRecv([&] {fastEnd = awaitEOP(fastSock);});
+
+    const Clock::time_point start = Clock::now();
+    (void)engine.sendProduct(&slow, product.data(), product.size());
+    (void)engine.sendProduct(&fast, product.data(), product.size());
+    slowRecv.join();
+    fastRecv.join();
+    EXPECT_NO_THROW(engine.Stop());
+
+    const double slowTime = (double)PRODSIZE * 8 / SLOW_RATE;
+    EXPECT_LT(std::chrono::duration<double>(fastEnd - start).count(),
+              slowTime / 4);
+    EXPECT_LT(std::chrono::duration<double>(slowEnd - start).count(),
+              slowTime * 1.5);
+}
+
+// A receiver that requests much more than it reads doesn't hold up the
+// answers to another receiver of the same reactor thread.
+TEST_F(fmtpSendEngineTest, SlowReaderDoesntBlockOthers) {
+    const int mcastSock = network.openMcastRecv("239.0.0.4", 5176,
+                                                "127.0.0.1");
+    engine.addFeed(&fast);
+    engine.Start();
+    const int slowReader = connectReceiver(fast, 1);
+    const int reader     = connectReceiver(fast, 2);
+
+    (void)engine.sendProduct(&fast, product.data(), product.size());
+    ASSERT_NE(Clock::time_point::max(), awaitEOP(mcastSock));
+
+    /* far more than the socket buffers of the connection hold */
+    for (int i = 0; i < 500; i++)
+        requestRetx(slowReader, 60000);
+    /* gives the reactor time to fill the slow reader's connection */
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    requestRetx(reader, FMTP_DATA_LEN);
+
+    struct timeval timeout = {5, 0};
+    ASSERT_EQ(0, setsockopt(reader, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                            sizeof(timeout)));
+    FmtpHeader header;
+    ASSERT_EQ((ssize_t)sizeof(header),
+              recv(reader, &header, sizeof(header), MSG_WAITALL));
+    EXPECT_EQ(FMTP_RETX_DATA, ntohs(header.flags));
+
+    EXPECT_NO_THROW(engine.Stop());
+    (void)close(reader);
+    (void)close(slowReader);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,313 @@
+/**
+ * Copyright 2015 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: fmtpSendv3Test.cpp
+ *
+ * This file tests class `fmtpSendv3` against a scripted receiver on a
+ * simulated network.
+ */
+
+#include "fmtpSendv3.h"
+#include "SimNetwork.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char           GROUP[]  = "239.0.0.1";
+const unsigned short PORT     = 5173;
+const uint32_t       PRODSIZE = 200 * FMTP_DATA_LEN;
+const char           DATA     = 0x5a;
+const char           POISON   = (char)0xee;
+const unsigned       NSMALL   = 5;
+const uint32_t       SMALLLEN = 10;
+
+/* Reuses a product as soon as it's released, like a sending application. */
+class Proxy : public SendProxy
+{
+public:
+    explicit Proxy(std::vector<char>& product)
+        : product(product), mutex(), cond(), accepted(false), released(0) {}
+
+    void notify_of_eop(uint32_t /*prodindex*/)
+    {
+        (void)memset(product.data(), POISON, product.size());
+        std::unique_lock<std::mutex> lock(mutex);
+        ++released;
+        cond.notify_all();
+    }
+    bool verify_new_recv(int /*newsock*/)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        accepted = true;
+        cond.notify_all();
+        return true;
+    }
+    void waitAccepted()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!accepted)
+            cond.wait(lock);
+    }
+    unsigned getReleased()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return released;
+    }
+    bool waitReleased(const unsigned count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, std::chrono::seconds(10),
+                             [this, count] {return released >= count;});
+    }
+
+private:
+    std::vector<char>&      product;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    bool                    accepted;
+    unsigned                released;
+};
+
+// The fixture for testing class fmtpSendv3.
+class fmtpSendv3Test : public ::testing::Test {
+ protected:
+  fmtpSendv3Test()
+      : product(PRODSIZE, DATA),
+        proxy(product),
+        network(),
+        sender("127.0.0.1", 0, GROUP, PORT, &proxy) {
+    sender.SetTransport(network);
+  }
+
+  // Connects a receiver to the sender and returns its socket.
+  int connectReceiver() {
+    struct sockaddr_in addr;
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(sender.getTcpPortNum());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 ||
+            connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        throw std::runtime_error("Couldn't connect to the sender");
+    proxy.waitAccepted();
+    return sock;
+  }
+
+  // Sends a RETX_END for `nprods` products starting at `prodindex`.
+  static void sendRetxEnd(const int sock, const uint32_t prodindex,
+                          const uint32_t nprods) {
+    FmtpHeader retxEnd;
+    retxEnd.prodindex  = htonl(prodindex);
+    retxEnd.seqnum     = htonl(nprods);
+    retxEnd.payloadlen = 0;
+    retxEnd.flags      = htons(FMTP_RETX_END);
+    ASSERT_EQ((ssize_t)sizeof(retxEnd),
+              send(sock, &retxEnd, sizeof(retxEnd), 0));
+  }
+
+  std::vector<char> product;
+  Proxy             proxy;
+  SimNetwork        network;
+  fmtpSendv3        sender;
+};
+
+// A RETX_END for the product still being multicast doesn't release the
+// product before its EOP is sent.
+TEST_F(fmtpSendv3Test, EarlyRetxEnd) {
+    const int mcastSock = network.openMcastRecv(GROUP, PORT, "127.0.0.1");
+    sender.SetSendRate(20000000);
+    sender.Start();
+    const int sock = connectReceiver();
+
+    std::thread sending([this] {
+        try {
+            (void)sender.sendProduct(product.data(), product.size());
+        }
+        catch (const std::exception& e) {
+            ADD_FAILURE() << e.what();
+        }
+    });
+
+    char       packet[MAX_FMTP_PACKET_LEN];
+    bool       acked    = false;
+    unsigned   poisoned = 0;
+    FmtpHeader header;
+    do {
+        const ssize_t nbytes = recv(mcastSock, packet, sizeof(packet), 0);
+        ASSERT_GE(nbytes, (ssize_t)FMTP_HEADER_LEN);
+        (void)memcpy(&header, packet, FMTP_HEADER_LEN);
+        header.flags = ntohs(header.flags);
+        if (header.flags != FMTP_MEM_DATA)
+            continue;
+        if (!acked) {
+            // the receiver recovered the rest of the product through TCP
+            FmtpHeader retxEnd;
+            retxEnd.prodindex  = htonl(0);
+            retxEnd.seqnum     = htonl(1);
+            retxEnd.payloadlen = 0;
+            retxEnd.flags      = htons(FMTP_RETX_END);
+            ASSERT_EQ((ssize_t)sizeof(retxEnd),
+                      send(sock, &retxEnd, sizeof(retxEnd), 0));
+            acked = true;
+        }
+        for (ssize_t i = FMTP_HEADER_LEN; i < nbytes; i++) {
+            if (packet[i] != DATA) {
+                ++poisoned;
+                break;
+            }
+        }
+    } while (header.flags != FMTP_EOP);
+    sending.join();
+
+    EXPECT_EQ(0U, poisoned);
+    EXPECT_EQ(1U, proxy.getReleased());
+    EXPECT_NO_THROW(sender.Stop());
+    (void)close(sock);
+}
+
+// Metadata longer than a BOP holds is multicast in BOP continuations, and a
+// requested BOP carries all of it.
+TEST_F(fmtpSendv3Test, LongMetadata) {
+    const uint16_t    metasize = AVAIL_BOP_LEN + FMTP_DATA_LEN + 100;
+    std::vector<char> metadata(metasize);
+    for (size_t i = 0; i < metadata.size(); i++)
+        metadata[i] = (char)(i % 253);
+    const int mcastSock = network.openMcastRecv(GROUP, PORT, "127.0.0.1");
+    sender.Start();
+    const int sock = connectReceiver();
+    (void)sender.sendProduct(product.data(), FMTP_DATA_LEN, metadata.data(),
+                             metasize);
+
+    // the BOP and its continuations
+    std::vector<char> multicast;
+    char              packet[MAX_FMTP_PACKET_LEN];
+    FmtpHeader        header;
+    do {
+        const ssize_t nbytes = recv(mcastSock, packet, sizeof(packet), 0);
+        ASSERT_GE(nbytes, (ssize_t)FMTP_HEADER_LEN);
+        (void)memcpy(&header, packet, FMTP_HEADER_LEN);
+        const size_t skip = (ntohs(header.flags) == FMTP_BOP) ?
+                sizeof(uint32_t) + sizeof(uint16_t) : 0;
+        if (ntohs(header.flags) == FMTP_BOP_CONT) {
+            EXPECT_EQ(multicast.size(), ntohl(header.seqnum));
+        }
+        multicast.insert(multicast.end(), packet + FMTP_HEADER_LEN + skip,
+                         packet + nbytes);
+    } while (multicast.size() < metasize);
+    EXPECT_TRUE(multicast == metadata);
+
+    FmtpHeader request;
+    request.prodindex  = htonl(0);
+    request.seqnum     = 0;
+    request.payloadlen = 0;
+    request.flags      = htons(FMTP_BOP_REQ);
+    ASSERT_EQ((ssize_t)sizeof(request),
+              send(sock, &request, sizeof(request), 0));
+    ASSERT_EQ((ssize_t)sizeof(header),
+              recv(sock, &header, sizeof(header), MSG_WAITALL));
+    EXPECT_EQ(FMTP_RETX_BOP, ntohs(header.flags));
+    std::vector<char> bop(ntohs(header.payloadlen));
+    ASSERT_EQ(sizeof(uint32_t) + sizeof(uint16_t) + metasize, bop.size());
+    ASSERT_EQ((ssize_t)bop.size(),
+              recv(sock, bop.data(), bop.size(), MSG_WAITALL));
+    uint32_t prodsize;
+    uint16_t bopmeta;
+    (void)memcpy(&prodsize, bop.data(), sizeof(prodsize));
+    (void)memcpy(&bopmeta, bop.data() + sizeof(prodsize), sizeof(bopmeta));
+    EXPECT_EQ((uint32_t)FMTP_DATA_LEN, ntohl(prodsize));
+    EXPECT_EQ(metasize, ntohs(bopmeta));
+    EXPECT_TRUE(std::equal(metadata.begin(), metadata.end(),
+                           bop.begin() + sizeof(prodsize) + sizeof(bopmeta)));
+
+    EXPECT_NO_THROW(sender.Stop());
+    (void)close(sock);
+}
+
+// Small products are multicast in one envelope, and a RETX_END covering the
+// run of them releases every one.
+TEST_F(fmtpSendv3Test, AggregatedRun) {
+    const int mcastSock = network.openMcastRecv(GROUP, PORT, "127.0.0.1");
+    sender.SetAggregation(100, 10);
+    sender.Start();
+    const int sock = connectReceiver();
+
+    char small[NSMALL][SMALLLEN];
+    for (unsigned i = 0; i < NSMALL; i++) {
+        (void)memset(small[i], 'a' + i, SMALLLEN);
+        EXPECT_EQ(i, sender.sendProduct(small[i], SMALLLEN));
+    }
+    sender.flushAggregate();
+
+    char          packet[MAX_FMTP_PACKET_LEN];
+    const ssize_t nbytes = recv(mcastSock, packet, sizeof(packet), 0);
+    ASSERT_EQ((ssize_t)(FMTP_HEADER_LEN +
+                        NSMALL * (AGGR_ENTRY_HEADER_LEN + SMALLLEN)),
+              nbytes);
+    FmtpHeader header;
+    (void)memcpy(&header, packet, FMTP_HEADER_LEN);
+    EXPECT_EQ(FMTP_AGGR_DATA, ntohs(header.flags));
+    EXPECT_EQ(0U, ntohl(header.prodindex));
+    EXPECT_EQ(NSMALL, ntohl(header.seqnum));
+    const char* entry = packet + FMTP_HEADER_LEN;
+    for (unsigned i = 0; i < NSMALL; i++) {
+        uint32_t prodsize;
+        uint16_t metasize;
+        (void)memcpy(&prodsize, entry, sizeof(prodsize));
+        (void)memcpy(&metasize, entry + sizeof(prodsize), sizeof(metasize));
+        EXPECT_EQ(SMALLLEN, ntohl(prodsize));
+        EXPECT_EQ(0, ntohs(metasize));
+        entry += AGGR_ENTRY_HEADER_LEN;
+        EXPECT_EQ(0, memcmp(small[i], entry, SMALLLEN));
+        entry += SMALLLEN;
+    }
+
+    sendRetxEnd(sock, 0, NSMALL);
+    EXPECT_TRUE(proxy.waitReleased(NSMALL));
+    EXPECT_EQ(NSMALL, proxy.getReleased());
+    EXPECT_NO_THROW(sender.Stop());
+    (void)close(sock);
+}
+
+// A RETX_END covering more products than an envelope holds releases only its
+// first product, without walking the rest of the run.
+TEST_F(fmtpSendv3Test, OversizedRun) {
+    sender.SetAggregation(100, 10);
+    sender.Start();
+    const int sock = connectReceiver();
+
+    char small[NSMALL][SMALLLEN];
+    for (unsigned i = 0; i < NSMALL; i++)
+        (void)sender.sendProduct(small[i], SMALLLEN);
+    sender.flushAggregate();
+
+    sendRetxEnd(sock, 0, 0xffffffff);
+    // handled after the first notice
+    sendRetxEnd(sock, 1, 1);
+    EXPECT_TRUE(proxy.waitReleased(2));
+    EXPECT_EQ(2U, proxy.getReleased());
+    EXPECT_NO_THROW(sender.Stop());
+    (void)close(sock);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,11 +22,29 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  * @brief     Dissector plugin of wireshark, used to parse FMTP packet header.
+ *
+ * Besides the header fields, the dissector analyzes the products across
+ * packets. Multicast blocks are checked for gaps, duplicates and reordering
+ * per product, the retransmission requests of every TCP connection are
+ * linked to the RETX_DATA, RETX_BOP, RETX_EOP or RETX_REJ that answers them,
+ * and the time from a request to the retransmission that completes its
+ * repair is shown on both. Products are identified by their index alone, so
+ * a capture should hold a single FMTP session.
  */
 
 
 #include "config.h"
 #include <epan/packet.h>
+#include <epan/conversation.h>
+#include <epan/expert.h>
+#include <epan/wmem/wmem.h>
+#include <epan/dissectors/packet-tcp.h>
+
+/* the plugin API changed after 1.12; see README for building the plugin */
+#if defined(VERSION_MAJOR) && defined(VERSION_MINOR) && \
+    (VERSION_MAJOR != 1 || VERSION_MINOR != 12)
+#error "packet-fmtp.c is written against the Wireshark 1.12 plugin API"
+#endif
 
 #define FMTP_MCAST_PORT 5173
 #define FMTP_RETX_PORT  1234
@@ -43,7 +61,16 @@
 #define FMTP_RETX_BOP   0x0100
 #define FMTP_EOP_REQ    0x0200
 #define FMTP_RETX_EOP   0x0400
+#define FMTP_AGGR_DATA  0x0800
+#define FMTP_BOP_CONT   0x1000
+#define FMTP_MEM_DATA_EXT 0x2000
+#define FMTP_RECV_STATS 0x4000
+/* modifier of BOP, EOP and data packets that end with a sender timestamp */
+#define FMTP_TIMESTAMPED 0x8000
 
+#define FMTP_HEADER_LEN 12
+#define DATA_EXT_LEN    8
+#define TIMESTAMP_LEN   8
 
 /* register the packet data structure */
 static int proto_fmtp = -1;
@@ -62,7 +89,496 @@ static int hf_fmtp_flag_bopreq = -1;
 static int hf_fmtp_flag_retxbop = -1;
 static int hf_fmtp_flag_eopreq = -1;
 static int hf_fmtp_flag_retxeop = -1;
+static int hf_fmtp_flag_aggrdata = -1;
+static int hf_fmtp_flag_bopcont = -1;
+static int hf_fmtp_flag_memdataext = -1;
+static int hf_fmtp_flag_recvstats = -1;
+static int hf_fmtp_flag_timestamped = -1;
+static int hf_fmtp_timestamp = -1;
+static int hf_fmtp_analysis = -1;
+static int hf_fmtp_bop_in = -1;
+static int hf_fmtp_gap = -1;
+static int hf_fmtp_duplicate_of = -1;
+static int hf_fmtp_request_in = -1;
+static int hf_fmtp_response_in = -1;
+static int hf_fmtp_repaired_in = -1;
+static int hf_fmtp_since_request = -1;
+static int hf_fmtp_repair_time = -1;
+static int hf_fmtp_retx_end_in = -1;
 static gint ett_fmtp = -1;
+static gint ett_fmtp_analysis = -1;
+
+/* names of the message types for the info column */
+static const value_string fmtp_type_vals[] = {
+    { FMTP_BOP,          "BOP" },
+    { FMTP_EOP,          "EOP" },
+    { FMTP_MEM_DATA,     "MEM_DATA" },
+    { FMTP_RETX_REQ,     "RETX_REQ" },
+    { FMTP_RETX_REJ,     "RETX_REJ" },
+    { FMTP_RETX_END,     "RETX_END" },
+    { FMTP_RETX_DATA,    "RETX_DATA" },
+    { FMTP_BOP_REQ,      "BOP_REQ" },
+    { FMTP_RETX_BOP,     "RETX_BOP" },
+    { FMTP_EOP_REQ,      "EOP_REQ" },
+    { FMTP_RETX_EOP,     "RETX_EOP" },
+    { FMTP_AGGR_DATA,    "AGGR_DATA" },
+    { FMTP_BOP_CONT,     "BOP_CONT" },
+    { FMTP_MEM_DATA_EXT, "MEM_DATA_EXT" },
+    { FMTP_RECV_STATS,   "RECV_STATS" },
+    { 0, NULL }
+};
+
+static expert_field ei_fmtp_gap = EI_INIT;
+static expert_field ei_fmtp_missing_tail = EI_INIT;
+static expert_field ei_fmtp_missing_prods = EI_INIT;
+static expert_field ei_fmtp_no_bop = EI_INIT;
+static expert_field ei_fmtp_duplicate = EI_INIT;
+static expert_field ei_fmtp_reordered = EI_INIT;
+static expert_field ei_fmtp_retransmitted = EI_INIT;
+static expert_field ei_fmtp_retx_again = EI_INIT;
+static expert_field ei_fmtp_retx_after_end = EI_INIT;
+static expert_field ei_fmtp_unsolicited = EI_INIT;
+static expert_field ei_fmtp_rejected = EI_INIT;
+static expert_field ei_fmtp_no_response = EI_INIT;
+
+
+/**
+ * A retransmission request (RETX_REQ, BOP_REQ or EOP_REQ) of a receiver and
+ * what became of it. A RETX_REQ asks for the bytes [start, end) of the
+ * product and may be answered by several RETX_DATA blocks.
+ */
+typedef struct {
+    guint16  type;
+    guint32  prodindex;
+    guint32  start;
+    guint32  end;
+    guint32  covered;       /* bytes retransmitted so far */
+    guint32  req_frame;
+    nstime_t req_time;
+    guint32  rsp_frame;     /* first answer, 0 if none */
+    guint32  done_frame;    /* answer that completed the repair, 0 if none */
+    nstime_t repair_time;
+    gboolean rejected;
+} fmtp_request_t;
+
+/* multicast state of a product */
+typedef struct {
+    guint32      size;
+    gboolean     size_known;
+    guint32      highest;   /* end of the highest block multicast so far */
+    guint32      bop_frame;
+    wmem_tree_t *blocks;    /* seqnum -> frame of the multicast block */
+} fmtp_prod_t;
+
+/* state of a multicast session, i.e. of its group and port */
+typedef struct {
+    wmem_tree_t *prods;     /* prodindex -> fmtp_prod_t */
+    guint32      last_prodindex;
+    gboolean     have_prodindex;
+} fmtp_mcast_t;
+
+/* state of the TCP connection of a receiver */
+typedef struct {
+    wmem_tree_t *pending;   /* prodindex -> wmem_list_t of open requests */
+    wmem_tree_t *retx;      /* [prodindex, seqnum] -> frame of RETX_DATA */
+    wmem_tree_t *ends;      /* prodindex -> frame of the RETX_END */
+} fmtp_conv_t;
+
+/**
+ * The analysis of a message, made when the capture is first read and kept
+ * for when the packet is dissected again.
+ */
+typedef struct {
+    guint32         bop_frame;
+    guint32         gap_start;      /* bytes [gap_start, gap_start + gap_len) */
+    guint32         gap_len;        /* weren't multicast before this block */
+    guint32         missing_tail;   /* bytes missing at the end, for an EOP */
+    guint32         missing_prods;  /* products skipped before this one */
+    guint32         dup_of;         /* frame that carried it before */
+    gboolean        reordered;
+    fmtp_request_t *request;        /* the request it is or answers */
+    nstime_t        since_request;
+    guint32         retx_end_frame; /* RETX_END that preceded a retx */
+} fmtp_pkt_t;
+
+
+/**
+ * Finds the state of the multicast session of the packet, creating it if
+ * needed. Product indices are only unique within a session, so a capture of
+ * several sessions keeps their products apart.
+ */
+static fmtp_mcast_t *fmtp_get_mcast(packet_info *pinfo)
+{
+    conversation_t *conv = find_or_create_conversation(pinfo);
+    fmtp_mcast_t   *state;
+
+    state = (fmtp_mcast_t *)conversation_get_proto_data(conv, proto_fmtp);
+    if (state == NULL) {
+        state = wmem_new0(wmem_file_scope(), fmtp_mcast_t);
+        state->prods = wmem_tree_new(wmem_file_scope());
+        conversation_add_proto_data(conv, proto_fmtp, state);
+    }
+    return state;
+}
+
+
+/**
+ * Finds the multicast state of a product of a session, creating it if needed.
+ */
+static fmtp_prod_t *fmtp_get_prod(fmtp_mcast_t *mcast, guint32 prodindex)
+{
+    fmtp_prod_t *prod;
+
+    prod = (fmtp_prod_t *)wmem_tree_lookup32(mcast->prods, prodindex);
+    if (prod == NULL) {
+        prod = wmem_new0(wmem_file_scope(), fmtp_prod_t);
+        prod->blocks = wmem_tree_new(wmem_file_scope());
+        wmem_tree_insert32(mcast->prods, prodindex, prod);
+    }
+    return prod;
+}
+
+
+/**
+ * Finds the state of the TCP connection of the packet, creating it if needed.
+ */
+static fmtp_conv_t *fmtp_get_conv(packet_info *pinfo)
+{
+    conversation_t *conv = find_or_create_conversation(pinfo);
+    fmtp_conv_t    *state;
+
+    state = (fmtp_conv_t *)conversation_get_proto_data(conv, proto_fmtp);
+    if (state == NULL) {
+        state = wmem_new0(wmem_file_scope(), fmtp_conv_t);
+        state->pending = wmem_tree_new(wmem_file_scope());
+        state->retx    = wmem_tree_new(wmem_file_scope());
+        state->ends    = wmem_tree_new(wmem_file_scope());
+        conversation_add_proto_data(conv, proto_fmtp, state);
+    }
+    return state;
+}
+
+
+/**
+ * Notes the last product index multicast in a session and how many were
+ * skipped before the product(s) [first, last].
+ */
+static guint32 fmtp_note_prodindex(fmtp_mcast_t *mcast, guint32 first,
+                                   guint32 last)
+{
+    guint32 skipped = 0;
+
+    if (mcast->have_prodindex) {
+        /* product indices wrap around; anything far ahead isn't a gap */
+        if ((gint32)(first - mcast->last_prodindex) > 1 &&
+                first - mcast->last_prodindex < 0x100000)
+            skipped = first - mcast->last_prodindex - 1;
+        if ((gint32)(last - mcast->last_prodindex) <= 0)
+            return skipped;
+    }
+    mcast->last_prodindex = last;
+    mcast->have_prodindex = TRUE;
+    return skipped;
+}
+
+
+/**
+ * Analyzes a multicast message.
+ */
+static void fmtp_analyze_mcast(tvbuff_t *tvb, packet_info *pinfo,
+                               fmtp_pkt_t *pkt, guint32 prodindex,
+                               guint32 seqnum, guint16 paylen, guint16 flags)
+{
+    fmtp_mcast_t *mcast = fmtp_get_mcast(pinfo);
+    fmtp_prod_t  *prod;
+    guint32       frame = pinfo->fd->num;
+    guint32       datalen = paylen;
+    guint32       i;
+
+    if (flags == FMTP_AGGR_DATA) {
+        /* seqnum is the number of products in the envelope */
+        pkt->missing_prods = fmtp_note_prodindex(mcast, prodindex,
+                prodindex + (seqnum ? seqnum - 1 : 0));
+        for (i = 0; i < seqnum; i++) {
+            prod = fmtp_get_prod(mcast, prodindex + i);
+            if (prod->bop_frame == 0)
+                prod->bop_frame = frame;
+            else
+                pkt->dup_of = prod->bop_frame;
+        }
+        return;
+    }
+
+    prod = fmtp_get_prod(mcast, prodindex);
+    switch (flags) {
+    case FMTP_BOP:
+        pkt->missing_prods = fmtp_note_prodindex(mcast, prodindex,
+                                                 prodindex);
+        if (prod->bop_frame) {
+            pkt->dup_of = prod->bop_frame;
+        }
+        else {
+            prod->bop_frame = frame;
+        }
+        if (tvb_length(tvb) >= FMTP_HEADER_LEN + 4) {
+            prod->size       = tvb_get_ntohl(tvb, FMTP_HEADER_LEN);
+            prod->size_known = TRUE;
+        }
+        break;
+
+    case FMTP_MEM_DATA_EXT:
+        if (paylen < DATA_EXT_LEN)
+            break;
+        datalen -= DATA_EXT_LEN;
+        if (tvb_length(tvb) >= FMTP_HEADER_LEN + 4) {
+            prod->size       = tvb_get_ntohl(tvb, FMTP_HEADER_LEN);
+            prod->size_known = TRUE;
+        }
+        /* FALLTHROUGH */
+    case FMTP_MEM_DATA:
+        pkt->dup_of = GPOINTER_TO_UINT(wmem_tree_lookup32(prod->blocks,
+                                                          seqnum));
+        if (pkt->dup_of)
+            break;
+        wmem_tree_insert32(prod->blocks, seqnum, GUINT_TO_POINTER(frame));
+        if (seqnum > prod->highest) {
+            pkt->gap_start = prod->highest;
+            pkt->gap_len   = seqnum - prod->highest;
+        }
+        else if (seqnum < prod->highest) {
+            pkt->reordered = TRUE;
+        }
+        if (seqnum + datalen > prod->highest)
+            prod->highest = seqnum + datalen;
+        break;
+
+    case FMTP_EOP:
+        if (prod->size_known && prod->highest < prod->size)
+            pkt->missing_tail = prod->size - prod->highest;
+        break;
+    }
+    pkt->bop_frame = prod->bop_frame;
+}
+
+
+/**
+ * Analyzes a message on the TCP connection of a receiver.
+ */
+static void fmtp_analyze_tcp(packet_info *pinfo, fmtp_pkt_t *pkt,
+                             guint32 prodindex, guint32 seqnum,
+                             guint16 paylen, guint16 flags)
+{
+    fmtp_conv_t      *conv = fmtp_get_conv(pinfo);
+    wmem_list_t      *pending;
+    wmem_list_frame_t *it;
+    fmtp_request_t   *req;
+    wmem_tree_key_t   key[3];
+    guint32           frame = pinfo->fd->num;
+    guint32           i;
+
+    pending = (wmem_list_t *)wmem_tree_lookup32(conv->pending, prodindex);
+
+    switch (flags) {
+    case FMTP_RETX_REQ:
+    case FMTP_BOP_REQ:
+    case FMTP_EOP_REQ:
+        req = wmem_new0(wmem_file_scope(), fmtp_request_t);
+        req->type      = flags;
+        req->prodindex = prodindex;
+        if (flags == FMTP_RETX_REQ) {
+            req->start = seqnum;
+            req->end   = seqnum + paylen;
+        }
+        req->req_frame = frame;
+        req->req_time  = pinfo->fd->abs_ts;
+        if (pending == NULL) {
+            pending = wmem_list_new(wmem_file_scope());
+            wmem_tree_insert32(conv->pending, prodindex, pending);
+        }
+        wmem_list_append(pending, req);
+        pkt->request = req;
+        return;
+
+    case FMTP_RETX_END:
+        /* seqnum > 1 acknowledges that many aggregated products */
+        for (i = 0; i < (seqnum > 1 ? seqnum : 1); i++)
+            if (!wmem_tree_lookup32(conv->ends, prodindex + i))
+                wmem_tree_insert32(conv->ends, prodindex + i,
+                                   GUINT_TO_POINTER(frame));
+        return;
+
+    case FMTP_RETX_DATA:
+        pkt->retx_end_frame = GPOINTER_TO_UINT(
+                wmem_tree_lookup32(conv->ends, prodindex));
+        key[0].length = 1;
+        key[0].key    = &prodindex;
+        key[1].length = 1;
+        key[1].key    = &seqnum;
+        key[2].length = 0;
+        key[2].key    = NULL;
+        pkt->dup_of = GPOINTER_TO_UINT(wmem_tree_lookup32_array(conv->retx,
+                                                                key));
+        if (!pkt->dup_of)
+            wmem_tree_insert32_array(conv->retx, key,
+                                     GUINT_TO_POINTER(frame));
+        break;
+
+    case FMTP_RETX_BOP:
+    case FMTP_RETX_EOP:
+    case FMTP_RETX_REJ:
+        break;
+
+    default:
+        return;
+    }
+
+    /* a rejection answers every open request of the product */
+    if (flags == FMTP_RETX_REJ) {
+        while (pending && (it = wmem_list_head(pending)) != NULL) {
+            req = (fmtp_request_t *)wmem_list_frame_data(it);
+            if (pkt->request == NULL) {
+                pkt->request = req;
+                nstime_delta(&pkt->since_request, &pinfo->fd->abs_ts,
+                             &req->req_time);
+            }
+            if (req->rsp_frame == 0)
+                req->rsp_frame = frame;
+            req->rejected = TRUE;
+            wmem_list_remove(pending, req);
+        }
+        return;
+    }
+
+    /* any other answer: find the oldest open request it answers */
+    for (it = pending ? wmem_list_head(pending) : NULL; it != NULL;
+            it = wmem_list_frame_next(it)) {
+        req = (fmtp_request_t *)wmem_list_frame_data(it);
+        if ((flags == FMTP_RETX_BOP && req->type == FMTP_BOP_REQ) ||
+                (flags == FMTP_RETX_EOP && req->type == FMTP_EOP_REQ) ||
+                (flags == FMTP_RETX_DATA && req->type == FMTP_RETX_REQ &&
+                 req->start < seqnum + paylen && seqnum < req->end))
+            break;
+    }
+    if (it == NULL)
+        return;
+
+    pkt->request = req;
+    nstime_delta(&pkt->since_request, &pinfo->fd->abs_ts, &req->req_time);
+    if (req->rsp_frame == 0)
+        req->rsp_frame = frame;
+    if (flags == FMTP_RETX_DATA) {
+        guint32 from = MAX(seqnum, req->start);
+        guint32 to   = MIN(seqnum + paylen, req->end);
+        req->covered += to - from;
+        if (req->covered < req->end - req->start)
+            return;
+    }
+    req->done_frame  = frame;
+    req->repair_time = pkt->since_request;
+    wmem_list_remove(pending, req);
+}
+
+
+/**
+ * Adds the analysis of a message to the tree and raises its expert info.
+ */
+static void fmtp_add_analysis(tvbuff_t *tvb, packet_info *pinfo,
+                              proto_tree *fmtp_tree, proto_item *ti,
+                              const fmtp_pkt_t *pkt, guint16 flags)
+{
+    proto_item     *item;
+    proto_tree     *tree;
+    fmtp_request_t *req = pkt->request;
+    gboolean        is_req = (flags == FMTP_RETX_REQ ||
+                              flags == FMTP_BOP_REQ || flags == FMTP_EOP_REQ);
+
+    item = proto_tree_add_item(fmtp_tree, hf_fmtp_analysis, tvb, 0, 0,
+                               ENC_NA);
+    PROTO_ITEM_SET_GENERATED(item);
+    tree = proto_item_add_subtree(item, ett_fmtp_analysis);
+
+    if (pkt->bop_frame) {
+        item = proto_tree_add_uint(tree, hf_fmtp_bop_in, tvb, 0, 0,
+                                   pkt->bop_frame);
+        PROTO_ITEM_SET_GENERATED(item);
+    }
+    else if (flags == FMTP_MEM_DATA || flags == FMTP_MEM_DATA_EXT ||
+             flags == FMTP_EOP) {
+        expert_add_info(pinfo, ti, &ei_fmtp_no_bop);
+    }
+    if (pkt->missing_prods)
+        expert_add_info_format(pinfo, ti, &ei_fmtp_missing_prods,
+                "%u product(s) missing before this one", pkt->missing_prods);
+    if (pkt->gap_len) {
+        item = proto_tree_add_uint(tree, hf_fmtp_gap, tvb, 0, 0,
+                                   pkt->gap_len);
+        PROTO_ITEM_SET_GENERATED(item);
+        expert_add_info_format(pinfo, item, &ei_fmtp_gap,
+                "%u bytes missing before this block (from byte %u)",
+                pkt->gap_len, pkt->gap_start);
+    }
+    if (pkt->missing_tail)
+        expert_add_info_format(pinfo, ti, &ei_fmtp_missing_tail,
+                "%u bytes missing at the end of the product",
+                pkt->missing_tail);
+    if (pkt->reordered)
+        expert_add_info(pinfo, ti, &ei_fmtp_reordered);
+    if (pkt->dup_of) {
+        item = proto_tree_add_uint(tree, hf_fmtp_duplicate_of, tvb, 0, 0,
+                                   pkt->dup_of);
+        PROTO_ITEM_SET_GENERATED(item);
+        expert_add_info(pinfo, item, flags == FMTP_RETX_DATA ?
+                        &ei_fmtp_retx_again : &ei_fmtp_duplicate);
+    }
+    if (flags == FMTP_RETX_DATA)
+        expert_add_info(pinfo, ti, &ei_fmtp_retransmitted);
+    if (pkt->retx_end_frame) {
+        item = proto_tree_add_uint(tree, hf_fmtp_retx_end_in, tvb, 0, 0,
+                                   pkt->retx_end_frame);
+        PROTO_ITEM_SET_GENERATED(item);
+        expert_add_info(pinfo, item, &ei_fmtp_retx_after_end);
+    }
+
+    if (is_req) {
+        if (req->rsp_frame) {
+            item = proto_tree_add_uint(tree, hf_fmtp_response_in, tvb, 0, 0,
+                                       req->rsp_frame);
+            PROTO_ITEM_SET_GENERATED(item);
+        }
+        else if (PINFO_FD_VISITED(pinfo)) {
+            /* only known once the whole capture has been read */
+            expert_add_info(pinfo, ti, &ei_fmtp_no_response);
+        }
+        if (req->done_frame) {
+            item = proto_tree_add_uint(tree, hf_fmtp_repaired_in, tvb, 0, 0,
+                                       req->done_frame);
+            PROTO_ITEM_SET_GENERATED(item);
+            item = proto_tree_add_time(tree, hf_fmtp_repair_time, tvb, 0, 0,
+                                       &req->repair_time);
+            PROTO_ITEM_SET_GENERATED(item);
+        }
+        if (req->rejected)
+            expert_add_info(pinfo, ti, &ei_fmtp_rejected);
+    }
+    else if (req) {
+        item = proto_tree_add_uint(tree, hf_fmtp_request_in, tvb, 0, 0,
+                                   req->req_frame);
+        PROTO_ITEM_SET_GENERATED(item);
+        item = proto_tree_add_time(tree, hf_fmtp_since_request, tvb, 0, 0,
+                                   &pkt->since_request);
+        PROTO_ITEM_SET_GENERATED(item);
+        if (req->done_frame == pinfo->fd->num) {
+            item = proto_tree_add_time(tree, hf_fmtp_repair_time, tvb, 0, 0,
+                                       &req->repair_time);
+            PROTO_ITEM_SET_GENERATED(item);
+        }
+    }
+    else if (flags == FMTP_RETX_DATA || flags == FMTP_RETX_BOP ||
+             flags == FMTP_RETX_EOP) {
+        /* e.g. the EOP the sender sends when a product times out */
+        expert_add_info(pinfo, ti, &ei_fmtp_unsolicited);
+    }
+}
 
 
 /**
@@ -71,58 +587,153 @@ static gint ett_fmtp = -1;
  * for example, MAC, IPv4 and UDP, then pass in a pointer to the remaining
  * payload in the buffer. Besides, it also passes in two other pointers, one
  * for containing metadata of the packet, another pointing at the parsing tree
- * of this protocol.
+ * of this protocol. A UDP datagram holds one FMTP message; over TCP it is
+ * called once for every message.
  */
-static void dissect_fmtp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
+static void dissect_fmtp_pdu(tvbuff_t *tvb, packet_info *pinfo,
+                             proto_tree *tree)
 {
     /* offset of the payload content */
     gint offset = 0;
+    proto_item *ti = NULL;
+    proto_tree *fmtp_tree = NULL;
+    guint32 prodindex = tvb_get_ntohl(tvb, 0);
+    guint32 seqnum    = tvb_get_ntohl(tvb, 4);
+    guint16 paylen    = tvb_get_ntohs(tvb, 8);
+    guint16 flags     = tvb_get_ntohs(tvb, 10);
+    /* a frame can hold several messages of a TCP connection */
+    guint32 key       = tvb_raw_offset(tvb);
+    fmtp_pkt_t *pkt;
+    /* the timestamp isn't part of the payload proper */
+    gboolean stamped  = (flags & FMTP_TIMESTAMPED) && paylen >= TIMESTAMP_LEN;
+
+    if (stamped) {
+        flags  &= ~FMTP_TIMESTAMPED;
+        paylen -= TIMESTAMP_LEN;
+    }
+
+    col_append_sep_fstr(pinfo->cinfo, COL_INFO, ", ",
+                        "%s prodindex=%u seqnum=%u len=%u",
+                        val_to_str_const(flags, fmtp_type_vals, "Unknown"),
+                        prodindex, seqnum, paylen);
+
+    pkt = (fmtp_pkt_t *)p_get_proto_data(wmem_file_scope(), pinfo,
+                                         proto_fmtp, key);
+    if (pkt == NULL && !PINFO_FD_VISITED(pinfo)) {
+        pkt = wmem_new0(wmem_file_scope(), fmtp_pkt_t);
+        if (pinfo->ptype == PT_TCP)
+            fmtp_analyze_tcp(pinfo, pkt, prodindex, seqnum, paylen, flags);
+        else
+            fmtp_analyze_mcast(tvb, pinfo, pkt, prodindex, seqnum, paylen,
+                               flags);
+        p_add_proto_data(wmem_file_scope(), pinfo, proto_fmtp, key, pkt);
+    }
+
+    /* add fields to the tree; they are skipped if there is none */
+    ti = proto_tree_add_item(tree, proto_fmtp, tvb, 0, -1, ENC_NA);
+    fmtp_tree = proto_item_add_subtree(ti, ett_fmtp);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_prodindex, tvb, offset, 4,
+                        ENC_BIG_ENDIAN);
+    offset += 4;
+    /* increment the offset for parsing the next field */
+    proto_tree_add_item(fmtp_tree, hf_fmtp_seqnum, tvb, offset, 4,
+                        ENC_BIG_ENDIAN);
+    offset += 4;
+    proto_tree_add_item(fmtp_tree, hf_fmtp_paylen, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    offset += 2;
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flags, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_bop, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_eop, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_memdata, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxreq, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxrej, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxend, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxdata, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_bopreq, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxbop, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_eopreq, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxeop, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_aggrdata, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_bopcont, tvb, offset, 2,
+                        ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_memdataext, tvb, offset,
+                        2, ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_recvstats, tvb, offset,
+                        2, ENC_BIG_ENDIAN);
+    proto_tree_add_item(fmtp_tree, hf_fmtp_flag_timestamped, tvb, offset,
+                        2, ENC_BIG_ENDIAN);
+    offset += 2;
+    if (stamped)
+        proto_tree_add_item(fmtp_tree, hf_fmtp_timestamp, tvb,
+                            FMTP_HEADER_LEN + paylen, TIMESTAMP_LEN,
+                            ENC_BIG_ENDIAN);
+
+    if (pkt)
+        fmtp_add_analysis(tvb, pinfo, fmtp_tree, ti, pkt, flags);
+}
+
+
+/**
+ * Returns the length of the FMTP message at the offset of a TCP stream. The
+ * requests of a receiver carry the requested length in the payload length
+ * field but have no payload.
+ */
+static guint get_fmtp_pdu_len(packet_info *pinfo _U_, tvbuff_t *tvb,
+                              int offset)
+{
+    guint16 flags = tvb_get_ntohs(tvb, offset + 10);
+
+    if (flags == FMTP_RETX_REQ || flags == FMTP_BOP_REQ ||
+            flags == FMTP_EOP_REQ || flags == FMTP_RETX_END)
+        return FMTP_HEADER_LEN;
+    return FMTP_HEADER_LEN + tvb_get_ntohs(tvb, offset + 8);
+}
+
+
+/**
+ * Dissects a message reassembled from a TCP stream. tcp_dissect_pdus() takes
+ * a new-style dissector, which returns the number of bytes it consumed.
+ */
+static int dissect_fmtp_tcp_pdu(tvbuff_t *tvb, packet_info *pinfo,
+                                proto_tree *tree, void *data _U_)
+{
+    dissect_fmtp_pdu(tvb, pinfo, tree);
+    return tvb_length(tvb);
+}
+
+
+static void dissect_fmtp_tcp(tvbuff_t *tvb, packet_info *pinfo,
+                             proto_tree *tree)
+{
     col_set_str(pinfo->cinfo, COL_PROTOCOL, "FMTP");
     /* Clear out stuff in the info column */
-    col_clear(pinfo->cinfo,COL_INFO);
-    if (tree) {
-        proto_item *ti = NULL;
-        proto_tree *fmtp_tree = NULL;
-
-        /* if the parsing tree exists, add fields to the tree */
-        ti = proto_tree_add_item(tree, proto_fmtp, tvb, 0, -1, ENC_NA);
-        fmtp_tree = proto_item_add_subtree(ti, ett_fmtp);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_prodindex, tvb, offset, 4,
-                            ENC_BIG_ENDIAN);
-        offset += 4;
-        /* increment the offset for parsing the next field */
-        proto_tree_add_item(fmtp_tree, hf_fmtp_seqnum, tvb, offset, 4,
-                            ENC_BIG_ENDIAN);
-        offset += 4;
-        proto_tree_add_item(fmtp_tree, hf_fmtp_paylen, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        offset += 2;
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flags, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_bop, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_eop, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_memdata, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxreq, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxrej, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxend, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxdata, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_bopreq, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxbop, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_eopreq, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        proto_tree_add_item(fmtp_tree, hf_fmtp_flag_retxeop, tvb, offset, 2,
-                            ENC_BIG_ENDIAN);
-        offset += 2;
-    }
+    col_clear(pinfo->cinfo, COL_INFO);
+    tcp_dissect_pdus(tvb, pinfo, tree, TRUE, FMTP_HEADER_LEN,
+                     get_fmtp_pdu_len, dissect_fmtp_tcp_pdu, NULL);
+}
+
+
+static void dissect_fmtp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
+{
+    col_set_str(pinfo->cinfo, COL_PROTOCOL, "FMTP");
+    /* Clear out stuff in the info column */
+    col_clear(pinfo->cinfo, COL_INFO);
+    if (tvb_length(tvb) >= FMTP_HEADER_LEN)
+        dissect_fmtp_pdu(tvb, pinfo, tree);
 }
 
 
@@ -241,12 +852,178 @@ void proto_register_fmtp(void)
             FT_BOOLEAN, 16,
             NULL, FMTP_RETX_EOP,
             NULL, HFILL }
+        },
+        /* Aggregate envelope type, sub-structure of flags field */
+        { &hf_fmtp_flag_aggrdata,
+            { "FMTP AGGR DATA Flag", "fmtp.flags.aggrdata",
+            FT_BOOLEAN, 16,
+            NULL, FMTP_AGGR_DATA,
+            NULL, HFILL }
+        },
+        /* BOP continuation type, sub-structure of flags field */
+        { &hf_fmtp_flag_bopcont,
+            { "FMTP BOP CONT Flag", "fmtp.flags.bopcont",
+            FT_BOOLEAN, 16,
+            NULL, FMTP_BOP_CONT,
+            NULL, HFILL }
+        },
+        /* Self-describing data block type, sub-structure of flags field */
+        { &hf_fmtp_flag_memdataext,
+            { "FMTP MEM DATA EXT Flag", "fmtp.flags.memdataext",
+            FT_BOOLEAN, 16,
+            NULL, FMTP_MEM_DATA_EXT,
+            NULL, HFILL }
+        },
+        /* Receiver statistics report type, sub-structure of flags field */
+        { &hf_fmtp_flag_recvstats,
+            { "FMTP RECV STATS Flag", "fmtp.flags.recvstats",
+            FT_BOOLEAN, 16,
+            NULL, FMTP_RECV_STATS,
+            NULL, HFILL }
+        },
+        /* Sender timestamp modifier, sub-structure of flags field */
+        { &hf_fmtp_flag_timestamped,
+            { "FMTP TIMESTAMPED Flag", "fmtp.flags.timestamped",
+            FT_BOOLEAN, 16,
+            NULL, FMTP_TIMESTAMPED,
+            NULL, HFILL }
+        },
+        /* Time the sender sent the packet, in nanoseconds since the epoch */
+        { &hf_fmtp_timestamp,
+            { "Sender timestamp (ns)", "fmtp.timestamp",
+            FT_UINT64, BASE_DEC,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Root of the analysis across packets */
+        { &hf_fmtp_analysis,
+            { "FMTP Analysis", "fmtp.analysis",
+            FT_NONE, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame of the BOP of the product */
+        { &hf_fmtp_bop_in,
+            { "BOP in", "fmtp.analysis.bop_in",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Bytes of the product skipped by the multicast before this block */
+        { &hf_fmtp_gap,
+            { "Gap before this block", "fmtp.analysis.gap",
+            FT_UINT32, BASE_DEC,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame that carried the same block before */
+        { &hf_fmtp_duplicate_of,
+            { "Duplicate of", "fmtp.analysis.duplicate_of",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame of the request a retransmission answers */
+        { &hf_fmtp_request_in,
+            { "Request in", "fmtp.analysis.request_in",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame of the first answer to a request */
+        { &hf_fmtp_response_in,
+            { "Response in", "fmtp.analysis.response_in",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame of the answer that completed a request */
+        { &hf_fmtp_repaired_in,
+            { "Repaired in", "fmtp.analysis.repaired_in",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Time from the request to this retransmission */
+        { &hf_fmtp_since_request,
+            { "Time since request", "fmtp.analysis.since_request",
+            FT_RELATIVE_TIME, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Time from the request to the end of its repair */
+        { &hf_fmtp_repair_time,
+            { "Request-to-repair time", "fmtp.analysis.repair_time",
+            FT_RELATIVE_TIME, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
+        },
+        /* Frame of the RETX_END that preceded a retransmission */
+        { &hf_fmtp_retx_end_in,
+            { "RETX END in", "fmtp.analysis.retx_end_in",
+            FT_FRAMENUM, BASE_NONE,
+            NULL, 0x0,
+            NULL, HFILL }
         }
     };
 
+    static ei_register_info ei[] = {
+        { &ei_fmtp_gap,
+            { "fmtp.analysis.gap.expert", PI_SEQUENCE, PI_WARN,
+            "Gap in the multicast of the product", EXPFILL }
+        },
+        { &ei_fmtp_missing_tail,
+            { "fmtp.analysis.missing_tail", PI_SEQUENCE, PI_WARN,
+            "End of the product missing from the multicast", EXPFILL }
+        },
+        { &ei_fmtp_missing_prods,
+            { "fmtp.analysis.missing_products", PI_SEQUENCE, PI_WARN,
+            "Products missing from the multicast", EXPFILL }
+        },
+        { &ei_fmtp_no_bop,
+            { "fmtp.analysis.no_bop", PI_SEQUENCE, PI_WARN,
+            "BOP of the product not seen", EXPFILL }
+        },
+        { &ei_fmtp_duplicate,
+            { "fmtp.analysis.duplicate", PI_SEQUENCE, PI_NOTE,
+            "Duplicate multicast packet", EXPFILL }
+        },
+        { &ei_fmtp_reordered,
+            { "fmtp.analysis.reordered", PI_SEQUENCE, PI_NOTE,
+            "Out-of-order block", EXPFILL }
+        },
+        { &ei_fmtp_retransmitted,
+            { "fmtp.analysis.retransmission", PI_SEQUENCE, PI_NOTE,
+            "Retransmitted block", EXPFILL }
+        },
+        { &ei_fmtp_retx_again,
+            { "fmtp.analysis.retransmitted_again", PI_SEQUENCE, PI_WARN,
+            "Block retransmitted to this receiver before", EXPFILL }
+        },
+        { &ei_fmtp_retx_after_end,
+            { "fmtp.analysis.retx_after_end", PI_SEQUENCE, PI_NOTE,
+            "Block retransmitted after the receiver's RETX_END", EXPFILL }
+        },
+        { &ei_fmtp_unsolicited,
+            { "fmtp.analysis.unsolicited", PI_SEQUENCE, PI_CHAT,
+            "Retransmission without an open request", EXPFILL }
+        },
+        { &ei_fmtp_rejected,
+            { "fmtp.analysis.rejected", PI_RESPONSE_CODE, PI_WARN,
+            "Request rejected by the sender", EXPFILL }
+        },
+        { &ei_fmtp_no_response,
+            { "fmtp.analysis.no_response", PI_SEQUENCE, PI_WARN,
+            "Request not answered in the capture", EXPFILL }
+        }
+    };
+
+    expert_module_t *expert_fmtp;
+
     /* Setup protocol subtree array */
     static gint *ett[] = {
-        &ett_fmtp
+        &ett_fmtp,
+        &ett_fmtp_analysis
     };
 
     proto_fmtp = proto_register_protocol (
@@ -257,6 +1034,8 @@ void proto_register_fmtp(void)
 
     proto_register_field_array(proto_fmtp, hf, array_length(hf));
     proto_register_subtree_array(ett, array_length(ett));
+    expert_fmtp = expert_register_protocol(proto_fmtp);
+    expert_register_field_array(expert_fmtp, ei, array_length(ei));
 }
 
 
@@ -267,8 +1046,10 @@ void proto_register_fmtp(void)
 void proto_reg_handoff_fmtp(void)
 {
     static dissector_handle_t fmtp_handle;
+    static dissector_handle_t fmtp_tcp_handle;
 
     fmtp_handle = create_dissector_handle(dissect_fmtp, proto_fmtp);
+    fmtp_tcp_handle = create_dissector_handle(dissect_fmtp_tcp, proto_fmtp);
     dissector_add_uint("udp.port", FMTP_MCAST_PORT, fmtp_handle);
-    dissector_add_uint("tcp.port", FMTP_RETX_PORT, fmtp_handle);
+    dissector_add_uint("tcp.port", FMTP_RETX_PORT, fmtp_tcp_handle);
 }
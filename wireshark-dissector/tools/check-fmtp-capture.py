@@ -0,0 +1,107 @@
+#!/usr/bin/env python
+#
+# Runs tshark with the FMTP plugin on a capture and checks the dissection.
+#
+# For the capture written by make-fmtp-capture.py, every display filter below
+# must match exactly the listed frames. For a capture recorded from a real
+# session (--recorded), FMTP messages must be found and none may be
+# malformed.
+#
+# FMTP is dissected on UDP port 5173 and TCP port 1234; for a session on other
+# ports, pass --decode-as "udp.port==5200,fmtp" etc. (tshark's -d).
+#
+# usage: check-fmtp-capture.py [--tshark TSHARK] [--plugin-dir DIR]
+#                              [--decode-as SPEC]... [--recorded] CAPTURE.pcap
+
+import os
+import subprocess
+import sys
+
+SAMPLE_EXPECTATIONS = [
+    ("fmtp",                              [1, 2, 3, 4, 8, 10, 11, 12, 13, 14,
+                                           15, 16]),
+    ("fmtp.analysis.bop_in == 1",         [1, 2, 3, 4, 14]),
+    ("fmtp.analysis.bop_in == 15",        [15, 16]),
+    ("fmtp.analysis.gap == 1000",         [3]),
+    ("fmtp.analysis.request_in == 8",     [10]),
+    ("fmtp.analysis.repaired_in == 10",   [8]),
+    ("fmtp.analysis.response_in == 12",   [11]),
+    ("fmtp.analysis.rejected",            [11]),
+    ("fmtp.analysis.missing_products",    [13]),
+    ("fmtp.analysis.duplicate_of == 2",   [14]),
+    ("fmtp.analysis.duplicate_of",        [14]),
+]
+
+
+def tshark_fields(tshark, decodes, capture, dfilter, field):
+    """Returns the values of a field in the frames that match a filter."""
+    # two passes, so that requests know the answers that follow them
+    cmd = [tshark, "-n", "-2", "-r", capture, "-T", "fields", "-e", field]
+    for spec in decodes:
+        cmd[1:1] = ["-d", spec]
+    if dfilter:
+        cmd[1:1] = ["-Y", dfilter]
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE)
+    out, err = proc.communicate()
+    if proc.returncode != 0:
+        raise RuntimeError("%s failed: %s" % (" ".join(cmd),
+                                             err.decode("utf-8", "replace")))
+    return [line for line in out.decode("utf-8", "replace").splitlines()
+            if line]
+
+
+def main(argv):
+    tshark    = "tshark"
+    recorded  = False
+    decodes   = []
+    args      = list(argv[1:])
+    capture   = None
+    while args:
+        arg = args.pop(0)
+        if arg == "--tshark":
+            tshark = args.pop(0)
+        elif arg == "--plugin-dir":
+            os.environ["WIRESHARK_PLUGIN_DIR"] = args.pop(0)
+        elif arg == "--decode-as":
+            decodes.append(args.pop(0))
+        elif arg == "--recorded":
+            recorded = True
+        else:
+            capture = arg
+    if capture is None:
+        sys.stderr.write("usage: check-fmtp-capture.py [--tshark TSHARK] "
+                         "[--plugin-dir DIR] [--decode-as SPEC]... "
+                         "[--recorded] CAPTURE.pcap\n")
+        return 2
+
+    failures = 0
+    protocols = tshark_fields(tshark, decodes, capture, None, "frame.protocols")
+    fmtp = [p for p in protocols if ":fmtp" in p]
+    malformed = [i + 1 for i, p in enumerate(protocols) if "malformed" in p]
+    if not fmtp:
+        sys.stderr.write("no FMTP message found; is the plugin loaded?\n")
+        failures += 1
+    if malformed:
+        sys.stderr.write("malformed frames: %s\n" % malformed)
+        failures += 1
+
+    if not recorded:
+        for dfilter, expected in SAMPLE_EXPECTATIONS:
+            frames = [int(n) for n in
+                      tshark_fields(tshark, decodes, capture, dfilter,
+                                    "frame.number")]
+            if frames != expected:
+                sys.stderr.write("%s: frames %s, expected %s\n" %
+                                 (dfilter, frames, expected))
+                failures += 1
+
+    if failures:
+        return 1
+    sys.stdout.write("%s: %d FMTP frame(s) dissected as expected\n" %
+                     (capture, len(fmtp)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
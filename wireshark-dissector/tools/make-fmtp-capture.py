@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+#
+# Writes a small pcap capture of an FMTP session that exercises the analysis
+# of the dissector: a multicast product with a gap, its repair over the TCP
+# connection of a receiver (with the answer split across two segments and two
+# requests in one segment), a rejected request, skipped products, a
+# duplicate block and a second session whose product indices overlap those of
+# the first. check-fmtp-capture.py knows what the dissector must make of every
+# frame.
+#
+# usage: make-fmtp-capture.py OUTPUT.pcap
+
+import struct
+import sys
+
+FMTP_BOP       = 0x0001
+FMTP_EOP       = 0x0002
+FMTP_MEM_DATA  = 0x0004
+FMTP_RETX_REQ  = 0x0008
+FMTP_RETX_REJ  = 0x0010
+FMTP_RETX_END  = 0x0020
+FMTP_RETX_DATA = 0x0040
+FMTP_BOP_REQ   = 0x0080
+
+MCAST_PORT = 5173
+RETX_PORT  = 1234
+RECV_PORT  = 40000
+
+SENDER   = (10, 0, 0, 1)
+RECEIVER = (10, 0, 0, 2)
+GROUP    = (239, 0, 0, 1)
+GROUP2   = (239, 0, 0, 2)
+
+SENDER_MAC   = b"\x02\x00\x00\x00\x00\x01"
+RECEIVER_MAC = b"\x02\x00\x00\x00\x00\x02"
+GROUP_MAC    = b"\x01\x00\x5e\x00\x00\x01"
+GROUP2_MAC   = b"\x01\x00\x5e\x00\x00\x02"
+
+PRODSIZE = 3000
+BLOCK    = 1000
+
+
+def fmtp(prodindex, seqnum, flags, payload=b"", paylen=None):
+    if paylen is None:
+        paylen = len(payload)
+    return struct.pack("!IIHH", prodindex, seqnum, paylen, flags) + payload
+
+
+def checksum(data):
+    if len(data) % 2:
+        data += b"\x00"
+    total = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    while total >> 16:
+        total = (total & 0xffff) + (total >> 16)
+    return ~total & 0xffff
+
+
+def ipv4(src, dst, proto, payload):
+    header = struct.pack("!BBHHHBBH4B4B", 0x45, 0, 20 + len(payload), 0,
+                         0x4000, 64, proto, 0, *(src + dst))
+    csum = checksum(header)
+    return header[:10] + struct.pack("!H", csum) + header[12:] + payload
+
+
+def ether(src, dst, payload):
+    return dst + src + struct.pack("!H", 0x0800) + payload
+
+
+def udp(payload, group=GROUP, group_mac=GROUP_MAC):
+    datagram = struct.pack("!HHHH", MCAST_PORT, MCAST_PORT, 8 + len(payload),
+                           0) + payload
+    return ether(SENDER_MAC, group_mac, ipv4(SENDER, group, 17, datagram))
+
+
+class TcpStream(object):
+    """The TCP connection of a receiver to the sender."""
+
+    def __init__(self):
+        self.seq = {True: 1000, False: 5000}   # keyed by "from receiver"
+
+    def segment(self, from_receiver, flags, payload=b""):
+        src, dst = (RECEIVER, SENDER) if from_receiver else (SENDER, RECEIVER)
+        sport, dport = (RECV_PORT, RETX_PORT) if from_receiver else \
+            (RETX_PORT, RECV_PORT)
+        smac, dmac = (RECEIVER_MAC, SENDER_MAC) if from_receiver else \
+            (SENDER_MAC, RECEIVER_MAC)
+        seq = self.seq[from_receiver]
+        ack = self.seq[not from_receiver] if flags & 0x10 else 0
+        header = struct.pack("!HHIIBBHHH", sport, dport, seq, ack, 5 << 4,
+                             flags, 65535, 0, 0)
+        pseudo = struct.pack("!4B4BBBH", *(src + dst + (0, 6,
+                             len(header) + len(payload))))
+        csum = checksum(pseudo + header + payload)
+        header = header[:16] + struct.pack("!H", csum) + header[18:]
+        self.seq[from_receiver] += len(payload) + (1 if flags & 0x02 else 0)
+        return ether(smac, dmac, ipv4(src, dst, 6, header + payload))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: make-fmtp-capture.py OUTPUT.pcap\n")
+        return 1
+
+    block = b"\x5a" * BLOCK
+    bop = struct.pack("!IH", PRODSIZE, 0)
+    tcp = TcpStream()
+    retx = fmtp(0, BLOCK, FMTP_RETX_DATA, block)
+    frames = [
+        udp(fmtp(0, 0, FMTP_BOP, bop)),                            # 1
+        udp(fmtp(0, 0, FMTP_MEM_DATA, block)),                     # 2
+        udp(fmtp(0, 2 * BLOCK, FMTP_MEM_DATA, block)),             # 3 gap
+        udp(fmtp(0, 0, FMTP_EOP)),                                 # 4
+        tcp.segment(True, 0x02),                                   # 5 SYN
+        tcp.segment(False, 0x12),                                  # 6
+        tcp.segment(True, 0x10),                                   # 7
+        tcp.segment(True, 0x18,
+                    fmtp(0, BLOCK, FMTP_RETX_REQ, paylen=BLOCK)),  # 8
+        tcp.segment(False, 0x10, retx[:500]),                      # 9
+        tcp.segment(False, 0x18, retx[500:]),                      # 10
+        tcp.segment(True, 0x18, fmtp(0, 1, FMTP_RETX_END) +
+                    fmtp(1, 0, FMTP_BOP_REQ)),                     # 11
+        tcp.segment(False, 0x18, fmtp(1, 0, FMTP_RETX_REJ)),       # 12
+        udp(fmtp(3, 0, FMTP_BOP, bop)),                            # 13
+        udp(fmtp(0, 0, FMTP_MEM_DATA, block)),                     # 14 dup
+        udp(fmtp(0, 0, FMTP_BOP, bop), GROUP2, GROUP2_MAC),        # 15
+        udp(fmtp(0, 0, FMTP_MEM_DATA, block), GROUP2, GROUP2_MAC), # 16
+    ]
+
+    out = open(sys.argv[1], "wb")
+    out.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+    for i, frame in enumerate(frames):
+        usec = 1000 * (i + 1)
+        out.write(struct.pack("<IIII", 1420070400, usec, len(frame),
+                              len(frame)))
+        out.write(frame)
+    out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())